@@ -6,6 +6,7 @@
 #include <hi_early_debug.h>
 #include <hi_gpio.h>
 #include <hi_task.h>
+#include <hi_time.h>
 #include "ohos_init.h"
 #include "cmsis_os2.h"
 
@@ -18,104 +19,149 @@
 #include <hi_stdlib.h>
 #include <hi_early_debug.h>
 
+#include "adc_key.h"
+#include "key_ladder.h"
+
+#define ADC_KEY_EVT_BLOCK 0x00000001U /* 采样定时器写完一块 */
+
+/* 高于 UDP 接收线程（36），网络繁忙时按键仍能及时判断和通知 */
+#define ADC_KEY_TASK_PRIORITY 37
+
+/*
+ * 按键窗口用 ADC 码值表示，编译时算好。一块采样取最小值与最大值之和（中点的
+ * 两倍）送给解码器，与原来 (min + max) / 2 的电压比较等价：
+ * 和 > ADC_KEY_SUM_ABOVE(mv) 即中点高于 mv，和 < ADC_KEY_SUM_BELOW(mv) 即中点低于 mv。
+ */
+#define ADC_KEY_SUM_ABOVE(mv) ((mv) * 2 * ADC_KEY_CODES / ADC_KEY_FULL_MV)
+#define ADC_KEY_SUM_BELOW(mv) (((mv) * 2 * ADC_KEY_CODES + ADC_KEY_FULL_MV - 1) / ADC_KEY_FULL_MV)
+#define ADC_KEY_WINDOW(lo_mv, hi_mv, key) { ADC_KEY_SUM_ABOVE(lo_mv) + 1, ADC_KEY_SUM_BELOW(hi_mv) - 1, (key) }
+
+/* S4 的分压电阻还没有实测，和原来的程序一样不判断它，等量出电压再加窗口 */
+static const struct key_ladder_window g_key_windows[] = {
+    ADC_KEY_WINDOW(400, 600, KEY_EVENT_S1),
+    ADC_KEY_WINDOW(800, 1100, KEY_EVENT_S2),
+    ADC_KEY_WINDOW(10, 300, KEY_EVENT_S3),
+};
+
+static const struct key_ladder_timing g_key_timing = {
+    .debounce_scans = ADC_KEY_DEBOUNCE_MS / ADC_KEY_SAMPLE_MS,
+    .release_scans = ADC_KEY_DEBOUNCE_MS / ADC_KEY_SAMPLE_MS,
+    .long_scans = ADC_KEY_LONG_MS / ADC_KEY_SAMPLE_MS,
+    .repeat_scans = ADC_KEY_REPEAT_MS / ADC_KEY_SAMPLE_MS,
+    .hyst_codes = ADC_KEY_SUM_ABOVE(ADC_KEY_HYST_MV),
+};
+
+/* 采样环形缓冲：定时器回调是唯一的写者（head），按键任务是唯一的读者（tail） */
+struct adc_key_ring {
+    hi_u32 head;
+    hi_u32 tail;
+    hi_u16 block[ADC_KEY_RING_BLOCKS][ADC_KEY_BURST];
+};
+
+static struct adc_key_ring g_adc_ring;
+static struct adc_key_stats g_adc_stats;
+static struct key_ladder g_key_ladder;
+static osEventFlagsId_t g_adc_event = NULL;
+static osTimerId_t g_adc_timer = NULL;
+static adc_key_notify_t g_key_notify = NULL;
+
+/* 取下一个按键事件，没有时返回 0。按键任务是唯一的写者，只能有一个消费者 */
+int adc_key_get_event(struct key_event *ev)
+{
+    return key_ladder_pop(&g_key_ladder, ev);
+}
 
-#define KEY_EVENT_NONE      0
-#define KEY_EVENT_S1      1
-#define KEY_EVENT_S2      2
-#define KEY_EVENT_S3      3
-#define KEY_EVENT_S4      4
-
-#define ADC_TEST_LENGTH  64
-#define VLT_MIN 100
-
-hi_u16 g_adc_buf[ADC_TEST_LENGTH] = { 0 };
-
+/* 只关心按下的旧接口：返回下一次按下的按键，其他事件丢弃 */
+int get_key_event(void)
+{
+    struct key_event ev;
 
+    while (adc_key_get_event(&ev)) {
+        if (ev.type == KEY_EV_PRESS) {
+            return ev.key;
+        }
+    }
+    return KEY_EVENT_NONE;
+}
 
-int key_status = KEY_EVENT_NONE;
-char key_flg = 0;
+/* 注册事件通知，注册者成为事件队列唯一的消费者 */
+void adc_key_set_notify(adc_key_notify_t notify)
+{
+    __atomic_store_n(&g_key_notify, notify, __ATOMIC_RELEASE);
+}
 
+void adc_key_get_stats(struct adc_key_stats *stats)
+{
+    *stats = g_adc_stats;
+    stats->overruns = __atomic_load_n(&g_adc_stats.overruns, __ATOMIC_RELAXED);
+    stats->sample_us_max = __atomic_load_n(&g_adc_stats.sample_us_max, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&g_key_ladder.dropped, __ATOMIC_RELAXED);
+}
 
-int get_key_event(void)
+/* 本板的按键窗口和时间参数，主机上回放录下的 ADC 码值时也用它 */
+void adc_key_ladder_init(struct key_ladder *kl)
 {
-    int tmp = key_status;
-    key_status = KEY_EVENT_NONE;
-    return tmp;
+    key_ladder_init(kl, g_key_windows, sizeof(g_key_windows) / sizeof(g_key_windows[0]), &g_key_timing);
 }
 
-/* asic adc test  */
-hi_void convert_to_voltage(hi_u32 data_len)
+/* 一块 n 个码值送给解码器的值：最小值与最大值之和 */
+hi_u16 adc_key_block_code(const hi_u16 *codes, hi_u32 n)
 {
     hi_u32 i;
-    float vlt_max = 0;
-    float vlt_min = VLT_MIN;
+    hi_u32 lo = 0xFFFF;
+    hi_u32 hi = 0;
 
-    float vlt_val = 0;
-
-    hi_u16 vlt;
-    for (i = 0; i < data_len; i++) {
-        vlt = g_adc_buf[i];
-        float voltage = (float)vlt * 1.8 * 4 / 4096.0;  /* vlt * 1.8 * 4 / 4096.0: Convert code into voltage */
-        vlt_max = (voltage > vlt_max) ? voltage : vlt_max;
-        vlt_min = (voltage < vlt_min) ? voltage : vlt_min;
+    for (i = 0; i < n; i++) {
+        lo = (codes[i] < lo) ? codes[i] : lo;
+        hi = (codes[i] > hi) ? codes[i] : hi;
     }
-//    printf("vlt_min:%.3f, vlt_max:%.3f \n", vlt_min, vlt_max);
+    return (hi_u16)(lo + hi);
+}
 
-    vlt_val = (vlt_min + vlt_max)/2.0;
+/* 定时器回调：连续采样一块写入环形缓冲，唤醒按键任务 */
+static void adc_key_sample(void *arg)
+{
+    struct adc_key_ring *ring = &g_adc_ring;
+    hi_u32 head = ring->head;
+    hi_u32 start = hi_get_us();
+    hi_u32 elapsed;
+    hi_u32 i;
+    hi_u16 data;
+    (void)arg;
 
-    if((vlt_val > 0.4) && (vlt_val < 0.6))
-    {
-        if(key_flg == 0)
-        {
-            key_flg = 1;
-            key_status = KEY_EVENT_S1;
-        }
-    }
-    if((vlt_val > 0.8) && (vlt_val < 1.1))
-    {
-        if(key_flg == 0)
-        {
-            key_flg = 1;
-            key_status = KEY_EVENT_S2;
-        }
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= ADC_KEY_RING_BLOCKS) {
+        __atomic_store_n(&g_adc_stats.overruns, g_adc_stats.overruns + 1, __ATOMIC_RELAXED);
+        return;
     }
 
-    if((vlt_val > 0.01) && (vlt_val < 0.3))
-    {
-        if(key_flg == 0)
-        {
-            key_flg = 1;
-            key_status = KEY_EVENT_S3;
+    for (i = 0; i < ADC_KEY_BURST; i++) {
+        if (hi_adc_read(ADC_KEY_CHANNEL, &data, HI_ADC_EQU_MODEL_1, HI_ADC_CUR_BAIS_DEFAULT, 0) != HI_ERR_SUCCESS) {
+            return;
         }
+        ring->block[head & (ADC_KEY_RING_BLOCKS - 1)][i] = data;
     }
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
 
-    if(vlt_val > 3.0)
-    {
-        key_flg = 0;
-        key_status = KEY_EVENT_NONE;
+    elapsed = hi_get_us() - start;
+    if (elapsed > g_adc_stats.sample_us_max) {
+        __atomic_store_n(&g_adc_stats.sample_us_max, elapsed, __ATOMIC_RELAXED);
     }
+    osEventFlagsSet(g_adc_event, ADC_KEY_EVT_BLOCK);
 }
 
-
-
-
-void app_demo_adc_test(void)
+/* 按键任务：解码一块采样，产生事件时返回 1 */
+static int adc_key_scan(const hi_u16 *codes, struct key_event *ev)
 {
-    hi_u32 ret, i;
-    hi_u16 data;  /* 10 */
-
-    memset_s(g_adc_buf, sizeof(g_adc_buf), 0x0, sizeof(g_adc_buf));
- 
-    for (i = 0; i < ADC_TEST_LENGTH; i++) {
-        ret = hi_adc_read((hi_adc_channel_index)HI_ADC_CHANNEL_2, &data, HI_ADC_EQU_MODEL_1, HI_ADC_CUR_BAIS_DEFAULT, 0);
-        if (ret != HI_ERR_SUCCESS) {
-            printf("ADC Read Fail\n");
-            return;
-        }
-        g_adc_buf[i] = data;
+    hi_u32 start = hi_get_us();
+    hi_u32 elapsed;
+    int ret = key_ladder_feed(&g_key_ladder, adc_key_block_code(codes, ADC_KEY_BURST), hi_get_ms(), ev);
+
+    elapsed = hi_get_us() - start;
+    g_adc_stats.scans++;
+    if (elapsed > g_adc_stats.scan_us_max) {
+        g_adc_stats.scan_us_max = elapsed;
     }
-    convert_to_voltage(ADC_TEST_LENGTH);
-
+    return ret;
 }
 
 void my_gpio_adc_demo(void *arg)
@@ -133,41 +179,37 @@ void my_gpio_adc_demo(void *arg)
         return;
     }
 
-    
+    adc_key_ladder_init(&g_key_ladder);
+    g_adc_event = osEventFlagsNew(NULL);
+    g_adc_timer = osTimerNew(adc_key_sample, osTimerPeriodic, NULL, NULL);
+    if (g_adc_event == NULL || g_adc_timer == NULL) {
+        printf("[key_demo] Failed to create ADC sampler!\r\n");
+        return;
+    }
+    osTimerStart(g_adc_timer, (ADC_KEY_SAMPLE_MS * osKernelGetTickFreq() + 999U) / 1000U);
+
     while(1)
     {
-        //读取ADC值
-        app_demo_adc_test();
-
-        switch(get_key_event())
-        {
-            case KEY_EVENT_NONE:
-            {
-                
-            }
-            break;
-
-            case KEY_EVENT_S1:
-            {
-                printf("KEY_EVENT_S1 \r\n");
-            }
-            break;
-
-            case KEY_EVENT_S2:
-            {
-                printf("KEY_EVENT_S2 \r\n");
-            }
-            break;
+        //等采样定时器写完一块，不再每 30ms 连续读 64 次 ADC
+        uint32_t flags = osEventFlagsWait(g_adc_event, ADC_KEY_EVT_BLOCK, osFlagsWaitAny, osWaitForever);
+        if (flags & osFlagsError) {
+            continue;
+        }
 
-            case KEY_EVENT_S3:
-            {
-                printf("KEY_EVENT_S3 \r\n");
+        while (g_adc_ring.tail != __atomic_load_n(&g_adc_ring.head, __ATOMIC_ACQUIRE)) {
+            struct key_event ev;
+            int got = adc_key_scan(g_adc_ring.block[g_adc_ring.tail & (ADC_KEY_RING_BLOCKS - 1)], &ev);
+            __atomic_store_n(&g_adc_ring.tail, g_adc_ring.tail + 1, __ATOMIC_RELEASE);
+
+            //事件已放入队列，先通知消费者，再打印（串口输出较慢）
+            if (got) {
+                adc_key_notify_t notify = __atomic_load_n(&g_key_notify, __ATOMIC_ACQUIRE);
+                if (notify != NULL) {
+                    notify();
+                }
+                printf("KEY_EVENT_S%u %s\r\n", ev.key, key_event_name(ev.type));
             }
-            break;
-
         }
-
-        usleep(30000);
     }
     
 
@@ -185,7 +227,7 @@ void key_demo(void)
     attr.cb_size = 0U;
     attr.stack_mem = NULL;
     attr.stack_size = 2048;
-    attr.priority = 26;
+    attr.priority = ADC_KEY_TASK_PRIORITY;
 
     if (osThreadNew((osThreadFunc_t)my_gpio_adc_demo, NULL, &attr) == NULL) {
         printf("[key_demo] Falied to create KeyTask!\n");
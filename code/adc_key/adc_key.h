@@ -0,0 +1,60 @@
+#ifndef __ADC_KEY_H__
+#define __ADC_KEY_H__
+
+#include <hi_types_base.h>
+#include <hi_adc.h>
+
+#include "key_ladder.h"
+
+#define KEY_EVENT_NONE      0
+#define KEY_EVENT_S1      1
+#define KEY_EVENT_S2      2
+#define KEY_EVENT_S3      3
+#define KEY_EVENT_S4      4
+
+/* 按键电阻分压接在 ADC 通道 2（GPIO5） */
+#define ADC_KEY_CHANNEL HI_ADC_CHANNEL_2
+
+/*
+ * 采样流水线。hi_adc 没有 FIFO 或扫描模式，所以由周期定时器定时采样：每
+ * ADC_KEY_SAMPLE_MS 在定时器回调里连续转换 ADC_KEY_BURST 次，写入环形缓冲中
+ * 按键任务不在读的那一块，再唤醒按键任务。按键任务按块判断，一块就是一次扫描。
+ * 缓冲满时丢弃新块并计入 overruns。
+ */
+#define ADC_KEY_SAMPLE_MS 10
+#define ADC_KEY_BURST 8
+#define ADC_KEY_RING_BLOCKS 4 /* 必须是 2 的幂 */
+
+/* ADC 码值与电压：参考电压 1.8V，输入经 1/4 分压，满量程 4096 */
+#define ADC_KEY_FULL_MV 7200
+#define ADC_KEY_CODES 4096
+
+/*
+ * 按键判断（见 key_ladder.h）：连续 ADC_KEY_DEBOUNCE_MS 落在窗口内算按下，
+ * 连续 ADC_KEY_DEBOUNCE_MS 离开放宽 ADC_KEY_HYST_MV 的窗口算松开；按住
+ * ADC_KEY_LONG_MS 产生长按，之后每 ADC_KEY_REPEAT_MS 产生一次连发。
+ */
+#define ADC_KEY_DEBOUNCE_MS 20
+#define ADC_KEY_HYST_MV 50
+#define ADC_KEY_LONG_MS 800
+#define ADC_KEY_REPEAT_MS 200
+
+struct adc_key_stats {
+    hi_u32 scans;        /* 处理过的块数 */
+    hi_u32 overruns;     /* 缓冲满时丢弃的块数 */
+    hi_u32 sample_us_max; /* 定时器回调里一次连续转换的最长时间 */
+    hi_u32 scan_us_max;   /* 按键任务判断一块的最长时间 */
+    hi_u32 dropped;       /* 事件队列满时丢弃的事件数 */
+};
+
+/* 按键任务产生事件后调用，调用者用 adc_key_get_event() 取出事件；在按键任务中执行，不能阻塞 */
+typedef void (*adc_key_notify_t)(void);
+
+int get_key_event(void);
+int adc_key_get_event(struct key_event *ev);
+void adc_key_ladder_init(struct key_ladder *kl);
+hi_u16 adc_key_block_code(const hi_u16 *codes, hi_u32 n);
+void adc_key_get_stats(struct adc_key_stats *stats);
+void adc_key_set_notify(adc_key_notify_t notify);
+
+#endif /* __ADC_KEY_H__ */
@@ -0,0 +1,128 @@
+#include <hi_types_base.h>
+#include <hi_stdlib.h>
+
+#include "key_ladder.h"
+
+#define KEY_LADDER_COUNT_MAX 0xFFFF
+
+static const char *const g_key_event_names[KEY_EV_MAX] = {
+    "press", "release", "long", "repeat",
+};
+
+const char *key_event_name(hi_u32 type)
+{
+    return (type < KEY_EV_MAX) ? g_key_event_names[type] : "unknown";
+}
+
+void key_ladder_init(struct key_ladder *kl, const struct key_ladder_window *windows, hi_u32 count,
+                     const struct key_ladder_timing *timing)
+{
+    memset_s(kl, sizeof(*kl), 0, sizeof(*kl));
+    kl->windows = windows;
+    kl->count = (count < KEY_LADDER_MAX_KEYS) ? count : KEY_LADDER_MAX_KEYS;
+    kl->timing = timing;
+}
+
+/* 写者：放入一个事件，队列满时丢弃 */
+static void key_ladder_push(struct key_ladder *kl, const struct key_event *ev)
+{
+    hi_u32 head = kl->head;
+
+    if (head - __atomic_load_n(&kl->tail, __ATOMIC_ACQUIRE) >= KEY_LADDER_QUEUE_SIZE) {
+        __atomic_store_n(&kl->dropped, kl->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    kl->queue[head & (KEY_LADDER_QUEUE_SIZE - 1)] = *ev;
+    __atomic_store_n(&kl->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static int key_ladder_emit(struct key_ladder *kl, hi_u32 index, hi_u32 type, hi_u32 time_ms, struct key_event *ev)
+{
+    ev->key = kl->windows[index].key;
+    ev->type = (hi_u8)type;
+    ev->reserved = 0;
+    ev->time_ms = time_ms;
+    key_ladder_push(kl, ev);
+    return 1;
+}
+
+/* 按着时：码值在放宽后的窗口内 */
+static int key_ladder_holds(const struct key_ladder *kl, hi_u16 code)
+{
+    const struct key_ladder_window *w = &kl->windows[kl->held - 1];
+    hi_u32 hyst = kl->timing->hyst_codes;
+
+    return (code + hyst >= w->lo) && (code <= w->hi + hyst);
+}
+
+/*
+ * 输入一次扫描的码值。产生事件时写入 ev 并返回 1（同时放入队列），否则返回 0。
+ * 每次扫描最多产生一个事件。
+ */
+int key_ladder_feed(struct key_ladder *kl, hi_u16 code, hi_u32 time_ms, struct key_event *ev)
+{
+    const struct key_ladder_timing *t = kl->timing;
+    hi_u32 index;
+    hi_u32 i;
+
+    if (kl->held != 0) {
+        index = kl->held - 1;
+        if (!key_ladder_holds(kl, code)) {
+            if (++kl->release_scans < t->release_scans) {
+                return 0;
+            }
+            kl->held = 0;
+            memset_s(kl->debounce, sizeof(kl->debounce), 0, sizeof(kl->debounce));
+            return key_ladder_emit(kl, index, KEY_EV_RELEASE, time_ms, ev);
+        }
+        kl->release_scans = 0;
+        kl->held_scans++;
+        if (t->long_scans == 0 || kl->held_scans < t->long_scans) {
+            return 0;
+        }
+        if (kl->held_scans == t->long_scans) {
+            kl->next_repeat = t->long_scans + t->repeat_scans;
+            return key_ladder_emit(kl, index, KEY_EV_LONG, time_ms, ev);
+        }
+        if (t->repeat_scans != 0 && kl->held_scans == kl->next_repeat) {
+            kl->next_repeat += t->repeat_scans;
+            return key_ladder_emit(kl, index, KEY_EV_REPEAT, time_ms, ev);
+        }
+        return 0;
+    }
+
+    index = kl->count;
+    for (i = 0; i < kl->count; i++) {
+        if (code >= kl->windows[i].lo && code <= kl->windows[i].hi) {
+            index = i;
+        } else {
+            kl->debounce[i] = 0;
+        }
+    }
+    if (index == kl->count) {
+        return 0;
+    }
+    if (kl->debounce[index] < KEY_LADDER_COUNT_MAX) {
+        kl->debounce[index]++;
+    }
+    if (kl->debounce[index] < t->debounce_scans) {
+        return 0;
+    }
+    kl->held = index + 1;
+    kl->held_scans = 0;
+    kl->release_scans = 0;
+    return key_ladder_emit(kl, index, KEY_EV_PRESS, time_ms, ev);
+}
+
+/* 消费者：取出一个事件，没有时返回 0 */
+int key_ladder_pop(struct key_ladder *kl, struct key_event *ev)
+{
+    hi_u32 tail = kl->tail;
+
+    if (tail == __atomic_load_n(&kl->head, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    *ev = kl->queue[tail & (KEY_LADDER_QUEUE_SIZE - 1)];
+    __atomic_store_n(&kl->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
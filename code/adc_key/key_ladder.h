@@ -0,0 +1,77 @@
+#ifndef __KEY_LADDER_H__
+#define __KEY_LADDER_H__
+
+#include <hi_types_base.h>
+
+/*
+ * 电阻分压按键解码。
+ *
+ * 多个按键经电阻分压接到同一路 ADC，每个按键对应一段 ADC 码值窗口。每次扫描
+ * 输入一个码值（一块采样的中点），只做几次整数比较：
+ *
+ *   - 没有按键按下时，码值落在某个窗口内的连续扫描数记在该按键的消抖计数里，
+ *     达到 debounce_scans 时产生 KEY_EV_PRESS；
+ *   - 按下后，码值只要还在该窗口两边各放宽 hyst_codes 的范围内就认为一直按着
+ *     （迟滞），连续 release_scans 次不在范围内时产生 KEY_EV_RELEASE；
+ *   - 按住 long_scans 次产生 KEY_EV_LONG，之后每 repeat_scans 次产生 KEY_EV_REPEAT。
+ *
+ * 事件放入无锁队列：调用 key_ladder_feed() 的任务是唯一的写者，一个消费者
+ * 用 key_ladder_pop() 读取。队列满时丢弃新事件并计数。不依赖任何外设，
+ * 可以在主机上直接用录下的 ADC 码值验证。
+ */
+
+#define KEY_LADDER_MAX_KEYS 8
+#define KEY_LADDER_QUEUE_SIZE 16 /* 必须是 2 的幂 */
+
+typedef enum {
+    KEY_EV_PRESS,
+    KEY_EV_RELEASE,
+    KEY_EV_LONG,
+    KEY_EV_REPEAT,
+    KEY_EV_MAX
+} key_event_type;
+
+struct key_event {
+    hi_u8 key;  /* key_ladder_window.key */
+    hi_u8 type; /* key_event_type */
+    hi_u16 reserved;
+    hi_u32 time_ms;
+};
+
+/* 一个按键的码值窗口，闭区间，一般由编译时常量构成 */
+struct key_ladder_window {
+    hi_u16 lo;
+    hi_u16 hi;
+    hi_u8 key;
+};
+
+struct key_ladder_timing {
+    hi_u16 debounce_scans;
+    hi_u16 release_scans;
+    hi_u16 long_scans;
+    hi_u16 repeat_scans;
+    hi_u16 hyst_codes;
+};
+
+struct key_ladder {
+    const struct key_ladder_window *windows;
+    hi_u32 count;
+    const struct key_ladder_timing *timing;
+    hi_u16 debounce[KEY_LADDER_MAX_KEYS]; /* 每个按键的消抖计数 */
+    hi_u32 held;                          /* 按着的按键下标加一，0 表示没有 */
+    hi_u32 held_scans;
+    hi_u32 next_repeat;
+    hi_u32 release_scans;
+    hi_u32 head; /* 写者 */
+    hi_u32 tail; /* 消费者 */
+    hi_u32 dropped;
+    struct key_event queue[KEY_LADDER_QUEUE_SIZE];
+};
+
+void key_ladder_init(struct key_ladder *kl, const struct key_ladder_window *windows, hi_u32 count,
+                     const struct key_ladder_timing *timing);
+int key_ladder_feed(struct key_ladder *kl, hi_u16 code, hi_u32 time_ms, struct key_event *ev);
+int key_ladder_pop(struct key_ladder *kl, struct key_event *ev);
+const char *key_event_name(hi_u32 type);
+
+#endif /* __KEY_LADDER_H__ */
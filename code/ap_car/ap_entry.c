@@ -5,8 +5,28 @@
 #include "ohos_init.h"
 #include "cmsis_os2.h"
 #include "wifi_hotspot.h"
+#include "hi_wifi_api.h"
 #include "lwip/netifapi.h"
 
+#include "car_test.h"
+#include "car_boot.h"
+
+// AP  DHCP ڱʱã̼ flash Уʱƴװ
+static const HotspotConfig g_apConfig = {
+    .ssid = "WDXCar",
+    .preSharedKey = "wdxsjyz540",
+    .securityType = WIFI_SEC_TYPE_PSK,
+    .band = HOTSPOT_BAND_TYPE_2G,
+    .channelNum = 7,
+};
+static const ip4_addr_t g_apAddr = {PP_HTONL(LWIP_MAKEU32(192, 168, 1, 1))};
+static const ip4_addr_t g_apGateway = {PP_HTONL(LWIP_MAKEU32(192, 168, 1, 1))};
+static const ip4_addr_t g_apNetmask = {PP_HTONL(LWIP_MAKEU32(255, 255, 255, 0))};
+
+// ȵĻصͨ¼֪ͨ񣬲ѯ
+#define AP_EVT_ACTIVE 0x00000001U
+static osEventFlagsId_t g_apEvent = NULL;
+
 static volatile int g_hotspotStarted = 0;
 
 static void OnHotspotStateChanged(int state)
@@ -15,6 +35,8 @@ static void OnHotspotStateChanged(int state)
     if (state == WIFI_HOTSPOT_ACTIVE)
     {
         g_hotspotStarted = 1;
+        car_boot_mark(CAR_BOOT_AP_UP);
+        osEventFlagsSet(g_apEvent, AP_EVT_ACTIVE);
     }
     else
     {
@@ -47,6 +69,8 @@ static void OnHotspotStaLeave(StationInfo *info)
     g_joinedStations--;
     PrintStationInfo(info);
     printf("-OnHotspotStaLeave: active stations = %d.\r\n", g_joinedStations);
+    // 뿪Ŀܾǿƶˣ·ʱֱͣ
+    car_station_left();
 }
 
 WifiEvent g_defaultWifiEventListener = {
@@ -61,6 +85,12 @@ int StartHotspot(const HotspotConfig *config)
 {
     WifiErrorCode errCode = WIFI_SUCCESS;
 
+    if (g_apEvent == NULL)
+    {
+        g_apEvent = osEventFlagsNew(NULL);
+    }
+    osEventFlagsClear(g_apEvent, AP_EVT_ACTIVE);
+
     errCode = RegisterWifiEvent(&g_defaultWifiEventListener);
     printf("RegisterWifiEvent: %d\r\n", errCode);
 
@@ -70,24 +100,20 @@ int StartHotspot(const HotspotConfig *config)
     g_hotspotStarted = 0;
     errCode = EnableHotspot();
     printf("EnableHotspot: %d\r\n", errCode);
-
-    while (!g_hotspotStarted)
+    car_boot_mark(CAR_BOOT_AP_ENABLE);
+    if (errCode != WIFI_SUCCESS)
     {
-        osDelay(10);
+        return errCode;
     }
+
+    // ȵ¼ڼ UDP ճ
+    osEventFlagsWait(g_apEvent, AP_EVT_ACTIVE, osFlagsWaitAny, osWaitForever);
     printf("g_hotspotStarted = %d.\r\n", g_hotspotStarted);
 
     g_iface = netifapi_netif_find("ap0");
     if (g_iface)
     {
-        ip4_addr_t ipaddr;
-        ip4_addr_t gateway;
-        ip4_addr_t netmask;
-
-        IP4_ADDR(&ipaddr, 192, 168, 1, 1);    /* input your IP for example: 192.168.1.1 */
-        IP4_ADDR(&gateway, 192, 168, 1, 1);   /* input your gateway for example: 192.168.1.1 */
-        IP4_ADDR(&netmask, 255, 255, 255, 0); /* input your netmask for example: 255.255.255.0 */
-        err_t ret = netifapi_netif_set_addr(g_iface, &ipaddr, &netmask, &gateway);
+        err_t ret = netifapi_netif_set_addr(g_iface, &g_apAddr, &g_apNetmask, &g_apGateway);
         printf("netifapi_netif_set_addr: %d\r\n", ret);
 
         ret = netifapi_dhcps_stop(g_iface); // ˼չHDCPӿ
@@ -95,6 +121,7 @@ int StartHotspot(const HotspotConfig *config)
 
         ret = netifapi_dhcps_start(g_iface, 0, 0); // ˼չHDCPӿ
         printf("netifapi_dhcp_start: %d\r\n", ret);
+        car_boot_mark(CAR_BOOT_DHCP);
     }
     return errCode;
 }
@@ -114,15 +141,22 @@ void StopHotspot(void)
     printf("EnableHotspot: %d\r\n", errCode);
 }
 
+// Ƚ񣨵UDP 񣩣ȵ㣬߲Уȵ˳
 static void WifiHotspotTask(void *arg)
 {
     (void)arg;
     WifiErrorCode errCode;
-    HotspotConfig config = {0};
+
+    car_boot_mark(CAR_BOOT_APP);
+    car_start();
+
+    printf("starting AP ...\r\n");
+    errCode = StartHotspot(&g_apConfig);
+    printf("StartHotspot: %d\r\n", errCode);
 
     unsigned char macaddr[6];
 
-    hi_wifi_get_macaddr(macaddr, 6);
+    hi_wifi_get_macaddr((char *)macaddr, 6);
 
     printf("hi_wifi_get_macaddr %.2x-%.2x-%.2x-%.2x-%.2x-%.2x\r\n ",
            macaddr[0],
@@ -131,21 +165,6 @@ static void WifiHotspotTask(void *arg)
            macaddr[3],
            macaddr[4],
            macaddr[5]);
-    // ׼APò?
-    // sprintf(config.ssid, "Hi3861_Car_%.2x-%.2x", macaddr[4], macaddr[5]);
-    sprintf(config.ssid, "WDXCar");
-    strcpy(config.preSharedKey, "wdxsjyz540");
-    config.securityType = WIFI_SEC_TYPE_PSK;
-    config.band = HOTSPOT_BAND_TYPE_2G;
-    config.channelNum = 7;
-
-    osDelay(10);
-
-    printf("starting AP ...\r\n");
-    errCode = StartHotspot(&config);
-    printf("StartHotspot: %d\r\n", errCode);
-
-    car_test();
 }
 
 static void WifiHotspotDemo(void)
@@ -0,0 +1,56 @@
+#include <hi_time.h>
+
+#include "car_boot.h"
+#include "car_trace.h"
+
+#define CAR_BOOT_NAME(name, str) str,
+static const char *const car_boot_names[CAR_BOOT_MAX] = {CAR_BOOT_STAGES(CAR_BOOT_NAME)};
+#undef CAR_BOOT_NAME
+
+static unsigned int car_boot_us[CAR_BOOT_MAX];
+
+const char *car_boot_name(unsigned int stage)
+{
+    return stage < CAR_BOOT_MAX ? car_boot_names[stage] : "unknown";
+}
+
+// 写者：第一次到达 stage 时记下时刻，返回 1；已经到达过返回 0
+int car_boot_mark(unsigned int stage)
+{
+    unsigned int us;
+
+    if (stage >= CAR_BOOT_MAX || __atomic_load_n(&car_boot_us[stage], __ATOMIC_RELAXED) != 0)
+    {
+        return 0;
+    }
+    // 0 表示没有到达
+    us = hi_get_us();
+    __atomic_store_n(&car_boot_us[stage], us != 0 ? us : 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+void car_boot_get(struct car_boot_timeline *tl)
+{
+    unsigned int i;
+
+    for (i = 0; i < CAR_BOOT_MAX; i++)
+    {
+        tl->us[i] = __atomic_load_n(&car_boot_us[i], __ATOMIC_ACQUIRE);
+    }
+}
+
+// 把到达过的阶段按阶段顺序写入 ring，由该环的写者调用
+void car_boot_trace(unsigned int ring)
+{
+    struct car_boot_timeline tl;
+    unsigned int i;
+
+    car_boot_get(&tl);
+    for (i = 0; i < CAR_BOOT_MAX; i++)
+    {
+        if (tl.us[i] != 0)
+        {
+            CAR_TRACE_INFO(ring, CAR_EV_BOOT_STAGE, i, tl.us[i] / 1000, tl.us[i] % 1000);
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef __CAR_BOOT_H__
+#define __CAR_BOOT_H__
+
+/*
+ * 启动时间线。
+ *
+ * 上电后各模块就绪的时刻（hi_get_us，即上电以来的微秒数）按阶段记录一次，
+ * 以后再到达同一阶段不再改写。电机、按键和 UDP 网络任务与热点启动并行，
+ * 所以除第一条指令外各阶段的先后不固定。每个阶段只有一个写者线程（见
+ * CAR_BOOT_STAGES），只用对齐字读写。UDP 网络任务执行第一条指令时把整条
+ * 时间线写入跟踪记录，上电到第一条指令的时间就是 first_cmd 一项。
+ */
+
+// 各阶段：名字、写者
+#define CAR_BOOT_STAGES(X)                                                  \
+    X(CAR_BOOT_APP, "app")             /* 启动任务开始运行，启动任务 */        \
+    X(CAR_BOOT_MOTORS, "motors")       /* PWM 初始化完，输出停车状态，控制任务 */ \
+    X(CAR_BOOT_NET, "net")             /* 指令端口已绑定，UDP 网络任务 */      \
+    X(CAR_BOOT_KEYS, "keys")           /* 按键任务已启动，控制任务 */          \
+    X(CAR_BOOT_AP_ENABLE, "ap_enable") /* 已请求启动热点，启动任务 */          \
+    X(CAR_BOOT_AP_UP, "ap_up")         /* 热点已启动，Wi-Fi 事件回调 */         \
+    X(CAR_BOOT_DHCP, "dhcp")           /* 地址已设置，DHCP 服务已启动，启动任务 */ \
+    X(CAR_BOOT_FIRST_CMD, "first_cmd") /* 第一条 UDP 指令已下发，UDP 网络任务 */
+
+#define CAR_BOOT_ENUM(name, str) name,
+typedef enum
+{
+    CAR_BOOT_STAGES(CAR_BOOT_ENUM)
+    CAR_BOOT_MAX
+} CarBootStage;
+#undef CAR_BOOT_ENUM
+
+// 各阶段的时刻，没有到达的为 0
+struct car_boot_timeline
+{
+    unsigned int us[CAR_BOOT_MAX];
+};
+
+int car_boot_mark(unsigned int stage);
+void car_boot_get(struct car_boot_timeline *tl);
+void car_boot_trace(unsigned int ring);
+const char *car_boot_name(unsigned int stage);
+
+#endif /* __CAR_BOOT_H__ */
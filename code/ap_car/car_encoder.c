@@ -0,0 +1,86 @@
+#include <stdio.h>
+
+#include "cmsis_os2.h"
+
+#include <iot_gpio.h>
+#include <iot_gpio_ex.h>
+#include <hi_io.h>
+#include <hi_time.h>
+#include "car_encoder.h"
+#include "car_motor.h"
+#include "car_seqlock.h"
+
+#define CAR_ENC_FUNC_GPIO 0
+
+struct car_encoder
+{
+    unsigned int gpio;
+    struct car_seqlock lock;
+    struct car_enc_count shared;
+    struct car_enc_count local; // 中断私有副本
+    unsigned int run;           // 连续间隔不超过 CAR_ENC_STOP_US 的脉冲数，中断私有
+};
+
+static struct car_encoder car_encoders[CAR_WHEEL_MAX] = {
+    {CAR_ENC_GPIO_LEFT},
+    {CAR_ENC_GPIO_RIGHT},
+};
+
+// 收到过一串连续的脉冲，说明装了码盘；没有装时速度闭环不起作用
+static unsigned int car_encoder_seen;
+
+// 中断：一个上升沿
+static void car_encoder_isr(char *arg)
+{
+    struct car_encoder *enc = (struct car_encoder *)arg;
+    unsigned int now = hi_get_us();
+
+    // 零星的干扰沿隔得很远，只有车轮在转时才会连续来脉冲
+    if (enc->local.ticks != 0 && now - enc->local.edge_us <= CAR_ENC_STOP_US)
+    {
+        enc->run++;
+    }
+    else
+    {
+        enc->run = 1;
+    }
+    enc->local.ticks++;
+    enc->local.edge_us = now;
+    car_seq_publish(&enc->lock, &enc->shared, &enc->local, sizeof(enc->local));
+    if (!car_encoder_seen && enc->run >= CAR_ENC_PRESENT_TICKS)
+    {
+        __atomic_store_n(&car_encoder_seen, 1U, __ATOMIC_RELEASE);
+    }
+}
+
+void car_encoder_init(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < CAR_WHEEL_MAX; i++)
+    {
+        struct car_encoder *enc = &car_encoders[i];
+
+        IoTGpioInit(enc->gpio);
+        hi_io_set_func(enc->gpio, CAR_ENC_FUNC_GPIO);
+        IoTGpioSetDir(enc->gpio, IOT_GPIO_DIR_IN);
+        // 码盘模块是比较器开漏（集电极开路）输出，没接码盘时也不能让输入悬空
+        IoTGpioSetPull(enc->gpio, IOT_IO_PULL_UP);
+        if (IoTGpioRegisterIsrFunc(enc->gpio, IOT_INT_TYPE_EDGE, IOT_GPIO_EDGE_RISE_LEVEL_HIGH, car_encoder_isr,
+                                   (char *)enc) != IOT_SUCCESS)
+        {
+            printf("[car_encoder] Failed to register GPIO%u interrupt!\r\n", enc->gpio);
+        }
+    }
+}
+
+// 任意线程：读出一个车轮一致的计数和时间
+void car_encoder_read(unsigned int wheel, struct car_enc_count *count)
+{
+    car_seq_read(&car_encoders[wheel].lock, &car_encoders[wheel].shared, count, sizeof(*count));
+}
+
+int car_encoder_present(void)
+{
+    return __atomic_load_n(&car_encoder_seen, __ATOMIC_ACQUIRE) != 0;
+}
@@ -0,0 +1,42 @@
+#ifndef __CAR_ENCODER_H__
+#define __CAR_ENCODER_H__
+
+/*
+ * 车轮测速码盘输入。
+ *
+ * 每个车轮一路脉冲接到 GPIO，上升沿中断里计数并记下这个沿的时间。中断是
+ * 每个车轮计数器唯一的写者，通过 car_seqlock 发布，控制任务无锁读取，
+ * 中断里不关中断也不等待。码盘不分方向，方向由调用者按输出的占空比决定。
+ *
+ * 码盘输入接上拉，没装码盘时引脚不悬空。
+ */
+
+// 左轮、右轮码盘接的 GPIO，电机已占用 GPIO0/1/9/10
+#define CAR_ENC_GPIO_LEFT 11
+#define CAR_ENC_GPIO_RIGHT 12
+
+// 码盘每圈的脉冲数（只计上升沿）
+#define CAR_ENC_TICKS_PER_REV 20
+
+// 占空比为 CAR_DUTY_MAX 时额定的车轮转速（脉冲/秒），占空比按它换算成目标转速
+#define CAR_ENC_TPS_MAX 400
+
+// 超过这个时间没有脉冲认为车轮已停
+#define CAR_ENC_STOP_US 200000
+
+// 一个车轮连续收到这么多个脉冲（相邻间隔不超过 CAR_ENC_STOP_US）才认为装了码盘，
+// 即半圈；零星的干扰沿不算
+#define CAR_ENC_PRESENT_TICKS 10
+
+// 一个车轮的累计脉冲数和最后一个脉冲的时间，大小是 4 的整数倍
+struct car_enc_count
+{
+    unsigned int ticks;
+    unsigned int edge_us;
+};
+
+void car_encoder_init(void);
+void car_encoder_read(unsigned int wheel, struct car_enc_count *count);
+int car_encoder_present(void);
+
+#endif /* __CAR_ENCODER_H__ */
@@ -0,0 +1,230 @@
+#include <string.h>
+
+#include "car_ingress.h"
+
+// 令牌以千分之一个数据报为单位
+#define CAR_INGRESS_TOKEN 1000U
+
+// 令牌桶：rate 为每秒补充的数据报数，最多存 burst 个
+struct car_ingress_bucket
+{
+    unsigned int last_us;
+    unsigned int tokens;
+    unsigned int frac; // 还不够一个令牌单位的补充，单位是令牌单位的千分之一
+};
+
+struct car_ingress_sender
+{
+    unsigned int addr;
+    unsigned short port;
+    unsigned short used;
+    struct car_ingress_bucket bucket;
+};
+
+// 环形队列：收和取都在 UDP 网络任务里，不需要同步。head 和 tail 只增不减，
+// 相减就是队列里的条数
+struct car_ingress_queue
+{
+    unsigned int head;
+    unsigned int tail;
+    struct car_ingress_entry entry[CAR_INGRESS_QUEUE_SIZE];
+};
+
+static struct car_ingress_sender car_ingress_senders[CAR_INGRESS_SENDERS];
+static struct car_ingress_bucket car_ingress_new_bucket;   // 新发送方的总预算
+static struct car_ingress_bucket car_ingress_total_bucket; // 桶里不到一半令牌的发送方共用的总预算
+static struct car_ingress_queue car_ingress_queue;
+static struct car_ingress_stats car_ingress_stats;
+
+// 按经过的时间补充令牌，够一个数据报时取走一个并返回 1。不足一个令牌单位的
+// 零头留到下一次：速率低的桶（新发送方每 50us 才补一个单位）调用得再频繁也
+// 照样补充
+static int car_ingress_take(struct car_ingress_bucket *b, unsigned int now_us, unsigned int rate, unsigned int burst)
+{
+    unsigned int elapsed = now_us - b->last_us;
+    unsigned int credit;
+
+    // 一秒足以把桶加满，限制 elapsed 避免乘法溢出
+    if (elapsed > 1000000U)
+    {
+        elapsed = 1000000U;
+    }
+    credit = elapsed * rate + b->frac;
+    b->tokens += credit / 1000U;
+    b->frac = credit % 1000U;
+    if (b->tokens >= burst * CAR_INGRESS_TOKEN)
+    {
+        b->tokens = burst * CAR_INGRESS_TOKEN;
+        b->frac = 0;
+    }
+    b->last_us = now_us;
+
+    if (b->tokens < CAR_INGRESS_TOKEN)
+    {
+        return 0;
+    }
+    b->tokens -= CAR_INGRESS_TOKEN;
+    return 1;
+}
+
+// 查找发送方；没有记录时从新发送方预算里取一个令牌，替换令牌最少的一项
+// （一直超速的发送方），令牌一样多时替换最久没有发送的。预算用完时返回
+// NULL，已有的记录不被挤掉
+static struct car_ingress_sender *car_ingress_sender(const struct sockaddr_in *from, unsigned int now_us)
+{
+    struct car_ingress_sender *victim = &car_ingress_senders[0];
+    unsigned int i;
+
+    for (i = 0; i < CAR_INGRESS_SENDERS; i++)
+    {
+        struct car_ingress_sender *s = &car_ingress_senders[i];
+
+        if (s->used && s->addr == from->sin_addr.s_addr && s->port == from->sin_port)
+        {
+            return s;
+        }
+        if (!victim->used)
+        {
+            continue;
+        }
+        if (!s->used || s->bucket.tokens < victim->bucket.tokens ||
+            (s->bucket.tokens == victim->bucket.tokens && (int)(s->bucket.last_us - victim->bucket.last_us) < 0))
+        {
+            victim = s;
+        }
+    }
+    if (!car_ingress_take(&car_ingress_new_bucket, now_us, CAR_INGRESS_NEW_RATE, CAR_INGRESS_SENDERS))
+    {
+        car_ingress_stats.new_limited++;
+        return NULL;
+    }
+
+    // 新的发送方只有 CAR_INGRESS_NEW_BURST 个数据报的令牌，之后按正常速率补充：
+    // 轮换源端口拿不到满桶
+    victim->addr = from->sin_addr.s_addr;
+    victim->port = from->sin_port;
+    victim->used = 1;
+    victim->bucket.last_us = now_us;
+    victim->bucket.tokens = CAR_INGRESS_NEW_BURST * CAR_INGRESS_TOKEN;
+    victim->bucket.frac = 0;
+    return victim;
+}
+
+// 接收一侧：按发送方的令牌桶和总预算决定是否接受这个数据报。桶里还剩一半以上
+// 令牌的发送方（按正常速率发送的控制端）不占总预算，洪泛再多也挤不掉它们
+int car_ingress_admit(const struct sockaddr_in *from, unsigned int now_us)
+{
+    struct car_ingress_sender *s;
+
+    car_ingress_stats.received++;
+    s = car_ingress_sender(from, now_us);
+    if (s == NULL || !car_ingress_take(&s->bucket, now_us, CAR_INGRESS_RATE, CAR_INGRESS_BURST) ||
+        (s->bucket.tokens < CAR_INGRESS_BURST * CAR_INGRESS_TOKEN / 2 &&
+         !car_ingress_take(&car_ingress_total_bucket, now_us, CAR_INGRESS_TOTAL_RATE, CAR_INGRESS_TOTAL_BURST)))
+    {
+        car_ingress_stats.rate_limited++;
+        return 0;
+    }
+    return 1;
+}
+
+// 接收一侧：取一个空位用来解码，队列满时返回 NULL 并计数
+struct car_ingress_entry *car_ingress_reserve(void)
+{
+    struct car_ingress_queue *q = &car_ingress_queue;
+    unsigned int head = q->head;
+
+    if (head - q->tail >= CAR_INGRESS_QUEUE_SIZE)
+    {
+        car_ingress_stats.overflow++;
+        return NULL;
+    }
+    return &q->entry[head & (CAR_INGRESS_QUEUE_SIZE - 1)];
+}
+
+// 队列满时接收一侧要先处理队列，再收下一个数据报
+int car_ingress_full(void)
+{
+    return car_ingress_queue.head - car_ingress_queue.tail >= CAR_INGRESS_QUEUE_SIZE;
+}
+
+// 接收一侧：解码完成，把负载拷进队列后发布。负载原来指向接收缓冲区
+void car_ingress_commit(struct car_ingress_entry *entry)
+{
+    struct car_ingress_queue *q = &car_ingress_queue;
+
+    if (entry->cmd.payload_len > 0)
+    {
+        if (entry->cmd.payload_len > sizeof(entry->data))
+        {
+            entry->cmd.payload_len = sizeof(entry->data);
+        }
+        memcpy(entry->data, entry->cmd.payload, entry->cmd.payload_len);
+    }
+    entry->cmd.payload = entry->data;
+    q->head++;
+}
+
+// 处理一侧：最早的一条，没有时返回 NULL
+struct car_ingress_entry *car_ingress_peek(void)
+{
+    struct car_ingress_queue *q = &car_ingress_queue;
+    unsigned int tail = q->tail;
+
+    if (tail == q->head)
+    {
+        return NULL;
+    }
+    return &q->entry[tail & (CAR_INGRESS_QUEUE_SIZE - 1)];
+}
+
+void car_ingress_release(void)
+{
+    car_ingress_queue.tail++;
+}
+
+/*
+ * 把 cmd 合并进还没有下发的 pending：运动指令（包括差速驱动）取代之前的运动，
+ * NOP 和不认识的指令保留之前的运动；模式、车速和停车方式只在 cmd 设置时更新。
+ * cmd 不能是停车或运动段，这两种由调用者按顺序单独下发。
+ */
+void car_ingress_coalesce(struct car_cmd *pending, const struct car_cmd *cmd)
+{
+    if (cmd->op <= CAR_OP_RIGHT || cmd->op == CAR_OP_DRIVE)
+    {
+        pending->op = cmd->op;
+        pending->linear = cmd->linear;
+        pending->turn = cmd->turn;
+    }
+    if (cmd->mode < CAR_MODE_MAX)
+    {
+        pending->mode = cmd->mode;
+    }
+    if (cmd->speed != 0)
+    {
+        pending->speed = cmd->speed;
+    }
+    if (cmd->stop != CAR_STOP_NONE)
+    {
+        pending->stop = cmd->stop;
+    }
+    pending->seq = cmd->seq;
+    pending->flags = cmd->flags;
+    car_ingress_stats.coalesced++;
+}
+
+void car_ingress_count_bad(void)
+{
+    car_ingress_stats.bad++;
+}
+
+void car_ingress_count_applied(void)
+{
+    car_ingress_stats.applied++;
+}
+
+// 其他线程读取计数，各项之间不保证是同一时刻的值
+void car_ingress_get_stats(struct car_ingress_stats *stats)
+{
+    *stats = car_ingress_stats;
+}
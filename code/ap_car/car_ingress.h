@@ -0,0 +1,85 @@
+#ifndef __CAR_INGRESS_H__
+#define __CAR_INGRESS_H__
+
+#include "lwip/sockets.h"
+
+#include "car_proto.h"
+#include "car_test.h"
+
+/*
+ * UDP 指令入口：限速、有界队列和指令合并。
+ *
+ * UDP 网络任务收到数据报后先按发送方（IP:端口）做令牌桶限速，超出
+ * CAR_INGRESS_RATE 的数据报不解码直接丢弃。新的发送方只带几个数据报的令牌，
+ * 每秒最多记录 CAR_INGRESS_NEW_RATE 个新发送方；桶里不到一半令牌的发送方
+ * 还要从所有发送方共用的总预算里取令牌。轮换源端口或者多个发送方一起发，
+ * 都越不过这些上限，按正常速率发送的控制端既不占总预算，也不会被挤出
+ * 发送方表。通过的数据报解码后放入定长的
+ * 环形队列。收数据报和处理队列都在 UDP 网络任务里，队列不需要同步。
+ * 处理时把队列里的指令合并成一条：运动指令只保留最新的一条，模式、车速和
+ * 停车方式各取最新设置的值，被取代的指令不再单独下发。合并后的指令至少
+ * 间隔 CAR_INGRESS_APPLY_MS 才写入控制任务的邮箱；停车指令和运动段不参与
+ * 合并，按到达顺序立即下发，后面的运动指令不会吞掉停车。
+ *
+ * 这样发送方每秒发几千个数据报时，控制任务的唤醒次数仍然有上限，运动段和
+ * 速度闭环的定时不受影响。各项计数只由 UDP 网络任务写。
+ */
+
+// 队列容量，必须是 2 的幂
+#define CAR_INGRESS_QUEUE_SIZE 8
+
+// 每个发送方每秒最多接受的数据报数和突发量，正常的控制端不超过 100Hz，
+// 突发量留给可靠指令的重发
+#define CAR_INGRESS_RATE 200
+#define CAR_INGRESS_BURST 50
+
+// 同时限速的发送方数量，超过时替换令牌最少的一个
+#define CAR_INGRESS_SENDERS 4
+
+// 新发送方起始的令牌数，和每秒最多接受的新发送方个数
+#define CAR_INGRESS_NEW_BURST 4
+#define CAR_INGRESS_NEW_RATE 20
+
+// 桶里不到一半令牌的发送方合起来每秒最多接受的数据报数和突发量
+#define CAR_INGRESS_TOTAL_RATE (2 * CAR_INGRESS_RATE)
+#define CAR_INGRESS_TOTAL_BURST (2 * CAR_INGRESS_BURST)
+
+// 合并后的指令写入邮箱的最短间隔
+#define CAR_INGRESS_APPLY_MS 5
+
+// 最长的负载：一批运动段
+#define CAR_INGRESS_PAYLOAD_MAX (1 + CAR_SEG_QUEUE_SIZE * CAR_SEG_WIRE_LEN)
+
+struct car_ingress_entry
+{
+    struct car_cmd cmd; // payload 指向 data
+    struct sockaddr_in from;
+    unsigned int recv_us;   // 收到数据报的时间
+    unsigned int parsed_us; // 解码完成的时间
+    unsigned int binary;
+    unsigned char data[CAR_INGRESS_PAYLOAD_MAX];
+};
+
+struct car_ingress_stats
+{
+    unsigned int received;     // 收到的数据报
+    unsigned int rate_limited; // 超过发送方速率或总预算而丢弃
+    unsigned int new_limited;  // 其中新发送方超出预算的
+    unsigned int bad;          // 解码失败
+    unsigned int overflow;     // 队列满而丢弃
+    unsigned int coalesced;    // 被后来的指令取代，没有单独下发
+    unsigned int applied;      // 写入邮箱的（合并后的）指令
+};
+
+int car_ingress_admit(const struct sockaddr_in *from, unsigned int now_us);
+struct car_ingress_entry *car_ingress_reserve(void);
+int car_ingress_full(void);
+void car_ingress_commit(struct car_ingress_entry *entry);
+struct car_ingress_entry *car_ingress_peek(void);
+void car_ingress_release(void);
+void car_ingress_coalesce(struct car_cmd *pending, const struct car_cmd *cmd);
+void car_ingress_count_bad(void);
+void car_ingress_count_applied(void);
+void car_ingress_get_stats(struct car_ingress_stats *stats);
+
+#endif /* __CAR_INGRESS_H__ */
@@ -0,0 +1,65 @@
+#include <stdio.h>
+
+#include "adc_key.h"
+#include "car_test.h"
+#include "car_keys.h"
+
+// S2 依次切换的车速
+static const CarSpeed car_keys_speeds[] = {CAR_SPEED_LOW, CAR_SPEED_MEDIUM, CAR_SPEED_HIGH};
+
+#define CAR_KEYS_SPEED_NUM (sizeof(car_keys_speeds) / sizeof(car_keys_speeds[0]))
+
+static CarSpeed car_keys_next_speed(unsigned int speed)
+{
+    unsigned int i;
+
+    for (i = 0; i < CAR_KEYS_SPEED_NUM; i++)
+    {
+        if (car_keys_speeds[i] == speed)
+        {
+            return car_keys_speeds[(i + 1) % CAR_KEYS_SPEED_NUM];
+        }
+    }
+    return CAR_SPEED_MEDIUM;
+}
+
+static void car_keys_apply(const struct key_event *ev)
+{
+    struct car_state state;
+
+    if (ev->key == KEY_EVENT_S1 && ev->type == KEY_EV_PRESS)
+    {
+        car_emergency_stop(CAR_SRC_KEY);
+    }
+    else if (ev->key == KEY_EVENT_S1 && ev->type == KEY_EV_LONG)
+    {
+        car_emergency_release(CAR_SRC_KEY);
+    }
+    else if (ev->key == KEY_EVENT_S2 && ev->type == KEY_EV_PRESS)
+    {
+        get_car_state(&state);
+        set_car_speed(CAR_SRC_KEY, car_keys_next_speed(state.speed));
+    }
+    else if (ev->key == KEY_EVENT_S3 && ev->type == KEY_EV_PRESS)
+    {
+        get_car_state(&state);
+        set_car_mode(CAR_SRC_KEY, state.mode == CAR_MODE_STEP ? CAR_MODE_ALWAY : CAR_MODE_STEP);
+    }
+}
+
+// 按键任务：取出全部事件，急停不等待其他处理
+static void car_keys_notify(void)
+{
+    struct key_event ev;
+
+    while (adc_key_get_event(&ev))
+    {
+        car_keys_apply(&ev);
+    }
+}
+
+// 控制任务创建事件后调用，之前的按键事件不处理
+void car_keys_init(void)
+{
+    adc_key_set_notify(car_keys_notify);
+}
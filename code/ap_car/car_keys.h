@@ -0,0 +1,20 @@
+#ifndef __CAR_KEYS_H__
+#define __CAR_KEYS_H__
+
+/*
+ * 板上按键作为本地指令来源（CAR_SRC_KEY）。
+ *
+ * adc_key 按键任务产生事件后调用通知回调，回调在按键任务中取出事件并写入
+ * 按键来源的指令邮箱，按键任务是这个邮箱唯一的写者：
+ *
+ *   S1 按下   急停：立即刹车并锁定，远程指令和运动段都被丢弃
+ *   S1 长按   解除急停锁定
+ *   S2 按下   车速在低、中、高之间切换
+ *   S3 按下   步进模式与持续模式切换
+ *
+ * S4 保留。
+ */
+
+void car_keys_init(void);
+
+#endif /* __CAR_KEYS_H__ */
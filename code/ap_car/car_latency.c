@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include "car_latency.h"
+
+#define CAR_LAT_NAME(name, str) str,
+static const char *const car_lat_names[CAR_LAT_MAX] = {CAR_LAT_STAGES(CAR_LAT_NAME)};
+#undef CAR_LAT_NAME
+
+static struct car_lat_hist car_lat_hists[CAR_LAT_MAX];
+
+// 清零计数，只由 UDP 网络任务写
+static unsigned int car_lat_reset_gen;
+
+const char *car_lat_name(unsigned int stage)
+{
+    return stage < CAR_LAT_MAX ? car_lat_names[stage] : "unknown";
+}
+
+// 值所在的格：低位区每微秒一格，之后每个 2 的幂区间 CAR_LAT_SUB 格
+static unsigned int car_lat_index(unsigned int us)
+{
+    unsigned int shift;
+
+    if (us >= (1U << CAR_LAT_RANGE_BITS))
+    {
+        return CAR_LAT_BUCKETS - 1;
+    }
+    if (us < 2 * CAR_LAT_SUB)
+    {
+        return us;
+    }
+    shift = 31 - __builtin_clz(us) - CAR_LAT_SUB_BITS;
+    return shift * CAR_LAT_SUB + (us >> shift);
+}
+
+// 格内的最大值
+static unsigned int car_lat_upper(unsigned int index)
+{
+    unsigned int shift;
+
+    if (index < 2 * CAR_LAT_SUB)
+    {
+        return index;
+    }
+    shift = index / CAR_LAT_SUB - 1;
+    return (((index % CAR_LAT_SUB) + CAR_LAT_SUB + 1) << shift) - 1;
+}
+
+// 写者：记录 stage 的一次延迟
+void car_lat_record(unsigned int stage, unsigned int us)
+{
+    struct car_lat_hist *h = &car_lat_hists[stage];
+    unsigned int gen = __atomic_load_n(&car_lat_reset_gen, __ATOMIC_ACQUIRE);
+    unsigned int *b;
+
+    if (h->reset_seen != gen)
+    {
+        memset(h->bucket, 0, sizeof(h->bucket));
+        __atomic_store_n(&h->max_us, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&h->reset_seen, gen, __ATOMIC_RELEASE);
+    }
+    b = &h->bucket[car_lat_index(us)];
+    __atomic_store_n(b, *b + 1, __ATOMIC_RELAXED);
+    if (us > h->max_us)
+    {
+        __atomic_store_n(&h->max_us, us, __ATOMIC_RELAXED);
+    }
+}
+
+// 读者：stage 的记录数、分位数和最大值
+void car_lat_get(unsigned int stage, struct car_lat_summary *sum)
+{
+    static const unsigned int pct[3] = {50, 90, 99};
+    struct car_lat_hist *h = &car_lat_hists[stage];
+    unsigned int *out[3] = {&sum->p50_us, &sum->p90_us, &sum->p99_us};
+    unsigned int count = 0;
+    unsigned int seen = 0;
+    unsigned int next = 0;
+    unsigned int i;
+
+    memset(sum, 0, sizeof(*sum));
+    if (__atomic_load_n(&h->reset_seen, __ATOMIC_ACQUIRE) != __atomic_load_n(&car_lat_reset_gen, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+
+    // 先数总数，再按总数找各分位所在的格；两遍之间新增的记录只会让最后几格多一些
+    for (i = 0; i < CAR_LAT_BUCKETS; i++)
+    {
+        count += __atomic_load_n(&h->bucket[i], __ATOMIC_RELAXED);
+    }
+    sum->count = count;
+    sum->max_us = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+    if (count == 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < CAR_LAT_BUCKETS && next < 3; i++)
+    {
+        seen += __atomic_load_n(&h->bucket[i], __ATOMIC_RELAXED);
+        while (next < 3 && (unsigned long long)seen * 100 >= (unsigned long long)count * pct[next])
+        {
+            *out[next] = car_lat_upper(i) < sum->max_us ? car_lat_upper(i) : sum->max_us;
+            next++;
+        }
+    }
+    while (next < 3)
+    {
+        *out[next++] = sum->max_us;
+    }
+}
+
+// UDP 网络任务：清空全部直方图，各段在下一次记录时生效
+void car_lat_reset(void)
+{
+    __atomic_store_n(&car_lat_reset_gen, car_lat_reset_gen + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,64 @@
+#ifndef __CAR_LATENCY_H__
+#define __CAR_LATENCY_H__
+
+/*
+ * 指令路径延迟直方图。
+ *
+ * 一条 UDP 运动指令从收到数据报到 PWM/GPIO 写完分成几段，每段一个固定
+ * 大小的对数线性直方图（HDR 风格）：小于 2 * CAR_LAT_SUB 微秒的值每微秒一格，
+ * 更大的值每个 2 的幂区间分 CAR_LAT_SUB 格，相对误差不超过 1/CAR_LAT_SUB。
+ * 超过量程的值计入最后一格，最大值另外精确记录。
+ *
+ * 每段只有一个写者线程（见 CAR_LAT_STAGES），计数只用对齐字读写；读者不加锁
+ * 遍历各格，统计过程中写者可能又记了几次，对分位数没有影响。清零由 UDP 接收
+ * 线程发起：它把清零计数加一，各段的写者在下一次记录前自己清空，读者看到
+ * 计数不一致时按空直方图报告。
+ */
+
+// 每个 2 的幂区间的格数，必须是 2 的幂；16 格约 6% 的相对误差
+#define CAR_LAT_SUB_BITS 4
+#define CAR_LAT_SUB (1U << CAR_LAT_SUB_BITS)
+
+// 量程 2^CAR_LAT_RANGE_BITS 微秒（约 1 秒）
+#define CAR_LAT_RANGE_BITS 20
+#define CAR_LAT_BUCKETS ((CAR_LAT_RANGE_BITS - CAR_LAT_SUB_BITS + 1) * CAR_LAT_SUB)
+
+// 各段：名字（stats 回复中使用）、写者
+#define CAR_LAT_STAGES(X)                                               \
+    X(CAR_LAT_PARSE, "parse")   /* 收到数据报 -> 解码完成，UDP 网络任务 */  \
+    X(CAR_LAT_APPLY, "apply")   /* 解码完成 -> 写入指令邮箱，UDP 网络任务 */   \
+    X(CAR_LAT_PICKUP, "pickup") /* 写入邮箱 -> 控制任务取出，控制任务 */       \
+    X(CAR_LAT_OUTPUT, "output") /* 控制任务取出 -> PWM/GPIO 写完，控制任务 */  \
+    X(CAR_LAT_TOTAL, "total")   /* 收到数据报 -> PWM/GPIO 写完，控制任务 */
+
+#define CAR_LAT_ENUM(name, str) name,
+typedef enum
+{
+    CAR_LAT_STAGES(CAR_LAT_ENUM)
+    CAR_LAT_MAX
+} CarLatStage;
+#undef CAR_LAT_ENUM
+
+struct car_lat_hist
+{
+    unsigned int reset_seen; // 写者已处理的清零计数
+    unsigned int max_us;
+    unsigned int bucket[CAR_LAT_BUCKETS];
+};
+
+// 一段的统计结果，分位数取所在格的上界（不超过最大值），单位微秒
+struct car_lat_summary
+{
+    unsigned int count;
+    unsigned int p50_us;
+    unsigned int p90_us;
+    unsigned int p99_us;
+    unsigned int max_us;
+};
+
+void car_lat_record(unsigned int stage, unsigned int us);
+void car_lat_get(unsigned int stage, struct car_lat_summary *sum);
+void car_lat_reset(void);
+const char *car_lat_name(unsigned int stage);
+
+#endif /* __CAR_LATENCY_H__ */
@@ -0,0 +1,201 @@
+#include <stdio.h>
+
+#include "car_link.h"
+#include "car_seqlock.h"
+#include "car_test.h"
+
+static const unsigned int car_link_gap_bounds[CAR_LINK_GAP_BUCKETS - 1] = CAR_LINK_GAP_BOUNDS;
+
+static struct car_link_limits car_link_limits = {
+    CAR_LINK_SLOW_MS,
+    CAR_LINK_BRAKE_MS,
+    CAR_LINK_STOP_MS,
+};
+static osTimerId_t car_link_timer = NULL;
+static osEventFlagsId_t car_link_event = NULL;
+static unsigned int car_link_flag;
+
+// UDP 网络任务私有
+struct car_link_rx_state
+{
+    unsigned int addr;
+    unsigned short port;
+    unsigned short seq;
+    int seq_valid;
+    unsigned int prev_gap_us;
+    unsigned int expected; // 按序号应收到的数据报
+    unsigned int received;
+    unsigned int hist_total;
+};
+
+static struct car_link_rx_state car_link_rx_state;
+static struct car_link_metrics car_link_local;
+static struct car_seqlock car_link_lock;
+static struct car_link_metrics car_link_shared;
+static unsigned int car_link_last_us; // 单独发布，控制任务每次检查都要读
+
+// 检查定时器只唤醒控制任务
+static void car_link_timer_cb(void *arg)
+{
+    (void)arg;
+    osEventFlagsSet(car_link_event, car_link_flag);
+}
+
+void car_link_init(osEventFlagsId_t event, unsigned int flag)
+{
+    car_link_event = event;
+    car_link_flag = flag;
+    car_link_timer = osTimerNew(car_link_timer_cb, osTimerPeriodic, NULL, NULL);
+    if (car_link_timer == NULL)
+    {
+        printf("[car_link] Failed to create link timer!\r\n");
+    }
+}
+
+void car_link_set_limits(const struct car_link_limits *limits)
+{
+    car_link_limits = *limits;
+}
+
+// 控制任务：开始或停止周期检查
+void car_link_watch(int on)
+{
+    if (car_link_timer == NULL || on == (osTimerIsRunning(car_link_timer) != 0))
+    {
+        return;
+    }
+    if (on)
+    {
+        osTimerStart(car_link_timer, CAR_MS_TO_TICKS(CAR_LINK_CHECK_MS));
+    }
+    else
+    {
+        osTimerStop(car_link_timer);
+    }
+}
+
+// 静默了 silence_ms 毫秒时应处的阶段
+CarLinkStage car_link_stage(unsigned int silence_ms)
+{
+    const struct car_link_limits *lim = &car_link_limits;
+
+    if (lim->stop_ms != 0 && silence_ms >= lim->stop_ms)
+    {
+        return CAR_LINK_STOP;
+    }
+    if (lim->brake_ms != 0 && silence_ms >= lim->brake_ms)
+    {
+        return CAR_LINK_BRAKE;
+    }
+    if (lim->slow_ms != 0 && silence_ms >= lim->slow_ms)
+    {
+        return CAR_LINK_SLOW;
+    }
+    return CAR_LINK_OK;
+}
+
+unsigned int car_link_last_rx_us(void)
+{
+    return __atomic_load_n(&car_link_last_us, __ATOMIC_ACQUIRE);
+}
+
+static void car_link_decay(struct car_link_rx_state *s, struct car_link_metrics *m)
+{
+    unsigned int i;
+
+    if (s->hist_total >= CAR_LINK_DECAY)
+    {
+        s->hist_total = 0;
+        for (i = 0; i < CAR_LINK_GAP_BUCKETS; i++)
+        {
+            m->gap_hist[i] /= 2;
+            s->hist_total += m->gap_hist[i];
+        }
+    }
+    if (s->expected >= CAR_LINK_DECAY)
+    {
+        s->expected /= 2;
+        s->received /= 2;
+    }
+}
+
+// UDP 网络任务：驾驶者的一个数据报在 now_us 到达，addr 和 port 为网络字节序
+void car_link_rx(unsigned int addr, unsigned short port, int has_seq, unsigned short seq, unsigned int now_us)
+{
+    struct car_link_rx_state *s = &car_link_rx_state;
+    struct car_link_metrics *m = &car_link_local;
+
+    if (m->rx != 0)
+    {
+        unsigned int gap_us = now_us - m->last_rx_us;
+        unsigned int gap_ms = gap_us / 1000;
+        unsigned int i = 0;
+
+        // 抖动：相邻两个间隔之差，按 1/16 做指数平均
+        int d = (int)(gap_us - s->prev_gap_us);
+        d = d < 0 ? -d : d;
+        m->jitter_us += (d - (int)m->jitter_us) / 16;
+        s->prev_gap_us = gap_us;
+
+        while (i < CAR_LINK_GAP_BUCKETS - 1 && gap_ms >= car_link_gap_bounds[i])
+        {
+            i++;
+        }
+        m->gap_hist[i]++;
+        s->hist_total++;
+    }
+
+    // 换了驾驶者时序号重新开始，间隔统计照常
+    if (addr != s->addr || port != s->port)
+    {
+        s->addr = addr;
+        s->port = port;
+        s->seq_valid = 0;
+        m->driver_changes++;
+    }
+    if (has_seq)
+    {
+        short delta = (short)(seq - s->seq);
+
+        // 重发和乱序到达的数据报不计入，晚到的数据报之前已被算作丢失
+        if (!s->seq_valid || delta > 0)
+        {
+            s->expected += s->seq_valid ? (unsigned int)delta : 1;
+            s->received++;
+            s->seq = seq;
+            s->seq_valid = 1;
+        }
+        m->loss_permille = s->expected != 0 ? (s->expected - s->received) * 1000 / s->expected : 0;
+    }
+    car_link_decay(s, m);
+
+    m->rx++;
+    m->last_rx_us = now_us;
+    __atomic_store_n(&car_link_last_us, now_us, __ATOMIC_RELEASE);
+    car_seq_publish(&car_link_lock, &car_link_shared, m, sizeof(*m));
+}
+
+void car_link_get_metrics(struct car_link_metrics *metrics)
+{
+    car_seq_read(&car_link_lock, &car_link_shared, metrics, sizeof(*metrics));
+}
+
+// 遥测用的链路指标：抖动饱和到 16 位，直方图换算成百分比
+void car_link_get_report(struct car_link_report *report)
+{
+    struct car_link_metrics m = {0};
+    unsigned int total = 0;
+    unsigned int i;
+
+    car_link_get_metrics(&m);
+    report->jitter_us = m.jitter_us > 0xffff ? 0xffff : (unsigned short)m.jitter_us;
+    report->loss_permille = (unsigned short)m.loss_permille;
+    for (i = 0; i < CAR_LINK_GAP_BUCKETS; i++)
+    {
+        total += m.gap_hist[i];
+    }
+    for (i = 0; i < CAR_LINK_GAP_BUCKETS; i++)
+    {
+        report->gap_pct[i] = total != 0 ? (unsigned char)(m.gap_hist[i] * 100U / total) : 0;
+    }
+}
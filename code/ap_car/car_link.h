@@ -0,0 +1,77 @@
+#ifndef __CAR_LINK_H__
+#define __CAR_LINK_H__
+
+#include "cmsis_os2.h"
+
+#include "car_proto.h"
+
+/*
+ * 控制链路监视。
+ *
+ * UDP 网络任务对驾驶者会话（car_session.h，发出当前运动指令的控制端）的每个
+ * 数据报调用 car_link_rx()，包括只带 NOP 的心跳和重发的可靠指令。观察者的
+ * 数据报不算，别的控制端发心跳不能让失联的驾驶者的小车继续行驶。这里据此
+ * 维护滑动的链路指标：到达间隔的
+ * 抖动（相邻两个间隔之差的指数平均，同 RFC 3550）、到达间隔直方图和按序号
+ * 缺口估计的丢包率。直方图和丢包计数累计到 CAR_LINK_DECAY 时减半，所以反映
+ * 的是最近几百个数据报。指标只由 UDP 网络任务写，通过顺序锁发布，遥测在
+ * 完整状态帧中带上（CAR_STATE_F_LINK）。
+ *
+ * 持续运动模式下由 UDP 指令驱动的小车在控制端静默时分级处理：静默超过
+ * slow_ms 降到低速，超过 brake_ms 刹车，超过 stop_ms 停车并输出确定的停止
+ * 状态。控制端恢复发送后降速撤销，刹车和停车保持到下一条运动指令。Wi-Fi
+ * 终端离开热点时立即刹车。检查由控制任务在 CAR_LINK_CHECK_MS 周期的定时器
+ * 事件中完成，只在需要监视时运行。
+ */
+
+#define CAR_LINK_SLOW_MS 500
+#define CAR_LINK_BRAKE_MS 1000
+#define CAR_LINK_STOP_MS 1500
+#define CAR_LINK_CHECK_MS 50
+
+// 降速阶段差速驱动的线速度和转向按这个比例缩小
+#define CAR_LINK_SLOW_PCT 30
+
+// 到达间隔直方图各格的上限（毫秒），最后一格收其余的间隔
+#define CAR_LINK_GAP_BOUNDS {20, 50, 100, 200, 500}
+#define CAR_LINK_GAP_BUCKETS CAR_STATE_LINK_GAPS
+
+#define CAR_LINK_DECAY 256
+
+typedef enum
+{
+    CAR_LINK_OK = 0,
+    CAR_LINK_SLOW,
+    CAR_LINK_BRAKE,
+    CAR_LINK_STOP,
+} CarLinkStage;
+
+// 各阶段的静默时间，为 0 时不进入该阶段
+struct car_link_limits
+{
+    unsigned int slow_ms;
+    unsigned int brake_ms;
+    unsigned int stop_ms;
+};
+
+struct car_link_metrics
+{
+    unsigned int rx;             // 收到的驾驶者数据报
+    unsigned int last_rx_us;     // 最近一个数据报的到达时间
+    unsigned int jitter_us;      // 到达间隔的抖动
+    unsigned int loss_permille;  // 按序号缺口估计的丢包率，没有序号时为 0
+    unsigned int driver_changes; // 换过的驾驶者个数
+    unsigned short gap_hist[CAR_LINK_GAP_BUCKETS];
+};
+
+void car_link_init(osEventFlagsId_t event, unsigned int flag);
+void car_link_set_limits(const struct car_link_limits *limits);
+void car_link_watch(int on);
+CarLinkStage car_link_stage(unsigned int silence_ms);
+unsigned int car_link_last_rx_us(void);
+
+void car_link_rx(unsigned int addr, unsigned short port, int has_seq, unsigned short seq, unsigned int now_us);
+void car_link_get_metrics(struct car_link_metrics *metrics);
+void car_link_get_report(struct car_link_report *report);
+
+#endif /* __CAR_LINK_H__ */
@@ -0,0 +1,330 @@
+#include <stdio.h>
+
+#include "cmsis_os2.h"
+
+#include <iot_pwm.h>
+#include <iot_gpio.h>
+#include <hi_pwm.h>
+#include "car_test.h"
+#include "car_motor.h"
+#include "car_pin.h"
+
+#define CAR_MOTOR_PWM_FREQ (60000)
+
+// 每个车轮的正转、反转通道
+struct car_wheel_pins
+{
+    unsigned int fwd_gpio;
+    unsigned int fwd_port;
+    unsigned int rev_gpio;
+    unsigned int rev_port;
+};
+
+// 左轮 GPIO1/PWM4 正转、GPIO0/PWM3 反转，右轮 GPIO10/PWM1 正转、GPIO9/PWM0 反转
+static const struct car_wheel_pins car_wheel_pins[CAR_WHEEL_MAX] = {
+    {IO_NAME_GPIO_1, PWM_PORT_PWM4, IO_NAME_GPIO_0, PWM_PORT_PWM3},
+    {IO_NAME_GPIO_10, PWM_PORT_PWM1, IO_NAME_GPIO_9, PWM_PORT_PWM0},
+};
+
+struct car_wheel_ramp
+{
+    int target;   // 目标占空比
+    int duty;     // 当前占空比
+    int step;     // 上一个周期的占空比变化量
+    int dwell_ms; // 换向时在 0 停留的剩余时间
+    int trim;     // 速度闭环的修正量，加在占空比的大小上
+    int out;      // 已写到硬件的占空比
+    int out_valid;
+};
+
+static struct car_wheel_ramp car_wheels[CAR_WHEEL_MAX];
+static struct car_motor_limits car_motor_limits = {
+    CAR_MOTOR_ACCEL_MAX,
+    CAR_MOTOR_DECEL_MAX,
+    CAR_MOTOR_JERK_MAX,
+    CAR_MOTOR_ZERO_DWELL_MS,
+};
+static osTimerId_t car_motor_timer = NULL;
+static osEventFlagsId_t car_motor_event = NULL;
+static unsigned int car_motor_flag;
+
+// 斜坡定时器只唤醒控制任务，PWM 只在控制任务中写
+static void car_motor_timer_cb(void *arg)
+{
+    (void)arg;
+    osEventFlagsSet(car_motor_event, car_motor_flag);
+}
+
+void car_motor_init(osEventFlagsId_t event, unsigned int flag)
+{
+    car_motor_event = event;
+    car_motor_flag = flag;
+    car_motor_timer = osTimerNew(car_motor_timer_cb, osTimerPeriodic, NULL, NULL);
+    if (car_motor_timer == NULL)
+    {
+        printf("[car_motor] Failed to create ramp timer!\r\n");
+    }
+}
+
+void car_motor_set_limits(const struct car_motor_limits *limits)
+{
+    car_motor_limits = *limits;
+}
+
+int car_motor_get(unsigned int wheel)
+{
+    return wheel < CAR_WHEEL_MAX ? car_wheels[wheel].duty : 0;
+}
+
+// 以每周期变化 step 起步、每周期减少 jd 直到停下，一共走过的占空比
+static long long car_stop_dist(long long step, long long jd)
+{
+    long long m = step / jd;
+
+    if (step <= 0)
+    {
+        return 0;
+    }
+    return step * (m + 1) - jd * m * (m + 1) / 2;
+}
+
+// 斜坡占空比加上速度闭环的修正量，方向不变，大小不低于原来的一半
+static int car_motor_trimmed(const struct car_wheel_ramp *w, int duty)
+{
+    int mag = duty < 0 ? -duty : duty;
+    int out = mag + w->trim;
+
+    if (duty == 0 || w->trim == 0)
+    {
+        return duty;
+    }
+    if (out > CAR_DUTY_MAX)
+    {
+        out = CAR_DUTY_MAX;
+    }
+    if (out < mag / 2)
+    {
+        out = mag / 2;
+    }
+    return duty < 0 ? -out : out;
+}
+
+// 把一个车轮的输出改为 duty：方向不变时只更新占空比，输出没有变化时不写
+static void car_motor_output(unsigned int wheel, int duty)
+{
+    struct car_wheel_ramp *w = &car_wheels[wheel];
+    const struct car_wheel_pins *pins = &car_wheel_pins[wheel];
+
+    duty = car_motor_trimmed(w, duty);
+    if (w->out_valid && w->out == duty)
+    {
+        return;
+    }
+
+    if (w->out_valid && duty != 0 && w->out != 0 && (duty > 0) == (w->out > 0))
+    {
+        IoTPwmStart(duty > 0 ? pins->fwd_port : pins->rev_port, duty > 0 ? duty : -duty, CAR_MOTOR_PWM_FREQ);
+    }
+    else
+    {
+        // 只停正在输出的通道，启动时所有通道状态未知
+        if (!w->out_valid || w->out > 0)
+        {
+            IoTPwmStop(pins->fwd_port);
+        }
+        if (!w->out_valid || w->out < 0)
+        {
+            IoTPwmStop(pins->rev_port);
+        }
+
+        // 输出 PWM 的引脚复用为 PWM，另一个引脚作为 GPIO 拉低
+        if (duty > 0)
+        {
+            car_pin_gpio(pins->rev_gpio, IOT_GPIO_VALUE0);
+            car_pin_pwm(pins->fwd_gpio);
+            IoTPwmStart(pins->fwd_port, duty, CAR_MOTOR_PWM_FREQ);
+        }
+        else if (duty < 0)
+        {
+            car_pin_gpio(pins->fwd_gpio, IOT_GPIO_VALUE0);
+            car_pin_pwm(pins->rev_gpio);
+            IoTPwmStart(pins->rev_port, -duty, CAR_MOTOR_PWM_FREQ);
+        }
+        else
+        {
+            car_pin_gpio(pins->fwd_gpio, (IotGpioValue)CAR_MOTOR_STOP_LEVEL);
+            car_pin_gpio(pins->rev_gpio, (IotGpioValue)CAR_MOTOR_STOP_LEVEL);
+        }
+    }
+
+    w->out = duty;
+    w->out_valid = 1;
+}
+
+// 一个车轮前进一个斜坡周期，返回是否还没有到达目标
+static int car_wheel_step(struct car_wheel_ramp *w, int dt_ms)
+{
+    const struct car_motor_limits *lim = &car_motor_limits;
+    int target = w->target;
+    int prev = w->duty;
+    long long cap;
+    long long jd;
+    long long step;
+    long long lo;
+    long long hi;
+    int err;
+    int dir;
+
+    if (lim->accel <= 0)
+    {
+        w->duty = target;
+        w->step = 0;
+        w->dwell_ms = 0;
+        return 0;
+    }
+
+    // 换向时先减到 0，并在 0 停留一段时间
+    if (w->dwell_ms > 0)
+    {
+        w->dwell_ms -= dt_ms;
+        return 1;
+    }
+    if (w->duty != 0 && target != 0 && (w->duty > 0) != (target > 0))
+    {
+        target = 0;
+    }
+
+    err = target - w->duty;
+    if (err == 0)
+    {
+        w->step = 0;
+        return w->duty != w->target;
+    }
+    dir = err > 0 ? 1 : -1;
+    err *= dir;
+
+    // 远离 0 时受加速度限制，靠近 0 时受减速度限制
+    cap = (target != 0 && (long long)w->duty * dir >= 0) ? lim->accel : lim->decel;
+    if (cap <= 0)
+    {
+        cap = lim->accel;
+    }
+    cap = cap * dt_ms / 1000;
+
+    // 以下都是沿 dir 方向、每个周期的变化量
+    step = (long long)w->step * dir;
+    if (lim->jerk > 0)
+    {
+        jd = (long long)lim->jerk * dt_ms * dt_ms / 1000000;
+        if (jd <= 0)
+        {
+            jd = 1;
+        }
+        lo = step - jd;
+        hi = step + jd < cap ? step + jd : cap;
+        // 取 jerk 允许范围内最大的一步，并且之后每周期减少 jd 还能在目标处停下
+        if (hi > lo && hi + car_stop_dist(hi - jd, jd) > err)
+        {
+            while (hi - lo > 1)
+            {
+                long long mid = lo + (hi - lo) / 2;
+                if (mid + car_stop_dist(mid - jd, jd) > err)
+                {
+                    hi = mid;
+                }
+                else
+                {
+                    lo = mid;
+                }
+            }
+            hi = lo;
+        }
+        step = hi;
+    }
+    else
+    {
+        step = cap;
+    }
+    if (step >= err)
+    {
+        w->duty = target;
+        w->step = 0;
+    }
+    else
+    {
+        w->duty += (int)step * dir;
+        w->step = (int)step * dir;
+    }
+
+    if (w->duty == 0 && prev != 0 && w->target != 0 && (w->target > 0) != (prev > 0))
+    {
+        w->dwell_ms = lim->zero_dwell_ms;
+    }
+    return w->duty != w->target || w->step != 0 || w->dwell_ms > 0;
+}
+
+// 控制任务：斜坡前进一步并输出，全部到达目标后停止定时器，返回是否还在变化
+int car_motor_step(void)
+{
+    int active = 0;
+    unsigned int i;
+
+    for (i = 0; i < CAR_WHEEL_MAX; i++)
+    {
+        active |= car_wheel_step(&car_wheels[i], CAR_MOTOR_RAMP_MS);
+        car_motor_output(i, car_wheels[i].duty);
+    }
+
+    if (!active && car_motor_timer != NULL && osTimerIsRunning(car_motor_timer))
+    {
+        osTimerStop(car_motor_timer);
+    }
+    return active;
+}
+
+// 控制任务：设置两个车轮的目标占空比，立即走第一步，其余由斜坡定时器完成
+void car_motor_set(int left_duty, int right_duty)
+{
+    car_wheels[CAR_WHEEL_LEFT].target = left_duty;
+    car_wheels[CAR_WHEEL_RIGHT].target = right_duty;
+
+    if (car_motor_step() && car_motor_timer != NULL && !osTimerIsRunning(car_motor_timer))
+    {
+        osTimerStart(car_motor_timer, CAR_MS_TO_TICKS(CAR_MOTOR_RAMP_MS));
+    }
+}
+
+// 控制任务：不经过斜坡，立即停止两个车轮的 PWM，输入都设为 CAR_MOTOR_STOP_LEVEL
+void car_motor_release(void)
+{
+    unsigned int i;
+
+    if (car_motor_timer != NULL && osTimerIsRunning(car_motor_timer))
+    {
+        osTimerStop(car_motor_timer);
+    }
+
+    for (i = 0; i < CAR_WHEEL_MAX; i++)
+    {
+        struct car_wheel_ramp *w = &car_wheels[i];
+
+        w->target = 0;
+        w->duty = 0;
+        w->step = 0;
+        w->dwell_ms = 0;
+        w->trim = 0;
+        car_motor_output(i, 0);
+    }
+}
+
+// 控制任务：设置速度闭环对两个车轮的修正量并立即输出
+void car_motor_trim(const int trim[CAR_WHEEL_MAX])
+{
+    unsigned int i;
+
+    for (i = 0; i < CAR_WHEEL_MAX; i++)
+    {
+        car_wheels[i].trim = trim[i];
+        car_motor_output(i, car_wheels[i].duty);
+    }
+}
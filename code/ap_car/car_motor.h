@@ -0,0 +1,57 @@
+#ifndef __CAR_MOTOR_H__
+#define __CAR_MOTOR_H__
+
+#include "cmsis_os2.h"
+
+/*
+ * 电机斜坡输出。
+ *
+ * 运动函数只设置两个车轮的目标占空比（带符号，正数正转），由控制任务按
+ * CAR_MOTOR_RAMP_MS 的周期逐步逼近：占空比变化率受加速度限制，变化率本身
+ * 的变化受加加速度（jerk）限制，换向时先减到 0 并停留 CAR_MOTOR_ZERO_DWELL_MS
+ * 再反向起步。每次只写有变化的通道。速度闭环（car_speed.c）可以在斜坡的
+ * 占空比上加一个修正量，斜坡本身不受影响。
+ *
+ * 占空比单位与 IoTPwmStart 相同，加速度单位为占空比/秒，加加速度为占空比/秒²。
+ */
+
+typedef enum
+{
+    CAR_WHEEL_LEFT,
+    CAR_WHEEL_RIGHT,
+    CAR_WHEEL_MAX
+} CarWheel;
+
+// 斜坡周期，一个 100Hz 系统节拍
+#define CAR_MOTOR_RAMP_MS 10
+
+// 默认限制：从停止到 CAR_DUTY_MAX 约 0.5 秒，减速允许快一倍
+#define CAR_MOTOR_ACCEL_MAX 160000
+#define CAR_MOTOR_DECEL_MAX 320000
+#define CAR_MOTOR_JERK_MAX 3200000
+
+// 换向时在 0 占空比停留的时间，等反电动势衰减
+#define CAR_MOTOR_ZERO_DWELL_MS 40
+
+// 占空比为 0 时两个输入的电平。板子上的 L9110S 两个输入都为低或都为高时输出状态相同，
+// 没有单独的悬空状态，所以刹车和滑行在这块板子上是同一个输出。与原来的 pwm_stop 一样都拉高
+#define CAR_MOTOR_STOP_LEVEL 1
+
+// 限制为 0 表示不限制（直接输出目标值）
+struct car_motor_limits
+{
+    int accel;
+    int decel;
+    int jerk;
+    int zero_dwell_ms;
+};
+
+void car_motor_init(osEventFlagsId_t event, unsigned int flag);
+void car_motor_set_limits(const struct car_motor_limits *limits);
+void car_motor_set(int left_duty, int right_duty);
+int car_motor_step(void);
+void car_motor_release(void);
+void car_motor_trim(const int trim[CAR_WHEEL_MAX]);
+int car_motor_get(unsigned int wheel);
+
+#endif /* __CAR_MOTOR_H__ */
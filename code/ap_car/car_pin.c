@@ -0,0 +1,100 @@
+#include "cmsis_os2.h"
+
+#include <iot_gpio.h>
+#include <hi_io.h>
+#include "car_test.h"
+#include "car_pin.h"
+
+#define CAR_PIN_FUNC_GPIO 0
+#define CAR_PIN_UNKNOWN 0xFF
+
+struct car_pin
+{
+    unsigned int gpio;
+    unsigned char pwm_func; // 复用为 PWM 输出时的功能号
+    unsigned char func;     // 以下为当前状态，CAR_PIN_UNKNOWN 表示未知
+    unsigned char dir;
+    unsigned char level;
+};
+
+static struct car_pin car_pins[] = {
+    {IO_NAME_GPIO_0, IO_FUNC_GPIO_0_PWM3_OUT, CAR_PIN_UNKNOWN, CAR_PIN_UNKNOWN, CAR_PIN_UNKNOWN},
+    {IO_NAME_GPIO_1, IO_FUNC_GPIO_1_PWM4_OUT, CAR_PIN_UNKNOWN, CAR_PIN_UNKNOWN, CAR_PIN_UNKNOWN},
+    {IO_NAME_GPIO_9, IO_FUNC_GPIO_9_PWM0_OUT, CAR_PIN_UNKNOWN, CAR_PIN_UNKNOWN, CAR_PIN_UNKNOWN},
+    {IO_NAME_GPIO_10, IO_FUNC_GPIO_10_PWM1_OUT, CAR_PIN_UNKNOWN, CAR_PIN_UNKNOWN, CAR_PIN_UNKNOWN},
+};
+
+#define CAR_PIN_NUM (sizeof(car_pins) / sizeof(car_pins[0]))
+
+static struct car_pin *car_pin_find(unsigned int gpio)
+{
+    unsigned int i;
+
+    for (i = 0; i < CAR_PIN_NUM; i++)
+    {
+        if (car_pins[i].gpio == gpio)
+        {
+            return &car_pins[i];
+        }
+    }
+    return NULL;
+}
+
+static void car_pin_set_func(struct car_pin *pin, unsigned char func)
+{
+    if (pin->func != func)
+    {
+        hi_io_set_func(pin->gpio, func);
+        pin->func = func;
+    }
+}
+
+// 引脚复用为 PWM 输出
+void car_pin_pwm(unsigned int gpio)
+{
+    struct car_pin *pin = car_pin_find(gpio);
+
+    if (pin != NULL)
+    {
+        car_pin_set_func(pin, pin->pwm_func);
+    }
+}
+
+// 引脚复用为 GPIO 输出并设置电平
+void car_pin_gpio(unsigned int gpio, IotGpioValue value)
+{
+    struct car_pin *pin = car_pin_find(gpio);
+
+    if (pin == NULL)
+    {
+        hi_io_set_func(gpio, CAR_PIN_FUNC_GPIO);
+        IoTGpioSetDir(gpio, IOT_GPIO_DIR_OUT);
+        IoTGpioSetOutputVal(gpio, value);
+        return;
+    }
+
+    car_pin_set_func(pin, CAR_PIN_FUNC_GPIO);
+    if (pin->dir != IOT_GPIO_DIR_OUT)
+    {
+        IoTGpioSetDir(gpio, IOT_GPIO_DIR_OUT);
+        pin->dir = IOT_GPIO_DIR_OUT;
+    }
+    if (pin->level != value)
+    {
+        IoTGpioSetOutputVal(gpio, value);
+        pin->level = value;
+    }
+}
+
+// 引脚可能被其他代码改过时调用，下一次切换会完整写入
+void car_pin_invalidate(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < CAR_PIN_NUM; i++)
+    {
+        car_pins[i].func = CAR_PIN_UNKNOWN;
+        car_pins[i].dir = CAR_PIN_UNKNOWN;
+        car_pins[i].level = CAR_PIN_UNKNOWN;
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef __CAR_PIN_H__
+#define __CAR_PIN_H__
+
+#include <iot_gpio.h>
+
+/*
+ * 电机引脚状态缓存。
+ *
+ * 记录四个电机引脚（GPIO0/1/9/10）当前的复用功能、方向和输出电平，切换时
+ * 只写真正变化的部分。GPIO 方向和电平寄存器在引脚复用为 PWM 时保持不变，
+ * 所以从 PWM 切回 GPIO 时通常只需要改复用功能。
+ *
+ * 只在控制任务中调用。其他引脚不缓存，每次都完整写入。
+ */
+
+void car_pin_pwm(unsigned int gpio);
+void car_pin_gpio(unsigned int gpio, IotGpioValue value);
+void car_pin_invalidate(void);
+
+#endif /* __CAR_PIN_H__ */
@@ -0,0 +1,855 @@
+#include <string.h>
+
+#include "car_test.h"
+#include "car_proto.h"
+#include "car_latency.h"
+#include "car_trace.h"
+
+/* CRC-16/CCITT-FALSE, one nibble at a time: a 32 byte table instead of 512. */
+static const unsigned short crc16_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+unsigned short car_proto_crc16(const unsigned char *data, int len)
+{
+    unsigned short crc = 0xFFFF;
+    int i;
+
+    for (i = 0; i < len; i++)
+    {
+        crc = (unsigned short)((crc << 4) ^ crc16_nibble[((crc >> 12) ^ (data[i] >> 4)) & 0x0F]);
+        crc = (unsigned short)((crc << 4) ^ crc16_nibble[((crc >> 12) ^ (data[i] & 0x0F)) & 0x0F]);
+    }
+    return crc;
+}
+
+static unsigned short get_le16(const unsigned char *p)
+{
+    return (unsigned short)(p[0] | (p[1] << 8));
+}
+
+static void put_le16(unsigned char *p, unsigned short v)
+{
+    p[0] = (unsigned char)(v & 0xFF);
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static unsigned int get_le32(const unsigned char *p)
+{
+    return (unsigned int)get_le16(p) | ((unsigned int)get_le16(p + 2) << 16);
+}
+
+static void put_le32(unsigned char *p, unsigned int v)
+{
+    put_le16(p, (unsigned short)(v & 0xFFFF));
+    put_le16(p + 2, (unsigned short)(v >> 16));
+}
+
+/**
+ * @brief Decodes a binary control frame in place.
+ *
+ * The frame is validated (magic, version, length, CRC, speed at most
+ * CAR_DUTY_MAX) and its fields are copied into cmd. The payload is not
+ * copied: cmd->payload points into buf, so buf must stay valid while the
+ * command is used.
+ *
+ * @return CAR_PROTO_OK, or a negative CarProtoError.
+ */
+int car_proto_decode(const unsigned char *buf, int len, struct car_cmd *cmd)
+{
+    int frame_len;
+
+    if (len < CAR_PROTO_MIN_LEN)
+    {
+        return CAR_PROTO_ERR_SHORT;
+    }
+    if (buf[0] != CAR_PROTO_MAGIC)
+    {
+        return CAR_PROTO_ERR_MAGIC;
+    }
+    if (buf[1] != CAR_PROTO_VERSION)
+    {
+        return CAR_PROTO_ERR_VERSION;
+    }
+
+    frame_len = CAR_PROTO_HDR_LEN + buf[8] + CAR_PROTO_CRC_LEN;
+    if (frame_len != len)
+    {
+        return CAR_PROTO_ERR_LEN;
+    }
+    if (car_proto_crc16(buf, len - CAR_PROTO_CRC_LEN) != get_le16(buf + len - CAR_PROTO_CRC_LEN))
+    {
+        return CAR_PROTO_ERR_CRC;
+    }
+
+    /* The speed is used as a duty cycle: a frame asking for more is dropped. */
+    cmd->speed = get_le16(buf + 6);
+    if (cmd->speed > CAR_DUTY_MAX)
+    {
+        return CAR_PROTO_ERR_RANGE;
+    }
+    cmd->seq = get_le16(buf + 2);
+    cmd->op = buf[4] & ~CAR_OP_F_RELIABLE;
+    cmd->mode = buf[5];
+    cmd->flags = (buf[4] & CAR_OP_F_RELIABLE) ? CAR_CMD_F_BINARY | CAR_CMD_F_RELIABLE : CAR_CMD_F_BINARY;
+    cmd->payload_len = buf[8];
+    cmd->payload = buf + CAR_PROTO_HDR_LEN;
+    cmd->linear = 0;
+    cmd->turn = 0;
+    cmd->stop = CAR_STOP_NONE;
+    if (cmd->op <= CAR_OP_RIGHT && cmd->payload_len > 0 && cmd->payload[0] < CAR_STOP_MAX)
+    {
+        cmd->stop = cmd->payload[0];
+    }
+    if (cmd->op == CAR_OP_DRIVE)
+    {
+        if (cmd->payload_len != CAR_PROTO_DRIVE_LEN)
+        {
+            return CAR_PROTO_ERR_LEN;
+        }
+        cmd->linear = (short)get_le16(cmd->payload);
+        cmd->turn = (short)get_le16(cmd->payload + 2);
+    }
+    return CAR_PROTO_OK;
+}
+
+/**
+ * @brief Encodes cmd as a binary control frame.
+ *
+ * @return The frame length, or CAR_PROTO_ERR_SHORT if buf is too small.
+ */
+int car_proto_encode(unsigned char *buf, int size, const struct car_cmd *cmd)
+{
+    int len = CAR_PROTO_HDR_LEN + cmd->payload_len + CAR_PROTO_CRC_LEN;
+
+    if (size < len)
+    {
+        return CAR_PROTO_ERR_SHORT;
+    }
+
+    buf[0] = CAR_PROTO_MAGIC;
+    buf[1] = CAR_PROTO_VERSION;
+    put_le16(buf + 2, cmd->seq);
+    buf[4] = (cmd->flags & CAR_CMD_F_RELIABLE) ? cmd->op | CAR_OP_F_RELIABLE : cmd->op;
+    buf[5] = cmd->mode;
+    put_le16(buf + 6, cmd->speed);
+    buf[8] = cmd->payload_len;
+    if (cmd->payload_len > 0)
+    {
+        memcpy(buf + CAR_PROTO_HDR_LEN, cmd->payload, cmd->payload_len);
+    }
+    put_le16(buf + len - CAR_PROTO_CRC_LEN, car_proto_crc16(buf, len - CAR_PROTO_CRC_LEN));
+    return len;
+}
+
+/**
+ * @brief Unpacks the segments of a CAR_OP_SEGMENTS command.
+ *
+ * @param seg    Output array of max entries.
+ * @param append Set to 1 if the batch is to be appended to the queue.
+ * @return The number of segments, CAR_PROTO_ERR_LEN if the payload is
+ *         malformed or holds more than max segments, or CAR_PROTO_ERR_RANGE
+ *         if any segment's op is not a motion state other than
+ *         CAR_STATUS_DRIVE or its speed exceeds CAR_DUTY_MAX. Nothing of a
+ *         rejected batch is queued.
+ */
+int car_proto_get_segments(const struct car_cmd *cmd, struct car_segment *seg, int max, int *append)
+{
+    const unsigned char *p = cmd->payload + 1;
+    int count;
+    int i;
+
+    if (cmd->payload_len < 1 || (cmd->payload_len - 1) % CAR_SEG_WIRE_LEN != 0)
+    {
+        return CAR_PROTO_ERR_LEN;
+    }
+    count = (cmd->payload_len - 1) / CAR_SEG_WIRE_LEN;
+    if (count > max)
+    {
+        return CAR_PROTO_ERR_LEN;
+    }
+
+    *append = (cmd->payload[0] & CAR_SEG_F_APPEND) != 0;
+    for (i = 0; i < count; i++, p += CAR_SEG_WIRE_LEN)
+    {
+        seg[i].op = p[0];
+        seg[i].reserved = 0;
+        seg[i].speed = get_le16(p + 1);
+        seg[i].duration_ms = get_le16(p + 3);
+        if (seg[i].op >= CAR_STATUS_MAX || seg[i].op == CAR_STATUS_DRIVE || seg[i].speed > CAR_DUTY_MAX)
+        {
+            return CAR_PROTO_ERR_RANGE;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Encodes the part of a telemetry frame that every session sent the
+ * same state shares: the header and the fields of state that differ from prev.
+ *
+ * @param prev The state the sessions last received, or NULL for a full frame.
+ * @param link Link metrics to append, or NULL; only sent in a full frame.
+ * @return 1 if the frame carries a change, 0 if state equals prev: the frame
+ *         is then only worth sending with an ack.
+ */
+int car_proto_state_prepare(struct car_state_frame *frame, const struct car_state *state,
+                            const struct car_state *prev, const struct car_link_report *link)
+{
+    unsigned char *buf = frame->buf;
+    unsigned char *payload = buf + CAR_PROTO_HDR_LEN;
+    int len = 1;
+    int changed = 0;
+
+    buf[0] = CAR_PROTO_MAGIC;
+    buf[1] = CAR_PROTO_VERSION;
+    buf[4] = CAR_OP_STATE;
+    buf[5] = CAR_PROTO_KEEP;
+    put_le16(buf + 6, 0);
+    payload[0] = prev == NULL ? CAR_STATE_F_FULL : 0;
+
+    if (prev == NULL || state->mode != prev->mode)
+    {
+        buf[5] = (unsigned char)state->mode;
+        changed = 1;
+    }
+    if (prev == NULL || state->speed != prev->speed)
+    {
+        put_le16(buf + 6, (unsigned short)state->speed);
+        changed = 1;
+    }
+    if (prev == NULL || state->cur_status != prev->cur_status)
+    {
+        payload[0] |= CAR_STATE_F_STATUS;
+        payload[len++] = (unsigned char)state->cur_status;
+    }
+    if (prev == NULL || state->go_status != prev->go_status)
+    {
+        payload[0] |= CAR_STATE_F_GO;
+        payload[len++] = (unsigned char)state->go_status;
+    }
+    if (prev == NULL || state->linear != prev->linear || state->turn != prev->turn)
+    {
+        payload[0] |= CAR_STATE_F_DRIVE;
+        put_le16(payload + len, (unsigned short)state->linear);
+        put_le16(payload + len + 2, (unsigned short)state->turn);
+        len += 4;
+    }
+    if (prev == NULL || state->left_tps != prev->left_tps || state->right_tps != prev->right_tps)
+    {
+        payload[0] |= CAR_STATE_F_WHEELS;
+        put_le16(payload + len, (unsigned short)state->left_tps);
+        put_le16(payload + len + 2, (unsigned short)state->right_tps);
+        len += 4;
+    }
+
+    frame->flags = payload[0];
+    frame->state_len = (unsigned char)(CAR_PROTO_HDR_LEN + len);
+    frame->has_link = link != NULL && prev == NULL;
+    if (frame->has_link)
+    {
+        frame->link = *link;
+    }
+    return changed || payload[0] != 0;
+}
+
+/**
+ * @brief Completes a prepared telemetry frame for one session.
+ *
+ * Only seq, the ack, the link metrics, the length and the CRC are written;
+ * the state fields stay as prepared, so this can be called once per session.
+ *
+ * @param ack The session's ack to append, or NULL.
+ * @return The frame length; the frame is in frame->buf.
+ */
+int car_proto_state_finish(struct car_state_frame *frame, unsigned short seq, const struct car_ack *ack)
+{
+    unsigned char *buf = frame->buf;
+    int len = frame->state_len;
+
+    put_le16(buf + 2, seq);
+    buf[CAR_PROTO_HDR_LEN] = frame->flags;
+    if (ack != NULL && ack->valid)
+    {
+        buf[CAR_PROTO_HDR_LEN] |= CAR_STATE_F_ACK;
+        put_le16(buf + len, ack->seq);
+        put_le32(buf + len + 2, ack->mask);
+        len += CAR_STATE_ACK_LEN;
+    }
+    if (frame->has_link)
+    {
+        buf[CAR_PROTO_HDR_LEN] |= CAR_STATE_F_LINK;
+        put_le16(buf + len, frame->link.jitter_us);
+        put_le16(buf + len + 2, frame->link.loss_permille);
+        memcpy(buf + len + 4, frame->link.gap_pct, CAR_STATE_LINK_GAPS);
+        len += CAR_STATE_LINK_LEN;
+    }
+    buf[8] = (unsigned char)(len - CAR_PROTO_HDR_LEN);
+    put_le16(buf + len, car_proto_crc16(buf, len));
+    return len + CAR_PROTO_CRC_LEN;
+}
+
+/**
+ * @brief Encodes a telemetry frame with the fields of state that differ
+ * from prev, for a single receiver.
+ *
+ * @param prev The state the controller last received, or NULL for a full frame.
+ * @param ack  The reliable session's ack to append, or NULL.
+ * @param link Link metrics to append, or NULL; only sent in a full frame.
+ * @return The frame length, or CAR_PROTO_ERR_SHORT if buf is too small.
+ */
+int car_proto_encode_state(unsigned char *buf, int size, unsigned short seq, const struct car_state *state,
+                           const struct car_state *prev, const struct car_ack *ack,
+                           const struct car_link_report *link)
+{
+    struct car_state_frame frame;
+    int len;
+
+    car_proto_state_prepare(&frame, state, prev, link);
+    len = car_proto_state_finish(&frame, seq, ack);
+    if (size < len)
+    {
+        return CAR_PROTO_ERR_SHORT;
+    }
+    memcpy(buf, frame.buf, len);
+    return len;
+}
+
+/* Offset in a CAR_OP_STATE payload of the field flagged by field. */
+static int car_proto_state_offset(unsigned char flags, unsigned char field)
+{
+    int off = 1;
+
+    off += (flags & CAR_STATE_F_STATUS) ? 1 : 0;
+    off += (flags & CAR_STATE_F_GO) ? 1 : 0;
+    off += (flags & CAR_STATE_F_DRIVE) ? 4 : 0;
+    off += (flags & CAR_STATE_F_WHEELS) ? 4 : 0;
+    if (field == CAR_STATE_F_LINK)
+    {
+        off += (flags & CAR_STATE_F_ACK) ? CAR_STATE_ACK_LEN : 0;
+    }
+    return off;
+}
+
+/**
+ * @brief Finds the ack in a decoded CAR_OP_STATE frame.
+ *
+ * @return 1 if the frame carries an ack, 0 if not, CAR_PROTO_ERR_LEN if the
+ *         payload is shorter than its flags say.
+ */
+int car_proto_get_ack(const struct car_cmd *cmd, struct car_ack *ack)
+{
+    int off;
+
+    ack->valid = 0;
+    if (cmd->op != CAR_OP_STATE || cmd->payload_len < 1 || !(cmd->payload[0] & CAR_STATE_F_ACK))
+    {
+        return 0;
+    }
+    off = car_proto_state_offset(cmd->payload[0], CAR_STATE_F_ACK);
+    if (cmd->payload_len < off + CAR_STATE_ACK_LEN)
+    {
+        return CAR_PROTO_ERR_LEN;
+    }
+    ack->seq = get_le16(cmd->payload + off);
+    ack->mask = get_le32(cmd->payload + off + 2);
+    ack->valid = 1;
+    return 1;
+}
+
+/**
+ * @brief Finds the link metrics in a decoded CAR_OP_STATE frame.
+ *
+ * @return 1 if the frame carries them, 0 if not, CAR_PROTO_ERR_LEN if the
+ *         payload is shorter than its flags say.
+ */
+int car_proto_get_link(const struct car_cmd *cmd, struct car_link_report *link)
+{
+    int off;
+
+    if (cmd->op != CAR_OP_STATE || cmd->payload_len < 1 || !(cmd->payload[0] & CAR_STATE_F_LINK))
+    {
+        return 0;
+    }
+    off = car_proto_state_offset(cmd->payload[0], CAR_STATE_F_LINK);
+    if (cmd->payload_len < off + CAR_STATE_LINK_LEN)
+    {
+        return CAR_PROTO_ERR_LEN;
+    }
+    link->jitter_us = get_le16(cmd->payload + off);
+    link->loss_permille = get_le16(cmd->payload + off + 2);
+    memcpy(link->gap_pct, cmd->payload + off + 4, CAR_STATE_LINK_GAPS);
+    return 1;
+}
+
+/**
+ * @brief Encodes the reply to a CAR_OP_STATS request.
+ *
+ * @param sum   count stage summaries in CarLatStage order.
+ * @return The frame length, or CAR_PROTO_ERR_SHORT if buf is too small.
+ */
+int car_proto_encode_stats(unsigned char *buf, int size, unsigned short seq, const struct car_lat_summary *sum,
+                           int count)
+{
+    unsigned char payload[CAR_STATS_MAX_LEN - CAR_PROTO_MIN_LEN];
+    struct car_cmd frame;
+    unsigned char *p = payload + 1;
+    int i;
+
+    if (count > (int)(sizeof(payload) - 1) / CAR_STATS_WIRE_LEN)
+    {
+        return CAR_PROTO_ERR_SHORT;
+    }
+    memset(&frame, 0, sizeof(frame));
+    frame.seq = seq;
+    frame.op = CAR_OP_STATS;
+    frame.mode = CAR_PROTO_KEEP;
+    frame.payload = payload;
+    frame.payload_len = (unsigned char)(1 + count * CAR_STATS_WIRE_LEN);
+    payload[0] = (unsigned char)count;
+    for (i = 0; i < count; i++, p += CAR_STATS_WIRE_LEN)
+    {
+        put_le32(p, sum[i].count);
+        put_le32(p + 4, sum[i].p50_us);
+        put_le32(p + 8, sum[i].p90_us);
+        put_le32(p + 12, sum[i].p99_us);
+        put_le32(p + 16, sum[i].max_us);
+    }
+    return car_proto_encode(buf, size, &frame);
+}
+
+/**
+ * @brief Unpacks the stage summaries of a CAR_OP_STATS reply.
+ *
+ * @param sum Output array of max entries; stages beyond max are skipped.
+ * @return The number of stages stored, or CAR_PROTO_ERR_LEN if the payload
+ *         is malformed.
+ */
+int car_proto_get_stats(const struct car_cmd *cmd, struct car_lat_summary *sum, int max)
+{
+    const unsigned char *p = cmd->payload + 1;
+    int count;
+    int i;
+
+    if (cmd->payload_len < 1 || cmd->payload_len != 1 + cmd->payload[0] * CAR_STATS_WIRE_LEN)
+    {
+        return CAR_PROTO_ERR_LEN;
+    }
+    count = cmd->payload[0] < max ? cmd->payload[0] : max;
+    for (i = 0; i < count; i++, p += CAR_STATS_WIRE_LEN)
+    {
+        sum[i].count = get_le32(p);
+        sum[i].p50_us = get_le32(p + 4);
+        sum[i].p90_us = get_le32(p + 8);
+        sum[i].p99_us = get_le32(p + 12);
+        sum[i].max_us = get_le32(p + 16);
+    }
+    return count;
+}
+
+/* Legacy JSON keys. */
+enum
+{
+    JSON_KEY_NONE,
+    JSON_KEY_CMD,
+    JSON_KEY_MODE,
+    JSON_KEY_SPEED,
+    JSON_KEY_LINEAR,
+    JSON_KEY_TURN,
+    JSON_KEY_STOP,
+};
+
+#define JSON_NO_MATCH 0xFF
+
+/*
+ * Keys and values are few and have distinct lengths, so they are matched by
+ * switching on the length and comparing against the single candidate of
+ * that length (two or three for "left"/"stop", "drive"/"stats"/"right",
+ * "mode"/"turn"/"stop" and "brake"/"coast", told apart by the first byte).
+ */
+static int json_match_key(const char *s, int len)
+{
+    switch (len)
+    {
+    case 3:
+        return memcmp(s, "cmd", 3) == 0 ? JSON_KEY_CMD : JSON_KEY_NONE;
+    case 4:
+        if (s[0] == 't')
+        {
+            return memcmp(s, "turn", 4) == 0 ? JSON_KEY_TURN : JSON_KEY_NONE;
+        }
+        if (s[0] == 's')
+        {
+            return memcmp(s, "stop", 4) == 0 ? JSON_KEY_STOP : JSON_KEY_NONE;
+        }
+        return memcmp(s, "mode", 4) == 0 ? JSON_KEY_MODE : JSON_KEY_NONE;
+    case 5:
+        return memcmp(s, "speed", 5) == 0 ? JSON_KEY_SPEED : JSON_KEY_NONE;
+    case 6:
+        return memcmp(s, "linear", 6) == 0 ? JSON_KEY_LINEAR : JSON_KEY_NONE;
+    default:
+        return JSON_KEY_NONE;
+    }
+}
+
+static unsigned int json_match_cmd(const char *s, int len)
+{
+    switch (len)
+    {
+    case 4:
+        if (s[0] == 'l')
+        {
+            return memcmp(s, "left", 4) == 0 ? CAR_OP_LEFT : JSON_NO_MATCH;
+        }
+        return memcmp(s, "stop", 4) == 0 ? CAR_OP_STOP : JSON_NO_MATCH;
+    case 5:
+        if (s[0] == 'd')
+        {
+            return memcmp(s, "drive", 5) == 0 ? CAR_OP_DRIVE : JSON_NO_MATCH;
+        }
+        if (s[0] == 's')
+        {
+            return memcmp(s, "stats", 5) == 0 ? CAR_OP_STATS : JSON_NO_MATCH;
+        }
+        return memcmp(s, "right", 5) == 0 ? CAR_OP_RIGHT : JSON_NO_MATCH;
+    case 7:
+        return memcmp(s, "forward", 7) == 0 ? CAR_OP_FORWARD : JSON_NO_MATCH;
+    case 8:
+        return memcmp(s, "backward", 8) == 0 ? CAR_OP_BACKWARD : JSON_NO_MATCH;
+    default:
+        return JSON_NO_MATCH;
+    }
+}
+
+static unsigned int json_match_mode(const char *s, int len)
+{
+    switch (len)
+    {
+    case 4:
+        return memcmp(s, "step", 4) == 0 ? CAR_MODE_STEP : JSON_NO_MATCH;
+    case 5:
+        return memcmp(s, "alway", 5) == 0 ? CAR_MODE_ALWAY : JSON_NO_MATCH;
+    default:
+        return JSON_NO_MATCH;
+    }
+}
+
+static unsigned int json_match_speed(const char *s, int len)
+{
+    switch (len)
+    {
+    case 3:
+        return memcmp(s, "low", 3) == 0 ? CAR_SPEED_LOW : JSON_NO_MATCH;
+    case 4:
+        return memcmp(s, "high", 4) == 0 ? CAR_SPEED_HIGH : JSON_NO_MATCH;
+    case 6:
+        return memcmp(s, "medium", 6) == 0 ? CAR_SPEED_MEDIUM : JSON_NO_MATCH;
+    default:
+        return JSON_NO_MATCH;
+    }
+}
+
+static unsigned int json_match_stop(const char *s, int len)
+{
+    switch (len)
+    {
+    case 4:
+        return memcmp(s, "ramp", 4) == 0 ? CAR_STOP_RAMP : JSON_NO_MATCH;
+    case 5:
+        if (s[0] == 'b')
+        {
+            return memcmp(s, "brake", 5) == 0 ? CAR_STOP_BRAKE : JSON_NO_MATCH;
+        }
+        return memcmp(s, "coast", 5) == 0 ? CAR_STOP_COAST : JSON_NO_MATCH;
+    default:
+        return JSON_NO_MATCH;
+    }
+}
+
+static int json_skip_ws(const char *p, int pos, int len)
+{
+    while (pos < len && (p[pos] == ' ' || p[pos] == '\t' || p[pos] == '\r' || p[pos] == '\n'))
+    {
+        pos++;
+    }
+    return pos;
+}
+
+/*
+ * Scans a string starting at the opening quote. On success start and slen
+ * give the raw contents; a string with escapes can never equal one of our
+ * keywords, so its length is reported as 0 and it is only skipped.
+ * Returns the position after the closing quote, or -1.
+ */
+static int json_scan_string(const char *p, int pos, int len, int *start, int *slen)
+{
+    int escaped = 0;
+
+    *start = ++pos;
+    while (pos < len && p[pos] != '"')
+    {
+        if (p[pos] == '\\')
+        {
+            escaped = 1;
+            pos++;
+        }
+        pos++;
+    }
+    if (pos >= len)
+    {
+        return -1;
+    }
+    *slen = escaped ? 0 : pos - *start;
+    return pos + 1;
+}
+
+/*
+ * Reads an integer such as -350. Fractions and exponents are not used by
+ * the controllers and make the value invalid. Returns the position after
+ * the number, or -1.
+ */
+static int json_scan_int(const char *p, int pos, int len, int *value)
+{
+    int negative = 0;
+    int digits = 0;
+    int v = 0;
+
+    if (pos < len && p[pos] == '-')
+    {
+        negative = 1;
+        pos++;
+    }
+    while (pos < len && p[pos] >= '0' && p[pos] <= '9')
+    {
+        if (v < 100000)
+        {
+            v = v * 10 + (p[pos] - '0');
+        }
+        digits++;
+        pos++;
+    }
+    if (digits == 0 || (pos < len && (p[pos] == '.' || p[pos] == 'e' || p[pos] == 'E')))
+    {
+        return -1;
+    }
+    *value = negative ? -v : v;
+    return pos;
+}
+
+/*
+ * Skips any value we do not interpret: numbers, literals, and nested
+ * objects or arrays (tracked with a depth counter, not recursion).
+ */
+static int json_skip_value(const char *p, int pos, int len)
+{
+    int depth = 0;
+    int start;
+    int slen;
+
+    while (pos < len)
+    {
+        char c = p[pos];
+        if (c == '"')
+        {
+            pos = json_scan_string(p, pos, len, &start, &slen);
+            if (pos < 0)
+            {
+                return -1;
+            }
+            if (depth == 0)
+            {
+                return pos;
+            }
+            continue;
+        }
+        if (c == '{' || c == '[')
+        {
+            depth++;
+        }
+        else if (c == '}' || c == ']')
+        {
+            if (depth == 0)
+            {
+                return pos;
+            }
+            if (--depth == 0)
+            {
+                return pos + 1;
+            }
+        }
+        else if (depth == 0 && (c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n'))
+        {
+            return pos;
+        }
+        pos++;
+    }
+    return depth == 0 ? pos : -1;
+}
+
+/**
+ * @brief Parses a legacy JSON command such as
+ * {"cmd":"forward","mode":"step","speed":"high"} or the joystick command
+ * {"cmd":"drive","linear":600,"turn":-200} into a car_cmd. A "stop" member
+ * ("ramp", "brake" or "coast") selects the stop variant.
+ *
+ * Single pass over the datagram with a fixed amount of stack and no heap:
+ * only the top-level "cmd", "mode", "speed" and "stop" string members are
+ * looked at, plus the integer "linear" and "turn" members; everything else is
+ * skipped. Unknown cmd values become CAR_OP_NOP and
+ * unknown modes are kept, as before. A missing or unknown speed selects
+ * medium, which is what the existing controllers rely on.
+ *
+ * @param text Datagram payload, need not be NUL terminated.
+ * @param len  Payload length.
+ * @return CAR_PROTO_OK, or CAR_PROTO_ERR_PARSE if text is not a JSON object.
+ */
+int car_proto_parse_json(const char *text, int len, struct car_cmd *cmd)
+{
+    int pos;
+    int start;
+    int slen;
+
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->op = CAR_OP_NOP;
+    cmd->mode = CAR_PROTO_KEEP;
+    cmd->speed = CAR_SPEED_MEDIUM;
+
+    pos = json_skip_ws(text, 0, len);
+    if (pos >= len || text[pos] != '{')
+    {
+        return CAR_PROTO_ERR_PARSE;
+    }
+    pos = json_skip_ws(text, pos + 1, len);
+    if (pos < len && text[pos] == '}')
+    {
+        return CAR_PROTO_OK;
+    }
+
+    while (pos < len)
+    {
+        int key;
+        unsigned int value;
+
+        if (text[pos] != '"')
+        {
+            return CAR_PROTO_ERR_PARSE;
+        }
+        pos = json_scan_string(text, pos, len, &start, &slen);
+        if (pos < 0)
+        {
+            return CAR_PROTO_ERR_PARSE;
+        }
+        key = json_match_key(text + start, slen);
+
+        pos = json_skip_ws(text, pos, len);
+        if (pos >= len || text[pos] != ':')
+        {
+            return CAR_PROTO_ERR_PARSE;
+        }
+        pos = json_skip_ws(text, pos + 1, len);
+        if (pos >= len)
+        {
+            return CAR_PROTO_ERR_PARSE;
+        }
+
+        if (key == JSON_KEY_LINEAR || key == JSON_KEY_TURN)
+        {
+            int number;
+
+            pos = json_scan_int(text, pos, len, &number);
+            if (pos < 0)
+            {
+                return CAR_PROTO_ERR_PARSE;
+            }
+            if (number > CAR_DRIVE_SCALE)
+            {
+                number = CAR_DRIVE_SCALE;
+            }
+            else if (number < -CAR_DRIVE_SCALE)
+            {
+                number = -CAR_DRIVE_SCALE;
+            }
+            if (key == JSON_KEY_LINEAR)
+            {
+                cmd->linear = (short)number;
+            }
+            else
+            {
+                cmd->turn = (short)number;
+            }
+        }
+        else if (key != JSON_KEY_NONE && text[pos] == '"')
+        {
+            pos = json_scan_string(text, pos, len, &start, &slen);
+            if (pos < 0)
+            {
+                return CAR_PROTO_ERR_PARSE;
+            }
+            switch (key)
+            {
+            case JSON_KEY_CMD:
+                value = json_match_cmd(text + start, slen);
+                if (value != JSON_NO_MATCH)
+                {
+                    cmd->op = (unsigned char)value;
+                }
+                else
+                {
+                    CAR_TRACE_INFO(CAR_TRACE_RING_RECV, CAR_EV_JSON_UNKNOWN, key, slen, 0);
+                }
+                break;
+            case JSON_KEY_STOP:
+                value = json_match_stop(text + start, slen);
+                if (value != JSON_NO_MATCH)
+                {
+                    cmd->stop = (unsigned char)value;
+                }
+                else
+                {
+                    CAR_TRACE_INFO(CAR_TRACE_RING_RECV, CAR_EV_JSON_UNKNOWN, key, slen, 0);
+                }
+                break;
+            case JSON_KEY_MODE:
+                value = json_match_mode(text + start, slen);
+                if (value != JSON_NO_MATCH)
+                {
+                    cmd->mode = (unsigned char)value;
+                }
+                else
+                {
+                    CAR_TRACE_INFO(CAR_TRACE_RING_RECV, CAR_EV_JSON_UNKNOWN, key, slen, 0);
+                }
+                break;
+            default:
+                value = json_match_speed(text + start, slen);
+                cmd->speed = (unsigned short)(value != JSON_NO_MATCH ? value : CAR_SPEED_MEDIUM);
+                break;
+            }
+        }
+        else
+        {
+            pos = json_skip_value(text, pos, len);
+            if (pos < 0)
+            {
+                return CAR_PROTO_ERR_PARSE;
+            }
+        }
+
+        pos = json_skip_ws(text, pos, len);
+        if (pos >= len)
+        {
+            return CAR_PROTO_ERR_PARSE;
+        }
+        if (text[pos] == '}')
+        {
+            return CAR_PROTO_OK;
+        }
+        if (text[pos] != ',')
+        {
+            return CAR_PROTO_ERR_PARSE;
+        }
+        pos = json_skip_ws(text, pos + 1, len);
+    }
+    return CAR_PROTO_ERR_PARSE;
+}
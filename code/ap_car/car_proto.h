@@ -0,0 +1,236 @@
+#ifndef __CAR_PROTO_H__
+#define __CAR_PROTO_H__
+
+/*
+ * Binary control frame, little endian:
+ *
+ *   0      magic    CAR_PROTO_MAGIC; JSON datagrams start with '{' or blanks
+ *   1      version  CAR_PROTO_VERSION
+ *   2..3   seq      sender sequence number
+ *   4      opcode   CAR_OP_*
+ *   5      mode     CarMode, or CAR_PROTO_KEEP to leave it unchanged
+ *   6..7   speed    raw PWM duty, 0 leaves it unchanged
+ *   8      len      payload length
+ *   9..    payload  len bytes
+ *   last 2 crc      CRC-16/CCITT-FALSE over magic..end of payload
+ */
+#define CAR_PROTO_MAGIC 0xA5
+#define CAR_PROTO_VERSION 1
+#define CAR_PROTO_HDR_LEN 9
+#define CAR_PROTO_CRC_LEN 2
+#define CAR_PROTO_MIN_LEN (CAR_PROTO_HDR_LEN + CAR_PROTO_CRC_LEN)
+#define CAR_PROTO_MAX_PAYLOAD 255
+
+#define CAR_PROTO_KEEP 0xFF
+
+#define CAR_PROTO_DRIVE_LEN 4
+
+/*
+ * Stop variants. CAR_OP_STOP..CAR_OP_RIGHT may carry a one byte payload
+ * with one of these: with CAR_OP_STOP it picks how to stop now, with a
+ * motion opcode how a step-mode run (and a segment queue) ends from then on.
+ * RAMP ramps the duty down as before, BRAKE and COAST stop the outputs
+ * right away. The board's L9110S has no separate brake and coast states,
+ * so the two differ only in the status the car reports.
+ */
+typedef enum
+{
+    CAR_STOP_NONE = 0,
+    CAR_STOP_RAMP = 1,
+    CAR_STOP_BRAKE = 2,
+    CAR_STOP_COAST = 3,
+    CAR_STOP_MAX
+} CarStopVariant;
+
+/* Motion opcodes share their values with CarStatus. */
+typedef enum
+{
+    CAR_OP_STOP = 0,
+    CAR_OP_FORWARD = 1,
+    CAR_OP_BACKWARD = 2,
+    CAR_OP_LEFT = 3,
+    CAR_OP_RIGHT = 4,
+
+    /* Only update mode/speed, keep the current motion. */
+    CAR_OP_NOP = 0x20,
+
+    /* Queue timed motion segments, see below. */
+    CAR_OP_SEGMENTS = 0x21,
+
+    /* Differential drive, payload: linear (le16, signed), turn (le16, signed). */
+    CAR_OP_DRIVE = 0x22,
+
+    /* Command-path latency statistics, see below. The reply uses it too. */
+    CAR_OP_STATS = 0x23,
+
+    /* Car -> controller: state telemetry, see below. */
+    CAR_OP_STATE = 0x40,
+} CarOpcode;
+
+/*
+ * Reliable delivery. A command opcode with CAR_OP_F_RELIABLE set asks for
+ * an acknowledgement, and its seq is a session sequence number: the
+ * controller numbers a session's commands from 0 (skipping 0 when seq
+ * wraps) and retransmits a command with its original seq. The car applies
+ * a command only if its seq is newer than any seen in the session;
+ * duplicates and commands overtaken by a newer one are acknowledged but
+ * not applied, so a retransmission is never applied twice. Each controller
+ * address and port is a session of its own (car_session.h).
+ *
+ * Acks ride on the telemetry stream (CAR_STATE_F_ACK). A command whose seq
+ * is neither acked nor older than the ack window has to be retransmitted:
+ * stops every CAR_REL_RETRY_STOP_MS, other commands every CAR_REL_RETRY_MS,
+ * until a newer command supersedes them.
+ */
+#define CAR_OP_F_RELIABLE 0x80
+#define CAR_REL_WINDOW 32
+#define CAR_REL_RETRY_MS 100
+#define CAR_REL_RETRY_STOP_MS 20
+
+/*
+ * CAR_OP_SEGMENTS payload: a CAR_SEG_F_* flags byte, then one record per
+ * segment: op (CarStatus), speed (le16, 0 keeps the current speed) and
+ * duration in ms (le16). The batch replaces whatever is queued or running
+ * unless CAR_SEG_F_APPEND is set. The frame's mode and speed are ignored.
+ * CAR_STATUS_DRIVE (no linear/turn in a segment), an unknown op or a speed
+ * above CAR_DUTY_MAX rejects the whole batch.
+ */
+#define CAR_SEG_F_APPEND 0x01
+#define CAR_SEG_WIRE_LEN 5
+
+/*
+ * CAR_OP_STATS asks for the command-path latency histograms (car_latency.h).
+ * An optional payload byte holds CAR_STATS_F_* flags; mode and speed are
+ * ignored. The car answers the sender's address and port with a CAR_OP_STATS
+ * frame echoing seq: a stage count byte, then per stage the number of
+ * samples, p50, p90, p99 and max in microseconds (le32 each), in
+ * CarLatStage order. A legacy {"cmd":"stats"} datagram gets the same numbers
+ * as a JSON object.
+ */
+#define CAR_STATS_F_RESET 0x01 /* clear the histograms after replying */
+#define CAR_STATS_WIRE_LEN 20
+#define CAR_STATS_MAX_LEN (CAR_PROTO_MIN_LEN + 1 + 8 * CAR_STATS_WIRE_LEN)
+
+/*
+ * Telemetry frames use the same layout with opcode CAR_OP_STATE and seq
+ * counting telemetry frames, so a gap means a frame was lost. Like in a
+ * command, mode is CAR_PROTO_KEEP and speed is 0 when they did not change
+ * since the previous frame. The payload starts with a CAR_STATE_F_* mask
+ * followed by the flagged fields: cur_status (1 byte), go_status (1 byte),
+ * linear and turn (le16 each, signed), then the measured left and right
+ * wheel speeds in encoder ticks per second (le16 each, signed).
+ * A frame with CAR_STATE_F_FULL carries every field and resynchronises a
+ * controller that missed a delta.
+ *
+ * CAR_STATE_F_ACK appends the reliable session's ack: the newest seq seen
+ * (le16) and a bitmap (le32) whose bit i is set when seq - i was seen,
+ * i < CAR_REL_WINDOW. A frame is sent for every ack change, even when the
+ * state did not change, and a full frame repeats the current ack.
+ *
+ * CAR_STATE_F_LINK, in full frames only, appends the car's view of the
+ * control link (car_link.h): the inter-arrival jitter in us (le16, saturated),
+ * the estimated loss in permille (le16), then CAR_STATE_LINK_GAPS bytes
+ * giving the share of recent inter-arrival gaps, in percent, that fell into
+ * each bucket of CAR_LINK_GAP_BOUNDS.
+ */
+#define CAR_STATE_F_STATUS 0x01
+#define CAR_STATE_F_GO 0x02
+#define CAR_STATE_F_DRIVE 0x04
+#define CAR_STATE_F_WHEELS 0x08
+#define CAR_STATE_F_ACK 0x10
+#define CAR_STATE_F_LINK 0x20
+#define CAR_STATE_F_FULL 0x80
+#define CAR_STATE_ACK_LEN 6
+#define CAR_STATE_LINK_GAPS 6
+#define CAR_STATE_LINK_LEN (4 + CAR_STATE_LINK_GAPS)
+#define CAR_STATE_MAX_LEN (CAR_PROTO_MIN_LEN + 11 + CAR_STATE_ACK_LEN + CAR_STATE_LINK_LEN)
+
+typedef enum
+{
+    CAR_PROTO_OK = 0,
+    CAR_PROTO_ERR_SHORT = -1,
+    CAR_PROTO_ERR_MAGIC = -2,
+    CAR_PROTO_ERR_VERSION = -3,
+    CAR_PROTO_ERR_LEN = -4,
+    CAR_PROTO_ERR_CRC = -5,
+    CAR_PROTO_ERR_PARSE = -6,
+    CAR_PROTO_ERR_RANGE = -7,
+} CarProtoError;
+
+/* The command arrived as a binary frame. */
+#define CAR_CMD_F_BINARY 0x01
+/* The opcode carried CAR_OP_F_RELIABLE; op itself has the bit cleared. */
+#define CAR_CMD_F_RELIABLE 0x02
+
+/* A decoded command. payload points into the receive buffer, nothing is copied. */
+struct car_cmd
+{
+    unsigned short seq;
+    unsigned char op;
+    unsigned char mode;
+    unsigned short speed;
+    unsigned char flags;
+    unsigned char payload_len;
+    const unsigned char *payload;
+    short linear; /* CAR_OP_DRIVE only */
+    short turn;
+    unsigned char stop; /* CarStopVariant */
+};
+
+/* A reliable session's ack, see CAR_STATE_F_ACK. */
+struct car_ack
+{
+    unsigned short seq;
+    unsigned short valid; /* 0: no reliable command seen yet */
+    unsigned int mask;
+};
+
+/* Link metrics as carried by CAR_STATE_F_LINK. */
+struct car_link_report
+{
+    unsigned short jitter_us;
+    unsigned short loss_permille;
+    unsigned char gap_pct[CAR_STATE_LINK_GAPS];
+};
+
+unsigned short car_proto_crc16(const unsigned char *data, int len);
+
+int car_proto_decode(const unsigned char *buf, int len, struct car_cmd *cmd);
+int car_proto_encode(unsigned char *buf, int size, const struct car_cmd *cmd);
+
+int car_proto_parse_json(const char *text, int len, struct car_cmd *cmd);
+
+/*
+ * A telemetry frame shared by every session that is sent the same state
+ * fields. car_proto_state_prepare() encodes the header and the state fields
+ * once; car_proto_state_finish() then fills in one session's seq and ack,
+ * the link metrics, the length and the CRC in place, so buf holds that
+ * session's frame until the next call.
+ */
+struct car_state_frame
+{
+    unsigned char buf[CAR_STATE_MAX_LEN];
+    unsigned char flags;     /* CAR_STATE_F_* of the state fields */
+    unsigned char state_len; /* header and state fields, in bytes */
+    unsigned char has_link;
+    struct car_link_report link;
+};
+
+struct car_state;
+struct car_segment;
+int car_proto_get_segments(const struct car_cmd *cmd, struct car_segment *seg, int max, int *append);
+int car_proto_state_prepare(struct car_state_frame *frame, const struct car_state *state,
+                            const struct car_state *prev, const struct car_link_report *link);
+int car_proto_state_finish(struct car_state_frame *frame, unsigned short seq, const struct car_ack *ack);
+int car_proto_encode_state(unsigned char *buf, int size, unsigned short seq, const struct car_state *state,
+                           const struct car_state *prev, const struct car_ack *ack,
+                           const struct car_link_report *link);
+int car_proto_get_ack(const struct car_cmd *cmd, struct car_ack *ack);
+int car_proto_get_link(const struct car_cmd *cmd, struct car_link_report *link);
+
+struct car_lat_summary;
+int car_proto_encode_stats(unsigned char *buf, int size, unsigned short seq, const struct car_lat_summary *sum,
+                           int count);
+int car_proto_get_stats(const struct car_cmd *cmd, struct car_lat_summary *sum, int max);
+
+#endif /* __CAR_PROTO_H__ */
@@ -0,0 +1,59 @@
+#include "car_reliable.h"
+
+static struct car_rel_stats car_rel_stats;
+
+// UDP 网络任务：按会话窗口判断带 CAR_OP_F_RELIABLE 的指令是否执行，并更新确认
+CarRelResult car_rel_check(struct car_rel_window *w, unsigned short seq)
+{
+    short delta = (short)(seq - w->seq);
+    CarRelResult result;
+
+    if (!w->active || (seq == 0 && (delta <= -CAR_REL_WINDOW || delta > 0)))
+    {
+        // 新窗口
+        w->active = 1;
+        w->seq = seq;
+        w->mask = 1;
+        car_rel_stats.sessions++;
+        result = CAR_REL_APPLY;
+    }
+    else if (delta > 0)
+    {
+        w->mask = delta < CAR_REL_WINDOW ? (w->mask << delta) | 1 : 1;
+        w->seq = seq;
+        result = CAR_REL_APPLY;
+    }
+    else if (delta <= -CAR_REL_WINDOW)
+    {
+        car_rel_stats.result[CAR_REL_TOO_OLD]++;
+        return CAR_REL_TOO_OLD;
+    }
+    else if (w->mask & (1U << -delta))
+    {
+        result = CAR_REL_DUPLICATE;
+    }
+    else
+    {
+        w->mask |= 1U << -delta;
+        result = CAR_REL_STALE;
+    }
+
+    car_rel_stats.result[result]++;
+    // 重复的指令也要再确认一次：多半是控制端没有收到上一次的确认
+    w->changed = 1;
+    return result;
+}
+
+// 遥测：会话窗口的确认，还没有收到可靠指令时 valid 为 0
+void car_rel_get_ack(const struct car_rel_window *w, struct car_ack *ack)
+{
+    ack->seq = w->seq;
+    ack->mask = w->mask;
+    ack->valid = w->active;
+}
+
+// 其他线程读取计数，各项之间不保证是同一时刻的值
+void car_rel_get_stats(struct car_rel_stats *stats)
+{
+    *stats = car_rel_stats;
+}
@@ -0,0 +1,49 @@
+#ifndef __CAR_RELIABLE_H__
+#define __CAR_RELIABLE_H__
+
+#include "car_proto.h"
+
+/*
+ * 可靠指令的会话窗口（协议见 car_proto.h 的 CAR_OP_F_RELIABLE）。
+ *
+ * 每个控制端会话（car_session.h，以发送方的 IP 和端口区分）有自己的窗口，
+ * 一个发送方的指令不会动别的发送方的窗口。会话的第一条可靠指令，或者收到序号
+ * 0 的指令，窗口从头开始；会话被清除或替换后窗口也随之清除。窗口记录会话里
+ * 最新的序号和它之前 CAR_REL_WINDOW - 1 个序号是否收到过：
+ *   - 比最新序号新的指令执行；
+ *   - 收到过的是重复（重发或网络复制），不再执行；
+ *   - 没收到过但比最新序号旧的，已被后发的指令取代，不执行，只记为收到；
+ *   - 比窗口还旧的直接丢弃。
+ * 序号 0 在窗口内时按重复处理，所以晚到的会话第一帧不会把窗口清空。
+ *
+ * 窗口和确认都只由 UDP 网络任务读写。
+ */
+
+typedef enum
+{
+    CAR_REL_APPLY = 0, // 新指令，执行
+    CAR_REL_DUPLICATE, // 收到过
+    CAR_REL_STALE,     // 被更新的指令取代
+    CAR_REL_TOO_OLD,   // 在窗口之外
+    CAR_REL_MAX
+} CarRelResult;
+
+struct car_rel_stats
+{
+    unsigned int sessions;
+    unsigned int result[CAR_REL_MAX];
+};
+
+struct car_rel_window
+{
+    unsigned short seq;    // 最新的序号
+    unsigned char active;
+    unsigned char changed; // 确认还没有发给会话
+    unsigned int mask;     // 第 i 位：seq - i 收到过
+};
+
+CarRelResult car_rel_check(struct car_rel_window *w, unsigned short seq);
+void car_rel_get_ack(const struct car_rel_window *w, struct car_ack *ack);
+void car_rel_get_stats(struct car_rel_stats *stats);
+
+#endif /* __CAR_RELIABLE_H__ */
@@ -0,0 +1,87 @@
+#ifndef __CAR_SEQLOCK_H__
+#define __CAR_SEQLOCK_H__
+
+/*
+ * 单写者顺序锁（seqlock）。
+ *
+ * 写者把序号加一（奇数表示正在写），写入数据，再加一；读者在前后两次读到
+ * 相同的偶数序号时，拷贝出的数据就是完整的一份，否则重读或者放弃这次读取。
+ * 读者从不阻塞写者，写者也不等待读者。
+ *
+ * 只用到对齐字的读写和内存屏障：Hi3861 的 RV32IMC 内核没有原子读改写指令，
+ * 所以每把锁只能有一个写者线程。被保护的数据按 unsigned int 逐字拷贝，
+ * 结构体大小必须是 4 的整数倍。
+ */
+
+struct car_seqlock
+{
+    unsigned int seq;
+};
+
+static inline void car_seq_copy_out(void *dst, const void *src, unsigned int size)
+{
+    unsigned int *d = (unsigned int *)dst;
+    const unsigned int *s = (const unsigned int *)src;
+    unsigned int i;
+
+    for (i = 0; i < size / sizeof(unsigned int); i++)
+    {
+        d[i] = __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+    }
+}
+
+static inline void car_seq_copy_in(void *dst, const void *src, unsigned int size)
+{
+    unsigned int *d = (unsigned int *)dst;
+    const unsigned int *s = (const unsigned int *)src;
+    unsigned int i;
+
+    for (i = 0; i < size / sizeof(unsigned int); i++)
+    {
+        __atomic_store_n(&d[i], s[i], __ATOMIC_RELAXED);
+    }
+}
+
+// 写者：发布一份完整的数据
+static inline void car_seq_publish(struct car_seqlock *lock, void *shared, const void *data, unsigned int size)
+{
+    unsigned int seq = lock->seq;
+
+    __atomic_store_n(&lock->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    car_seq_copy_in(shared, data, size);
+    __atomic_store_n(&lock->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// 读者：读一次，拷贝出的数据完整时返回 1。写者正在写（序号为奇数）或读的过程中
+// 写者写过时返回 0，data 的内容不可用，也不重读
+static inline int car_seq_try_read(const struct car_seqlock *lock, const void *shared, void *data, unsigned int size)
+{
+    unsigned int begin = __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE);
+
+    if ((begin & 1U) != 0)
+    {
+        return 0;
+    }
+    car_seq_copy_out(data, shared, size);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&lock->seq, __ATOMIC_RELAXED) == begin;
+}
+
+// 读者：重读直到拷贝出一份一致的数据，返回重读次数。
+// 只能在优先级不高于写者的线程中使用（或者写者是中断）：LiteOS 按优先级抢占，
+// 读者优先级更高时，写了一半被抢占的写者不会再运行，读者会一直重读下去。
+// 优先级更高的读者用 car_seq_try_read()，读不到时留到下次唤醒
+static inline unsigned int car_seq_read(const struct car_seqlock *lock, const void *shared, void *data,
+                                        unsigned int size)
+{
+    unsigned int retries = 0;
+
+    while (!car_seq_try_read(lock, shared, data, size))
+    {
+        retries++;
+    }
+    return retries;
+}
+
+#endif /* __CAR_SEQLOCK_H__ */
@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include "car_session.h"
+#include "car_trace.h"
+
+static struct car_session car_sessions[CAR_SESSION_MAX];
+static struct car_session_stats car_session_stats;
+
+// UDP 网络任务：from 发来一个数据报，返回它的会话，没有时建立。
+// 新会话和换了格式的会话下一次收到完整的状态
+struct car_session *car_session_touch(const struct sockaddr_in *from, int binary, unsigned int now_us)
+{
+    struct car_session *victim = NULL;
+    struct car_session *s;
+    unsigned int i;
+
+    for (i = 0; i < CAR_SESSION_MAX; i++)
+    {
+        s = &car_sessions[i];
+        if (s->used && s->addr == from->sin_addr.s_addr && s->port == from->sin_port)
+        {
+            if (s->binary != (binary != 0))
+            {
+                s->binary = binary != 0;
+                s->synced = 0;
+            }
+            s->last_us = now_us;
+            return s;
+        }
+        // 空位优先，其次是最久没有数据报的观察者
+        if (victim != NULL && !victim->used)
+        {
+            continue;
+        }
+        if (!s->used || (s->role == CAR_ROLE_OBSERVER &&
+                         (victim == NULL || (int)(s->last_us - victim->last_us) < 0)))
+        {
+            victim = s;
+        }
+    }
+
+    if (victim->used)
+    {
+        car_session_stats.replaced++;
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->addr = from->sin_addr.s_addr;
+    victim->port = from->sin_port;
+    victim->used = 1;
+    victim->role = CAR_ROLE_OBSERVER;
+    victim->binary = binary != 0;
+    victim->last_us = now_us;
+    car_session_stats.opened++;
+    CAR_TRACE_INFO(CAR_TRACE_RING_RECV, CAR_EV_UDP_CLIENT, victim->addr, ntohs(victim->port), victim->binary);
+    return victim;
+}
+
+// 会话发出了驾驶指令：成为驾驶者，原来的驾驶者变成观察者。驾驶者换了时返回 1
+int car_session_drive(struct car_session *s)
+{
+    struct car_session *prev = car_session_driver();
+
+    if (prev == s)
+    {
+        return 0;
+    }
+    if (prev != NULL)
+    {
+        prev->role = CAR_ROLE_OBSERVER;
+    }
+    s->role = CAR_ROLE_DRIVER;
+    car_session_stats.drivers++;
+    CAR_TRACE_INFO(CAR_TRACE_RING_RECV, CAR_EV_UDP_DRIVER, s->addr, ntohs(s->port), 0);
+    return 1;
+}
+
+struct car_session *car_session_driver(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < CAR_SESSION_MAX; i++)
+    {
+        if (car_sessions[i].used && car_sessions[i].role == CAR_ROLE_DRIVER)
+        {
+            return &car_sessions[i];
+        }
+    }
+    return NULL;
+}
+
+// 第 i 项，没有使用时返回 NULL
+struct car_session *car_session_get(unsigned int i)
+{
+    return i < CAR_SESSION_MAX && car_sessions[i].used ? &car_sessions[i] : NULL;
+}
+
+unsigned int car_session_count(void)
+{
+    unsigned int count = 0;
+    unsigned int i;
+
+    for (i = 0; i < CAR_SESSION_MAX; i++)
+    {
+        count += car_sessions[i].used;
+    }
+    return count;
+}
+
+// 清除空闲的会话，返回清除的个数
+unsigned int car_session_expire(unsigned int now_us)
+{
+    unsigned int expired = 0;
+    unsigned int i;
+
+    for (i = 0; i < CAR_SESSION_MAX; i++)
+    {
+        struct car_session *s = &car_sessions[i];
+
+        if (s->used && now_us - s->last_us >= CAR_SESSION_IDLE_MS * 1000U)
+        {
+            CAR_TRACE_INFO(CAR_TRACE_RING_RECV, CAR_EV_UDP_CLIENT_IDLE, s->addr, ntohs(s->port), s->role);
+            s->used = 0;
+            expired++;
+        }
+    }
+    car_session_stats.expired += expired;
+    return expired;
+}
+
+// 会话的源地址，遥测和应答发往这里
+void car_session_addr(const struct car_session *s, struct sockaddr_in *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = s->addr;
+    addr->sin_port = s->port;
+}
+
+// 其他线程读取计数，各项之间不保证是同一时刻的值
+void car_session_get_stats(struct car_session_stats *stats)
+{
+    *stats = car_session_stats;
+}
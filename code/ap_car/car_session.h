@@ -0,0 +1,74 @@
+#ifndef __CAR_SESSION_H__
+#define __CAR_SESSION_H__
+
+#include "lwip/sockets.h"
+
+#include "car_reliable.h"
+
+/*
+ * 控制端会话表。
+ *
+ * 向指令端口发送过指令或心跳（CAR_OP_NOP）的每个 IP:端口 占一项，记录最近
+ * 一次收到数据报的时间、角色和遥测订阅。二进制遥测和应答都发往会话的源地址
+ * 和源端口，所以控制端在发指令的套接字上接收；旧的 JSON 控制端一直在状态
+ * 端口（50002）上接收，JSON 状态发往它的地址的这个端口，同一地址只发一份。
+ * 统计查询不建立会话。
+ *
+ * 角色：发出运动、停车、模式或车速等指令的会话成为驾驶者，原来的驾驶者变成
+ * 观察者；只发心跳的会话是观察者。同一时刻最多一个驾驶者。
+ *
+ * 订阅：每个会话按它最近一次发来的格式接收遥测，二进制帧的会话收增量状态帧
+ * （CAR_OP_STATE），帧序号按会话计数；JSON 会话收 JSON 状态字符串，同一个
+ * 字符串只格式化一次，发给所有 JSON 会话。
+ *
+ * 可靠指令：每个会话有自己的确认窗口（car_reliable.h），确认只发给这个会话。
+ *
+ * 超过 CAR_SESSION_IDLE_MS 没有数据报的会话被清除；表满时替换最久没有数据报
+ * 的观察者。表里最多一个驾驶者，所以总有观察者可以替换。
+ *
+ * 会话表只由 UDP 网络任务读写。
+ */
+
+#define CAR_SESSION_MAX 4
+
+// 观察者至少这么久发一次心跳。旧的 JSON 控制端只在有操作时发数据报，闲置
+// 更久时会话被清除，下一个数据报重新建立并收到完整状态
+#define CAR_SESSION_IDLE_MS 30000
+
+typedef enum
+{
+    CAR_ROLE_OBSERVER = 0,
+    CAR_ROLE_DRIVER,
+} CarRole;
+
+struct car_session
+{
+    unsigned int addr;    // 网络字节序
+    unsigned short port;  // 网络字节序
+    unsigned char used;
+    unsigned char role;   // CarRole
+    unsigned char binary; // 遥测格式
+    unsigned char synced; // 收到过完整的状态，之后可以只发增量
+    unsigned short tx_seq; // 下一个遥测帧的序号
+    unsigned int last_us; // 最近一个数据报的到达时间
+    struct car_rel_window rel;
+};
+
+struct car_session_stats
+{
+    unsigned int opened;   // 建立的会话
+    unsigned int expired;  // 空闲超时清除的
+    unsigned int replaced; // 表满时被新会话替换的
+    unsigned int drivers;  // 换过的驾驶者
+};
+
+struct car_session *car_session_touch(const struct sockaddr_in *from, int binary, unsigned int now_us);
+int car_session_drive(struct car_session *s);
+struct car_session *car_session_driver(void);
+struct car_session *car_session_get(unsigned int i);
+unsigned int car_session_count(void);
+unsigned int car_session_expire(unsigned int now_us);
+void car_session_addr(const struct car_session *s, struct sockaddr_in *addr);
+void car_session_get_stats(struct car_session_stats *stats);
+
+#endif /* __CAR_SESSION_H__ */
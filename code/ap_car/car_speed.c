@@ -0,0 +1,211 @@
+#include <stdio.h>
+
+#include "cmsis_os2.h"
+
+#include <hi_time.h>
+#include "car_test.h"
+#include "car_motor.h"
+#include "car_encoder.h"
+#include "car_speed.h"
+
+// 目标比例的定点位数
+#define CAR_SPEED_SCALE_SHIFT 10
+
+struct car_speed_wheel
+{
+    unsigned int ticks;   // 上一个周期读到的脉冲数
+    unsigned int edge_us; // 上一个周期读到的最后一个脉冲的时间
+    int moving;           // edge_us 之后的脉冲可以按间隔计算转速
+    int tps;              // 测得的转速（大小）
+    int dir;              // 最近一次输出的方向，停止输出后车轮还在转时沿用
+    int integ;            // 积分项（占空比）
+    int stall_ms;         // 有目标但没有脉冲的时间
+};
+
+static struct car_speed_wheel car_speed_wheels[CAR_WHEEL_MAX];
+static int car_speed_trims[CAR_WHEEL_MAX];
+static osTimerId_t car_speed_timer = NULL;
+static osEventFlagsId_t car_speed_event = NULL;
+static unsigned int car_speed_flag;
+
+// 控制定时器只唤醒控制任务，PWM 只在控制任务中写
+static void car_speed_timer_cb(void *arg)
+{
+    (void)arg;
+    osEventFlagsSet(car_speed_event, car_speed_flag);
+}
+
+void car_speed_init(osEventFlagsId_t event, unsigned int flag)
+{
+    car_speed_event = event;
+    car_speed_flag = flag;
+    car_speed_timer = osTimerNew(car_speed_timer_cb, osTimerPeriodic, NULL, NULL);
+    if (car_speed_timer == NULL)
+    {
+        printf("[car_speed] Failed to create control timer!\r\n");
+    }
+    car_encoder_init();
+}
+
+// 控制任务：车轮开始转动时启动控制周期，已在运行时不重新计时
+void car_speed_start(void)
+{
+    if (car_speed_timer != NULL && !osTimerIsRunning(car_speed_timer))
+    {
+        osTimerStart(car_speed_timer, CAR_MS_TO_TICKS(CAR_SPEED_CTRL_MS));
+    }
+}
+
+// 测量一个车轮的转速：有新脉冲时按脉冲间隔计算，没有时按距上一个脉冲的时间逐渐减小
+static void car_speed_measure(unsigned int wheel, unsigned int now_us)
+{
+    struct car_speed_wheel *s = &car_speed_wheels[wheel];
+    struct car_enc_count count;
+    unsigned int n;
+    unsigned int dt_us;
+
+    car_encoder_read(wheel, &count);
+    n = count.ticks - s->ticks;
+    if (n > 0)
+    {
+        dt_us = count.edge_us - s->edge_us;
+        if (s->moving && dt_us > 0)
+        {
+            s->tps = (int)((unsigned long long)n * 1000000U / dt_us);
+        }
+        else
+        {
+            // 从静止起步，上一个脉冲太早，按一个控制周期计算
+            s->tps = (int)(n * 1000U / CAR_SPEED_CTRL_MS);
+        }
+        s->ticks = count.ticks;
+        s->edge_us = count.edge_us;
+        s->moving = 1;
+        return;
+    }
+
+    dt_us = now_us - s->edge_us;
+    if (!s->moving || dt_us >= CAR_ENC_STOP_US)
+    {
+        s->tps = 0;
+        s->moving = 0;
+    }
+    else if ((unsigned long long)s->tps * dt_us > 1000000U)
+    {
+        s->tps = (int)(1000000U / dt_us);
+    }
+}
+
+static int car_speed_abs(int v)
+{
+    return v < 0 ? -v : v;
+}
+
+// 一个车轮的 PI 控制：ref 为目标转速的大小，duty 为斜坡占空比的大小，返回修正量
+static int car_speed_control(struct car_speed_wheel *s, int ref, int duty)
+{
+    int hi = CAR_DUTY_MAX - duty < CAR_SPEED_TRIM_MAX ? CAR_DUTY_MAX - duty : CAR_SPEED_TRIM_MAX;
+    int err = ref - s->tps;
+    int p = CAR_SPEED_KP * err;
+    int integ = s->integ + CAR_SPEED_KI * err * CAR_SPEED_CTRL_MS / 1000;
+    int trim;
+
+    if (s->tps == 0)
+    {
+        s->stall_ms += CAR_SPEED_CTRL_MS;
+        if (s->stall_ms >= CAR_SPEED_STALL_MS)
+        {
+            s->integ = 0;
+            return 0;
+        }
+    }
+    else
+    {
+        s->stall_ms = 0;
+    }
+
+    // 输出已到限幅且误差还在把它往外推时不再积分
+    if ((p + integ > hi && err > 0) || (p + integ < -CAR_SPEED_TRIM_MAX && err < 0))
+    {
+        integ = s->integ;
+    }
+    s->integ = integ;
+
+    trim = p + integ;
+    if (trim > hi)
+    {
+        trim = hi;
+    }
+    if (trim < -CAR_SPEED_TRIM_MAX)
+    {
+        trim = -CAR_SPEED_TRIM_MAX;
+    }
+    return trim;
+}
+
+// 控制任务：一个控制周期，返回是否还有车轮在转
+int car_speed_step(void)
+{
+    unsigned int now_us = hi_get_us();
+    int ref[CAR_WHEEL_MAX];
+    int duty[CAR_WHEEL_MAX];
+    int scale = 1 << CAR_SPEED_SCALE_SHIFT;
+    int active = 0;
+    unsigned int i;
+
+    for (i = 0; i < CAR_WHEEL_MAX; i++)
+    {
+        struct car_speed_wheel *s = &car_speed_wheels[i];
+
+        car_speed_measure(i, now_us);
+        duty[i] = car_motor_get(i);
+        if (duty[i] != 0)
+        {
+            s->dir = duty[i] < 0 ? -1 : 1;
+            duty[i] = car_speed_abs(duty[i]);
+        }
+        ref[i] = (int)((long long)duty[i] * CAR_ENC_TPS_MAX / CAR_DUTY_MAX);
+        active |= duty[i] != 0 || s->tps != 0;
+
+        // 输出已到最大仍追不上目标的车轮决定两个车轮共同的目标比例
+        if (ref[i] > 0 && s->tps < ref[i] && duty[i] + car_speed_trims[i] >= CAR_DUTY_MAX)
+        {
+            int r = (int)(((long long)s->tps << CAR_SPEED_SCALE_SHIFT) / ref[i]);
+            if (r < scale)
+            {
+                scale = r;
+            }
+        }
+    }
+
+    for (i = 0; i < CAR_WHEEL_MAX; i++)
+    {
+        struct car_speed_wheel *s = &car_speed_wheels[i];
+
+        if (duty[i] == 0 || !car_encoder_present())
+        {
+            s->integ = 0;
+            s->stall_ms = 0;
+            car_speed_trims[i] = 0;
+            continue;
+        }
+        car_speed_trims[i] = car_speed_control(s, (ref[i] * scale) >> CAR_SPEED_SCALE_SHIFT, duty[i]);
+    }
+    car_motor_trim(car_speed_trims);
+
+    if (!active && car_speed_timer != NULL && osTimerIsRunning(car_speed_timer))
+    {
+        osTimerStop(car_speed_timer);
+    }
+    return active;
+}
+
+// 测得的车轮转速，方向取最近一次输出的方向
+int car_speed_get(unsigned int wheel)
+{
+    if (wheel >= CAR_WHEEL_MAX)
+    {
+        return 0;
+    }
+    return car_speed_wheels[wheel].dir < 0 ? -car_speed_wheels[wheel].tps : car_speed_wheels[wheel].tps;
+}
@@ -0,0 +1,39 @@
+#ifndef __CAR_SPEED_H__
+#define __CAR_SPEED_H__
+
+#include "cmsis_os2.h"
+
+/*
+ * 车轮速度闭环。
+ *
+ * 控制任务按 CAR_SPEED_CTRL_MS 的固定周期，用码盘测出每个车轮的转速，和斜坡
+ * 占空比按 CAR_ENC_TPS_MAX 换算出的目标转速比较，PI 控制器算出的修正量加在
+ * 占空比上（car_motor_trim）。斜坡占空比相当于前馈，闭环只补偿电池电压和
+ * 负载造成的偏差。
+ *
+ * 一个车轮的输出已到最大仍达不到目标时，两个车轮的目标按同一比例降低，
+ * 转速比不变，直线行驶不会跑偏。没有装码盘（从未收到脉冲），或者有目标却
+ * 超过 CAR_SPEED_STALL_MS 没有脉冲时，修正量清零，退回开环。
+ *
+ * 转速单位为脉冲/秒，带符号，正数正转。
+ */
+
+// 控制周期，两个 100Hz 系统节拍
+#define CAR_SPEED_CTRL_MS 20
+
+// 比例增益为 占空比/(脉冲/秒)，积分增益为 占空比/(脉冲/秒)/秒
+#define CAR_SPEED_KP 160
+#define CAR_SPEED_KI 3000
+
+// 修正量的范围
+#define CAR_SPEED_TRIM_MAX (CAR_DUTY_MAX / 3)
+
+// 有目标但这么久没有脉冲时认为车轮堵转或码盘脱落
+#define CAR_SPEED_STALL_MS 300
+
+void car_speed_init(osEventFlagsId_t event, unsigned int flag);
+void car_speed_start(void);
+int car_speed_step(void);
+int car_speed_get(unsigned int wheel);
+
+#endif /* __CAR_SPEED_H__ */
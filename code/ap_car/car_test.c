@@ -15,47 +15,259 @@
 #include <hi_pwm.h>
 #include <hi_gpio.h>
 #include <hi_io.h>
+#include <hi_time.h>
 #include "car_test.h"
+#include "car_seqlock.h"
+#include "car_trace.h"
+#include "car_motor.h"
+#include "car_pin.h"
+#include "car_speed.h"
+#include "car_keys.h"
+#include "car_latency.h"
+#include "car_link.h"
+#include "car_boot.h"
 
 #include "iot_pwm.h"
 
-#define GPIO0 0
-#define GPIO1 1
-#define GPIO9 9
-#define GPIO10 10
-#define GPIOFUNC 0
-#define PWM_FREQ_FREQUENCY (60000)
-
+// 控制任务事件：收到指令 / 步进定时器到期
+#define CAR_EVT_CMD 0x00000001U
+#define CAR_EVT_STEP_EXPIRE 0x00000002U
+#define CAR_EVT_SEG 0x00000004U        // 运动段入队
+#define CAR_EVT_SEG_EXPIRE 0x00000008U // 当前运动段到期
+#define CAR_EVT_RAMP 0x00000010U       // 电机斜坡周期
+#define CAR_EVT_SPEED 0x00000020U      // 速度闭环周期
+#define CAR_EVT_LINK 0x00000040U       // 链路检查周期或 Wi-Fi 终端离开
+#define CAR_EVT_ALL                                                                                        \
+	(CAR_EVT_CMD | CAR_EVT_STEP_EXPIRE | CAR_EVT_SEG | CAR_EVT_SEG_EXPIRE | CAR_EVT_RAMP | CAR_EVT_SPEED | \
+	 CAR_EVT_LINK)
+
+// 控制任务优先级高于 UDP 网络任务（36）和按键任务：网络繁忙时本地急停仍能及时输出。
+// 因此它读各来源邮箱时用 car_seq_try_read()，不等被抢占的写者
+#define CAR_CTRL_PRIORITY osPriorityHigh
+// car_start() 新建的控制任务的栈：控制循环最深的是运动段取出时的段数组
+#define CAR_CTRL_STACK_SIZE 4096
+
+// 电机引脚经过状态缓存，只写有变化的复用功能、方向和电平
 void gpio_control(unsigned int gpio, IotGpioValue value)
 {
-	hi_io_set_func(gpio, GPIOFUNC);
-	IoTGpioSetDir(gpio, IOT_GPIO_DIR_OUT);
-	IoTGpioSetOutputVal(gpio, value);
+	car_pin_gpio(gpio, value);
 }
 
+// 指令邮箱：一个指令来源写入期望的状态，控制任务读取。每一项有自己的
+// 计数，只在该项被设置时增加，控制任务只采用计数变化的项：单独修改模式或
+// 车速不会重新下发旧的运动指令，一个来源也不会用旧值覆盖另一个来源的设置
+struct car_mailbox
+{
+	unsigned int gen;
+	unsigned int status_gen;
+	unsigned int mode_gen;
+	unsigned int speed_gen;
+	unsigned int stop_gen;
+	unsigned int go_status;
+	unsigned int mode;
+	unsigned int speed;
+	unsigned int cmd_time_us; // 最近一次写入的时间
+	unsigned int origin_us;   // 来源收到这条指令的时间，见 car_set_origin()
+	int linear;
+	int turn;
+	unsigned int stop_status;
+	unsigned int source;   // CarSource
+	unsigned int priority; // 最近一次写入的优先级，CarPriority
+	unsigned int hold;     // 急停锁定
+};
+
+// 指令来源：写者线程私有的副本和发布的邮箱，以及控制任务已经采用的计数
+struct car_source
+{
+	struct car_seqlock lock;
+	struct car_mailbox shared;
+	struct car_mailbox shadow; // 写者私有副本
+	struct car_mailbox seen;   // 控制任务私有
+};
+
+// 运动段队列：UDP 线程是唯一的写者（head、flush_*），控制任务是唯一的读者（tail）。
+// 替换队列时写者记下 flush_at，控制任务看到 flush_gen 变化后丢弃它之前的全部运动段
+struct car_seg_queue
+{
+	unsigned int head;
+	unsigned int tail;
+	unsigned int flush_gen;
+	unsigned int flush_at;
+	struct car_segment seg[CAR_SEG_QUEUE_SIZE];
+};
+
+// car_info 只由控制任务读写，其他线程读取 car_state 快照
 struct car_sys_info car_info;
 
+static osEventFlagsId_t car_event = NULL;
+static osTimerId_t car_step_timer = NULL;
+static struct car_loop_stats car_stats;
+static unsigned int car_jitter_reset_gen;
+
+static struct car_seqlock car_state_lock;
+static struct car_state car_state_shared;
+static unsigned int car_state_version;
+static car_state_notify_t car_state_notify;
+
+static struct car_source car_sources[CAR_SRC_MAX];
+
+// 各来源的普通指令优先级
+static const unsigned char car_src_priority[CAR_SRC_MAX] = {
+	[CAR_SRC_UDP] = CAR_PRIO_REMOTE,
+	[CAR_SRC_KEY] = CAR_PRIO_LOCAL,
+};
+
+static struct car_seg_queue car_seg_queue;
+static osTimerId_t car_seg_timer = NULL;
+static unsigned int car_seg_flush_seen;
+static int car_seg_active;              // 正在执行运动段
+static unsigned int car_seg_deadline_us; // 当前运动段的结束时刻
+
+// 链路监视（car_link.h），只由控制任务读写；car_link_leave_gen 由 Wi-Fi 事件回调加一
+static CarLinkStage car_link_cur;
+static unsigned int car_link_rx_seen;   // 进入当前阶段时最近一个数据报的到达时间
+static CarSpeed car_link_speed;         // 降速前的车速和差速驱动参数
+static int car_link_linear;
+static int car_link_turn;
+static unsigned int car_link_leave_gen;
+static unsigned int car_link_leave_seen;
+
+// 会让车轮转动的状态，步进定时只对它们生效
+#define CAR_MOTION_MOVES(arg, status, name, left, right, mix, again, release) \
+	[status] = (left) != 0 || (right) != 0 || (mix) != 0,
+static const unsigned char car_status_moves[CAR_STATUS_MAX] = {CAR_MOTIONS(CAR_MOTION_MOVES, 0)};
+#undef CAR_MOTION_MOVES
+
 // CarStatus carstatus = CAR_STATUS_STOP;
 // CarMode carmode = CAR_MODE_STEP;
 
+static void car_step_timer_cb(void *arg)
+{
+	(void)arg;
+	osEventFlagsSet(car_event, CAR_EVT_STEP_EXPIRE);
+}
+
+static void car_seg_timer_cb(void *arg)
+{
+	(void)arg;
+	osEventFlagsSet(car_event, CAR_EVT_SEG_EXPIRE);
+}
+
+// 实测转速与已发布的值相差至少 CAR_STATE_TPS_STEP，或者车轮停下时才算变化
+static int car_state_tps_changed(int published, int tps)
+{
+	int diff = tps - published;
+
+	return (tps == 0 && published != 0) || diff >= CAR_STATE_TPS_STEP || diff <= -CAR_STATE_TPS_STEP;
+}
+
+// 控制任务发布当前状态快照，状态没有变化时不重复发布
+static void car_state_publish(void)
+{
+	static struct car_state state;
+	int left_tps = car_speed_get(CAR_WHEEL_LEFT);
+	int right_tps = car_speed_get(CAR_WHEEL_RIGHT);
+
+	if (car_state_version != 0 && state.go_status == car_info.go_status &&
+		state.cur_status == car_info.cur_status && state.mode == car_info.mode && state.speed == car_info.speed &&
+		state.linear == car_info.linear && state.turn == car_info.turn &&
+		!car_state_tps_changed(state.left_tps, left_tps) && !car_state_tps_changed(state.right_tps, right_tps))
+	{
+		return;
+	}
+
+	state.go_status = car_info.go_status;
+	state.cur_status = car_info.cur_status;
+	state.mode = car_info.mode;
+	state.speed = car_info.speed;
+	state.linear = car_info.linear;
+	state.turn = car_info.turn;
+	state.left_tps = left_tps;
+	state.right_tps = right_tps;
+	state.version = ++car_state_version;
+	car_seq_publish(&car_state_lock, &car_state_shared, &state, sizeof(state));
+
+	if (car_state_notify != NULL)
+	{
+		car_state_notify();
+	}
+}
+
+// 在控制任务启动 UDP 线程前注册
+void car_set_state_notify(car_state_notify_t notify)
+{
+	car_state_notify = notify;
+}
+
+void get_car_state(struct car_state *state)
+{
+	car_seq_read(&car_state_lock, &car_state_shared, state, sizeof(*state));
+}
+
+// 写者（来源 src 的线程）：发布邮箱并唤醒控制任务
+static void car_mail_post(CarSource src, CarPriority priority)
+{
+	struct car_source *s = &car_sources[src];
+
+	s->shadow.gen++;
+	s->shadow.cmd_time_us = hi_get_us();
+	s->shadow.priority = priority;
+	car_seq_publish(&s->lock, &s->shared, &s->shadow, sizeof(s->shadow));
+
+	osEventFlagsSet(car_event, CAR_EVT_CMD);
+}
+
+// 写者：之后写入的指令都带上这个到达时间
+void car_set_origin(CarSource src, unsigned int origin_us)
+{
+	car_sources[src].shadow.origin_us = origin_us;
+}
+
 // 初始化函数中增加车速初始化
 void car_info_init(void)
 {
+	unsigned int src;
+
 	car_info.go_status = CAR_STATUS_STOP;
 	car_info.cur_status = CAR_STATUS_STOP;
 	car_info.mode = CAR_MODE_STEP;
-	car_info.step_count = CAR_STEP_COUNT;
 	car_info.speed = CAR_SPEED_MEDIUM; // 默认中速
+	car_info.stop_status = CAR_STATUS_STOP;
+
+	for (src = 0; src < CAR_SRC_MAX; src++)
+	{
+		struct car_source *s = &car_sources[src];
+
+		s->shadow.go_status = car_info.go_status;
+		s->shadow.stop_status = car_info.stop_status;
+		s->shadow.mode = car_info.mode;
+		s->shadow.speed = car_info.speed;
+		s->shadow.source = src;
+		s->shadow.priority = car_src_priority[src];
+		car_seq_publish(&s->lock, &s->shared, &s->shadow, sizeof(s->shadow));
+		s->seen = s->shadow;
+	}
+	car_state_publish();
+
+	car_event = osEventFlagsNew(NULL);
+	car_step_timer = osTimerNew(car_step_timer_cb, osTimerOnce, NULL, NULL);
+	car_seg_timer = osTimerNew(car_seg_timer_cb, osTimerOnce, NULL, NULL);
+	if (car_event == NULL || car_step_timer == NULL || car_seg_timer == NULL)
+	{
+		printf("[car_test] Failed to create control events!\r\n");
+	}
 }
 
-void set_car_speed(CarSpeed speed)
+void set_car_speed(CarSource src, CarSpeed speed)
 {
-	car_info.speed = speed;
+	car_sources[src].shadow.speed = speed;
+	car_sources[src].shadow.speed_gen++;
+	car_mail_post(src, car_src_priority[src]);
 }
 
-char *get_car_speed()
+const char *car_speed_name(unsigned int speed)
 {
-	switch (car_info.speed)
+	switch (speed)
 	{
 	case CAR_SPEED_HIGH:
 		return "high";
@@ -68,45 +280,257 @@ char *get_car_speed()
 	}
 }
 
+char *get_car_speed()
+{
+	struct car_state state;
+
+	get_car_state(&state);
+	return (char *)car_speed_name(state.speed);
+}
+
+// 步进模式下重新开始计时，到期后由定时器唤醒控制任务停车
 void step_count_update(void)
 {
-	car_info.step_count = CAR_STEP_COUNT;
+	// 运动段自带时长，执行期间不使用步进定时
+	if (car_info.mode == CAR_MODE_STEP && car_status_moves[car_info.go_status] && !car_seg_active)
+	{
+		osTimerStart(car_step_timer, CAR_MS_TO_TICKS(CAR_STEP_TIME_MS));
+	}
+	else if (osTimerIsRunning(car_step_timer))
+	{
+		osTimerStop(car_step_timer);
+	}
 }
 
-void set_car_status(CarStatus status)
+static void car_status_request(CarStatus status)
 {
 	if (status != car_info.cur_status)
 	{
 		car_info.status_change = 1;
 	}
 	car_info.go_status = status;
+}
 
-	step_count_update();
+void set_car_status(CarSource src, CarStatus status)
+{
+	car_sources[src].shadow.go_status = status;
+	car_sources[src].shadow.status_gen++;
+	car_mail_post(src, car_src_priority[src]);
 }
 
-char *get_car_status()
+// 急停：立即刹车并锁定，之后所有来源的普通运动指令和运动段都被丢弃，
+// 直到同一来源调用 car_emergency_release()
+void car_emergency_stop(CarSource src)
 {
-	switch (car_info.cur_status)
-	{
-	case CAR_STATUS_STOP:
-		return "stopped";
-	case CAR_STATUS_FORWARD:
-		return "forward";
-	case CAR_STATUS_BACKWARD:
-		return "backward";
-	case CAR_STATUS_LEFT:
-		return "left";
-	case CAR_STATUS_RIGHT:
-		return "right";
-	default:
-		return "unknown";
+	car_sources[src].shadow.go_status = CAR_STATUS_BRAKE;
+	car_sources[src].shadow.status_gen++;
+	car_sources[src].shadow.hold = 1;
+	car_mail_post(src, CAR_PRIO_STOP);
+}
+
+void car_emergency_release(CarSource src)
+{
+	car_sources[src].shadow.hold = 0;
+	car_mail_post(src, CAR_PRIO_STOP);
+}
+
+static void car_seg_abort(void);
+
+static int car_drive_clamp(int value)
+{
+	if (value > CAR_DRIVE_SCALE)
+	{
+		return CAR_DRIVE_SCALE;
+	}
+	if (value < -CAR_DRIVE_SCALE)
+	{
+		return -CAR_DRIVE_SCALE;
+	}
+	return value;
+}
+
+// 步进结束和运动段执行完时的停车方式：CAR_STATUS_STOP、CAR_STATUS_BRAKE 或 CAR_STATUS_COAST
+void set_car_stop_mode(CarSource src, CarStatus status)
+{
+	car_sources[src].shadow.stop_status = status;
+	car_sources[src].shadow.stop_gen++;
+	car_mail_post(src, car_src_priority[src]);
+}
+
+// 差速驱动指令，例如摇杆：linear 控制前后，turn 控制转向
+void set_car_drive(CarSource src, int linear, int turn)
+{
+	struct car_mailbox *m = &car_sources[src].shadow;
+
+	m->go_status = CAR_STATUS_DRIVE;
+	m->linear = car_drive_clamp(linear);
+	m->turn = car_drive_clamp(turn);
+	m->status_gen++;
+	car_mail_post(src, car_src_priority[src]);
+}
+
+// 控制任务：采用一个来源邮箱中变化的项，返回是否需要重新计算步进定时
+static int car_mail_apply(const struct car_mailbox *mail)
+{
+	struct car_mailbox *seen = &car_sources[mail->source].seen;
+	unsigned int bit = 1U << mail->source;
+	int rearm = 0;
+
+	if (mail->hold != seen->hold)
+	{
+		car_info.hold_mask = mail->hold ? (car_info.hold_mask | bit) : (car_info.hold_mask & ~bit);
+		CAR_TRACE_INFO(CAR_TRACE_RING_CTRL, CAR_EV_CMD_HOLD, mail->source, mail->hold, car_info.hold_mask);
+	}
+	if (mail->mode_gen != seen->mode_gen && mail->mode != car_info.mode)
+	{
+		car_info.mode = (CarMode)mail->mode;
+		rearm = 1;
+	}
+	if (mail->speed_gen != seen->speed_gen)
+	{
+		car_info.speed = (CarSpeed)mail->speed;
+	}
+	if (mail->stop_gen != seen->stop_gen)
+	{
+		car_info.stop_status = (CarStatus)mail->stop_status;
+	}
+
+	if (mail->status_gen != seen->status_gen && car_info.hold_mask != 0 && mail->priority < CAR_PRIO_STOP)
+	{
+		// 急停锁定期间丢弃普通运动指令
+		CAR_TRACE_INFO(CAR_TRACE_RING_CTRL, CAR_EV_CMD_REJECTED, mail->source, mail->go_status, car_info.hold_mask);
+		car_stats.rejected++;
+	}
+	else if (mail->status_gen != seen->status_gen)
+	{
+		// 普通运动指令取消正在执行的运动段
+		car_seg_abort();
+		car_info.cmd_time_us = mail->cmd_time_us;
+		car_info.origin_us = mail->origin_us;
+		car_info.cmd_source = (CarSource)mail->source;
+		car_status_request((CarStatus)mail->go_status);
+		if (mail->go_status == CAR_STATUS_DRIVE && (mail->linear != car_info.linear || mail->turn != car_info.turn))
+		{
+			// 驱动状态不变，但两个车轮的输出要重新计算
+			car_info.status_change = 1;
+		}
+		car_info.linear = mail->linear;
+		car_info.turn = mail->turn;
+		rearm = 1;
+	}
+	*seen = *mail;
+	return rearm;
+}
+
+// 控制任务：取出各来源邮箱中的新指令，按写入时间先后采用，
+// 返回是否需要重新计算步进定时
+static int car_mail_fetch(void)
+{
+	struct car_mailbox mail[CAR_SRC_MAX];
+	unsigned int pending = 0;
+	unsigned int src;
+	int rearm = 0;
+
+	for (src = 0; src < CAR_SRC_MAX; src++)
+	{
+		// 控制任务优先级高于写者，不能等写者写完：这次跳过这个来源，
+		// 写者发布完会再置 CAR_EVT_CMD，下次唤醒时再取
+		if (!car_seq_try_read(&car_sources[src].lock, &car_sources[src].shared, &mail[src], sizeof(mail[src])))
+		{
+			car_stats.mail_torn++;
+			continue;
+		}
+		if (mail[src].gen != car_sources[src].seen.gen)
+		{
+			pending |= 1U << src;
+		}
+	}
+
+	while (pending != 0)
+	{
+		unsigned int first = CAR_SRC_MAX;
+
+		for (src = 0; src < CAR_SRC_MAX; src++)
+		{
+			if ((pending & (1U << src)) &&
+				(first == CAR_SRC_MAX || (int)(mail[src].cmd_time_us - mail[first].cmd_time_us) < 0))
+			{
+				first = src;
+			}
+		}
+		pending &= ~(1U << first);
+		rearm |= car_mail_apply(&mail[first]);
 	}
+	return rearm;
+}
+
+#define CAR_MOTION_NAME(arg, status, name, left, right, mix, again, release) [status] = name,
+static const char *const car_status_names[CAR_STATUS_MAX] = {CAR_MOTIONS(CAR_MOTION_NAME, 0)};
+#undef CAR_MOTION_NAME
+
+const char *car_status_name(unsigned int status)
+{
+	return status < CAR_STATUS_MAX ? car_status_names[status] : "unknown";
+}
+
+char *get_car_status()
+{
+	struct car_state state;
+
+	get_car_state(&state);
+	return (char *)car_status_name(state.cur_status);
 }
 
 // 设置行驶模弝
-void set_car_mode(CarMode mode)
+void set_car_mode(CarSource src, CarMode mode)
+{
+	car_sources[src].shadow.mode = mode;
+	car_sources[src].shadow.mode_gen++;
+	car_mail_post(src, car_src_priority[src]);
+}
+
+// 速度闭环的一个周期，记录相邻两个周期间隔偏离周期的最大值
+static void car_speed_tick(void)
+{
+	static unsigned int last_us;
+	static int running;
+	static unsigned int reset_seen;
+	unsigned int now_us = hi_get_us();
+	unsigned int gen = __atomic_load_n(&car_jitter_reset_gen, __ATOMIC_ACQUIRE);
+
+	if (reset_seen != gen)
+	{
+		car_stats.speed_jitter_max_us = 0;
+		reset_seen = gen;
+	}
+	if (running)
+	{
+		int jitter = (int)(now_us - last_us) - CAR_SPEED_CTRL_MS * 1000;
+		unsigned int abs_jitter = jitter < 0 ? -jitter : jitter;
+		car_stats.speed_ticks++;
+		if (abs_jitter > car_stats.speed_jitter_max_us)
+		{
+			car_stats.speed_jitter_max_us = abs_jitter;
+		}
+		if (abs_jitter > CAR_STEP_TICK_MS * 1000)
+		{
+			car_stats.speed_late_ticks++;
+		}
+	}
+	last_us = now_us;
+	// 车轮都停下后定时器停止，下次启动时重新开始计算间隔
+	running = car_speed_step();
+}
+
+void get_car_loop_stats(struct car_loop_stats *stats)
 {
-	car_info.mode = mode;
+	*stats = car_stats;
+}
+
+// 任意线程：清零速度闭环周期偏离的最大值，在速度闭环的下一个周期生效
+void reset_car_speed_jitter(void)
+{
+	__atomic_add_fetch(&car_jitter_reset_gen, 1U, __ATOMIC_RELEASE);
 }
 
 void pwm_init(void)
@@ -117,10 +541,11 @@ void pwm_init(void)
 	IoTGpioInit(IO_NAME_GPIO_10);
 
 	// 引脚复用 - 启用PWM功能
-	hi_io_set_func(IO_NAME_GPIO_0, IO_FUNC_GPIO_0_PWM3_OUT);
-	hi_io_set_func(IO_NAME_GPIO_1, IO_FUNC_GPIO_1_PWM4_OUT);
-	hi_io_set_func(IO_NAME_GPIO_9, IO_FUNC_GPIO_9_PWM0_OUT);
-	hi_io_set_func(IO_NAME_GPIO_10, IO_FUNC_GPIO_10_PWM1_OUT);
+	car_pin_invalidate();
+	car_pin_pwm(IO_NAME_GPIO_0);
+	car_pin_pwm(IO_NAME_GPIO_1);
+	car_pin_pwm(IO_NAME_GPIO_9);
+	car_pin_pwm(IO_NAME_GPIO_10);
 
 	// 初始化pwm
 	IoTPwmInit(PWM_PORT_PWM3);
@@ -132,174 +557,396 @@ void pwm_init(void)
 // 坜止
 void pwm_stop(void)
 {
-	// 停止所有PWM输出
-	IoTPwmStop(PWM_PORT_PWM0);
-	IoTPwmStop(PWM_PORT_PWM1);
-	IoTPwmStop(PWM_PORT_PWM3);
-	IoTPwmStop(PWM_PORT_PWM4);
-
-	// 确保电机断电
-	gpio_control(GPIO0, IOT_GPIO_VALUE1);
-	gpio_control(GPIO1, IOT_GPIO_VALUE1);
-	gpio_control(GPIO9, IOT_GPIO_VALUE1);
-	gpio_control(GPIO10, IOT_GPIO_VALUE1);
+	// 两个车轮减速到 0，到 0 后与原来一样所有输入拉高
+	car_motor_set(0, 0);
 }
 
-void car_stop(void)
+// 剝进
+void pwm_backward(void)
 {
-	car_info.cur_status = car_info.go_status;
-
-	printf("pwm_stop \r\n");
-
-	pwm_stop();
+	// 两个车轮反转，经斜坡加速到当前设置的车速
+	car_motor_set(-(int)car_info.speed, -(int)car_info.speed);
 }
 
-// 剝进
-void pwm_backward(void)
+// 坎退
+void pwm_forward(void)
+{
+	// 两个车轮正转，经斜坡加速到当前设置的车速
+	car_motor_set(car_info.speed, car_info.speed);
+}
+// 左转
+void pwm_right(void)
 {
-	// 设置方向
-	gpio_control(GPIO0, IOT_GPIO_VALUE1);
-	gpio_control(GPIO1, IOT_GPIO_VALUE0);
-	gpio_control(GPIO9, IOT_GPIO_VALUE1);
-	gpio_control(GPIO10, IOT_GPIO_VALUE0);
+	// 只有右轮反转
+	car_motor_set(0, -(int)car_info.speed);
+}
+// 坳转
+void pwm_left(void)
+{
+	// 只有左轮反转
+	car_motor_set(-(int)car_info.speed, 0);
+}
+// 差速混合：左轮 = 线速度 + 转向，右轮 = 线速度 - 转向。超出范围时两轮按同一比例缩小，
+// 保持转弯半径不变。输出为带符号的占空比，正数正转，负数反转
+void car_drive_mix(int linear, int turn, int *left_duty, int *right_duty)
+{
+	int left = car_drive_clamp(linear) + car_drive_clamp(turn);
+	int right = car_drive_clamp(linear) - car_drive_clamp(turn);
+	int left_abs = left < 0 ? -left : left;
+	int right_abs = right < 0 ? -right : right;
+	int peak = left_abs > right_abs ? left_abs : right_abs;
+	int scale = peak > CAR_DRIVE_SCALE ? peak : CAR_DRIVE_SCALE;
+
+	*left_duty = (int)((long long)left * CAR_DUTY_MAX / scale);
+	*right_duty = (int)((long long)right * CAR_DUTY_MAX / scale);
+}
 
-	// 启动PWM，使用当前设置的车速
-	IoTPwmStart(PWM_PORT_PWM3, car_info.speed, PWM_FREQ_FREQUENCY);
-	IoTPwmStart(PWM_PORT_PWM0, car_info.speed, PWM_FREQ_FREQUENCY);
+void pwm_drive(int left_duty, int right_duty)
+{
+	car_motor_set(left_duty, right_duty);
 }
 
-void car_forward(void)
+extern void start_udp_thread(void);
+
+// 状态切换表：按（当前状态，目标状态）查出两个车轮的输出。当前状态为
+// CAR_STATUS_MAX 表示强制重新输出，所以每个状态一行，再加 CAR_STATUS_MAX 一行
+struct car_transition
 {
-	if (car_info.go_status != CAR_STATUS_FORWARD)
+	signed char left;    // 左轮方向，乘以车速
+	signed char right;   // 右轮方向，乘以车速
+	unsigned char mix;   // 两个车轮按差速混合计算
+	unsigned char apply;   // 为 0 时状态没有变化，不输出
+	unsigned char release; // CAR_RELEASE_*，不为 0 时不经过斜坡直接停车
+};
+
+#define CAR_TRANSITION_CELL(cur, status, name, left, right, mix, again, release) \
+	{(left), (right), (mix), (cur) != (status) || (again), (release)},
+
+// 每一行也由 CAR_MOTIONS 生成。预处理器不会在 CAR_MOTIONS 的展开中再次展开它，
+// 所以行内的 CAR_MOTIONS 经 CAR_DEFER 推迟到 CAR_EXPAND 重新扫描时才展开
+#define CAR_EMPTY()
+#define CAR_DEFER(id) id CAR_EMPTY()
+#define CAR_EXPAND(...) __VA_ARGS__
+#define CAR_MOTIONS_INDIRECT() CAR_MOTIONS
+#define CAR_TRANSITION_ROW(arg, status, name, left, right, mix, again, release) \
+	[status] = {CAR_DEFER(CAR_MOTIONS_INDIRECT)()(CAR_TRANSITION_CELL, status)},
+
+// 目标状态为 CAR_STATUS_MAX 的一列全为 0（不输出），car_dispatch 也不会查到
+static const struct car_transition car_transitions[CAR_STATUS_MAX + 1][CAR_STATUS_MAX + 1] = {
+	CAR_EXPAND(CAR_MOTIONS(CAR_TRANSITION_ROW, 0))
+	[CAR_STATUS_MAX] = {CAR_MOTIONS(CAR_TRANSITION_CELL, CAR_STATUS_MAX)},
+};
+
+#undef CAR_TRANSITION_ROW
+#undef CAR_MOTIONS_INDIRECT
+#undef CAR_EXPAND
+#undef CAR_DEFER
+#undef CAR_EMPTY
+#undef CAR_TRANSITION_CELL
+
+// 当前状态和目标状态都不超过 CAR_STATUS_MAX，都在表内
+#define CAR_TRANSITION_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+typedef char car_transition_rows_check[CAR_TRANSITION_COUNT(car_transitions) == CAR_STATUS_MAX + 1 ? 1 : -1];
+typedef char car_transition_cols_check[CAR_TRANSITION_COUNT(car_transitions[0]) == CAR_STATUS_MAX + 1 ? 1 : -1];
+#undef CAR_TRANSITION_COUNT
+
+static void car_dispatch(void)
+{
+	const struct car_transition *tr;
+	int left_duty;
+	int right_duty;
+
+	car_info.status_change = 0;
+
+	// 只记录二进制事件，由跟踪任务稍后输出，不在这里等待串口
+	CAR_TRACE_INFO(CAR_TRACE_RING_CTRL, CAR_EV_CAR_MOTION, car_info.cur_status, car_info.go_status, car_info.speed);
+
+	if ((unsigned int)car_info.go_status >= CAR_STATUS_MAX)
 	{
-		// 直接退�?
 		return;
 	}
-	if (car_info.cur_status == car_info.go_status)
+	tr = &car_transitions[car_info.cur_status][car_info.go_status];
+	car_info.cur_status = car_info.go_status;
+	if (!tr->apply)
 	{
-		// 状思没有坘化，直接推出
 		return;
 	}
 
-	car_info.cur_status = car_info.go_status;
-
-	printf("pwm_forward \r\n");
+	// 刹车和滑行：不经过斜坡立即停止输出
+	if (tr->release != CAR_RELEASE_NONE)
+	{
+		car_motor_release();
+		step_count_update();
+		return;
+	}
 
-	pwm_forward();
+	car_drive_mix(car_info.linear, car_info.turn, &left_duty, &right_duty);
+	left_duty = tr->left * (int)car_info.speed + tr->mix * left_duty;
+	right_duty = tr->right * (int)car_info.speed + tr->mix * right_duty;
+	car_motor_set(left_duty, right_duty);
+	if (left_duty != 0 || right_duty != 0)
+	{
+		car_speed_start();
+	}
 
 	step_count_update();
 }
 
-// 坎退
-void pwm_forward(void)
+// UDP 线程：把一批运动段放入队列，replace 为真时取代队列中和正在执行的运动段。
+// 队列空间不足时整批拒绝，返回 -1
+int car_queue_segments(const struct car_segment *seg, unsigned int count, int replace)
 {
-	// 设置方向
-	gpio_control(GPIO0, IOT_GPIO_VALUE0);
-	gpio_control(GPIO1, IOT_GPIO_VALUE1);
-	gpio_control(GPIO9, IOT_GPIO_VALUE0);
-	gpio_control(GPIO10, IOT_GPIO_VALUE1);
+	struct car_seg_queue *q = &car_seg_queue;
+	unsigned int head = q->head;
+	unsigned int used = head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+	unsigned int i;
 
-	// 启动PWM，使用当前设置的车速
-	IoTPwmStart(PWM_PORT_PWM4, car_info.speed, PWM_FREQ_FREQUENCY);
-	IoTPwmStart(PWM_PORT_PWM1, car_info.speed, PWM_FREQ_FREQUENCY);
-}
-void car_backward(void)
-{
-	if (car_info.go_status != CAR_STATUS_BACKWARD)
+	if (count == 0 || count > CAR_SEG_QUEUE_SIZE - used)
 	{
-		// 直接退�?
-		return;
+		CAR_TRACE_ERR(CAR_TRACE_RING_RECV, CAR_EV_SEG_REJECTED, count, CAR_SEG_QUEUE_SIZE - used, 0);
+		return -1;
 	}
-	if (car_info.cur_status == car_info.go_status)
+
+	if (replace)
 	{
-		// 状思没有坘化，直接推出
-		return;
+		__atomic_store_n(&q->flush_at, head, __ATOMIC_RELAXED);
+		__atomic_store_n(&q->flush_gen, q->flush_gen + 1, __ATOMIC_RELEASE);
 	}
+	for (i = 0; i < count; i++)
+	{
+		q->seg[(head + i) & (CAR_SEG_QUEUE_SIZE - 1)] = seg[i];
+	}
+	__atomic_store_n(&q->head, head + count, __ATOMIC_RELEASE);
 
-	car_info.cur_status = car_info.go_status;
-
-	printf("pwm_backward \r\n");
-
-	pwm_backward();
-
-	step_count_update();
+	CAR_TRACE_INFO(CAR_TRACE_RING_RECV, CAR_EV_SEG_QUEUED, count, replace, 0);
+	osEventFlagsSet(car_event, CAR_EVT_SEG);
+	return 0;
 }
 
-// 左转
-void pwm_right(void)
+// 控制任务：停止执行运动段并丢弃队列
+static void car_seg_abort(void)
 {
-	// 设置方向
-	gpio_control(GPIO0, IOT_GPIO_VALUE0);
-	gpio_control(GPIO1, IOT_GPIO_VALUE0);
-	gpio_control(GPIO9, IOT_GPIO_VALUE1);
-	gpio_control(GPIO10, IOT_GPIO_VALUE0);
-
-	// 启动PWM，使用当前设置的车速
-	IoTPwmStart(PWM_PORT_PWM0, car_info.speed, PWM_FREQ_FREQUENCY);
+	car_seg_active = 0;
+	osTimerStop(car_seg_timer);
+	__atomic_store_n(&car_seg_queue.tail, __atomic_load_n(&car_seg_queue.head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
 }
-void car_left(void)
+
+// 控制任务：开始下一个运动段，队列为空时停车。
+// 截止时刻按绝对时间累加，系统节拍的取整误差不会逐段累积
+static void car_seg_next(void)
 {
-	if (car_info.go_status != CAR_STATUS_LEFT)
+	struct car_seg_queue *q = &car_seg_queue;
+	unsigned int tail = q->tail;
+	struct car_segment seg;
+	int remain_us;
+
+	if (tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
 	{
-		// 直接退�?
+		CAR_TRACE_INFO(CAR_TRACE_RING_CTRL, CAR_EV_SEG_DONE, hi_get_us() - car_seg_deadline_us, 0, 0);
+		car_seg_active = 0;
+		car_status_request(car_info.stop_status);
+		if (car_info.status_change)
+		{
+			car_dispatch();
+		}
 		return;
 	}
-	if (car_info.cur_status == car_info.go_status)
+
+	seg = q->seg[tail & (CAR_SEG_QUEUE_SIZE - 1)];
+	__atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+	CAR_TRACE_INFO(CAR_TRACE_RING_CTRL, CAR_EV_SEG_START, seg.op, seg.speed, seg.duration_ms);
+
+	car_seg_active = 1;
+	car_seg_deadline_us += seg.duration_ms * 1000U;
+	if (seg.op < CAR_STATUS_MAX && seg.op != CAR_STATUS_DRIVE)
 	{
-		// 状思没有坘化，直接推出
-		return;
+		if (seg.speed != 0 && seg.speed != car_info.speed)
+		{
+			// 车速变化时强制重新输出当前方向
+			car_info.speed = (CarSpeed)seg.speed;
+			car_info.cur_status = CAR_STATUS_MAX;
+		}
+		car_status_request((CarStatus)seg.op);
+		if (car_info.status_change)
+		{
+			car_dispatch();
+		}
+	}
+	if (osTimerIsRunning(car_step_timer))
+	{
+		osTimerStop(car_step_timer);
 	}
 
-	car_info.cur_status = car_info.go_status;
+	// 已经落后时至少等一个节拍，每一段都会被执行
+	remain_us = (int)(car_seg_deadline_us - hi_get_us());
+	if (remain_us < 1)
+	{
+		remain_us = 1;
+	}
+	osTimerStart(car_seg_timer, CAR_MS_TO_TICKS((remain_us + 999) / 1000));
+}
 
-	printf("pwm_left \r\n");
+// 控制任务：处理新入队的运动段
+static void car_seg_fetch(void)
+{
+	struct car_seg_queue *q = &car_seg_queue;
+	unsigned int flush_gen = __atomic_load_n(&q->flush_gen, __ATOMIC_ACQUIRE);
 
-	pwm_left();
+	if (flush_gen != car_seg_flush_seen)
+	{
+		car_seg_flush_seen = flush_gen;
+		car_seg_active = 0;
+		osTimerStop(car_seg_timer);
+		__atomic_store_n(&q->tail, __atomic_load_n(&q->flush_at, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+	}
+	// 急停锁定期间运动段与普通运动指令一样被丢弃
+	if (car_info.hold_mask != 0 && q->tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+	{
+		CAR_TRACE_INFO(CAR_TRACE_RING_CTRL, CAR_EV_CMD_REJECTED, CAR_SRC_UDP, CAR_STATUS_MAX, car_info.hold_mask);
+		car_stats.rejected++;
+		__atomic_store_n(&q->tail, __atomic_load_n(&q->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+		return;
+	}
+	if (!car_seg_active && q->tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+	{
+		car_seg_deadline_us = hi_get_us();
+		car_seg_next();
+	}
+}
 
+// 控制任务：立即输出 status，链路处理和指令一样取消运动段
+static void car_link_output(CarStatus status)
+{
+	car_seg_abort();
+	car_status_request(status);
+	if (car_info.status_change)
+	{
+		car_dispatch();
+	}
 	step_count_update();
 }
 
-// 坳转
-void pwm_left(void)
+// 控制任务：进入链路监视的 stage 阶段，silence_ms 只用于记录
+static void car_link_enter(CarLinkStage stage, unsigned int silence_ms)
 {
-	// 设置方向
-	gpio_control(GPIO0, IOT_GPIO_VALUE1);
-	gpio_control(GPIO1, IOT_GPIO_VALUE0);
-	gpio_control(GPIO9, IOT_GPIO_VALUE0);
-	gpio_control(GPIO10, IOT_GPIO_VALUE0);
-
-	// 启动PWM，使用当前设置的车速
-	IoTPwmStart(PWM_PORT_PWM3, car_info.speed, PWM_FREQ_FREQUENCY);
+	CAR_TRACE_INFO(CAR_TRACE_RING_CTRL, CAR_EV_LINK_STAGE, stage, silence_ms, car_info.cur_status);
+	car_stats.link_actions[stage]++;
+	if (stage == CAR_LINK_SLOW)
+	{
+		car_link_speed = car_info.speed;
+		car_link_linear = car_info.linear;
+		car_link_turn = car_info.turn;
+		if (car_info.speed > CAR_SPEED_LOW)
+		{
+			car_info.speed = CAR_SPEED_LOW;
+		}
+		car_info.linear = car_info.linear * CAR_LINK_SLOW_PCT / 100;
+		car_info.turn = car_info.turn * CAR_LINK_SLOW_PCT / 100;
+		// 方向不变，强制按新的车速重新输出
+		car_info.cur_status = CAR_STATUS_MAX;
+		car_link_output(car_info.go_status);
+	}
+	else if (car_link_cur == CAR_LINK_SLOW)
+	{
+		// 从降速进入刹车或停车：车速不再起作用，恢复后的指令仍按原来的车速执行
+		car_info.speed = car_link_speed;
+		car_info.linear = car_link_linear;
+		car_info.turn = car_link_turn;
+	}
+	if (stage == CAR_LINK_BRAKE)
+	{
+		car_link_output(CAR_STATUS_BRAKE);
+	}
+	else if (stage == CAR_LINK_STOP)
+	{
+		car_link_output(CAR_STATUS_STOP);
+	}
+	car_link_cur = stage;
 }
-void car_right(void)
+
+// 控制任务：控制端恢复发送后撤销降速，刹车和停车保持到下一条运动指令
+static void car_link_recover(void)
 {
-	if (car_info.go_status != CAR_STATUS_RIGHT)
+	if (car_link_cur == CAR_LINK_OK || car_link_last_rx_us() == car_link_rx_seen)
 	{
-		// 直接退�?
 		return;
 	}
-	if (car_info.cur_status == car_info.go_status)
+	CAR_TRACE_INFO(CAR_TRACE_RING_CTRL, CAR_EV_LINK_STAGE, CAR_LINK_OK, 0, car_info.cur_status);
+	car_stats.link_actions[CAR_LINK_OK]++;
+	if (car_link_cur == CAR_LINK_SLOW)
 	{
-		// 状思没有坘化，直接推出
-		return;
+		car_info.speed = car_link_speed;
+		car_info.linear = car_link_linear;
+		car_info.turn = car_link_turn;
+		if (car_status_moves[car_info.cur_status])
+		{
+			car_info.cur_status = CAR_STATUS_MAX;
+			car_link_output(car_info.go_status);
+		}
 	}
+	car_link_cur = CAR_LINK_OK;
+}
 
-	car_info.cur_status = car_info.go_status;
-
-	printf("pwm_right \r\n");
-
-	pwm_right();
+// 控制任务：链路检查周期到或 Wi-Fi 终端离开
+static void car_link_check(void)
+{
+	unsigned int leave_gen = __atomic_load_n(&car_link_leave_gen, __ATOMIC_ACQUIRE);
+	unsigned int silence_ms;
+	CarLinkStage stage;
+	int left = leave_gen != car_link_leave_seen;
+
+	car_link_leave_seen = leave_gen;
+	car_link_recover();
+	car_link_rx_seen = car_link_last_rx_us();
+	if (car_info.cmd_source != CAR_SRC_UDP || car_info.mode != CAR_MODE_ALWAY || car_seg_active ||
+		car_link_cur == CAR_LINK_STOP)
+	{
+		return;
+	}
+	silence_ms = (hi_get_us() - car_link_rx_seen) / 1000;
+	stage = car_link_stage(silence_ms);
+	// 终端离开热点时控制端已经不可能再发送，不等静默时间直接刹车
+	if (left && car_status_moves[car_info.cur_status] && stage < CAR_LINK_BRAKE)
+	{
+		stage = CAR_LINK_BRAKE;
+	}
+	if (stage > car_link_cur && (car_status_moves[car_info.cur_status] || car_link_cur != CAR_LINK_OK))
+	{
+		car_link_enter(stage, silence_ms);
+	}
+}
 
-	step_count_update();
+// 控制任务：持续运动模式下 UDP 指令驱动的运动，以及降级处理直到停车，需要周期检查
+static void car_link_update(void)
+{
+	car_link_watch(car_info.cmd_source == CAR_SRC_UDP && car_info.mode == CAR_MODE_ALWAY && !car_seg_active &&
+				   (car_status_moves[car_info.cur_status] ||
+					(car_link_cur != CAR_LINK_OK && car_link_cur != CAR_LINK_STOP)));
 }
 
-extern void start_udp_thread(void);
+// Wi-Fi 事件回调：有终端离开热点
+void car_station_left(void)
+{
+	__atomic_store_n(&car_link_leave_gen, car_link_leave_gen + 1, __ATOMIC_RELEASE);
+	osEventFlagsSet(car_event, CAR_EVT_LINK);
+}
 
 void car_test(void)
 {
-	start_udp_thread();
-	pwm_init();
+	// 先创建事件与定时器，UDP线程收到指令时才能唤醒控制任务
+	osThreadSetPriority(osThreadGetId(), CAR_CTRL_PRIORITY);
 	car_info_init();
+	car_trace_start();
+	pwm_init();
+	car_motor_init(car_event, CAR_EVT_RAMP);
+	car_speed_init(car_event, CAR_EVT_SPEED);
+	car_link_init(car_event, CAR_EVT_LINK);
+	// 上电后先输出确定的停车状态，引脚不再停留在 PWM 复用、没有输出的状态
+	pwm_stop();
+	car_boot_mark(CAR_BOOT_MOTORS);
+	start_udp_thread();
+	car_keys_init();
+	car_boot_mark(CAR_BOOT_KEYS);
 	// set_car_status(CAR_STATUS_FORWARD);
 	// set_car_mode(CAR_MODE_ALWAY);
 	/*
@@ -319,54 +966,109 @@ void car_test(void)
 	*/
 	while (1)
 	{
-		if (car_info.status_change)
+		// 没有指令或定时器到期时一直阻塞，不再每 1ms 轮询
+		uint32_t flags = osEventFlagsWait(car_event, CAR_EVT_ALL, osFlagsWaitAny, osWaitForever);
+		if (flags & osFlagsError)
 		{
-			car_info.status_change = 0;
+			continue;
+		}
+		car_stats.wakeups++;
 
-			switch (car_info.go_status)
+		// 先撤销降速，新指令在恢复后的车速和驱动参数上生效
+		if (flags & CAR_EVT_CMD)
+		{
+			car_link_recover();
+		}
+		if ((flags & CAR_EVT_CMD) && car_mail_fetch())
+		{
+			if (car_info.status_change)
 			{
-			case CAR_STATUS_STOP:
-				car_stop();
-				break;
-
-			case CAR_STATUS_FORWARD:
-				car_forward();
-				break;
-
-			case CAR_STATUS_BACKWARD:
-				car_backward();
-				break;
+				unsigned int pickup_us = hi_get_us();
 
-			case CAR_STATUS_LEFT:
-				car_left();
-				break;
+				car_dispatch();
 
-			case CAR_STATUS_RIGHT:
-				car_right();
-				break;
+				unsigned int output_us = hi_get_us();
+				unsigned int latency = output_us - car_info.cmd_time_us;
+				car_stats.commands++;
+				car_stats.last_latency_us = latency;
+				if (latency > car_stats.max_latency_us)
+				{
+					car_stats.max_latency_us = latency;
+				}
+				car_stats.src_commands[car_info.cmd_source]++;
+				if (latency > car_stats.src_max_latency_us[car_info.cmd_source])
+				{
+					car_stats.src_max_latency_us[car_info.cmd_source] = latency;
+				}
+				// 指令路径各段只统计带有接收时间的 UDP 指令
+				if (car_info.cmd_source == CAR_SRC_UDP)
+				{
+					car_lat_record(CAR_LAT_PICKUP, pickup_us - car_info.cmd_time_us);
+					car_lat_record(CAR_LAT_OUTPUT, output_us - pickup_us);
+					car_lat_record(CAR_LAT_TOTAL, output_us - car_info.origin_us);
+				}
+			}
+			step_count_update();
+		}
 
-			default:
+		if (flags & CAR_EVT_RAMP)
+		{
+			car_motor_step();
+		}
+		if (flags & CAR_EVT_SPEED)
+		{
+			car_speed_tick();
+		}
 
-				break;
-			}
+		if (flags & CAR_EVT_SEG)
+		{
+			car_seg_fetch();
+		}
+		if ((flags & CAR_EVT_SEG_EXPIRE) && car_seg_active && !osTimerIsRunning(car_seg_timer))
+		{
+			car_seg_next();
 		}
 
-		if (car_info.mode == CAR_MODE_STEP)
+		// 同一次唤醒里若新指令已重新启动定时器，则忽略旧的到期事件
+		if ((flags & CAR_EVT_STEP_EXPIRE) && !osTimerIsRunning(car_step_timer))
 		{
-			if (car_info.go_status != CAR_STATUS_STOP)
+			if (car_info.mode == CAR_MODE_STEP && car_status_moves[car_info.go_status] && !car_seg_active)
 			{
-				if (car_info.step_count > 0)
+				CAR_TRACE_INFO(CAR_TRACE_RING_CTRL, CAR_EV_CAR_STEP_STOP, car_info.stop_status, 0, 0);
+				car_status_request(car_info.stop_status);
+				if (car_info.status_change)
 				{
-					car_info.step_count--;
-				}
-				else
-				{
-					printf("stop... \r\n");
-					set_car_status(CAR_STATUS_STOP);
+					car_dispatch();
 				}
 			}
 		}
 
-		usleep(1000);
+		if (flags & CAR_EVT_LINK)
+		{
+			car_link_check();
+		}
+		car_link_update();
+
+		car_state_publish();
+	}
+}
+
+static void car_control_task(void *arg)
+{
+	(void)arg;
+	car_test();
+}
+
+// 启动任务调用：控制任务优先级更高，创建后先完成初始化，启动任务再去启动热点
+void car_start(void)
+{
+	osThreadAttr_t attr = {0};
+
+	attr.name = "car_ctrl";
+	attr.stack_size = CAR_CTRL_STACK_SIZE;
+	attr.priority = CAR_CTRL_PRIORITY;
+	if (osThreadNew(car_control_task, NULL, &attr) == NULL)
+	{
+		printf("[car_test] Failed to create control task!\r\n");
 	}
 }
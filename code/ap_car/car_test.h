@@ -18,26 +18,43 @@
 
 #define CAR_STEP_COUNT 150
 
-typedef enum
-{
-    /*停止*/
-    CAR_STATUS_STOP,
-
-    /*前进*/
-    CAR_STATUS_FORWARD,
+/* 步进模式持续时间：原轮询循环 150 次，每次约一个 10ms 系统节拍 */
+#define CAR_STEP_TICK_MS 10
+#define CAR_STEP_TIME_MS (CAR_STEP_COUNT * CAR_STEP_TICK_MS)
 
-    /*后退*/
-    CAR_STATUS_BACKWARD,
+/* 毫秒转换为 CMSIS 系统节拍，向上取整 */
+#define CAR_MS_TO_TICKS(ms) ((((unsigned int)(ms)) * osKernelGetTickFreq() + 999U) / 1000U)
 
-    /*左转*/
-    CAR_STATUS_LEFT,
-
-    /*右转*/
-    CAR_STATUS_RIGHT,
+/*
+ * 运动状态表，CarStatus、状态名和控制任务的状态切换表都由它生成。
+ * 每一行依次为：状态、名字、左轮和右轮方向（乘以车速，正数正转）、是否按
+ * 差速混合计算两个车轮、已处于该状态时是否重新输出、停车方式（CAR_RELEASE_*）。
+ * 前五个状态的编号就是协议中的运动指令编号，新状态只能加在末尾。
+ */
+#define CAR_MOTIONS(X, arg)                                                                 \
+    X(arg, CAR_STATUS_STOP, "stopped", 0, 0, 0, 1, CAR_RELEASE_NONE)      /*停止*/          \
+    X(arg, CAR_STATUS_FORWARD, "forward", 1, 1, 0, 0, CAR_RELEASE_NONE)   /*前进*/          \
+    X(arg, CAR_STATUS_BACKWARD, "backward", -1, -1, 0, 0, CAR_RELEASE_NONE) /*后退*/        \
+    X(arg, CAR_STATUS_LEFT, "left", -1, 0, 0, 0, CAR_RELEASE_NONE)        /*左转*/          \
+    X(arg, CAR_STATUS_RIGHT, "right", 0, -1, 0, 0, CAR_RELEASE_NONE)      /*右转*/          \
+    X(arg, CAR_STATUS_DRIVE, "drive", 0, 0, 1, 1, CAR_RELEASE_NONE)       /*差速驱动*/      \
+    X(arg, CAR_STATUS_BRAKE, "brake", 0, 0, 0, 0, CAR_RELEASE_NOW)        /*刹车*/          \
+    X(arg, CAR_STATUS_COAST, "coast", 0, 0, 0, 0, CAR_RELEASE_NOW)        /*滑行*/
+
+// 停车方式：按斜坡减速到 0 / 立即停止输出。L9110S 上刹车和滑行是同一个输出
+// 状态（见 CAR_MOTOR_STOP_LEVEL），两者只在上报的状态名上不同
+#define CAR_RELEASE_NONE 0
+#define CAR_RELEASE_NOW 1
+
+#define CAR_MOTION_ENUM(arg, status, name, left, right, mix, again, release) status,
+typedef enum
+{
+    CAR_MOTIONS(CAR_MOTION_ENUM, 0)
 
     /** Maximum value */
     CAR_STATUS_MAX
 } CarStatus;
+#undef CAR_MOTION_ENUM
 
 typedef enum
 {
@@ -58,27 +75,138 @@ typedef enum
     CAR_SPEED_HIGH = 64000,   // 高速，占空比约100%
 } CarSpeed;
 
+// 差速驱动：线速度和转向速率的取值范围为 -CAR_DRIVE_SCALE..CAR_DRIVE_SCALE，
+// 转向速率为正时向右转。每个车轮的占空比最大为 CAR_DUTY_MAX
+#define CAR_DRIVE_SCALE 1000
+#define CAR_DUTY_MAX CAR_SPEED_HIGH
+
+// 指令来源：每个来源有自己的指令邮箱，只能由一个线程写入（见 car_seqlock.h）
+typedef enum
+{
+    CAR_SRC_UDP, // UDP 网络任务
+    CAR_SRC_KEY, // 板上按键，按键任务
+    CAR_SRC_MAX
+} CarSource;
+
+// 指令优先级：急停锁定期间只执行不低于 CAR_PRIO_STOP 的运动指令
+typedef enum
+{
+    CAR_PRIO_REMOTE, // 远程控制
+    CAR_PRIO_LOCAL,  // 本地按键
+    CAR_PRIO_STOP,   // 急停
+    CAR_PRIO_MAX
+} CarPriority;
+
 // 全局变量增加车速控制
 struct car_sys_info
 {
     CarStatus go_status;
     CarStatus cur_status;
     CarMode mode;
-    int step_count;
     int status_change;
     CarSpeed speed; // 新增：车速控制
+    unsigned int cmd_time_us; // 最近一次指令到达时间，用于统计指令到PWM的延迟
+    int linear;               // 差速驱动的线速度
+    int turn;                 // 差速驱动的转向速率
+    CarStatus stop_status;    // 步进结束、运动段执行完时的停车方式：停止、刹车或滑行
+    CarSource cmd_source;     // 最近一次运动指令的来源
+    unsigned int hold_mask;   // 正在急停锁定的来源，每个来源一位
+    unsigned int origin_us;   // 最近一次运动指令被来源收到的时间（UDP 为收到数据报时）
+};
+
+// 控制任务发布的状态快照，其他线程通过 get_car_state() 无锁读取，不会读到一半的数据
+struct car_state
+{
+    unsigned int go_status;
+    unsigned int cur_status;
+    unsigned int mode;
+    unsigned int speed;
+    int linear;
+    int turn;
+    int left_tps;         // 实测车轮转速（脉冲/秒），见 car_speed.h
+    int right_tps;
+    unsigned int version; // 每次发布加一
 };
 
-void set_car_speed(CarSpeed speed);
+// 实测转速变化达到这个值才重新发布快照，测量的抖动不会触发遥测
+#define CAR_STATE_TPS_STEP 8
+
+// 定时运动段：以 speed 执行 op（CarStatus）duration_ms 毫秒，speed 为 0 时保持当前车速
+struct car_segment
+{
+    unsigned char op;
+    unsigned char reserved;
+    unsigned short speed;
+    unsigned int duration_ms;
+};
+
+// 运动段队列容量，必须是 2 的幂
+#define CAR_SEG_QUEUE_SIZE 32
+
+// 控制任务统计：唤醒次数与指令到PWM输出的延迟
+struct car_loop_stats
+{
+    unsigned int wakeups;
+    unsigned int commands;
+    unsigned int last_latency_us;
+    unsigned int max_latency_us;
+    unsigned int src_commands[CAR_SRC_MAX];       // 各来源执行的运动指令数
+    unsigned int src_max_latency_us[CAR_SRC_MAX]; // 各来源的最大延迟
+    unsigned int rejected;                        // 急停锁定期间丢弃的运动指令和运动段
+    unsigned int speed_ticks;                     // 速度闭环连续运行的周期数
+    unsigned int speed_jitter_max_us;             // 速度闭环周期间隔偏离周期的最大值，reset_car_speed_jitter() 清零
+    unsigned int speed_late_ticks;                // 速度闭环周期间隔偏离超过一个系统节拍（CAR_STEP_TICK_MS）的次数
+    unsigned int link_actions[4];                 // 链路监视进入各阶段（CarLinkStage）的次数，[0] 为恢复
+    unsigned int mail_torn;                       // 邮箱正在被写，留到写者写完唤醒时再取的次数
+};
+
+void set_car_speed(CarSource src, CarSpeed speed);
 
 char *get_car_speed();
 
+// 控制任务：在当前线程初始化电机、按键和 UDP 网络任务，然后进入控制循环，不返回
 void car_test(void);
+// 新建控制任务运行 car_test() 后立即返回，启动任务可以接着启动热点
+void car_start(void);
 
-void set_car_status(CarStatus status);
+void set_car_status(CarSource src, CarStatus status);
 char *get_car_status();
 
-void set_car_mode(CarMode mode);
+void set_car_mode(CarSource src, CarMode mode);
+void set_car_stop_mode(CarSource src, CarStatus status);
+
+void set_car_drive(CarSource src, int linear, int turn);
+
+// 来源收到一条指令的时间，之后的 set_car_* 都带上它，用于统计指令路径各段延迟（car_latency.h）
+void car_set_origin(CarSource src, unsigned int origin_us);
+
+void car_emergency_stop(CarSource src);
+void car_emergency_release(CarSource src);
+
+// Wi-Fi 终端离开热点，UDP 控制的持续运动立即刹车（car_link.h）
+void car_station_left(void);
+void car_drive_mix(int linear, int turn, int *left_duty, int *right_duty);
+
+void get_car_state(struct car_state *state);
+
+// 状态快照发布后的通知回调，在控制任务中调用，不能阻塞
+typedef void (*car_state_notify_t)(void);
+void car_set_state_notify(car_state_notify_t notify);
+const char *car_status_name(unsigned int status);
+const char *car_speed_name(unsigned int speed);
+
+void get_car_loop_stats(struct car_loop_stats *stats);
+void reset_car_speed_jitter(void);
+
+int car_queue_segments(const struct car_segment *seg, unsigned int count, int replace);
+
+void pwm_init(void);
+void pwm_stop(void);
+void pwm_forward(void);
+void pwm_backward(void);
+void pwm_left(void);
+void pwm_right(void);
+void pwm_drive(int left_duty, int right_duty);
 
 #define IO_NAME_GPIO_0 0
 #define IO_NAME_GPIO_1 1
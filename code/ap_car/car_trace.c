@@ -0,0 +1,168 @@
+#include <stdio.h>
+
+#include "cmsis_os2.h"
+
+#include <hi_time.h>
+#include "car_test.h"
+#include "car_trace.h"
+
+// 单生产者单消费者环：head 只由生产者写，tail 只由排空任务写
+struct car_trace_ring
+{
+    unsigned int head;
+    unsigned int tail;
+    unsigned int dropped;
+    struct car_trace_rec rec[CAR_TRACE_RING_SIZE];
+};
+
+struct car_trace_desc
+{
+    unsigned char arg;
+    const char *fmt;
+};
+
+#define CAR_TRACE_DESC(name, arg, fmt) {arg, fmt},
+static const struct car_trace_desc car_trace_desc[CAR_EV_MAX] = {CAR_TRACE_EVENTS(CAR_TRACE_DESC)};
+#undef CAR_TRACE_DESC
+
+static struct car_trace_ring car_trace_rings[CAR_TRACE_RING_MAX];
+
+// 生产者：写一条记录，环满时丢弃
+void car_trace_write(unsigned int ring, unsigned int id, unsigned int a, unsigned int b, unsigned int c)
+{
+    struct car_trace_ring *r = &car_trace_rings[ring];
+    unsigned int head = r->head;
+    struct car_trace_rec *rec;
+
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= CAR_TRACE_RING_SIZE)
+    {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    rec = &r->rec[head & (CAR_TRACE_RING_SIZE - 1)];
+    rec->t_us = hi_get_us();
+    rec->id = id;
+    rec->a = a;
+    rec->b = b;
+    rec->c = c;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void car_trace_print(unsigned int ring, const struct car_trace_rec *rec)
+{
+    const struct car_trace_desc *desc;
+    char ip[16];
+
+    printf("[%u.%06u] %u ", rec->t_us / 1000000U, rec->t_us % 1000000U, ring);
+    if (rec->id >= CAR_EV_MAX)
+    {
+        printf("event %u\r\n", rec->id);
+        return;
+    }
+
+    desc = &car_trace_desc[rec->id];
+    if (desc->arg == CAR_TRACE_ARG_IP)
+    {
+        // 网络字节序：内存中第一个字节是地址的最高位
+        const unsigned char *p = (const unsigned char *)&rec->a;
+        snprintf(ip, sizeof(ip), "%u.%u.%u.%u", p[0], p[1], p[2], p[3]);
+        printf(desc->fmt, ip, rec->b, rec->c);
+    }
+    else
+    {
+        printf(desc->fmt, rec->a, rec->b, rec->c);
+    }
+    printf("\r\n");
+}
+
+// 排空任务：按时间顺序合并各个环并输出，返回输出的记录数
+unsigned int car_trace_drain(void)
+{
+    unsigned int heads[CAR_TRACE_RING_MAX];
+    unsigned int count = 0;
+    unsigned int i;
+
+    for (i = 0; i < CAR_TRACE_RING_MAX; i++)
+    {
+        heads[i] = __atomic_load_n(&car_trace_rings[i].head, __ATOMIC_ACQUIRE);
+    }
+
+    for (;;)
+    {
+        const struct car_trace_rec *oldest = NULL;
+        unsigned int ring = 0;
+
+        for (i = 0; i < CAR_TRACE_RING_MAX; i++)
+        {
+            struct car_trace_ring *r = &car_trace_rings[i];
+            const struct car_trace_rec *rec;
+
+            if (r->tail == heads[i])
+            {
+                continue;
+            }
+            rec = &r->rec[r->tail & (CAR_TRACE_RING_SIZE - 1)];
+            if (oldest == NULL || (int)(rec->t_us - oldest->t_us) < 0)
+            {
+                oldest = rec;
+                ring = i;
+            }
+        }
+        if (oldest == NULL)
+        {
+            return count;
+        }
+
+        car_trace_print(ring, oldest);
+        __atomic_store_n(&car_trace_rings[ring].tail, car_trace_rings[ring].tail + 1, __ATOMIC_RELEASE);
+        count++;
+    }
+}
+
+unsigned int car_trace_dropped(void)
+{
+    unsigned int dropped = 0;
+    unsigned int i;
+
+    for (i = 0; i < CAR_TRACE_RING_MAX; i++)
+    {
+        dropped += __atomic_load_n(&car_trace_rings[i].dropped, __ATOMIC_RELAXED);
+    }
+    return dropped;
+}
+
+static void car_trace_task(void *arg)
+{
+    unsigned int reported = 0;
+
+    (void)arg;
+    while (1)
+    {
+        osDelay(CAR_MS_TO_TICKS(CAR_TRACE_DRAIN_MS));
+        car_trace_drain();
+
+        unsigned int dropped = car_trace_dropped();
+        if (dropped != reported)
+        {
+            printf("[car_trace] %u records dropped\r\n", dropped - reported);
+            reported = dropped;
+        }
+    }
+}
+
+void car_trace_start(void)
+{
+#if CAR_TRACE_LEVEL > CAR_TRACE_LEVEL_OFF
+    osThreadAttr_t attr = {0};
+
+    attr.name = "car_trace";
+    attr.stack_size = 2048;
+    attr.priority = osPriorityLow;
+
+    if (osThreadNew(car_trace_task, NULL, &attr) == NULL)
+    {
+        printf("[car_trace] Failed to create drain task!\r\n");
+    }
+#endif
+}
@@ -0,0 +1,116 @@
+#ifndef __CAR_TRACE_H__
+#define __CAR_TRACE_H__
+
+/*
+ * 二进制跟踪记录，代替热路径上的 printf。
+ *
+ * 每条记录是定长的（时间戳、事件号、三个参数），写入生产者线程自己的环形
+ * 缓冲区：每个环只有一个写者和一个读者（排空任务），只用对齐字读写和内存
+ * 屏障，不加锁。低优先级的排空任务定期把记录按时间顺序格式化输出到串口。
+ * 环满时丢弃新记录并计数，生产者从不等待。
+ *
+ * 级别在编译时确定：高于 CAR_TRACE_LEVEL 的 CAR_TRACE_* 宏不产生任何代码。
+ */
+
+#define CAR_TRACE_LEVEL_OFF 0
+#define CAR_TRACE_LEVEL_ERR 1
+#define CAR_TRACE_LEVEL_INFO 2
+#define CAR_TRACE_LEVEL_DEBUG 3
+
+#ifndef CAR_TRACE_LEVEL
+#define CAR_TRACE_LEVEL CAR_TRACE_LEVEL_INFO
+#endif
+
+// 每个环的记录数，必须是 2 的幂
+#ifndef CAR_TRACE_RING_SIZE
+#define CAR_TRACE_RING_SIZE 64
+#endif
+
+// 排空周期
+#define CAR_TRACE_DRAIN_MS 200
+
+// 生产者：每个环只有一个写者
+typedef enum
+{
+    CAR_TRACE_RING_CTRL, // 控制任务
+    CAR_TRACE_RING_RECV, // UDP 网络任务：接收和指令
+    CAR_TRACE_RING_SEND, // UDP 网络任务：遥测
+    CAR_TRACE_RING_MAX
+} CarTraceRing;
+
+// 参数格式：全部按 %u/%d 输出，或第一个参数是网络字节序的 IPv4 地址
+#define CAR_TRACE_ARG_U 0
+#define CAR_TRACE_ARG_IP 1
+
+// 事件表：名字、参数格式、输出格式
+#define CAR_TRACE_EVENTS(X)                                                       \
+    X(CAR_EV_UDP_RX, CAR_TRACE_ARG_IP, "udp rx from %s:%u len=%u")                \
+    X(CAR_EV_UDP_CMD, CAR_TRACE_ARG_U, "cmd op=%u mode=%u speed=%u")             \
+    X(CAR_EV_UDP_BAD_FRAME, CAR_TRACE_ARG_U, "dropped frame err=%d len=%u")      \
+    X(CAR_EV_UDP_BAD_JSON, CAR_TRACE_ARG_U, "bad json len=%u")                   \
+    X(CAR_EV_UDP_RX_FAIL, CAR_TRACE_ARG_U, "rx failed err=%d")                   \
+    X(CAR_EV_UDP_REL_SKIP, CAR_TRACE_ARG_U, "reliable seq=%u not applied, result=%u") \
+    X(CAR_EV_UDP_CLIENT, CAR_TRACE_ARG_IP, "client %s:%u binary=%u")             \
+    X(CAR_EV_UDP_DRIVER, CAR_TRACE_ARG_IP, "driver %s:%u")                       \
+    X(CAR_EV_UDP_CLIENT_IDLE, CAR_TRACE_ARG_IP, "client %s:%u idle, role=%u")     \
+    X(CAR_EV_UDP_TX_JSON, CAR_TRACE_ARG_U, "tx json len=%u")                     \
+    X(CAR_EV_UDP_TX_STATE, CAR_TRACE_ARG_U, "tx state seq=%u len=%u")            \
+    X(CAR_EV_UDP_TX_NO_CLIENT, CAR_TRACE_ARG_U, "tx skipped, no client")         \
+    X(CAR_EV_UDP_TX_FAIL, CAR_TRACE_ARG_U, "tx failed ret=%d errno=%u")          \
+    X(CAR_EV_UDP_NET_RESET, CAR_TRACE_ARG_U, "sockets reset after %u failures")  \
+    X(CAR_EV_JSON_UNKNOWN, CAR_TRACE_ARG_U, "json unknown value key=%u len=%u")  \
+    X(CAR_EV_CAR_MOTION, CAR_TRACE_ARG_U, "motion %u -> %u speed=%u")            \
+    X(CAR_EV_CAR_STEP_STOP, CAR_TRACE_ARG_U, "step timeout, stop as %u")       \
+    X(CAR_EV_SEG_QUEUED, CAR_TRACE_ARG_U, "segments queued n=%u replace=%u")   \
+    X(CAR_EV_SEG_REJECTED, CAR_TRACE_ARG_U, "segments rejected n=%u free=%u")  \
+    X(CAR_EV_SEG_START, CAR_TRACE_ARG_U, "segment op=%u speed=%u ms=%u")       \
+    X(CAR_EV_SEG_DONE, CAR_TRACE_ARG_U, "segments done, late=%uus")           \
+    X(CAR_EV_CMD_HOLD, CAR_TRACE_ARG_U, "src=%u hold=%u holders=0x%x")        \
+    X(CAR_EV_CMD_REJECTED, CAR_TRACE_ARG_U, "src=%u status=%u rejected, holders=0x%x") \
+    X(CAR_EV_LINK_STAGE, CAR_TRACE_ARG_U, "link stage=%u silence=%ums status=%u") \
+    X(CAR_EV_BOOT_STAGE, CAR_TRACE_ARG_U, "boot stage=%u at %u.%03ums")
+
+#define CAR_TRACE_ENUM(name, arg, fmt) name,
+typedef enum
+{
+    CAR_TRACE_EVENTS(CAR_TRACE_ENUM)
+    CAR_EV_MAX
+} CarTraceEvent;
+#undef CAR_TRACE_ENUM
+
+struct car_trace_rec
+{
+    unsigned int t_us;
+    unsigned int id;
+    unsigned int a;
+    unsigned int b;
+    unsigned int c;
+};
+
+void car_trace_write(unsigned int ring, unsigned int id, unsigned int a, unsigned int b, unsigned int c);
+void car_trace_start(void);
+unsigned int car_trace_drain(void);
+unsigned int car_trace_dropped(void);
+
+#define CAR_TRACE_EMIT(ring, id, a, b, c) \
+    car_trace_write((ring), (id), (unsigned int)(a), (unsigned int)(b), (unsigned int)(c))
+
+#if CAR_TRACE_LEVEL >= CAR_TRACE_LEVEL_ERR
+#define CAR_TRACE_ERR(ring, id, a, b, c) CAR_TRACE_EMIT(ring, id, a, b, c)
+#else
+#define CAR_TRACE_ERR(ring, id, a, b, c) ((void)0)
+#endif
+
+#if CAR_TRACE_LEVEL >= CAR_TRACE_LEVEL_INFO
+#define CAR_TRACE_INFO(ring, id, a, b, c) CAR_TRACE_EMIT(ring, id, a, b, c)
+#else
+#define CAR_TRACE_INFO(ring, id, a, b, c) ((void)0)
+#endif
+
+#if CAR_TRACE_LEVEL >= CAR_TRACE_LEVEL_DEBUG
+#define CAR_TRACE_DEBUG(ring, id, a, b, c) CAR_TRACE_EMIT(ring, id, a, b, c)
+#else
+#define CAR_TRACE_DEBUG(ring, id, a, b, c) ((void)0)
+#endif
+
+#endif /* __CAR_TRACE_H__ */
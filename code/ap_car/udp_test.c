@@ -1,4 +1,5 @@
 #include "hi_wifi_api.h"
+#include "lwip/api.h"
 #include "lwip/ip_addr.h"
 #include "lwip/netifapi.h"
 #include "lwip/sockets.h"
@@ -8,381 +9,899 @@
 #include "ohos_init.h"
 #include <errno.h>
 #include "cmsis_os2.h"
-#include "cJSON.h"
+#include <hi_time.h>
 
 #include "car_test.h" // Assuming this header defines get_car_status, set_car_status, set_car_mode, and CAR_STATUS/MODE enums
+#include "car_proto.h"
+#include "car_ingress.h"
+#include "car_latency.h"
+#include "car_link.h"
+#include "car_reliable.h"
+#include "car_session.h"
+#include "car_trace.h"
+#include "car_boot.h"
+
+// The car listens for commands on UDP_CMD_PORT and sends telemetry from
+// UDP_STATUS_PORT (see car_session.h): binary sessions get it on their source
+// address and port, legacy JSON controllers on UDP_STATUS_PORT of their
+// address, where they have always listened. One network task owns both
+// connections.
+#define UDP_CMD_PORT 50001
+#define UDP_STATUS_PORT 50002
+
+// The network task stack: commands are decoded in place without cJSON and
+// telemetry frames are a few dozen bytes, printf is the deepest call
+#define UDP_NET_STACK_SIZE 4096
+#define UDP_NET_PRIORITY 36
+
+// Consecutive socket errors, receive or send, before both sockets are
+// closed and opened again, and the wait before retrying a failed open
+#define UDP_NET_MAX_FAILURES 10
+#define UDP_NET_RETRY_MS 100
+
+// Telemetry is event driven: the control task raises TELEMETRY_EVT_STATE
+// when it publishes a new car state and the network task sends it at once.
+// A full update goes out once per heartbeat, which also resynchronises a
+// controller that lost a delta frame.
+#define TELEMETRY_HEARTBEAT_MS 1000
+#define TELEMETRY_EVT_STATE 0x00000001U  // car state snapshot changed
+#define TELEMETRY_EVT_CLIENT 0x00000002U // a session needs a full update
+#define TELEMETRY_EVT_ACK 0x00000004U    // reliable command received, ack it
+#define TELEMETRY_EVT_ALL (TELEMETRY_EVT_STATE | TELEMETRY_EVT_CLIENT | TELEMETRY_EVT_ACK)
+#define UDP_EVT_RX 0x00000008U           // datagrams wait on the command connection
+#define UDP_NET_EVT_ALL (TELEMETRY_EVT_ALL | UDP_EVT_RX)
+
+// Datagrams taken from the connection per wakeup. Most of a flood is dropped
+// by the rate limit before decoding, so this is several times the queue size;
+// the queue is handled whenever it fills up during a drain.
+#define UDP_DRAIN_MAX (4 * CAR_INGRESS_QUEUE_SIZE)
+
+// Commands are decoded in the pbuf they arrived in. Only a datagram that
+// lwIP spread over a pbuf chain is copied out first; the longest valid one
+// is a binary frame with a full payload.
+#define UDP_RX_LINEAR_MAX (CAR_PROTO_MIN_LEN + CAR_PROTO_MAX_PAYLOAD)
+
+static osEventFlagsId_t net_event = NULL;
+static struct netconn *recv_conn = NULL; // Command connection
+static int send_sockfd = -1;             // Telemetry socket
+static unsigned char rx_linear[UDP_RX_LINEAR_MAX]; // Network task only
+static char stats_reply[512];                       // Network task only
 
-// Client address storage (for sending responses)
-// WARNING: This variable is shared between udp_thread and status_send_thread.
-// Without a mutex, there is a risk of race conditions and data corruption
-// if both threads access it concurrently.
-static struct sockaddr_in client_addr;
-static socklen_t client_addr_len = sizeof(client_addr);
-static int send_sockfd = -1; // Sending socket
-// Mutex removed as per user request.
-// static osMutexId_t client_addr_mutex = NULL; // Mutex to protect client_addr
-static int consecutive_failures = 0; // Consecutive send failure counter
-const int MAX_FAILURES = 10;         // Max consecutive failures before socket reset
-char recvline[1024];
+/**
+ * @brief Sends one datagram to the controller.
+ *
+ * @return The sendto() result, or -1 if the socket or the address is not set up.
+ */
+static int udp_send_to(const struct sockaddr_in *dest, const void *buf, int len)
+{
+    // Check if the sending socket is initialized and client address is known
+    if (send_sockfd < 0 || dest->sin_addr.s_addr == INADDR_ANY ||
+        dest->sin_port == 0) // Also check if port is set
+    {
+        CAR_TRACE_INFO(CAR_TRACE_RING_SEND, CAR_EV_UDP_TX_NO_CLIENT, 0, 0, 0);
+        return -1;
+    }
+
+    int ret = sendto(send_sockfd, buf, len, 0, (const struct sockaddr *)dest, sizeof(*dest));
+    if (ret < 0)
+    {
+        // Record the error; the trace task prints it later
+        CAR_TRACE_ERR(CAR_TRACE_RING_SEND, CAR_EV_UDP_TX_FAIL, ret, errno, 0);
+    }
+    return ret;
+}
+
+/**
+ * @brief Sends one datagram to a session's source address and port.
+ */
+static int udp_send_session(const struct car_session *session, const void *buf, int len)
+{
+    struct sockaddr_in dest;
+
+    car_session_addr(session, &dest);
+    return udp_send_to(&dest, buf, len);
+}
 
 /**
  * @brief Sends the car's current status via UDP.
  *
- * This function constructs a JSON string with the car's status and sends it
- * to the last known client address.
+ * This function constructs a JSON string with the car's status once and
+ * sends it to UDP_STATUS_PORT of every address with a session that speaks
+ * legacy JSON, once per address: a legacy controller that came back on a new
+ * source port still has its old session until it expires. Network task only.
  *
  * @param status A string representing the car's current status (e.g., "forward", "stop").
- * @return 0 on success, -1 on failure.
+ * @param left_tps Measured left wheel speed in encoder ticks per second.
+ * @param right_tps Measured right wheel speed in encoder ticks per second.
+ * @return The length sent, or -1 if there is no JSON session or a send failed.
  */
-int udp_send_car_status(const char *status, const char *speed)
+int udp_send_car_status(const char *status, const char *speed, int left_tps, int right_tps)
 {
-    printf("Enter udp_send_car_status, status: %s\n", status);
+    // Construct JSON format status data
+    char send_buf[128] = {0};
+    // Ensure the buffer is large enough for the JSON string
+    snprintf(send_buf, sizeof(send_buf), "{\"status\":\"%s\", \"speed\":\"%s\", \"left_tps\":%d, \"right_tps\":%d}",
+             status, speed, left_tps, right_tps);
+    int len = strlen(send_buf);
+    unsigned int dest_addr[CAR_SESSION_MAX];
+    unsigned char dest_ok[CAR_SESSION_MAX];
+    unsigned int dests = 0;
+    int sent = 0;
+    int failed = 0;
+    unsigned int i;
+
+    for (i = 0; i < CAR_SESSION_MAX; i++)
+    {
+        struct car_session *session = car_session_get(i);
+        struct sockaddr_in dest;
+        unsigned int j;
+        if (session == NULL || session->binary)
+        {
+            continue;
+        }
+        for (j = 0; j < dests && dest_addr[j] != session->addr; j++)
+        {
+        }
+        if (j < dests)
+        {
+            session->synced = dest_ok[j];
+            continue;
+        }
+        car_session_addr(session, &dest);
+        dest.sin_port = htons(UDP_STATUS_PORT);
+        dest_addr[dests] = session->addr;
+        dest_ok[dests] = udp_send_to(&dest, send_buf, len) >= 0;
+        session->synced = dest_ok[dests];
+        if (!dest_ok[dests++])
+        {
+            failed = 1;
+            continue;
+        }
+        sent = 1;
+        CAR_TRACE_DEBUG(CAR_TRACE_RING_SEND, CAR_EV_UDP_TX_JSON, len, 0, 0);
+    }
+    return sent && !failed ? len : -1;
+}
 
-    // Check if the sending socket is initialized and client address is known
-    if (send_sockfd < 0 || client_addr.sin_addr.s_addr == INADDR_ANY ||
-        client_addr.sin_port == 0) // Also check if port is set
+/**
+ * @brief Sends one binary telemetry frame to a session.
+ *
+ * @param frame The full or delta frame prepared for all sessions; only the
+ *              session's seq and ack are filled in here.
+ * @param ack   The session's reliable-command ack to send along, or NULL.
+ * @return 1 if the frame was sent, -1 on failure.
+ */
+static int udp_send_state(struct car_session *session, struct car_state_frame *frame, const struct car_ack *ack)
+{
+    // seq counts the frames this session was sent, so it sees its own gaps
+    int len = car_proto_state_finish(frame, session->tx_seq, ack);
+    if (udp_send_session(session, frame->buf, len) < 0)
     {
-        printf("UDP send not initialized or client address unknown/invalid\n");
         return -1;
     }
+    CAR_TRACE_DEBUG(CAR_TRACE_RING_SEND, CAR_EV_UDP_TX_STATE, session->tx_seq, len, 0);
+    session->tx_seq++;
+    return 1;
+}
 
-    // Construct JSON format status data
-    char send_buf[128] = {0};
-    // Ensure the buffer is large enough for the JSON string
-    snprintf(send_buf, sizeof(send_buf), "{\"status\":\"%s\", \"speed\":\"%s\"}", status, speed);
+/**
+ * @brief Control-task callback: a new car state snapshot was published.
+ */
+static void telemetry_notify(void)
+{
+    osEventFlagsSet(net_event, TELEMETRY_EVT_STATE);
+}
 
-    // WARNING: client_addr is accessed here without protection.
-    int ret = sendto(send_sockfd, send_buf, strlen(send_buf), 0,
-                     (struct sockaddr *)&client_addr, client_addr_len);
+// Telemetry state, owned by the network task
+struct udp_telemetry
+{
+    struct car_state sent;         // What the synced sessions last received
+    unsigned int next_heartbeat_us;
+    struct car_state_frame full;   // This step's frames, encoded once for all sessions
+    struct car_state_frame delta;
+};
 
-    if (ret < 0)
+/**
+ * @brief Sends telemetry to every session if the state changed, an ack is
+ * due, a session is not synced yet or the heartbeat is due.
+ *
+ * Legacy JSON sessions all get the same status string. Binary sessions get a
+ * delta against the state they all last received, or a full update while
+ * they are not synced; a session whose send fails is resynchronised later.
+ * The full and the delta frame are each encoded once, when the first session
+ * needs them, and only the session's seq and ack are filled in per session.
+ *
+ * @param flags The TELEMETRY_EVT_* events raised since the last call.
+ * @return 1 if something was sent, 0 if nothing was due or there is no
+ *         session yet, -1 if a send failed.
+ */
+static int udp_telemetry_step(struct udp_telemetry *tm, uint32_t flags, unsigned int now_us)
+{
+    int due = (int)(now_us - tm->next_heartbeat_us) >= 0;
+    if ((flags == 0 && !due) || car_session_count() == 0)
+    {
+        return 0;
+    }
+    if (due)
+    {
+        tm->next_heartbeat_us = now_us + TELEMETRY_HEARTBEAT_MS * 1000U;
+    }
+
+    // Take one snapshot so status and speed belong together
+    struct car_state state;
+    get_car_state(&state);
+
+    // Each frame is prepared when the first session needs it; delta_changed
+    // stays -1 until then
+    int have_full = 0;
+    int delta_changed = -1;
+
+    int json_due = due || state.cur_status != tm->sent.cur_status || state.speed != tm->sent.speed;
+    int sent = 0;
+    int failed = 0;
+    unsigned int i;
+    for (i = 0; i < CAR_SESSION_MAX; i++)
+    {
+        struct car_session *session = car_session_get(i);
+        if (session == NULL)
+        {
+            continue;
+        }
+        int full = due || !session->synced;
+        if (!session->binary)
+        {
+            json_due |= full;
+            continue;
+        }
+
+        // The session's ack goes out when it changed, and with every full update
+        struct car_ack rel;
+        const struct car_ack *ack = NULL;
+        if (session->rel.active && (full || session->rel.changed))
+        {
+            car_rel_get_ack(&session->rel, &rel);
+            ack = &rel;
+        }
+        if (full && !have_full)
+        {
+            // The link metrics only change slowly and ride along with the full updates
+            struct car_link_report link;
+            car_link_get_report(&link);
+            car_proto_state_prepare(&tm->full, &state, NULL, &link);
+            have_full = 1;
+        }
+        if (!full && delta_changed < 0)
+        {
+            delta_changed = car_proto_state_prepare(&tm->delta, &state, &tm->sent, NULL);
+        }
+        // A new ack is sent even if the state did not change
+        if (!full && !delta_changed && ack == NULL)
+        {
+            continue;
+        }
+        if (udp_send_state(session, full ? &tm->full : &tm->delta, ack) < 0)
+        {
+            session->synced = 0;
+            failed = 1;
+        }
+        else
+        {
+            session->synced = 1;
+            session->rel.changed = 0;
+            sent = 1;
+        }
+    }
+
+    // Legacy clients are only sent status and speed changes; the wheel
+    // speeds ride along and are refreshed by the heartbeat
+    if (json_due)
+    {
+        if (udp_send_car_status(car_status_name(state.cur_status), car_speed_name(state.speed), state.left_tps,
+                                state.right_tps) < 0)
+        {
+            failed = 1;
+        }
+        else
+        {
+            sent = 1;
+        }
+    }
+
+    // A session that missed this state is no longer synced and gets a full update
+    tm->sent = state;
+    return failed ? -1 : sent;
+}
+
+/* CarStopVariant -> the state that stops the car that way. */
+static const CarStatus udp_stop_status[CAR_STOP_MAX] = {
+    [CAR_STOP_NONE] = CAR_STATUS_STOP,
+    [CAR_STOP_RAMP] = CAR_STATUS_STOP,
+    [CAR_STOP_BRAKE] = CAR_STATUS_BRAKE,
+    [CAR_STOP_COAST] = CAR_STATUS_COAST,
+};
+
+/**
+ * @brief Applies a decoded command to the car.
+ *
+ * Mode, speed and the stop variant are set before the motion so the control
+ * task picks them up together with the status change. A stop variant also
+ * sets how later step-mode runs end.
+ *
+ * @param cmd Command decoded from a binary frame or a legacy JSON datagram.
+ */
+static void udp_apply_cmd(const struct car_cmd *cmd)
+{
+    CAR_TRACE_INFO(CAR_TRACE_RING_RECV, CAR_EV_UDP_CMD, cmd->op, cmd->mode, cmd->speed);
+
+    // A whole manoeuvre in one datagram, timed by the control task
+    if (cmd->op == CAR_OP_SEGMENTS)
+    {
+        struct car_segment seg[CAR_SEG_QUEUE_SIZE];
+        int append = 0;
+        int count = car_proto_get_segments(cmd, seg, CAR_SEG_QUEUE_SIZE, &append);
+        if (count < 0)
+        {
+            CAR_TRACE_ERR(CAR_TRACE_RING_RECV, CAR_EV_UDP_BAD_FRAME, count, cmd->payload_len, 0);
+            return;
+        }
+        car_queue_segments(seg, count, !append);
+        return;
+    }
+
+    if (cmd->mode < CAR_MODE_MAX)
+    {
+        set_car_mode(CAR_SRC_UDP, (CarMode)cmd->mode);
+    }
+    if (cmd->speed != 0)
+    {
+        set_car_speed(CAR_SRC_UDP, (CarSpeed)cmd->speed);
+    }
+    if (cmd->stop != CAR_STOP_NONE)
     {
-        // Print detailed error information if send fails
-        printf("Failed to send status: %d, errno=%d, %s\n",
-               ret, errno, strerror(errno));
+        set_car_stop_mode(CAR_SRC_UDP, udp_stop_status[cmd->stop]);
+    }
+    if (cmd->op == CAR_OP_DRIVE)
+    {
+        set_car_drive(CAR_SRC_UDP, cmd->linear, cmd->turn);
+    }
+    else if (cmd->op == CAR_OP_STOP && cmd->stop != CAR_STOP_NONE)
+    {
+        set_car_status(CAR_SRC_UDP, udp_stop_status[cmd->stop]);
+    }
+    else if (cmd->op <= CAR_OP_RIGHT)
+    {
+        set_car_status(CAR_SRC_UDP, (CarStatus)cmd->op);
+    }
+}
+
+/**
+ * @brief Answers a stats request with the command-path latency histograms.
+ *
+ * The reply goes to the address and port the request came from, in the
+ * request's format: a CAR_OP_STATS frame for binary requests, a JSON object
+ * such as {"stats":{"parse":{"n":10,"p50":4,"p90":6,"p99":9,"max":12},...}}
+ * for legacy ones. Binary requests may also clear the histograms.
+ */
+static void udp_reply_stats(const struct sockaddr_in *from, const struct car_cmd *cmd)
+{
+    struct car_lat_summary sum[CAR_LAT_MAX];
+    unsigned int stage;
+    int len;
+
+    for (stage = 0; stage < CAR_LAT_MAX; stage++)
+    {
+        car_lat_get(stage, &sum[stage]);
+    }
+
+    if (cmd->flags & CAR_CMD_F_BINARY)
+    {
+        len = car_proto_encode_stats((unsigned char *)stats_reply, sizeof(stats_reply), cmd->seq, sum, CAR_LAT_MAX);
+        if (cmd->payload_len > 0 && (cmd->payload[0] & CAR_STATS_F_RESET))
+        {
+            car_lat_reset();
+        }
     }
     else
     {
-        printf("Status sent successfully: %s to %s:%d\n", send_buf,
-               inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+        len = snprintf(stats_reply, sizeof(stats_reply), "{\"stats\":{");
+        for (stage = 0; stage < CAR_LAT_MAX && len < (int)sizeof(stats_reply); stage++)
+        {
+            len += snprintf(stats_reply + len, sizeof(stats_reply) - len,
+                            "%s\"%s\":{\"n\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}",
+                            stage > 0 ? "," : "", car_lat_name(stage), sum[stage].count, sum[stage].p50_us,
+                            sum[stage].p90_us, sum[stage].p99_us, sum[stage].max_us);
+        }
+        if (len < (int)sizeof(stats_reply))
+        {
+            len += snprintf(stats_reply + len, sizeof(stats_reply) - len, "}}");
+        }
+    }
+    if (len <= 0 || len >= (int)sizeof(stats_reply))
+    {
+        return;
     }
 
-    return ret; // Return the result of sendto
+    // The reply leaves from the command port, the data is not copied
+    struct netbuf *buf = netbuf_new();
+    ip_addr_t addr;
+    err_t err = ERR_MEM;
+    ip_addr_set_ip4_u32(&addr, from->sin_addr.s_addr);
+    if (buf != NULL && netbuf_ref(buf, stats_reply, (u16_t)len) == ERR_OK)
+    {
+        err = netconn_sendto(recv_conn, buf, &addr, ntohs(from->sin_port));
+    }
+    netbuf_delete(buf);
+    if (err != ERR_OK)
+    {
+        CAR_TRACE_ERR(CAR_TRACE_RING_RECV, CAR_EV_UDP_TX_FAIL, err, 0, 0);
+    }
 }
 
 /**
- * @brief Thread for periodically sending car status updates.
+ * @brief Decodes one datagram straight into an ingress queue entry.
  *
- * This thread initializes a UDP sending socket, binds it to a fixed port,
- * and then periodically sends the car's current status. It also includes logic
- * to reset the socket if too many consecutive send failures occur.
+ * @param data The datagram, in the pbuf it arrived in; only the payload of
+ *             the decoded command is copied, when the entry is committed.
+ */
+static void udp_decode(const unsigned char *data, int len, const struct sockaddr_in *from, unsigned int recv_us)
+{
+    struct car_ingress_entry *entry = car_ingress_reserve();
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    // Binary frames are told apart from legacy JSON by their first byte
+    int binary = len > 0 && data[0] == CAR_PROTO_MAGIC;
+    int err;
+    if (binary)
+    {
+        err = car_proto_decode(data, len, &entry->cmd);
+        if (err != CAR_PROTO_OK)
+        {
+            CAR_TRACE_ERR(CAR_TRACE_RING_RECV, CAR_EV_UDP_BAD_FRAME, err, len, 0);
+        }
+    }
+    else
+    {
+        err = car_proto_parse_json((const char *)data, len, &entry->cmd);
+        if (err != CAR_PROTO_OK)
+        {
+            CAR_TRACE_ERR(CAR_TRACE_RING_RECV, CAR_EV_UDP_BAD_JSON, len, 0, 0);
+        }
+    }
+    if (err != CAR_PROTO_OK)
+    {
+        car_ingress_count_bad();
+        return;
+    }
+
+    entry->from = *from;
+    entry->binary = binary;
+    entry->recv_us = recv_us;
+    entry->parsed_us = hi_get_us();
+    car_ingress_commit(entry);
+}
+
+/**
+ * @brief Takes one datagram from the command connection and queues it as a
+ * decoded command.
+ *
+ * Datagrams over the sender's rate (see car_ingress.h) are dropped before
+ * they are decoded. The netbuf is released as soon as it is decoded.
  *
- * @param arg Unused argument.
+ * @return 1 if a datagram was taken, 0 if none is waiting, -1 on failure.
  */
-void status_send_thread(void *arg)
+static int udp_receive(void)
 {
-    (void)arg; // Cast to void to suppress unused parameter warning
+    struct netbuf *buf;
+    err_t err = netconn_recv(recv_conn, &buf);
+    if (err == ERR_WOULDBLOCK)
+    {
+        return 0;
+    }
+    if (err != ERR_OK)
+    {
+        CAR_TRACE_ERR(CAR_TRACE_RING_RECV, CAR_EV_UDP_RX_FAIL, err, 0, 0);
+        return -1;
+    }
+    unsigned int recv_us = hi_get_us();
 
-    // Create sending socket
-    send_sockfd = socket(PF_INET, SOCK_DGRAM, 0);
-    if (send_sockfd < 0)
+    struct sockaddr_in from = {0};
+    from.sin_family = AF_INET;
+    from.sin_addr.s_addr = ip4_addr_get_u32(ip_2_ip4(netbuf_fromaddr(buf)));
+    from.sin_port = htons(netbuf_fromport(buf));
+    int total = netbuf_len(buf);
+
+    // Record client information, the payload itself is not kept
+    CAR_TRACE_DEBUG(CAR_TRACE_RING_RECV, CAR_EV_UDP_RX, from.sin_addr.s_addr, ntohs(from.sin_port), total);
+
+    if (car_ingress_admit(&from, recv_us))
     {
-        printf("Failed to create sending socket\n");
-        return; // Exit thread if socket creation fails
+        void *data = NULL;
+        u16_t len = 0;
+        netbuf_data(buf, &data, &len);
+        if (len < total)
+        {
+            // A pbuf chain: too long for any command, or linearised first
+            data = rx_linear;
+            len = total <= (int)sizeof(rx_linear) ? netbuf_copy(buf, rx_linear, sizeof(rx_linear)) : 0;
+        }
+        if (len == total)
+        {
+            udp_decode((const unsigned char *)data, len, &from, recv_us);
+        }
+        else
+        {
+            CAR_TRACE_ERR(CAR_TRACE_RING_RECV, CAR_EV_UDP_BAD_FRAME, CAR_PROTO_ERR_LEN, total, 0);
+            car_ingress_count_bad();
+        }
     }
+    netbuf_delete(buf);
+    return 1;
+}
 
-    struct sockaddr_in send_addr = {0};
-    send_addr.sin_family = AF_INET;
-    send_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    send_addr.sin_port = htons(50002); // Fixed sending port 50002 (car sends FROM this port)
+// The coalesced command waiting for its turn to be applied
+struct udp_pending
+{
+    struct car_cmd cmd;
+    unsigned int recv_us;   // of the newest command merged into it
+    unsigned int parsed_us;
+    int valid;
+};
 
-    // Removed: client_addr.sin_port = htons(50002);
-    // This line was incorrectly trying to set the *destination* port for status updates
-    // in the sending thread. The destination port should be set by the receiving thread
-    // based on the client's known listening port.
+static unsigned int udp_last_apply_us;
 
-    // Bind the sending socket
-    if (bind(send_sockfd, (struct sockaddr *)&send_addr, sizeof(send_addr)) < 0)
+/**
+ * @brief Applies a command taken from the ingress queue and records its
+ * apply latency.
+ */
+static void udp_apply_queued(const struct car_cmd *cmd, unsigned int recv_us, unsigned int parsed_us)
+{
+    car_set_origin(CAR_SRC_UDP, recv_us);
+    udp_apply_cmd(cmd);
+    udp_last_apply_us = hi_get_us();
+    car_lat_record(CAR_LAT_APPLY, udp_last_apply_us - parsed_us);
+    car_ingress_count_applied();
+    if (car_boot_mark(CAR_BOOT_FIRST_CMD))
     {
-        printf("Failed to bind sending port\n");
-        close(send_sockfd); // Close socket on bind failure
-        send_sockfd = -1;   // Invalidate socket descriptor
-        return;             // Exit thread
+        car_boot_trace(CAR_TRACE_RING_RECV);
     }
+}
 
-    printf("Status sending thread started\n");
+/**
+ * @brief Empties the ingress queue.
+ *
+ * Stats queries are answered right away. Stops and segments are applied
+ * at once, in order after whatever came before them. Every other command
+ * is folded into the pending one, so that only the newest motion is applied.
+ */
+static void udp_handle_queue(struct udp_pending *pending)
+{
+    struct car_ingress_entry *entry;
 
-    while (1)
+    while ((entry = car_ingress_peek()) != NULL)
     {
-        osDelay(500); // Send status every 500ms
+        // A stats query neither drives the car nor opens a session
+        if (entry->cmd.op == CAR_OP_STATS)
+        {
+            udp_reply_stats(&entry->from, &entry->cmd);
+            car_ingress_release();
+            continue;
+        }
 
-        // Check if socket needs to be reset due to too many failures
-        if (consecutive_failures >= MAX_FAILURES)
+        // Telemetry goes to every session; a new one gets a full update right away
+        struct car_session *session = car_session_touch(&entry->from, entry->binary, entry->recv_us);
+        if (!session->synced)
         {
-            printf("Too many consecutive failures, resetting socket\n");
-            if (send_sockfd >= 0)
-            {
-                close(send_sockfd);
-            }
+            osEventFlagsSet(net_event, TELEMETRY_EVT_CLIENT);
+        }
+        if (entry->cmd.op != CAR_OP_NOP)
+        {
+            car_session_drive(session);
+        }
+        // Only the driver, heartbeats and retransmissions included, keeps the link alive
+        if (session->role == CAR_ROLE_DRIVER)
+        {
+            car_link_rx(entry->from.sin_addr.s_addr, entry->from.sin_port, entry->binary, entry->cmd.seq,
+                        entry->recv_us);
+        }
+        car_lat_record(CAR_LAT_PARSE, entry->parsed_us - entry->recv_us);
 
-            // Attempt to recreate the socket
-            send_sockfd = socket(PF_INET, SOCK_DGRAM, 0);
-            if (send_sockfd < 0)
+        // Every reliable command is acked; retransmissions and commands
+        // overtaken by a newer one are not applied again
+        if (entry->cmd.flags & CAR_CMD_F_RELIABLE)
+        {
+            CarRelResult rel = car_rel_check(&session->rel, entry->cmd.seq);
+            osEventFlagsSet(net_event, TELEMETRY_EVT_ACK);
+            if (rel != CAR_REL_APPLY)
             {
-                printf("Failed to recreate socket\n");
-                consecutive_failures++; // Continue incrementing to prevent infinite loop if recreation consistently fails
-                continue;               // Skip sending this cycle
+                CAR_TRACE_DEBUG(CAR_TRACE_RING_RECV, CAR_EV_UDP_REL_SKIP, entry->cmd.seq, rel, 0);
+                car_ingress_release();
+                continue;
             }
-
-            // Rebind the new socket
-            if (bind(send_sockfd, (struct sockaddr *)&send_addr, sizeof(send_addr)) < 0)
+        }
+        // A stop is never folded into a later motion, and segments keep their order
+        if (entry->cmd.op == CAR_OP_STOP || entry->cmd.op == CAR_OP_SEGMENTS)
+        {
+            if (pending->valid)
             {
-                printf("Failed to rebind sending port after reset\n");
-                close(send_sockfd);
-                send_sockfd = -1;
-                consecutive_failures++;
-                continue;
+                udp_apply_queued(&pending->cmd, pending->recv_us, pending->parsed_us);
+                pending->valid = 0;
             }
-
-            consecutive_failures = 0; // Reset failure counter on successful socket reset
+            udp_apply_queued(&entry->cmd, entry->recv_us, entry->parsed_us);
         }
-
-        // Get current car status from car_test.h/c
-        char *status = get_car_status();
-        char *speed = get_car_speed();
-        if (status != NULL && speed != NULL)
+        else
         {
-            if (udp_send_car_status(status, speed) < 0)
+            if (pending->valid)
             {
-                consecutive_failures++; // Increment on send failure
+                car_ingress_coalesce(&pending->cmd, &entry->cmd);
             }
             else
             {
-                consecutive_failures = 0; // Reset on successful send
+                pending->cmd = entry->cmd;
+                pending->valid = 1;
             }
+            // Only segments use the payload, and the entry is about to be reused
+            pending->cmd.payload = NULL;
+            pending->cmd.payload_len = 0;
+            pending->recv_us = entry->recv_us;
+            pending->parsed_us = entry->parsed_us;
         }
+        car_ingress_release();
     }
 }
 
 /**
- * @brief Main UDP receiving thread for car control commands.
+ * @brief lwIP callback for the command connection, from the TCP/IP thread.
+ */
+static void udp_recv_notify(struct netconn *conn, enum netconn_evt evt, u16_t len)
+{
+    (void)conn;
+    (void)len;
+    if (evt == NETCONN_EVT_RCVPLUS)
+    {
+        osEventFlagsSet(net_event, UDP_EVT_RX);
+    }
+}
+
+/**
+ * @brief Closes the command connection and the telemetry socket.
+ */
+static void udp_net_close(void)
+{
+    if (recv_conn != NULL)
+    {
+        netconn_delete(recv_conn);
+        recv_conn = NULL;
+    }
+    if (send_sockfd >= 0)
+    {
+        close(send_sockfd);
+        send_sockfd = -1;
+    }
+}
+
+/**
+ * @brief Opens the command connection and the telemetry socket.
  *
- * This thread initializes a UDP receiving socket, binds it to port 50001,
- * and continuously listens for incoming commands. Upon receiving a command,
- * it parses the JSON data, updates the car's status or mode, and saves the
- * client's address for sending responses.
+ * Commands arrive on a netconn so that they can be decoded in the pbuf they
+ * arrived in; its callback wakes the network task. Telemetry goes out on a
+ * plain socket from UDP_STATUS_PORT.
  *
- * @param pdata Unused argument.
+ * @return 0 on success, -1 if either failed (both are closed then).
  */
-void udp_thread(void *pdata)
+static int udp_net_open(void)
 {
-    int ret;
-    struct sockaddr_in servaddr;
-    cJSON *recvjson;
-
-    (void)pdata; // Cast to void to suppress unused parameter warning
+    recv_conn = netconn_new_with_callback(NETCONN_UDP, udp_recv_notify);
+    if (recv_conn == NULL || netconn_bind(recv_conn, IP_ADDR_ANY, UDP_CMD_PORT) != ERR_OK)
+    {
+        printf("Failed to bind port %u\n", UDP_CMD_PORT);
+        udp_net_close();
+        return -1;
+    }
+    netconn_set_nonblocking(recv_conn, 1);
 
-    // Create receiving socket
-    int sockfd = socket(PF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0)
+    struct sockaddr_in addr = {0};
+    send_sockfd = socket(PF_INET, SOCK_DGRAM, 0);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(UDP_STATUS_PORT);
+    if (send_sockfd < 0 || bind(send_sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
     {
-        printf("Failed to create receiving socket\n");
-        return; // Exit thread on socket creation failure
+        printf("Failed to bind port %u\n", UDP_STATUS_PORT);
+        udp_net_close();
+        return -1;
     }
 
-    bzero(&servaddr, sizeof(servaddr)); // Clear server address structure
-    servaddr.sin_family = AF_INET;
-    servaddr.sin_addr.s_addr = htonl(INADDR_ANY); // Listen on all available interfaces
-    servaddr.sin_port = htons(50001);             // Listening port 50001 (car listens ON this port)
+    // Datagrams that arrived before the callback was set are picked up at once
+    osEventFlagsSet(net_event, UDP_EVT_RX);
+    car_boot_mark(CAR_BOOT_NET);
+    return 0;
+}
 
-    printf("UDP thread started\n");
+/**
+ * @brief How long the network task may wait for an event, in ticks.
+ *
+ * Until the pending command's apply slot or, while there is a session, the
+ * next heartbeat; no wait while datagrams are left from the last drain.
+ */
+static uint32_t udp_net_timeout(const struct udp_pending *pending, const struct udp_telemetry *tm, int rx_more,
+                                unsigned int now_us)
+{
+    int wait_us = -1;
 
-    // Bind the receiving socket
-    ret = bind(sockfd, (struct sockaddr *)&servaddr, sizeof(servaddr));
-    if (ret < 0)
+    if (rx_more)
     {
-        printf("Failed to bind socket\n");
-        close(sockfd); // Close socket on bind failure
-        return;        // Exit thread
+        return 0;
     }
-
-    while (1)
+    if (car_session_count() != 0)
     {
-        struct sockaddr_in addrClient;
-        socklen_t sizeClientAddr = sizeof(struct sockaddr_in); // Use socklen_t for size
-
-        // Initialize receive buffer before each recvfrom call
-        memset(recvline, 0, sizeof(recvline));
+        wait_us = (int)(tm->next_heartbeat_us - now_us);
+        wait_us = wait_us < 0 ? 0 : wait_us;
+    }
+    if (pending->valid)
+    {
+        int slot_us = (int)(CAR_INGRESS_APPLY_MS * 1000U - (now_us - udp_last_apply_us));
+        slot_us = slot_us < 0 ? 0 : slot_us;
+        wait_us = wait_us < 0 || slot_us < wait_us ? slot_us : wait_us;
+    }
+    if (wait_us < 0)
+    {
+        return osWaitForever;
+    }
+    return CAR_MS_TO_TICKS((wait_us + 999) / 1000);
+}
 
-        // Receive data from any client
-        ret = recvfrom(sockfd, recvline, sizeof(recvline) - 1, 0,
-                       (struct sockaddr *)&addrClient, &sizeClientAddr); // Pass pointer to socklen_t
+/**
+ * @brief Sends every session a full update next, after the sockets were reset.
+ */
+static void udp_unsync_sessions(void)
+{
+    unsigned int i;
 
-        if (ret > 0)
+    for (i = 0; i < CAR_SESSION_MAX; i++)
+    {
+        struct car_session *session = car_session_get(i);
+        if (session != NULL)
         {
-            recvline[ret] = '\0'; // Null-terminate the received string
-            char *pClientIP = inet_ntoa(addrClient.sin_addr);
+            session->synced = 0;
+        }
+    }
+}
 
-            // Print client information and received data
-            printf("Client %s:%d says: %s\n", pClientIP, ntohs(addrClient.sin_port), recvline);
+/**
+ * @brief The network task.
+ *
+ * One task owns both connections and waits on one event group: datagrams
+ * on the command connection, a new car state from the control task, and
+ * the pending command's apply slot or the heartbeat as the timeout. Each
+ * wakeup takes every datagram that has arrived (up to UDP_DRAIN_MAX) into
+ * the ingress queue, decoded in place as a binary frame (see car_proto.h)
+ * or legacy JSON data, and coalesces the queue into one command whenever
+ * it is full and once the drain is done. That
+ * command is applied at most once per CAR_INGRESS_APPLY_MS, stops right
+ * away, so a flooding controller cannot keep the control task busy. Every
+ * sender of a command gets a session (car_session.h) and telemetry, which
+ * is sent from the same loop; idle sessions are dropped there too.
+ *
+ * Errors on either connection are counted together; after
+ * UDP_NET_MAX_FAILURES in a row both are opened again.
+ *
+ * @param pdata Unused argument.
+ */
+void udp_net_task(void *pdata)
+{
+    struct udp_pending pending = {0};
+    struct udp_telemetry tm = {0};
+    unsigned int failures = 0;
+    int rx_more = 0; // The last drain stopped at UDP_DRAIN_MAX
 
-            // WARNING: client_addr is written here without protection.
-            // This can lead to race conditions if status_send_thread is reading it concurrently.
-            // Only copy the IP address and family from the incoming packet.
-            client_addr.sin_addr = addrClient.sin_addr;
-            client_addr.sin_family = addrClient.sin_family;
-            client_addr_len = sizeClientAddr; // Keep the length, though it's usually constant for IPv4
+    (void)pdata; // Cast to void to suppress unused parameter warning
 
-            // *** CRITICAL FIX: Explicitly set the destination port for status updates
-            // to the known C# client listening port (50002).
-            // This ensures status is sent to the correct port on the client. ***
-            client_addr.sin_port = htons(50002);
+    printf("UDP network task started\n");
 
-            // Print the saved client address for verification
-            char client_ip_str[INET_ADDRSTRLEN]; // Buffer for IP address string
-            inet_ntop(AF_INET, &client_addr.sin_addr, client_ip_str, sizeof(client_ip_str));
-            printf("Saved client address for status updates: %s:%d\n",
-                   client_ip_str, ntohs(client_addr.sin_port));
+    udp_last_apply_us = hi_get_us() - CAR_INGRESS_APPLY_MS * 1000U;
+    tm.next_heartbeat_us = hi_get_us();
+    while (1)
+    {
+        if (failures >= UDP_NET_MAX_FAILURES)
+        {
+            printf("Too many consecutive failures, resetting sockets\n");
+            CAR_TRACE_ERR(CAR_TRACE_RING_RECV, CAR_EV_UDP_NET_RESET, failures, 0, 0);
+            udp_net_close();
+            udp_unsync_sessions();
+            failures = 0;
+        }
+        if (recv_conn == NULL && udp_net_open() < 0)
+        {
+            osDelay(CAR_MS_TO_TICKS(UDP_NET_RETRY_MS));
+            continue;
+        }
 
-            // Parse received JSON command
-            recvjson = cJSON_Parse(recvline);
-            if (recvjson != NULL)
-            {
-                cJSON *cmd = cJSON_GetObjectItem(recvjson, "cmd");
-                if (cmd != NULL && cJSON_IsString(cmd) && cmd->valuestring != NULL)
-                {
-                    printf("Command received: %s\n", cmd->valuestring);
-
-                    // Process car control commands
-                    if (strcmp("forward", cmd->valuestring) == 0)
-                    {
-                        set_car_status(CAR_STATUS_FORWARD);
-                        printf("Moving forward\n");
-                    }
-                    else if (strcmp("backward", cmd->valuestring) == 0)
-                    {
-                        set_car_status(CAR_STATUS_BACKWARD);
-                        printf("Moving backward\n");
-                    }
-                    else if (strcmp("left", cmd->valuestring) == 0)
-                    {
-                        set_car_status(CAR_STATUS_LEFT);
-                        printf("Turning left\n");
-                    }
-                    else if (strcmp("right", cmd->valuestring) == 0)
-                    {
-                        set_car_status(CAR_STATUS_RIGHT);
-                        printf("Turning right\n");
-                    }
-                    else if (strcmp("stop", cmd->valuestring) == 0)
-                    {
-                        set_car_status(CAR_STATUS_STOP);
-                        printf("Stopped\n");
-                    }
-                    else
-                    {
-                        printf("Unknown command: %s\n", cmd->valuestring);
-                    }
-                }
+        uint32_t flags = osEventFlagsWait(net_event, UDP_NET_EVT_ALL, osFlagsWaitAny,
+                                          udp_net_timeout(&pending, &tm, rx_more, hi_get_us()));
+        if (flags & osFlagsError)
+        {
+            flags = 0; // Timed out
+        }
 
-                cJSON *mode = cJSON_GetObjectItem(recvjson, "mode");
-                if (mode != NULL && cJSON_IsString(mode) && mode->valuestring != NULL)
+        // Take whatever has arrived without blocking
+        if ((flags & UDP_EVT_RX) || rx_more)
+        {
+            int i;
+            for (i = 0; i < UDP_DRAIN_MAX; i++)
+            {
+                int ret = udp_receive();
+                if (ret < 0)
                 {
-                    // Process car mode commands
-                    if (strcmp("step", mode->valuestring) == 0)
-                    {
-                        set_car_mode(CAR_MODE_STEP);
-                        printf("Mode set to STEP\n");
-                    }
-                    else if (strcmp("alway", mode->valuestring) == 0) // Note: "alway" might be a typo, should it be "always"?
-                    {
-                        set_car_mode(CAR_MODE_ALWAY);
-                        printf("Mode set to ALWAY\n");
-                    }
-                    else
-                    {
-                        printf("Unknown mode: %s\n", mode->valuestring);
-                    }
+                    failures++;
                 }
-
-                cJSON *speed = cJSON_GetObjectItem(recvjson, "speed");
-                if (speed != NULL && cJSON_IsString(speed) && speed->valuestring != NULL)
+                if (ret <= 0)
                 {
-                    printf("Speed received: %s\n", speed->valuestring);
-
-                    // 根据收到的speed值设置对应的车速
-                    if (strcmp("low", speed->valuestring) == 0)
-                    {
-                        set_car_speed(CAR_SPEED_LOW);
-                        printf("Speed set to low\n");
-                    }
-                    else if (strcmp("medium", speed->valuestring) == 0)
-                    {
-                        set_car_speed(CAR_SPEED_MEDIUM);
-                        printf("Speed set to medium\n");
-                    }
-                    else if (strcmp("high", speed->valuestring) == 0)
-                    {
-                        set_car_speed(CAR_SPEED_HIGH);
-                        printf("Speed set to high\n");
-                    }
-                    else
-                    {
-                        // 未知车速时默认设为中速
-                        set_car_speed(CAR_SPEED_MEDIUM);
-                        printf("Unknown speed: %s, default to medium\n", speed->valuestring);
-                    }
+                    break;
                 }
-                else
+                failures = 0;
+                // Make room before the next datagram, so that no command, a
+                // stop least of all, is dropped for lack of a queue entry
+                if (car_ingress_full())
                 {
-                    // 如果没有收到speed字段，默认使用中速
-                    set_car_speed(CAR_SPEED_MEDIUM);
-                    printf("No speed received, default to medium\n");
+                    udp_handle_queue(&pending);
                 }
-
-                cJSON_Delete(recvjson); // Free cJSON object
-            }
-            else
-            {
-                printf("Failed to parse JSON: %s\n", recvline);
             }
+            rx_more = i == UDP_DRAIN_MAX;
         }
-        else if (ret < 0)
+
+        udp_handle_queue(&pending);
+        unsigned int now_us = hi_get_us();
+        car_session_expire(now_us);
+        if (pending.valid && now_us - udp_last_apply_us >= CAR_INGRESS_APPLY_MS * 1000U)
         {
-            printf("recvfrom failed: errno=%d, %s\n", errno, strerror(errno));
-            // Depending on the error, you might want to close and recreate the socket,
-            // or add a delay to prevent a tight loop on persistent errors.
-            osDelay(100); // Add a small delay to prevent busy-waiting on errors
+            udp_apply_queued(&pending.cmd, pending.recv_us, pending.parsed_us);
+            pending.valid = 0;
+        }
+
+        // Events raised during this wakeup, by this task or the control task
+        uint32_t more = osEventFlagsClear(net_event, TELEMETRY_EVT_ALL);
+        if (!(more & osFlagsError))
+        {
+            flags |= more;
+        }
+        int ret = udp_telemetry_step(&tm, flags & TELEMETRY_EVT_ALL, now_us);
+        if (ret < 0)
+        {
+            failures++;
+        }
+        else if (ret > 0)
+        {
+            failures = 0;
         }
-        // If ret == 0, it means the connection was gracefully closed, which is unlikely for UDP.
     }
 }
 
 /**
- * @brief Starts the UDP receiving and status sending threads.
+ * @brief Starts the UDP network task.
  *
- * This function creates and launches two threads: one for receiving UDP commands
- * and another for periodically sending car status updates.
+ * It runs in the control task, which is also where the state-change
+ * callback is called from.
  */
 void start_udp_thread(void)
 {
-    osThreadAttr_t attr_recv = {0}; // Initialize to zero
-    attr_recv.name = "udp_recv_thread";
-    attr_recv.stack_size = 10240; // Sufficient stack size for UDP operations and cJSON parsing
-    attr_recv.priority = 36;      // High priority for command reception
-
-    if (osThreadNew((osThreadFunc_t)udp_thread, NULL, &attr_recv) == NULL)
+    net_event = osEventFlagsNew(NULL);
+    if (net_event == NULL)
     {
-        printf("[CarControl] Failed to create UDP receiving thread!\n");
+        printf("[CarControl] Failed to create telemetry events!\n");
+        return;
     }
+    car_set_state_notify(telemetry_notify);
 
-    osThreadAttr_t attr_send = {0}; // Initialize to zero
-    attr_send.name = "status_send_thread";
-    attr_send.stack_size = 10240;               // Sufficient stack size
-    attr_send.priority = osPriorityBelowNormal; // Lower priority for periodic status updates
+    osThreadAttr_t attr = {0}; // Initialize to zero
+    attr.name = "udp_net_task";
+    attr.stack_size = UDP_NET_STACK_SIZE;
+    attr.priority = UDP_NET_PRIORITY; // High priority for command reception
 
-    if (osThreadNew((osThreadFunc_t)status_send_thread, NULL, &attr_send) == NULL)
+    if (osThreadNew((osThreadFunc_t)udp_net_task, NULL, &attr) == NULL)
     {
-        printf("[CarControl] Failed to create status sending thread!\n");
+        printf("[CarControl] Failed to create UDP network task!\n");
     }
 }
@@ -0,0 +1,162 @@
+/*
+ * Boot timeline: from power-on to the first command a controller gets
+ * through. The simulated Wi-Fi service reports the hotspot up after
+ * wifi_ms; the bench then joins as a station and sends a forward command
+ * every millisecond until the motors start.
+ *
+ * Reports the application's boot timeline (car_boot.h) and what the bench
+ * saw from outside: the first motor HAL write (outputs initialised), the
+ * hotspot coming up and the first command at the HAL, all in ms since
+ * sim_start(). Checks that every boot stage was reached, that the motors
+ * and the command port were ready before the hotspot came up and that the
+ * first command reached the motors within one control tick of the station
+ * joining.
+ *
+ *   ./build/bench_boot [wifi_ms]
+ *
+ * The car binds its ports with SIM_BIND_PORT_OFFSET (default 10000).
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_boot.h"
+#include "car_proto.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "sim_hal.h"
+#include "wifi_hotspot.h"
+
+#define CMD_PORT 50001
+#define WAIT_MS 2000
+/* One control tick: the 10 ms kernel tick the control timers run on. */
+#define TICK_US (CAR_STEP_TICK_MS * 1000U)
+
+static const unsigned char station_mac[6] = { 0x02, 0x00, 0x5e, 0x00, 0x00, 0x01 };
+
+static volatile int ap_up;
+static uint64_t ap_up_ns;
+static uint64_t motors_ns;
+static volatile int cmd_armed;
+static uint64_t cmd_ns;
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int is_motor_port(unsigned int port)
+{
+    return port == HI_PWM_PORT_PWM0 || port == HI_PWM_PORT_PWM1 || port == HI_PWM_PORT_PWM3 ||
+           port == HI_PWM_PORT_PWM4;
+}
+
+/* HAL hook: the first motor write (init) and the first motor start after the station joined. */
+static void on_hal(const struct sim_hal_event *ev, void *ctx)
+{
+    (void)ctx;
+    if ((ev->type != SIM_HAL_PWM_START && ev->type != SIM_HAL_PWM_STOP) || !is_motor_port(ev->id)) {
+        return;
+    }
+    if (motors_ns == 0) {
+        motors_ns = ev->t_ns;
+    }
+    if (ev->type == SIM_HAL_PWM_START && cmd_armed) {
+        cmd_ns = ev->t_ns;
+        __atomic_store_n(&cmd_armed, 0, __ATOMIC_RELEASE);
+    }
+}
+
+static void on_hotspot_state(int state)
+{
+    if (state == WIFI_HOTSPOT_ACTIVE && !ap_up) {
+        ap_up_ns = sim_now_ns();
+        __atomic_store_n(&ap_up, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static WifiEvent bench_listener = {
+    .OnHotspotStateChanged = on_hotspot_state,
+};
+
+static double ms_since(uint64_t t0_ns, uint64_t ns)
+{
+    return ns == 0 ? -1.0 : (double)(ns - t0_ns) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    const char *wifi_ms = argc > 1 ? argv[1] : "300";
+    struct car_boot_timeline tl;
+    struct sockaddr_in car_addr;
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    struct car_cmd cmd;
+    uint64_t t0_ns;
+    uint64_t join_ns;
+    unsigned int waited = 0;
+    unsigned short seq = 0;
+    unsigned int i;
+    int all_stages = 1;
+    int ok;
+    int len;
+    int fd;
+    FILE *out;
+
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", wifi_ms, 1);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = CAR_OP_FORWARD;
+    cmd.mode = CAR_MODE_ALWAY;
+
+    sim_hal_set_hook(on_hal, NULL);
+    RegisterWifiEvent(&bench_listener);
+    t0_ns = sim_now_ns();
+    sim_start();
+
+    while (!__atomic_load_n(&ap_up, __ATOMIC_ACQUIRE) && waited++ < WAIT_MS) {
+        sleep_ms(1);
+    }
+    /* A controller joins as soon as the hotspot is up and starts driving. */
+    sim_wifi_station_join(station_mac);
+    join_ns = sim_now_ns();
+    __atomic_store_n(&cmd_armed, 1, __ATOMIC_RELEASE);
+    for (waited = 0; __atomic_load_n(&cmd_armed, __ATOMIC_ACQUIRE) && waited < WAIT_MS; waited++) {
+        cmd.seq = seq++;
+        len = car_proto_encode(frame, sizeof(frame), &cmd);
+        sendto(fd, frame, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+        sleep_ms(1);
+    }
+    close(fd);
+    sleep_ms(20);
+    car_boot_get(&tl);
+
+    fprintf(out, "{\"bench\":\"boot\",\"wifi_ms\":%s,\"timeline_ms\":{", wifi_ms);
+    for (i = 0; i < CAR_BOOT_MAX; i++) {
+        fprintf(out, "%s\"%s\":%.1f", i ? "," : "", car_boot_name(i),
+                tl.us[i] ? (double)(tl.us[i] - (unsigned int)(t0_ns / 1000ULL)) / 1e3 : -1.0);
+        all_stages &= tl.us[i] != 0;
+    }
+    fprintf(out, "},\"motors_ms\":%.1f,\"ap_up_ms\":%.1f,\"join_ms\":%.1f,\"first_cmd_ms\":%.1f", ms_since(t0_ns, motors_ns),
+            ms_since(t0_ns, ap_up_ns), ms_since(t0_ns, join_ns), ms_since(t0_ns, cmd_ns));
+    fprintf(out, ",\"join_to_first_cmd_ms\":%.2f}\n", cmd_ns ? (double)(cmd_ns - join_ns) / 1e6 : -1.0);
+    fclose(out);
+
+    ok = all_stages && motors_ns != 0 && motors_ns < ap_up_ns && tl.us[CAR_BOOT_NET] < tl.us[CAR_BOOT_AP_UP] &&
+         cmd_ns != 0 && cmd_ns - join_ns <= TICK_US * 1000ULL;
+    _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,339 @@
+/*
+ * Stop variants: runs step-mode forward moves at high speed that end with a
+ * ramp, brake or coast stop ({"cmd":"forward","mode":"step","speed":"high",
+ * "stop":"brake"}), rebuilds what each wheel's inputs did from the writes
+ * seen by the simulated HAL and checks the sequence:
+ *
+ *   - ramp:          the duty ramps down to zero, then both inputs go to
+ *                    CAR_MOTOR_STOP_LEVEL,
+ *   - brake, coast:  straight from driving to both inputs at
+ *                    CAR_MOTOR_STOP_LEVEL. The board's L9110S gives the same
+ *                    output for both, so the two must look the same here.
+ *
+ * A first-order motor model (time constants below) turns the input sequence
+ * into a speed trace, which gives the stopping distance from the nominal end
+ * of the step and its spread over the runs. Stop latency is measured from
+ * that nominal end (first driving write + CAR_STEP_TIME_MS) to the first
+ * write that stops driving.
+ *
+ *   ./build/bench_brake [runs]
+ *
+ * Exits non-zero on any sequencing error.
+ */
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_motor.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define MAX_SAMPLES 1024
+/* HAL writes closer together than this belong to one output change. */
+#define BURST_GAP_NS 1000000ULL
+#define SETTLE_MS 800
+
+/* Motor model: speed at full duty, and time constants driving and stopped. */
+#define MODEL_TOP_SPEED_MM_S 1000.0
+#define MODEL_TAU_DRIVE_S 0.100
+#define MODEL_TAU_STOP_S 0.020
+#define MODEL_DT_S 0.0001
+
+enum wheel_mode {
+    WHEEL_DRIVE,
+    WHEEL_STOP,
+    WHEEL_OTHER, /* pins half way through an output change */
+};
+
+struct sample {
+    uint64_t t_ns;
+    unsigned char mode;
+    int duty;
+};
+
+struct wheel_trace {
+    unsigned int fwd_port;
+    unsigned int rev_port;
+    unsigned int fwd_gpio;
+    unsigned int rev_gpio;
+    unsigned int count;
+    struct sample samples[MAX_SAMPLES];
+};
+
+static struct wheel_trace wheels[CAR_WHEEL_MAX] = {
+    { HI_PWM_PORT_PWM4, HI_PWM_PORT_PWM3, 1, 0, 0, { { 0, 0, 0 } } },
+    { HI_PWM_PORT_PWM1, HI_PWM_PORT_PWM0, 10, 9, 0, { { 0, 0, 0 } } },
+};
+
+/* What the hook has seen so far; the boot-time stop leaves every input high. */
+static unsigned int pwm_duty[SIM_PWM_NUM];
+static unsigned char pin_func[SIM_GPIO_NUM];
+static unsigned char pin_level[SIM_GPIO_NUM] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+
+struct variant {
+    const char *name;
+    int ramp; /* the duty ramps down before the inputs stop */
+};
+
+static const struct variant variants[] = {
+    { "ramp", 1 },
+    { "brake", 0 },
+    { "coast", 0 },
+};
+
+#define VARIANT_NUM (sizeof(variants) / sizeof(variants[0]))
+
+static void wheel_state(const struct wheel_trace *w, unsigned char *mode, int *duty)
+{
+    *duty = 0;
+    if (pwm_duty[w->fwd_port] != 0 && pwm_duty[w->rev_port] == 0) {
+        *mode = WHEEL_DRIVE;
+        *duty = (int)pwm_duty[w->fwd_port];
+    } else if (pwm_duty[w->rev_port] != 0 && pwm_duty[w->fwd_port] == 0) {
+        *mode = WHEEL_DRIVE;
+        *duty = -(int)pwm_duty[w->rev_port];
+    } else if (pwm_duty[w->fwd_port] != 0 || pin_func[w->fwd_gpio] != 0 || pin_func[w->rev_gpio] != 0) {
+        *mode = WHEEL_OTHER;
+    } else if (pin_level[w->fwd_gpio] == CAR_MOTOR_STOP_LEVEL && pin_level[w->rev_gpio] == CAR_MOTOR_STOP_LEVEL) {
+        *mode = WHEEL_STOP;
+    } else {
+        *mode = WHEEL_OTHER;
+    }
+}
+
+/* HAL hook, called from the control task: one sample per HAL write. */
+static void on_hal(const struct sim_hal_event *ev, void *ctx)
+{
+    unsigned int i;
+
+    (void)ctx;
+    switch (ev->type) {
+    case SIM_HAL_PWM_START:
+        pwm_duty[ev->id] = ev->value;
+        break;
+    case SIM_HAL_PWM_STOP:
+        pwm_duty[ev->id] = 0;
+        break;
+    case SIM_HAL_IO_FUNC:
+        pin_func[ev->id] = (unsigned char)ev->value;
+        break;
+    case SIM_HAL_GPIO_OUT:
+        pin_level[ev->id] = (unsigned char)ev->value;
+        break;
+    default:
+        return;
+    }
+    for (i = 0; i < CAR_WHEEL_MAX; i++) {
+        struct wheel_trace *w = &wheels[i];
+        unsigned int n = w->count;
+
+        if (n < MAX_SAMPLES) {
+            w->samples[n].t_ns = ev->t_ns;
+            wheel_state(w, &w->samples[n].mode, &w->samples[n].duty);
+            __atomic_store_n(&w->count, n + 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* Keeps the last sample of every burst of writes: the settled output states. */
+static unsigned int settled(const struct wheel_trace *w, struct sample *out)
+{
+    unsigned int n = __atomic_load_n(&w->count, __ATOMIC_ACQUIRE);
+    unsigned int m = 0;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        if (i + 1 == n || w->samples[i + 1].t_ns - w->samples[i].t_ns > BURST_GAP_NS) {
+            out[m++] = w->samples[i];
+        }
+    }
+    return m;
+}
+
+struct run_result {
+    double latency_ms;
+    double distance_mm;
+    int ok;
+};
+
+/* Integrates the model over the settled states; distance counts from t_end on. */
+static double model_distance(const struct sample *s, unsigned int n, uint64_t t_end, uint64_t t_stop)
+{
+    double v = 0;
+    double dist = 0;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        uint64_t t = s[i].t_ns;
+        uint64_t next = i + 1 < n ? s[i + 1].t_ns : t_stop;
+
+        for (; t < next; t += (uint64_t)(MODEL_DT_S * 1e9)) {
+            if (s[i].mode == WHEEL_DRIVE) {
+                v += ((double)s[i].duty / 65535.0 * MODEL_TOP_SPEED_MM_S - v) / MODEL_TAU_DRIVE_S * MODEL_DT_S;
+            } else {
+                v -= v / MODEL_TAU_STOP_S * MODEL_DT_S;
+            }
+            if (t >= t_end) {
+                dist += v * MODEL_DT_S;
+            }
+        }
+    }
+    return dist;
+}
+
+static int check_wheel(const char *name, const struct variant *var, const struct wheel_trace *w, struct run_result *r)
+{
+    static struct sample s[MAX_SAMPLES];
+    unsigned int n = settled(w, s);
+    unsigned int first_drive = n;
+    unsigned int stop = n;
+    uint64_t t_end;
+    int prev_duty;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        if (s[i].mode == WHEEL_DRIVE && first_drive == n) {
+            first_drive = i;
+        }
+        if (first_drive < n && s[i].mode == WHEEL_DRIVE && s[i].duty == CAR_SPEED_HIGH) {
+            stop = i + 1;
+        }
+    }
+    if (stop >= n) {
+        fprintf(stderr, "%s %s: never reached full speed and stopped\n", var->name, name);
+        return 0;
+    }
+    t_end = s[first_drive].t_ns + (uint64_t)CAR_STEP_TIME_MS * 1000000ULL;
+    r->latency_ms = ((double)s[stop].t_ns - (double)t_end) / 1e6;
+    r->distance_mm = model_distance(s, n, t_end, s[n - 1].t_ns + (uint64_t)SETTLE_MS * 1000000ULL);
+
+    prev_duty = CAR_SPEED_HIGH;
+    for (i = stop; i < n; i++) {
+        if (var->ramp && s[i].mode == WHEEL_DRIVE && s[i].duty > 0 && s[i].duty < prev_duty) {
+            prev_duty = s[i].duty;
+            continue;
+        }
+        break;
+    }
+    if (i == stop && var->ramp) {
+        fprintf(stderr, "ramp %s: stopped without ramping down\n", name);
+        return 0;
+    }
+    if (i >= n || s[i].mode != WHEEL_STOP) {
+        fprintf(stderr, "%s %s: wrong stop state\n", var->name, name);
+        return 0;
+    }
+    if (i + 1 != n) {
+        fprintf(stderr, "%s %s: %u extra output changes after stopping\n", var->name, name, n - i - 1);
+        return 0;
+    }
+    return 1;
+}
+
+struct stats {
+    double sum;
+    double sum_sq;
+    double min;
+    double max;
+    unsigned int n;
+};
+
+static void stats_add(struct stats *s, double v)
+{
+    if (s->n == 0 || v < s->min) {
+        s->min = v;
+    }
+    if (s->n == 0 || v > s->max) {
+        s->max = v;
+    }
+    s->sum += v;
+    s->sum_sq += v * v;
+    s->n++;
+}
+
+static double stats_sd(const struct stats *s)
+{
+    double mean = s->sum / s->n;
+    double var = s->sum_sq / s->n - mean * mean;
+
+    return var > 0 ? sqrt(var) : 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int runs = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 3U;
+    struct sockaddr_in car_addr = { 0 };
+    unsigned int failures = 0;
+    unsigned int v;
+    unsigned int run;
+    int fd;
+    FILE *out;
+
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+
+    sim_hal_set_hook(on_hal, NULL);
+    sim_start();
+    sleep_ms(500);
+
+    fprintf(out, "{\"bench\":\"brake\",\"runs\":%u", runs);
+    for (v = 0; v < VARIANT_NUM; v++) {
+        struct stats latency = { 0, 0, 0, 0, 0 };
+        struct stats distance = { 0, 0, 0, 0, 0 };
+
+        for (run = 0; run < runs; run++) {
+            struct run_result left;
+            struct run_result right;
+            char json[96];
+            int len;
+
+            __atomic_store_n(&wheels[CAR_WHEEL_LEFT].count, 0, __ATOMIC_RELEASE);
+            __atomic_store_n(&wheels[CAR_WHEEL_RIGHT].count, 0, __ATOMIC_RELEASE);
+            len = snprintf(json, sizeof(json), "{\"cmd\":\"forward\",\"mode\":\"step\",\"speed\":\"high\",\"stop\":\"%s\"}",
+                           variants[v].name);
+            sendto(fd, json, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+            sleep_ms(CAR_STEP_TIME_MS + SETTLE_MS);
+
+            if (!check_wheel("left", &variants[v], &wheels[CAR_WHEEL_LEFT], &left) ||
+                !check_wheel("right", &variants[v], &wheels[CAR_WHEEL_RIGHT], &right)) {
+                failures++;
+                continue;
+            }
+            stats_add(&latency, left.latency_ms > right.latency_ms ? left.latency_ms : right.latency_ms);
+            stats_add(&distance, (left.distance_mm + right.distance_mm) / 2);
+        }
+        if (distance.n == 0) {
+            continue;
+        }
+        fprintf(out, ",\"%s\":{\"stop_latency_ms_mean\":%.1f,\"stop_latency_ms_max\":%.1f", variants[v].name,
+                latency.sum / latency.n, latency.max);
+        fprintf(out, ",\"stop_dist_mm_mean\":%.1f,\"stop_dist_mm_sd\":%.2f,\"stop_dist_mm_spread\":%.2f}",
+                distance.sum / distance.n, stats_sd(&distance), distance.max - distance.min);
+    }
+    fprintf(out, ",\"failures\":%u}\n", failures);
+    fclose(out);
+    _exit(failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,197 @@
+/*
+ * Differential drive: checks car_drive_mix() against known vectors, then
+ * sweeps joystick commands (binary CAR_OP_DRIVE and JSON "drive") through
+ * the running application and compares the per-wheel PWM outputs recorded
+ * by the simulated HAL with the mix. Reports command-to-PWM latency.
+ *
+ *   ./build/bench_drive
+ *
+ * Exits non-zero on any mismatch.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_motor.h"
+#include "car_proto.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define SETTLE_TIMEOUT_NS 300000000ULL
+
+struct mix_vector {
+    int linear;
+    int turn;
+    int left;
+    int right;
+};
+
+static const struct car_motor_limits no_ramp = { 0, 0, 0, 0 };
+
+static const struct mix_vector mix_vectors[] = {
+    { 0, 0, 0, 0 },
+    { 1000, 0, CAR_DUTY_MAX, CAR_DUTY_MAX },
+    { -1000, 0, -CAR_DUTY_MAX, -CAR_DUTY_MAX },
+    { 0, 1000, CAR_DUTY_MAX, -CAR_DUTY_MAX },
+    { 1000, 1000, CAR_DUTY_MAX, 0 },
+    { 500, 250, 48000, 16000 },
+    { -1000, 500, -21333, -CAR_DUTY_MAX },
+    { 2000, 0, CAR_DUTY_MAX, CAR_DUTY_MAX },
+};
+
+static const int sweep_linear[] = { -1000, -600, -150, 0, 300, 1000 };
+static const int sweep_turn[] = { -1000, -400, 0, 250, 1000 };
+
+static int cmd_fd;
+static struct sockaddr_in car_addr;
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static void send_drive(int linear, int turn, int binary, unsigned short seq)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN + CAR_PROTO_DRIVE_LEN];
+    unsigned char payload[CAR_PROTO_DRIVE_LEN];
+    char json[96];
+    struct car_cmd cmd;
+    int len;
+
+    if (!binary) {
+        len = snprintf(json, sizeof(json), "{\"cmd\":\"drive\",\"mode\":\"alway\",\"linear\":%d,\"turn\":%d}", linear,
+                       turn);
+        sendto(cmd_fd, json, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+        return;
+    }
+    payload[0] = (unsigned char)(linear & 0xFF);
+    payload[1] = (unsigned char)((linear >> 8) & 0xFF);
+    payload[2] = (unsigned char)(turn & 0xFF);
+    payload[3] = (unsigned char)((turn >> 8) & 0xFF);
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.seq = seq;
+    cmd.op = CAR_OP_DRIVE;
+    cmd.mode = CAR_MODE_ALWAY;
+    cmd.payload = payload;
+    cmd.payload_len = sizeof(payload);
+    len = car_proto_encode(frame, sizeof(frame), &cmd);
+    sendto(cmd_fd, frame, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+}
+
+/* One wheel matches a signed duty: only the port for its direction runs, at |duty|. */
+static int wheel_matches(unsigned int fwd_port, unsigned int rev_port, int duty)
+{
+    struct sim_pwm_state fwd;
+    struct sim_pwm_state rev;
+
+    sim_pwm_get(fwd_port, &fwd);
+    sim_pwm_get(rev_port, &rev);
+    if (duty > 0) {
+        return fwd.running && fwd.duty == (unsigned int)duty && !rev.running;
+    }
+    if (duty < 0) {
+        return rev.running && rev.duty == (unsigned int)-duty && !fwd.running;
+    }
+    return !fwd.running && !rev.running;
+}
+
+static int outputs_match(int left, int right)
+{
+    return wheel_matches(HI_PWM_PORT_PWM4, HI_PWM_PORT_PWM3, left) &&
+           wheel_matches(HI_PWM_PORT_PWM1, HI_PWM_PORT_PWM0, right);
+}
+
+int main(void)
+{
+    unsigned int mix_fail = 0;
+    unsigned int pwm_fail = 0;
+    unsigned int checks = 0;
+    double sum_us = 0;
+    double max_us = 0;
+    unsigned short seq = 0;
+    unsigned int i;
+    unsigned int j;
+    int binary;
+    FILE *out;
+
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(mix_vectors) / sizeof(mix_vectors[0]); i++) {
+        int left;
+        int right;
+
+        car_drive_mix(mix_vectors[i].linear, mix_vectors[i].turn, &left, &right);
+        if (left != mix_vectors[i].left || right != mix_vectors[i].right) {
+            fprintf(stderr, "mix(%d, %d) = (%d, %d), want (%d, %d)\n", mix_vectors[i].linear, mix_vectors[i].turn,
+                    left, right, mix_vectors[i].left, mix_vectors[i].right);
+            mix_fail++;
+        }
+    }
+
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+    cmd_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+
+    /* Outputs jump straight to their targets; the ramp has its own bench. */
+    car_motor_set_limits(&no_ramp);
+    sim_start();
+    sleep_ms(500);
+
+    for (binary = 0; binary <= 1; binary++) {
+        for (i = 0; i < sizeof(sweep_linear) / sizeof(sweep_linear[0]); i++) {
+            for (j = 0; j < sizeof(sweep_turn) / sizeof(sweep_turn[0]); j++) {
+                int linear = sweep_linear[i];
+                int turn = sweep_turn[j];
+                int left;
+                int right;
+                uint64_t t0;
+
+                car_drive_mix(linear, turn, &left, &right);
+                t0 = sim_now_ns();
+                send_drive(linear, turn, binary, ++seq);
+                while (!outputs_match(left, right) && sim_now_ns() - t0 < SETTLE_TIMEOUT_NS) {
+                    struct timespec ts = { 0, 20000 };
+                    nanosleep(&ts, NULL);
+                }
+                checks++;
+                if (!outputs_match(left, right)) {
+                    fprintf(stderr, "%s drive(%d, %d): PWM does not show (%d, %d)\n", binary ? "binary" : "json",
+                            linear, turn, left, right);
+                    pwm_fail++;
+                    continue;
+                }
+                double us = (double)(sim_now_ns() - t0) / 1000.0;
+                sum_us += us;
+                if (us > max_us) {
+                    max_us = us;
+                }
+                /* Let the outputs of this command settle before the next one. */
+                sleep_ms(5);
+            }
+        }
+    }
+
+    fprintf(out, "{\"bench\":\"drive\",\"mix_vectors\":%u,\"mix_failures\":%u,\"pwm_checks\":%u,\"pwm_failures\":%u",
+            (unsigned int)(sizeof(mix_vectors) / sizeof(mix_vectors[0])), mix_fail, checks, pwm_fail);
+    if (checks > pwm_fail) {
+        fprintf(out, ",\"cmd_to_pwm_us_mean\":%.0f,\"cmd_to_pwm_us_max\":%.0f", sum_us / (checks - pwm_fail), max_us);
+    }
+    fprintf(out, "}\n");
+    fclose(out);
+    _exit(mix_fail == 0 && pwm_fail == 0 ? 0 : 1);
+}
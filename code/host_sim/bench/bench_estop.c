@@ -0,0 +1,274 @@
+/*
+ * Board keys as a local command source under a UDP packet flood. Flood
+ * threads send "forward, alway, high" binary frames to the car as fast as
+ * the socket takes them, while the bench presses the keys through the
+ * scripted ADC source:
+ *
+ *   - S1 press: emergency stop. Measured from the press to the first motor
+ *     write that stops driving (key debounce included), and from the key
+ *     task's post to that write (the control task's per-source latency,
+ *     which must stay within one control tick);
+ *   - while the stop is held the flood's forward commands must not restart
+ *     the motors;
+ *   - S1 long press releases the hold and the flood drives the car again.
+ *
+ * Then, without the flood, S2 must step the speed and S3 toggle the mode.
+ *
+ *   ./build/bench_estop [presses] [flood_threads]
+ *
+ * The car binds its ports with SIM_BIND_PORT_OFFSET (default 10000). Exits
+ * non-zero when a stop is missed or late, the hold leaks or a key is ignored.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "adc_key.h"
+#include "car_proto.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define IDLE_CODE 4095
+#define MAX_PRESSES 64
+#define MAX_FLOODS 8
+#define STOP_TIMEOUT_MS 200
+#define HOLD_CHECK_MS 300
+#define RESUME_TIMEOUT_MS 200
+/* One control tick: the 10 ms kernel tick the control timers run on. */
+#define LOCAL_LATENCY_MAX_US (CAR_STEP_TICK_MS * 1000U)
+
+/* Codes in the middle of each key's window, as in bench_keys. */
+#define S1_CODE 284
+#define S2_CODE 540
+#define S3_CODE 85
+
+static struct sockaddr_in car_addr;
+static volatile int flood_on;
+static volatile int flood_quit;
+static unsigned long flood_sent;
+
+static volatile int stop_armed;
+static uint64_t stop_ns;
+static unsigned int starts_while_held;
+static volatile int held;
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int is_motor_port(unsigned int port)
+{
+    return port == HI_PWM_PORT_PWM0 || port == HI_PWM_PORT_PWM1 || port == HI_PWM_PORT_PWM3 ||
+           port == HI_PWM_PORT_PWM4;
+}
+
+/* HAL hook: the first PWM stop after a press, and PWM starts while the stop is held. */
+static void on_hal(const struct sim_hal_event *ev, void *ctx)
+{
+    (void)ctx;
+    if (!is_motor_port(ev->id)) {
+        return;
+    }
+    if (ev->type == SIM_HAL_PWM_STOP && stop_armed) {
+        stop_ns = ev->t_ns;
+        __atomic_store_n(&stop_armed, 0, __ATOMIC_RELEASE);
+    } else if (ev->type == SIM_HAL_PWM_START && held) {
+        __atomic_add_fetch(&starts_while_held, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void *flood_thread(void *arg)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    struct car_cmd cmd;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int len;
+
+    (void)arg;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = CAR_OP_FORWARD;
+    cmd.mode = CAR_MODE_ALWAY;
+    cmd.speed = CAR_SPEED_HIGH;
+    len = car_proto_encode(frame, sizeof(frame), &cmd);
+    while (!flood_quit) {
+        if (!flood_on) {
+            sleep_ms(1);
+            continue;
+        }
+        if (sendto(fd, frame, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr)) == len) {
+            __atomic_add_fetch(&flood_sent, 1, __ATOMIC_RELAXED);
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static int motors_running(void)
+{
+    struct sim_pwm_state fwd;
+    struct sim_pwm_state rev;
+
+    sim_pwm_get(HI_PWM_PORT_PWM4, &fwd);
+    sim_pwm_get(HI_PWM_PORT_PWM1, &rev);
+    return fwd.running && rev.running;
+}
+
+/* Polls cond every millisecond for up to timeout_ms. */
+static int wait_for(int (*cond)(void), unsigned int timeout_ms)
+{
+    unsigned int i;
+
+    for (i = 0; i < timeout_ms; i++) {
+        if (cond()) {
+            return 1;
+        }
+        sleep_ms(1);
+    }
+    return cond();
+}
+
+static int stop_seen(void)
+{
+    return !__atomic_load_n(&stop_armed, __ATOMIC_ACQUIRE);
+}
+
+static void press(unsigned short code, unsigned long hold_ms)
+{
+    sim_adc_set(ADC_KEY_CHANNEL, code);
+    sleep_ms(hold_ms);
+    sim_adc_set(ADC_KEY_CHANNEL, IDLE_CODE);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int presses = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 10U;
+    unsigned int floods = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 2U;
+    static double stop_ms[MAX_PRESSES];
+    pthread_t flood[MAX_FLOODS];
+    struct car_loop_stats stats;
+    struct car_state before;
+    struct car_state after;
+    unsigned int missed = 0;
+    unsigned int leaks = 0;
+    unsigned int stuck = 0;
+    unsigned int n = 0;
+    unsigned int speed_ok;
+    unsigned int mode_ok;
+    uint64_t flood_start;
+    uint64_t flood_ns = 0;
+    unsigned int i;
+    int ok;
+    FILE *out;
+
+    presses = presses > MAX_PRESSES ? MAX_PRESSES : presses;
+    floods = floods > MAX_FLOODS ? MAX_FLOODS : floods;
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+
+    sim_adc_set(ADC_KEY_CHANNEL, IDLE_CODE);
+    sim_hal_set_hook(on_hal, NULL);
+    sim_start();
+    sleep_ms(500);
+    for (i = 0; i < floods; i++) {
+        pthread_create(&flood[i], NULL, flood_thread, NULL);
+    }
+
+    for (i = 0; i < presses; i++) {
+        /* Flooded and driving. */
+        flood_start = sim_now_ns();
+        flood_on = 1;
+        if (!wait_for(motors_running, RESUME_TIMEOUT_MS)) {
+            stuck++;
+        }
+        sleep_ms(50 + (unsigned long)(rand() % ADC_KEY_SAMPLE_MS));
+
+        /* S1: emergency stop. */
+        __atomic_store_n(&stop_armed, 1, __ATOMIC_RELEASE);
+        uint64_t pressed = sim_now_ns();
+        sim_adc_set(ADC_KEY_CHANNEL, S1_CODE);
+        if (wait_for(stop_seen, STOP_TIMEOUT_MS)) {
+            stop_ms[n++] = (double)(stop_ns - pressed) / 1e6;
+        } else {
+            missed++;
+        }
+        sleep_ms(50);
+        sim_adc_set(ADC_KEY_CHANNEL, IDLE_CODE);
+
+        /* The flood must not restart the motors while the stop is held. */
+        held = 1;
+        sleep_ms(HOLD_CHECK_MS);
+        held = 0;
+        if (motors_running()) {
+            leaks++;
+        }
+
+        /* S1 long press: release; the flood drives again. */
+        press(S1_CODE, ADC_KEY_LONG_MS + 100);
+        if (!wait_for(motors_running, RESUME_TIMEOUT_MS)) {
+            stuck++;
+        }
+        flood_on = 0;
+        flood_ns += sim_now_ns() - flood_start;
+        sleep_ms(20);
+    }
+    leaks += __atomic_load_n(&starts_while_held, __ATOMIC_RELAXED);
+    get_car_loop_stats(&stats);
+
+    /* Local speed and mode switch, no flood. */
+    sleep_ms(100);
+    get_car_state(&before);
+    press(S2_CODE, 60);
+    sleep_ms(50);
+    press(S3_CODE, 60);
+    sleep_ms(50);
+    get_car_state(&after);
+    speed_ok = after.speed != before.speed;
+    mode_ok = after.mode != before.mode;
+
+    flood_quit = 1;
+    for (i = 0; i < floods; i++) {
+        pthread_join(flood[i], NULL);
+    }
+
+    fprintf(out, "{\"bench\":\"estop\",\"presses\":%u,\"flood_threads\":%u,\"flood_pkts_per_s\":%.0f", presses, floods,
+            flood_ns > 0 ? (double)flood_sent * 1e9 / (double)flood_ns : 0.0);
+    if (n > 0) {
+        qsort(stop_ms, n, sizeof(stop_ms[0]), cmp_double);
+        fprintf(out, ",\"press_to_stop_ms_p50\":%.1f,\"press_to_stop_ms_max\":%.1f", stop_ms[n / 2], stop_ms[n - 1]);
+    }
+    fprintf(out, ",\"key_cmds\":%u,\"key_post_to_pwm_us_max\":%u,\"udp_cmds\":%u,\"udp_post_to_pwm_us_max\":%u",
+            stats.src_commands[CAR_SRC_KEY], stats.src_max_latency_us[CAR_SRC_KEY], stats.src_commands[CAR_SRC_UDP],
+            stats.src_max_latency_us[CAR_SRC_UDP]);
+    fprintf(out, ",\"rejected\":%u,\"missed\":%u,\"hold_leaks\":%u,\"not_resumed\":%u,\"speed_key\":%u,\"mode_key\":%u}\n",
+            stats.rejected, missed, leaks, stuck, speed_ok, mode_ok);
+    fclose(out);
+
+    ok = missed == 0 && leaks == 0 && stuck == 0 && speed_ok && mode_ok && stats.rejected > 0 &&
+         stats.src_max_latency_us[CAR_SRC_KEY] <= LOCAL_LATENCY_MAX_US;
+    _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,359 @@
+/*
+ * UDP ingress under a packet flood (car_ingress.h). A controller drives the
+ * running car forward at 100 Hz; after a quiet phase a second sender floods
+ * the car with the same forward frame at flood_pps, first from one source
+ * port and then rotating over FLOOD_PORTS ports, as a sender dodging the
+ * per-sender limit would. The motor ramp is turned off so that stops write
+ * the outputs from the control task.
+ *
+ * Per phase the bench reports the control task's wakeups per second, the
+ * speed-loop periods that were off by more than one control tick and the
+ * worst period jitter within the phase (the maximum is reset at the start
+ * of each phase), and checks that:
+ *
+ *   - the flood adds at most one wakeup per CAR_INGRESS_APPLY_MS,
+ *   - the speed loop keeps its period: the flood phase has at most one
+ *     period in LATE_SHARE more off by a control tick than the quiet phase.
+ *     A single late period is the host scheduler, which shows them in the
+ *     quiet phase too on a loaded or single-CPU host, so the maximum jitter
+ *     is reported but not checked,
+ *   - the flood sender is rate limited and the commands that pass are
+ *     coalesced rather than applied one by one, and none of them is
+ *     dropped for lack of an ingress queue entry,
+ *   - rotating the source port gets no more through than the total budget
+ *     allows on top of the controller's own commands,
+ *   - stop commands from the controller still reach the motor HAL within
+ *     one control tick of sendto() while the rotating flood goes on.
+ *
+ * Before the car starts, car_ingress_admit() is called directly with a new
+ * source port every NEW_GAP_US for NEW_SECONDS, on made-up timestamps: the
+ * new-sender budget must still refill at CAR_INGRESS_NEW_RATE when the calls
+ * come closer together than it adds a token unit.
+ *
+ *   ./build/bench_flood [seconds] [flood_pps]
+ *
+ * The car binds its ports with SIM_BIND_PORT_OFFSET (default 10000).
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_ingress.h"
+#include "car_motor.h"
+#include "car_proto.h"
+#include "car_speed.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define CONTROL_HZ 100
+#define STOPS 20
+#define STOP_GAP_MS 50
+#define STOP_TIMEOUT_MS 200
+/* One control tick: the 10 ms kernel tick the control timers run on. */
+#define TICK_US (CAR_STEP_TICK_MS * 1000U)
+#define APPLY_PER_S (1000U / CAR_INGRESS_APPLY_MS)
+#define FLOOD_PORTS 16
+#define LATE_SHARE 10
+#define NEW_GAP_US 40
+#define NEW_SECONDS 2
+
+/* Without the ramp every dispatch writes the motor outputs at once. */
+static const struct car_motor_limits no_ramp = { 0, 0, 0, 0 };
+
+static struct sockaddr_in car_addr;
+static volatile int control_on;
+static volatile int flood_on;
+static volatile int flood_rotate;
+static volatile int quit;
+static unsigned int flood_pps;
+static unsigned long flood_sent;
+
+static volatile int stop_armed;
+static uint64_t stop_ns;
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int is_motor_port(unsigned int port)
+{
+    return port == HI_PWM_PORT_PWM0 || port == HI_PWM_PORT_PWM1 || port == HI_PWM_PORT_PWM3 ||
+           port == HI_PWM_PORT_PWM4;
+}
+
+/* HAL hook: the first motor PWM stop after a stop command was sent. */
+static void on_hal(const struct sim_hal_event *ev, void *ctx)
+{
+    (void)ctx;
+    if (ev->type == SIM_HAL_PWM_STOP && is_motor_port(ev->id) && stop_armed) {
+        stop_ns = ev->t_ns;
+        __atomic_store_n(&stop_armed, 0, __ATOMIC_RELEASE);
+    }
+}
+
+static int encode(unsigned char *frame, size_t size, unsigned short seq, unsigned char op)
+{
+    struct car_cmd cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.seq = seq;
+    cmd.op = op;
+    cmd.mode = CAR_MODE_ALWAY;
+    cmd.speed = CAR_SPEED_HIGH;
+    return car_proto_encode(frame, size, &cmd);
+}
+
+/* The controller: forward at CONTROL_HZ while control_on. */
+static void *control_thread(void *arg)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    int fd = *(const int *)arg;
+    unsigned short seq = 0;
+
+    while (!quit) {
+        if (control_on) {
+            int len = encode(frame, sizeof(frame), seq++, CAR_OP_FORWARD);
+            sendto(fd, frame, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+        }
+        sleep_ms(1000 / CONTROL_HZ);
+    }
+    return NULL;
+}
+
+/* The flood: forward frames from another port, or from FLOOD_PORTS in turn, paced to flood_pps. */
+static void *flood_thread(void *arg)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    int fds[FLOOD_PORTS];
+    unsigned short seq = 0;
+    uint64_t start = 0;
+    unsigned long sent = 0;
+
+    (void)arg;
+    for (int i = 0; i < FLOOD_PORTS; i++) {
+        fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    }
+    while (!quit) {
+        if (!flood_on) {
+            start = 0;
+            sleep_ms(1);
+            continue;
+        }
+        if (start == 0) {
+            start = sim_now_ns();
+            sent = 0;
+        }
+        /* Send in bursts of 10 and sleep until the next burst is due. */
+        if (sent * 1000000000ULL >= (sim_now_ns() - start) * flood_pps) {
+            usleep(100);
+            continue;
+        }
+        for (int i = 0; i < 10; i++) {
+            int len = encode(frame, sizeof(frame), seq++, CAR_OP_FORWARD);
+            int fd = fds[flood_rotate ? sent % FLOOD_PORTS : 0];
+            if (sendto(fd, frame, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr)) == len) {
+                __atomic_add_fetch(&flood_sent, 1, __ATOMIC_RELAXED);
+            }
+            sent++;
+        }
+    }
+    for (int i = 0; i < FLOOD_PORTS; i++) {
+        close(fds[i]);
+    }
+    return NULL;
+}
+
+/* New senders recorded by the ingress, one per call, with the calls NEW_GAP_US apart. */
+static unsigned int new_senders_admitted(void)
+{
+    struct car_ingress_stats before;
+    struct car_ingress_stats after;
+    struct sockaddr_in from;
+    unsigned int t;
+
+    memset(&from, 0, sizeof(from));
+    from.sin_family = AF_INET;
+    from.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1);
+    car_ingress_get_stats(&before);
+    for (t = 0; t < NEW_SECONDS * 1000000U; t += NEW_GAP_US) {
+        from.sin_port = htons((unsigned short)(t / NEW_GAP_US));
+        car_ingress_admit(&from, t);
+    }
+    car_ingress_get_stats(&after);
+    return (after.received - before.received) - (after.new_limited - before.new_limited);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int seconds = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 1U;
+    static double stop_us[STOPS];
+    pthread_t control;
+    pthread_t flood;
+    struct car_loop_stats s0;
+    struct car_loop_stats s1;
+    struct car_loop_stats s2;
+    struct car_ingress_stats i1;
+    struct car_ingress_stats i2;
+    struct car_ingress_stats i3;
+    unsigned int rotate_admitted;
+    unsigned int rotate_max;
+    unsigned int new_admitted;
+    unsigned int new_min;
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    unsigned long sent_before;
+    unsigned long sent_flood;
+    double quiet_wps;
+    unsigned int quiet_late;
+    unsigned int flood_late;
+    double flood_wps;
+    double flood_rx_pps;
+    double stop_p50 = 0.0;
+    double stop_max = 0.0;
+    unsigned int missed = 0;
+    unsigned int n = 0;
+    unsigned int i;
+    int ok;
+    int fd;
+    FILE *out;
+
+    flood_pps = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 10000U;
+    seconds = seconds == 0 ? 1 : seconds;
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    /* The budget starts empty at time 0: its refill over NEW_SECONDS, less the token due at the end. */
+    new_admitted = new_senders_admitted();
+    new_min = NEW_SECONDS * CAR_INGRESS_NEW_RATE - 1;
+
+    sim_hal_set_hook(on_hal, NULL);
+    car_motor_set_limits(&no_ramp);
+    sim_start();
+    sleep_ms(500);
+    pthread_create(&control, NULL, control_thread, &fd);
+    pthread_create(&flood, NULL, flood_thread, NULL);
+
+    /* Quiet phase: the controller alone, after the speed loop has started. */
+    control_on = 1;
+    sleep_ms(200);
+    get_car_loop_stats(&s0);
+    reset_car_speed_jitter();
+    sleep_ms(seconds * 1000UL);
+    get_car_loop_stats(&s1);
+    reset_car_speed_jitter();
+
+    /* Flood phase. */
+    car_ingress_get_stats(&i1);
+    sent_before = flood_sent;
+    flood_on = 1;
+    sleep_ms(seconds * 1000UL);
+    get_car_loop_stats(&s2);
+    car_ingress_get_stats(&i2);
+    sent_flood = flood_sent - sent_before;
+    flood_rx_pps = (double)(i2.received - i1.received) / seconds;
+
+    /* Rotating flood: the same rate spread over FLOOD_PORTS source ports. */
+    flood_rotate = 1;
+    sleep_ms(seconds * 1000UL);
+    car_ingress_get_stats(&i3);
+    rotate_admitted = (i3.received - i2.received) - (i3.rate_limited - i2.rate_limited);
+    /*
+     * The controller's commands and the total budget the flood ports draw on
+     * once their buckets are below half, plus the half buckets they start
+     * from and a tick's worth of the controller's commands at the edges.
+     */
+    rotate_max = seconds * (CONTROL_HZ + CAR_INGRESS_TOTAL_RATE) + CAR_INGRESS_TOTAL_BURST +
+                 CAR_INGRESS_SENDERS * CAR_INGRESS_BURST / 2 + CONTROL_HZ / 10;
+
+    /* Stops from the controller while the rotating flood keeps driving the car forward. */
+    control_on = 0;
+    for (i = 0; i < STOPS; i++) {
+        int len = encode(frame, sizeof(frame), (unsigned short)(0x8000 + i), CAR_OP_STOP);
+        uint64_t sent;
+        unsigned int waited = 0;
+
+        sleep_ms(STOP_GAP_MS);
+        __atomic_store_n(&stop_armed, 1, __ATOMIC_RELEASE);
+        sent = sim_now_ns();
+        sendto(fd, frame, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+        while (__atomic_load_n(&stop_armed, __ATOMIC_ACQUIRE) && waited++ < STOP_TIMEOUT_MS * 10) {
+            usleep(100);
+        }
+        if (__atomic_load_n(&stop_armed, __ATOMIC_ACQUIRE)) {
+            missed++;
+        } else {
+            stop_us[n++] = (double)(stop_ns - sent) / 1e3;
+        }
+    }
+    __atomic_store_n(&stop_armed, 0, __ATOMIC_RELEASE);
+    flood_on = 0;
+    quit = 1;
+    pthread_join(flood, NULL);
+    pthread_join(control, NULL);
+    close(fd);
+
+    quiet_wps = (double)(s1.wakeups - s0.wakeups) / seconds;
+    quiet_late = s1.speed_late_ticks - s0.speed_late_ticks;
+    flood_late = s2.speed_late_ticks - s1.speed_late_ticks;
+    flood_wps = (double)(s2.wakeups - s1.wakeups) / seconds;
+    if (n > 0) {
+        qsort(stop_us, n, sizeof(stop_us[0]), cmp_double);
+        stop_p50 = stop_us[n / 2];
+        stop_max = stop_us[n - 1];
+    }
+
+    fprintf(out, "{\"bench\":\"flood\",\"seconds\":%u,\"flood_pps\":%u,\"flood_sent\":%lu,\"flood_rx_pps\":%.0f",
+            seconds, flood_pps, sent_flood, flood_rx_pps);
+    fprintf(out, ",\"quiet\":{\"wakeups_per_s\":%.0f,\"speed_ticks\":%u,\"speed_late_ticks\":%u", quiet_wps,
+            s1.speed_ticks - s0.speed_ticks, quiet_late);
+    fprintf(out, ",\"speed_jitter_max_us\":%u}", s1.speed_jitter_max_us);
+    fprintf(out, ",\"flood\":{\"wakeups_per_s\":%.0f,\"speed_ticks\":%u,\"speed_late_ticks\":%u", flood_wps,
+            s2.speed_ticks - s1.speed_ticks, flood_late);
+    fprintf(out, ",\"speed_jitter_max_us\":%u}", s2.speed_jitter_max_us);
+    fprintf(out,
+            ",\"ingress\":{\"received\":%u,\"rate_limited\":%u,\"bad\":%u,\"overflow\":%u,\"coalesced\":%u,"
+            "\"applied\":%u}",
+            i2.received - i1.received, i2.rate_limited - i1.rate_limited, i2.bad - i1.bad,
+            i2.overflow - i1.overflow, i2.coalesced - i1.coalesced, i2.applied - i1.applied);
+    fprintf(out, ",\"rotate\":{\"ports\":%u,\"received\":%u,\"admitted\":%u,\"admitted_max\":%u,\"new_limited\":%u}",
+            FLOOD_PORTS, i3.received - i2.received, rotate_admitted, rotate_max, i3.new_limited - i2.new_limited);
+    fprintf(out, ",\"new_senders\":{\"gap_us\":%u,\"admitted\":%u,\"admitted_min\":%u}", NEW_GAP_US, new_admitted,
+            new_min);
+    fprintf(out, ",\"stops\":%u,\"stop_missed\":%u,\"stop_us_p50\":%.0f,\"stop_us_max\":%.0f}\n", STOPS, missed,
+            stop_p50, stop_max);
+    fclose(out);
+
+    /* The speed loop ran throughout: CAR_SPEED_CTRL_MS ticks, give or take one per phase. */
+    ok = s2.speed_ticks - s1.speed_ticks + 1 >= seconds * 1000U / CAR_SPEED_CTRL_MS - 1 &&
+         flood_late <= quiet_late + (s2.speed_ticks - s1.speed_ticks) / LATE_SHARE &&
+         flood_wps <= quiet_wps + APPLY_PER_S &&
+         i2.rate_limited > i1.rate_limited && i2.applied - i1.applied <= (seconds + 1) * APPLY_PER_S &&
+         i2.coalesced > i1.coalesced && i2.overflow == i1.overflow && rotate_admitted <= rotate_max &&
+         missed == 0 && stop_max <= TICK_US && new_admitted >= new_min;
+    _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,566 @@
+/*
+ * Control-path hot spots replayed from recorded traces and compared against a
+ * stored baseline, so that a regression shows up before a firmware is built:
+ *
+ *   - parse:    every datagram of traces/packets.trace through the branch
+ *               udp_thread takes (binary frame or legacy JSON), ns per packet;
+ *   - dispatch: every motion command of the same trace posted with
+ *               set_car_status()/set_car_drive() to the first motor HAL
+ *               write, motor ramp off, us p50/p99;
+ *   - status:   udp_send_car_status() formatting and sendto to a listening
+ *               controller, ns per call;
+ *   - keys:     every adc_key scan of traces/keys.trace through
+ *               adc_key_block_code() and key_ladder_feed(), ns per scan.
+ *
+ * The timed loops count the thread's CPU time, so time the host spends on
+ * other work does not show up, and report the median of ROUNDS rounds; the
+ * parse and keys rounds alternate so both see the same host load. The
+ * dispatch p50 is a wake-up latency and is the median of DISPATCH_ROUNDS
+ * passes over the trace. With that, a metric stays within about 15% of its
+ * typical value from run to run.
+ *
+ *   ./build/bench_hotpath [-r] [baseline] [tolerance_pct]
+ *
+ * A metric fails when it exceeds its baseline value by more than
+ * tolerance_pct, default 25. With -r the results are written to the
+ * baseline file instead. The baseline defaults to bench/hotpath.baseline and
+ * holds "<metric> <value>" lines. Exits non-zero on a regression, when a
+ * trace cannot be loaded or when a command never reaches the HAL.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "adc_key.h"
+#include "car_link.h"
+#include "car_motor.h"
+#include "car_proto.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "key_ladder.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define STATUS_PORT 50002
+#define PACKET_MAX 1024
+#define PACKET_BYTES 256
+#define KEY_STEPS_MAX 4096
+#define MOTION_MAX 1024
+#define ROUNDS 50
+#define PARSE_REPEAT 200
+#define KEY_REPEAT 50
+#define STATUS_CALLS 5000
+#define DISPATCH_ROUNDS 9
+#define WRITE_TIMEOUT_MS 50
+#define METRIC_MAX 16
+
+extern int udp_send_car_status(const char *status, const char *speed, int left_tps, int right_tps);
+
+/* Without the ramp every dispatch writes the motor outputs at once. */
+static const struct car_motor_limits no_ramp = { 0, 0, 0, 0 };
+
+/* The scripted controller does not keep the link alive between commands. */
+static const struct car_link_limits no_watchdog = { 0, 0, 0 };
+
+struct packet {
+    int len;
+    unsigned char data[PACKET_BYTES];
+};
+
+struct key_step {
+    unsigned long ms;
+    unsigned short code;
+};
+
+struct motion {
+    unsigned char op;
+    short linear;
+    short turn;
+};
+
+struct metric {
+    const char *name;
+    double value;
+    double baseline; /* < 0: not in the baseline */
+};
+
+static struct packet packets[PACKET_MAX];
+static unsigned int packet_count;
+static struct key_step key_steps[KEY_STEPS_MAX];
+static unsigned int key_step_count;
+static struct motion motions[MOTION_MAX];
+static unsigned int motion_count;
+static struct metric metrics[METRIC_MAX];
+static unsigned int metric_count;
+static volatile unsigned long sink;
+
+static volatile int armed;
+static uint64_t write_ns;
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* "<time_ms> json <datagram>" or "<time_ms> bin <hex>" lines. */
+static int load_packets(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[2 * PACKET_BYTES + 32];
+
+    if (fp == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL && packet_count < PACKET_MAX) {
+        struct packet *p = &packets[packet_count];
+        unsigned long ms;
+        char kind[8];
+        int off;
+        int i;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || sscanf(line, "%lu %7s %n", &ms, kind, &off) != 2) {
+            continue;
+        }
+        if (strcmp(kind, "json") == 0) {
+            p->len = (int)strlen(line + off);
+            memcpy(p->data, line + off, (size_t)p->len);
+        } else if (strcmp(kind, "bin") == 0) {
+            for (i = off, p->len = 0; hex_value(line[i]) >= 0 && hex_value(line[i + 1]) >= 0; i += 2) {
+                p->data[p->len++] = (unsigned char)(hex_value(line[i]) << 4 | hex_value(line[i + 1]));
+            }
+        } else {
+            continue;
+        }
+        packet_count++;
+    }
+    fclose(fp);
+    return packet_count > 0 ? 0 : -1;
+}
+
+static int load_keys(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[128];
+
+    if (fp == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL && key_step_count < KEY_STEPS_MAX) {
+        unsigned long ms;
+        unsigned int channel;
+        unsigned int code;
+        if (line[0] == '#' || sscanf(line, "%lu %u %u", &ms, &channel, &code) != 3 || channel != ADC_KEY_CHANNEL) {
+            continue;
+        }
+        key_steps[key_step_count].ms = ms;
+        key_steps[key_step_count].code = (unsigned short)(code > 4095 ? 4095 : code);
+        key_step_count++;
+    }
+    fclose(fp);
+    return key_step_count > 0 ? 0 : -1;
+}
+
+/* The decode branch of udp_thread. */
+static int parse_packet(const struct packet *p, struct car_cmd *cmd)
+{
+    if (p->data[0] == CAR_PROTO_MAGIC) {
+        return car_proto_decode(p->data, p->len, cmd);
+    }
+    return car_proto_parse_json((const char *)p->data, p->len, cmd);
+}
+
+/* Motion commands of the trace that change what the wheels do. */
+static void collect_motions(void)
+{
+    struct motion last = { CAR_STATUS_STOP, 0, 0 };
+    struct car_cmd cmd;
+    unsigned int i;
+
+    for (i = 0; i < packet_count && motion_count < MOTION_MAX; i++) {
+        struct motion m;
+        if (parse_packet(&packets[i], &cmd) != CAR_PROTO_OK || (cmd.op > CAR_OP_RIGHT && cmd.op != CAR_OP_DRIVE)) {
+            continue;
+        }
+        m.op = cmd.op == CAR_OP_DRIVE ? CAR_STATUS_DRIVE : cmd.op;
+        m.linear = cmd.linear;
+        m.turn = cmd.turn;
+        if (m.op == last.op && (m.op != CAR_STATUS_DRIVE || (m.linear == last.linear && m.turn == last.turn))) {
+            continue;
+        }
+        /* A drive that mixes to the same duty as the last one leaves the HAL alone. */
+        if (m.op == CAR_STATUS_DRIVE && last.op == CAR_STATUS_DRIVE) {
+            int l0, r0, l1, r1;
+            car_drive_mix(last.linear, last.turn, &l0, &r0);
+            car_drive_mix(m.linear, m.turn, &l1, &r1);
+            if (l0 == l1 && r0 == r1) {
+                continue;
+            }
+        }
+        if (m.op == CAR_STATUS_DRIVE && last.op == CAR_STATUS_STOP && m.linear == 0 && m.turn == 0) {
+            continue;
+        }
+        motions[motion_count++] = m;
+        last = m;
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts v in place. */
+static double median(double *v, unsigned int n)
+{
+    qsort(v, n, sizeof(v[0]), cmp_double);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/* CPU time of the calling thread: time spent preempted by other work on the host does not count. */
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void add_metric(const char *name, double value)
+{
+    if (metric_count < METRIC_MAX) {
+        metrics[metric_count].name = name;
+        metrics[metric_count].value = value;
+        metrics[metric_count].baseline = -1.0;
+        metric_count++;
+    }
+}
+
+/* One round of the parse metric: ns per packet. */
+static double parse_round(void)
+{
+    struct car_cmd cmd;
+    unsigned int rep;
+    unsigned int i;
+    uint64_t start = cpu_ns();
+
+    for (rep = 0; rep < PARSE_REPEAT; rep++) {
+        for (i = 0; i < packet_count; i++) {
+            sink += (unsigned long)parse_packet(&packets[i], &cmd) + cmd.op;
+        }
+    }
+    return (double)(cpu_ns() - start) / ((double)PARSE_REPEAT * packet_count);
+}
+
+/* One round of the keys metric: an adc_key scan every ADC_KEY_SAMPLE_MS over the trace, ns per scan. */
+static double keys_round(void)
+{
+    unsigned short block[ADC_KEY_BURST];
+    unsigned long end = key_steps[key_step_count - 1].ms;
+    struct key_ladder kl;
+    struct key_event ev;
+    unsigned long scans = 0;
+    unsigned int rep;
+    uint64_t start = cpu_ns();
+
+    for (rep = 0; rep < KEY_REPEAT; rep++) {
+        unsigned int pos = 0;
+        unsigned long t;
+        adc_key_ladder_init(&kl);
+        for (t = 0; t <= end; t += ADC_KEY_SAMPLE_MS) {
+            unsigned int i;
+            while (pos + 1 < key_step_count && key_steps[pos + 1].ms <= t) {
+                pos++;
+            }
+            for (i = 0; i < ADC_KEY_BURST; i++) {
+                block[i] = key_steps[pos].code;
+            }
+            sink += (unsigned long)key_ladder_feed(&kl, adc_key_block_code(block, ADC_KEY_BURST), (hi_u32)t, &ev);
+            scans++;
+        }
+        while (key_ladder_pop(&kl, &ev)) {
+        }
+    }
+    return (double)(cpu_ns() - start) / (double)scans;
+}
+
+/* Alternates the rounds of the two metrics so that both sample the same stretch of host load. */
+static void bench_trace(double *parse_ns, double *keys_ns)
+{
+    double parse[ROUNDS];
+    double keys[ROUNDS];
+    unsigned int round;
+
+    for (round = 0; round < ROUNDS; round++) {
+        parse[round] = parse_round();
+        keys[round] = keys_round();
+    }
+    *parse_ns = median(parse, ROUNDS);
+    *keys_ns = median(keys, ROUNDS);
+}
+
+static double bench_status(void)
+{
+    double ns[ROUNDS];
+    unsigned int round;
+    unsigned int i;
+
+    for (round = 0; round < ROUNDS; round++) {
+        uint64_t start = cpu_ns();
+        for (i = 0; i < STATUS_CALLS / ROUNDS; i++) {
+            sink += (unsigned long)udp_send_car_status(car_status_name(i % CAR_STATUS_MAX), car_speed_name(CAR_SPEED_HIGH),
+                                                       (int)i, -(int)i);
+        }
+        ns[round] = (double)(cpu_ns() - start) / (double)(STATUS_CALLS / ROUNDS);
+    }
+    return median(ns, ROUNDS);
+}
+
+static int is_motor_port(unsigned int port)
+{
+    return port == HI_PWM_PORT_PWM0 || port == HI_PWM_PORT_PWM1 || port == HI_PWM_PORT_PWM3 ||
+           port == HI_PWM_PORT_PWM4;
+}
+
+static int is_motor_gpio(unsigned int gpio)
+{
+    return gpio == 0 || gpio == 1 || gpio == 9 || gpio == 10;
+}
+
+/* HAL hook: the first motor write after a command was posted. */
+static void on_hal(const struct sim_hal_event *ev, void *ctx)
+{
+    int motor = ((ev->type == SIM_HAL_PWM_START || ev->type == SIM_HAL_PWM_STOP) && is_motor_port(ev->id)) ||
+                (ev->type == SIM_HAL_GPIO_OUT && is_motor_gpio(ev->id));
+
+    (void)ctx;
+    if (motor && armed) {
+        write_ns = ev->t_ns;
+        __atomic_store_n(&armed, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Posts every motion command and waits for its HAL write; returns the commands that never got one.
+ * The p50 is the median of the rounds' p50s, the p99 is over every command.
+ */
+static unsigned int bench_dispatch(double *p50_us, double *p99_us)
+{
+    static double us[MOTION_MAX * DISPATCH_ROUNDS];
+    double p50[DISPATCH_ROUNDS];
+    unsigned int rounds = 0;
+    unsigned int missed = 0;
+    unsigned int n = 0;
+    unsigned int round;
+    unsigned int i;
+
+    set_car_mode(CAR_SRC_UDP, CAR_MODE_ALWAY);
+    for (round = 0; round < DISPATCH_ROUNDS; round++) {
+        unsigned int first = n;
+
+        for (i = 0; i < motion_count; i++) {
+            const struct motion *m = &motions[i];
+            unsigned int waited = 0;
+
+            __atomic_store_n(&armed, 1, __ATOMIC_RELEASE);
+            uint64_t posted = sim_now_ns();
+            if (m->op == CAR_STATUS_DRIVE) {
+                set_car_drive(CAR_SRC_UDP, m->linear, m->turn);
+            } else {
+                set_car_status(CAR_SRC_UDP, (CarStatus)m->op);
+            }
+            while (__atomic_load_n(&armed, __ATOMIC_ACQUIRE) && waited++ < WRITE_TIMEOUT_MS * 10) {
+                usleep(100);
+            }
+            if (__atomic_load_n(&armed, __ATOMIC_ACQUIRE)) {
+                missed++;
+            } else {
+                us[n++] = (double)(write_ns - posted) / 1e3;
+            }
+            sleep_ms(1);
+        }
+        if (n > first) {
+            p50[rounds++] = median(us + first, n - first);
+        }
+        /* Each round starts from a stopped car, like the trace. */
+        __atomic_store_n(&armed, 0, __ATOMIC_RELEASE);
+        set_car_status(CAR_SRC_UDP, CAR_STATUS_STOP);
+        sleep_ms(20);
+    }
+    __atomic_store_n(&armed, 0, __ATOMIC_RELEASE);
+    if (n > 0) {
+        *p50_us = median(p50, rounds);
+        qsort(us, n, sizeof(us[0]), cmp_double);
+        *p99_us = us[(n * 99) / 100];
+    }
+    return missed;
+}
+
+/*
+ * Opens a legacy controller session, as a controller's first datagram would,
+ * and listens on STATUS_PORT for the status like the legacy controller.
+ */
+static void become_client(void)
+{
+    static const char hello[] = "{\"cmd\":\"stop\"}";
+    struct sockaddr_in status_addr;
+    struct sockaddr_in car_addr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int status_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    memset(&status_addr, 0, sizeof(status_addr));
+    status_addr.sin_family = AF_INET;
+    status_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    status_addr.sin_port = htons(STATUS_PORT);
+    if (bind(status_fd, (struct sockaddr *)&status_addr, sizeof(status_addr)) != 0) {
+        fprintf(stderr, "bench_hotpath: cannot bind status port %u\n", STATUS_PORT);
+    }
+
+    memset(&car_addr, 0, sizeof(car_addr));
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+    sendto(fd, hello, sizeof(hello) - 1, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+    sleep_ms(50);
+}
+
+static void load_baseline(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[128];
+
+    if (fp == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char name[64];
+        double value;
+        unsigned int i;
+        if (line[0] == '#' || sscanf(line, "%63s %lf", name, &value) != 2) {
+            continue;
+        }
+        for (i = 0; i < metric_count; i++) {
+            if (strcmp(metrics[i].name, name) == 0) {
+                metrics[i].baseline = value;
+            }
+        }
+    }
+    fclose(fp);
+}
+
+static int save_baseline(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    unsigned int i;
+
+    if (fp == NULL) {
+        return -1;
+    }
+    fprintf(fp, "# bench_hotpath baseline: \"<metric> <value>\", typical values on the reference\n");
+    fprintf(fp, "# host. Re-record with ./build/bench_hotpath -r after an intended change.\n");
+    for (i = 0; i < metric_count; i++) {
+        fprintf(fp, "%s %.1f\n", metrics[i].name, metrics[i].value);
+    }
+    return fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+    const char *baseline = "bench/hotpath.baseline";
+    double tolerance = 25.0;
+    double parse_ns;
+    double keys_ns;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    unsigned int regressions = 0;
+    unsigned int missed;
+    int record = 0;
+    int arg = 1;
+    unsigned int i;
+    FILE *out;
+
+    if (arg < argc && strcmp(argv[arg], "-r") == 0) {
+        record = 1;
+        arg++;
+    }
+    if (arg < argc) {
+        baseline = argv[arg++];
+    }
+    if (arg < argc) {
+        tolerance = strtod(argv[arg++], NULL);
+    }
+
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    if (load_packets("traces/packets.trace") != 0 || load_keys("traces/keys.trace") != 0) {
+        fprintf(stderr, "bench_hotpath: cannot load traces/packets.trace or traces/keys.trace\n");
+        return 1;
+    }
+    collect_motions();
+
+    bench_trace(&parse_ns, &keys_ns);
+    add_metric("parse_ns_per_pkt", parse_ns);
+    add_metric("keys_ns_per_scan", keys_ns);
+
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+    sim_hal_set_hook(on_hal, NULL);
+    car_motor_set_limits(&no_ramp);
+    car_link_set_limits(&no_watchdog);
+    sim_start();
+    sleep_ms(500);
+    become_client();
+
+    add_metric("status_ns_per_send", bench_status());
+    missed = bench_dispatch(&p50_us, &p99_us);
+    add_metric("dispatch_us_p50", p50_us);
+
+    if (record && save_baseline(baseline) != 0) {
+        fprintf(stderr, "bench_hotpath: cannot write %s\n", baseline);
+        _exit(1);
+    }
+    load_baseline(baseline);
+
+    fprintf(out, "{\"bench\":\"hotpath\",\"packets\":%u,\"motions\":%u,\"baseline\":\"%s\",\"tolerance_pct\":%.0f",
+            packet_count, motion_count, baseline, tolerance);
+    for (i = 0; i < metric_count; i++) {
+        const struct metric *m = &metrics[i];
+        fprintf(out, ",\"%s\":{\"value\":%.1f", m->name, m->value);
+        if (m->baseline > 0.0) {
+            int slower = m->value > m->baseline * (1.0 + tolerance / 100.0);
+            fprintf(out, ",\"baseline\":%.1f,\"ratio\":%.2f,\"regressed\":%d", m->baseline, m->value / m->baseline,
+                    slower);
+            regressions += (unsigned int)slower;
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, ",\"dispatch_us_p99\":%.1f,\"dispatch_missed\":%u,\"regressions\":%u}\n", p99_us, missed, regressions);
+    fclose(out);
+
+    _exit(regressions == 0 && missed == 0 ? 0 : 1);
+}
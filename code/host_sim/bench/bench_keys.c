@@ -0,0 +1,295 @@
+/*
+ * adc_key sampling: compares the old scan (64 blocking hi_adc_read() calls
+ * and a float conversion of every sample, replayed here) with one block of
+ * the timer-paced sampler run through the key_ladder decoder, and checks
+ * that a debounced press decodes to the key the old code chose for every
+ * (min, max) pair. Then runs adc_key on the simulated HAL, presses each key
+ * through the scripted ADC source and measures the time from the press to
+ * the KEY_EVENT press line on the key task's output.
+ *
+ *   ./build/bench_keys [presses]
+ *
+ * Exits non-zero when the two decoders disagree or a press is missed.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "adc_key.h"
+#include "hi_adc.h"
+#include "sim_hal.h"
+
+#define LEGACY_LENGTH 64
+#define LEGACY_PERIOD_MS 30
+#define LEGACY_UNKNOWN (-1)
+#define SCAN_ITERATIONS 20000
+#define IDLE_CODE 4095
+#define PRESS_TIMEOUT_MS 500
+#define MAX_PRESSES 256
+
+struct key_level {
+    int key;
+    unsigned short code;
+};
+
+/* Codes in the middle of each key's window. */
+static const struct key_level key_levels[] = {
+    { KEY_EVENT_S1, 284 },
+    { KEY_EVENT_S2, 540 },
+    { KEY_EVENT_S3, 85 },
+};
+
+#define KEY_LEVELS (sizeof(key_levels) / sizeof(key_levels[0]))
+
+static unsigned short legacy_buf[LEGACY_LENGTH];
+static struct key_ladder scan_ladder;
+
+static pthread_mutex_t seen_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t seen_cond = PTHREAD_COND_INITIALIZER;
+static int seen_key;
+static uint64_t seen_ns;
+
+/* The old convert_to_voltage() decision, without the latch. */
+static int legacy_classify(const unsigned short *buf, unsigned int n)
+{
+    float vlt_max = 0;
+    float vlt_min = 100;
+    float vlt_val;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        float voltage = (float)buf[i] * 1.8 * 4 / 4096.0;
+        vlt_max = (voltage > vlt_max) ? voltage : vlt_max;
+        vlt_min = (voltage < vlt_min) ? voltage : vlt_min;
+    }
+    vlt_val = (vlt_min + vlt_max) / 2.0;
+    if ((vlt_val > 0.4) && (vlt_val < 0.6)) {
+        return KEY_EVENT_S1;
+    }
+    if ((vlt_val > 0.8) && (vlt_val < 1.1)) {
+        return KEY_EVENT_S2;
+    }
+    if ((vlt_val > 0.01) && (vlt_val < 0.3)) {
+        return KEY_EVENT_S3;
+    }
+    return vlt_val > 3.0 ? KEY_EVENT_NONE : LEGACY_UNKNOWN;
+}
+
+static int legacy_scan(void)
+{
+    unsigned short data;
+    unsigned int i;
+
+    for (i = 0; i < LEGACY_LENGTH; i++) {
+        hi_adc_read(ADC_KEY_CHANNEL, &data, HI_ADC_EQU_MODEL_1, HI_ADC_CUR_BAIS_DEFAULT, 0);
+        legacy_buf[i] = data;
+    }
+    return legacy_classify(legacy_buf, LEGACY_LENGTH);
+}
+
+static int block_scan(void)
+{
+    unsigned short block[ADC_KEY_BURST];
+    struct key_event ev;
+    unsigned short data;
+    unsigned int i;
+
+    for (i = 0; i < ADC_KEY_BURST; i++) {
+        hi_adc_read(ADC_KEY_CHANNEL, &data, HI_ADC_EQU_MODEL_1, HI_ADC_CUR_BAIS_DEFAULT, 0);
+        block[i] = data;
+    }
+    return key_ladder_feed(&scan_ladder, adc_key_block_code(block, ADC_KEY_BURST), 0, &ev);
+}
+
+static double ns_per_scan(int (*scan)(void))
+{
+    uint64_t start = sim_now_ns();
+    volatile int sink = 0;
+    unsigned int i;
+
+    for (i = 0; i < SCAN_ITERATIONS; i++) {
+        sim_adc_set(ADC_KEY_CHANNEL, key_levels[i % KEY_LEVELS].code);
+        sink += scan();
+    }
+    (void)sink;
+    return (double)(sim_now_ns() - start) / SCAN_ITERATIONS;
+}
+
+/* The key a fresh decoder presses after a steady block code, 0 when none. */
+static int ladder_press(unsigned short code)
+{
+    static struct key_ladder kl;
+    struct key_event ev;
+    int i;
+
+    adc_key_ladder_init(&kl);
+    for (i = 0; i < ADC_KEY_DEBOUNCE_MS / ADC_KEY_SAMPLE_MS; i++) {
+        if (key_ladder_feed(&kl, code, 0, &ev)) {
+            return ev.type == KEY_EV_PRESS ? ev.key : -1;
+        }
+    }
+    return 0;
+}
+
+/* Both decoders on every constant level and on spread (min, max) pairs. */
+static unsigned int compare_decoders(unsigned int *cases)
+{
+    unsigned short pair[2];
+    unsigned int mismatches = 0;
+    unsigned int lo;
+    unsigned int hi;
+
+    *cases = 0;
+    for (lo = 0; lo < 4096; lo++) {
+        for (hi = lo; hi < 4096; hi += (lo % 7 == 0) ? 1 : 61) {
+            int legacy;
+            int key;
+            pair[0] = (unsigned short)lo;
+            pair[1] = (unsigned short)hi;
+            (*cases)++;
+            legacy = legacy_classify(pair, 2);
+            key = ladder_press(adc_key_block_code(pair, 2));
+            if (key != (legacy == LEGACY_UNKNOWN ? KEY_EVENT_NONE : legacy)) {
+                mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+/* Reads the key task's output and records the first KEY_EVENT press after each press. */
+static void *output_reader(void *arg)
+{
+    FILE *in = fdopen((int)(long)arg, "r");
+    char line[128];
+
+    while (in != NULL && fgets(line, sizeof(line), in) != NULL) {
+        const char *ev = strstr(line, "KEY_EVENT_S");
+        if (ev == NULL || strstr(ev, " press") == NULL) {
+            continue;
+        }
+        pthread_mutex_lock(&seen_lock);
+        if (seen_key == 0) {
+            seen_key = ev[11] - '0';
+            seen_ns = sim_now_ns();
+            pthread_cond_signal(&seen_cond);
+        }
+        pthread_mutex_unlock(&seen_lock);
+    }
+    return NULL;
+}
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int presses = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 30U;
+    static double latency_ms[MAX_PRESSES];
+    struct adc_key_stats stats;
+    struct key_event ev;
+    unsigned int n = 0;
+    unsigned int missed = 0;
+    unsigned int wrong = 0;
+    unsigned int cases;
+    unsigned int mismatches;
+    double legacy_ns;
+    double block_ns;
+    pthread_t reader;
+    int fds[2];
+    unsigned int i;
+    FILE *out;
+
+    if (presses > MAX_PRESSES) {
+        presses = MAX_PRESSES;
+    }
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || pipe(fds) != 0 || dup2(fds[1], STDOUT_FILENO) < 0) {
+        return 1;
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    pthread_create(&reader, NULL, output_reader, (void *)(long)fds[0]);
+
+    mismatches = compare_decoders(&cases);
+    adc_key_ladder_init(&scan_ladder);
+    legacy_ns = ns_per_scan(legacy_scan);
+    block_ns = ns_per_scan(block_scan);
+
+    sim_adc_set(ADC_KEY_CHANNEL, IDLE_CODE);
+    sim_start();
+    sleep_ms(200);
+
+    for (i = 0; i < presses; i++) {
+        const struct key_level *level = &key_levels[i % KEY_LEVELS];
+        struct timespec deadline;
+        uint64_t pressed;
+        int key;
+
+        /* Press at a random phase of the sampling period. */
+        sleep_ms(50 + (unsigned long)(rand() % ADC_KEY_SAMPLE_MS));
+        pthread_mutex_lock(&seen_lock);
+        seen_key = 0;
+        pthread_mutex_unlock(&seen_lock);
+        pressed = sim_now_ns();
+        sim_adc_set(ADC_KEY_CHANNEL, level->code);
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += PRESS_TIMEOUT_MS / 1000;
+        deadline.tv_nsec += (PRESS_TIMEOUT_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&seen_lock);
+        while (seen_key == 0 && pthread_cond_timedwait(&seen_cond, &seen_lock, &deadline) == 0) {
+        }
+        key = seen_key;
+        if (key != 0) {
+            latency_ms[n++] = (double)(seen_ns - pressed) / 1e6;
+        }
+        pthread_mutex_unlock(&seen_lock);
+
+        if (key == 0) {
+            missed++;
+        } else if (key != level->key) {
+            wrong++;
+        }
+        sleep_ms(50);
+        sim_adc_set(ADC_KEY_CHANNEL, IDLE_CODE);
+        /* The bench is the queue's consumer. */
+        while (adc_key_get_event(&ev)) {
+        }
+    }
+    sleep_ms(50);
+    adc_key_get_stats(&stats);
+
+    fprintf(out, "{\"bench\":\"keys\",\"decoder_cases\":%u,\"decoder_mismatches\":%u", cases, mismatches);
+    fprintf(out, ",\"legacy\":{\"adc_reads_per_scan\":%u,\"ns_per_scan\":%.0f,\"adc_reads_per_s\":%u}", LEGACY_LENGTH,
+            legacy_ns, LEGACY_LENGTH * 1000 / LEGACY_PERIOD_MS);
+    fprintf(out, ",\"block\":{\"adc_reads_per_scan\":%u,\"ns_per_scan\":%.0f,\"adc_reads_per_s\":%u}", ADC_KEY_BURST,
+            block_ns, ADC_KEY_BURST * 1000 / ADC_KEY_SAMPLE_MS);
+    fprintf(out, ",\"presses\":%u,\"missed\":%u,\"wrong\":%u", presses, missed, wrong);
+    if (n > 0) {
+        qsort(latency_ms, n, sizeof(latency_ms[0]), cmp_double);
+        fprintf(out, ",\"detect_ms_p50\":%.1f,\"detect_ms_max\":%.1f", latency_ms[n / 2], latency_ms[n - 1]);
+    }
+    fprintf(out, ",\"scans\":%u,\"overruns\":%u,\"sample_us_max\":%u,\"scan_us_max\":%u", stats.scans,
+            stats.overruns, stats.sample_us_max, stats.scan_us_max);
+    fprintf(out, ",\"dropped\":%u}\n", stats.dropped);
+    fclose(out);
+    _exit(mismatches == 0 && missed == 0 && wrong == 0 && stats.dropped == 0 ? 0 : 1);
+}
@@ -0,0 +1,183 @@
+/*
+ * key_ladder decoder against a recorded ADC trace: replays the trace offline
+ * one adc_key scan at a time (ADC_KEY_BURST samples every ADC_KEY_SAMPLE_MS,
+ * with +/-noise codes of deterministic jitter on each sample), runs the board
+ * windows and timing through key_ladder_feed() and compares the events with
+ * the trace's "# expect <time_ms> S<key> <type>" lines, in order and to the
+ * scan. Also reports the replay cost per scan, block jitter included.
+ *
+ *   ./build/bench_ladder [trace] [noise]
+ *
+ * The trace defaults to traces/keys.trace. Exits non-zero when an event is
+ * missing, extra or wrong.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adc_key.h"
+#include "key_ladder.h"
+#include "sim_hal.h"
+
+#define TRACE_MAX 4096
+#define EXPECT_MAX 256
+#define TIMING_ROUNDS 200
+
+struct trace_step {
+    unsigned long ms;
+    unsigned short code;
+};
+
+static struct trace_step steps[TRACE_MAX];
+static unsigned int step_count;
+static struct key_event expected[EXPECT_MAX];
+static unsigned int expect_count;
+static struct key_event got[EXPECT_MAX];
+static unsigned int got_count;
+static unsigned int extra;
+static unsigned int noise;
+static unsigned long rng = 1;
+
+static int parse_type(const char *name)
+{
+    int type;
+
+    for (type = 0; type < KEY_EV_MAX; type++) {
+        if (strcmp(name, key_event_name((hi_u32)type)) == 0) {
+            return type;
+        }
+    }
+    return -1;
+}
+
+static int load_trace(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[128];
+
+    if (fp == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        unsigned long ms;
+        unsigned int channel;
+        unsigned int code;
+        unsigned int key;
+        char type[16];
+        if (sscanf(line, "# expect %lu S%u %15s", &ms, &key, type) == 3) {
+            if (expect_count < EXPECT_MAX && parse_type(type) >= 0) {
+                expected[expect_count].key = (hi_u8)key;
+                expected[expect_count].type = (hi_u8)parse_type(type);
+                expected[expect_count].time_ms = (hi_u32)ms;
+                expect_count++;
+            }
+            continue;
+        }
+        if (line[0] == '#' || sscanf(line, "%lu %u %u", &ms, &channel, &code) != 3 ||
+            channel != ADC_KEY_CHANNEL || step_count == TRACE_MAX) {
+            continue;
+        }
+        steps[step_count].ms = ms;
+        steps[step_count].code = (unsigned short)(code > 4095 ? 4095 : code);
+        step_count++;
+    }
+    fclose(fp);
+    return step_count > 0 ? 0 : -1;
+}
+
+static unsigned short jitter(unsigned short code)
+{
+    int value;
+
+    if (noise == 0) {
+        return code;
+    }
+    rng = rng * 1103515245UL + 12345UL;
+    value = (int)code + (int)((rng >> 16) % (2 * noise + 1)) - (int)noise;
+    return (unsigned short)(value < 0 ? 0 : (value > 4095 ? 4095 : value));
+}
+
+/* Builds the block the sampler would read at t_ms. */
+static void sample_block(unsigned long t_ms, unsigned int *pos, unsigned short *block)
+{
+    unsigned int i;
+
+    while (*pos + 1 < step_count && steps[*pos + 1].ms <= t_ms) {
+        (*pos)++;
+    }
+    for (i = 0; i < ADC_KEY_BURST; i++) {
+        block[i] = jitter(steps[*pos].code);
+    }
+}
+
+/* One pass over the trace; records the events when record is set. */
+static unsigned int replay(int record)
+{
+    unsigned long end = steps[step_count - 1].ms;
+    unsigned short block[ADC_KEY_BURST];
+    struct key_ladder kl;
+    struct key_event ev;
+    unsigned int scans = 0;
+    unsigned int pos = 0;
+    unsigned long t;
+
+    adc_key_ladder_init(&kl);
+    for (t = 0; t <= end; t += ADC_KEY_SAMPLE_MS) {
+        sample_block(t, &pos, block);
+        scans++;
+        if (!key_ladder_feed(&kl, adc_key_block_code(block, ADC_KEY_BURST), (hi_u32)t, &ev) || !record) {
+            continue;
+        }
+        if (got_count < EXPECT_MAX) {
+            got[got_count++] = ev;
+        }
+    }
+    /* Every event went through the queue as well. */
+    while (key_ladder_pop(&kl, &ev)) {
+    }
+    return scans;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "traces/keys.trace";
+    unsigned int wrong = 0;
+    unsigned int missing = 0;
+    unsigned int scans;
+    uint64_t start;
+    double ns_per_scan;
+    unsigned int i;
+
+    noise = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 6U;
+    if (load_trace(path) != 0) {
+        fprintf(stderr, "bench_ladder: cannot load %s\n", path);
+        return 1;
+    }
+
+    scans = replay(1);
+    for (i = 0; i < expect_count; i++) {
+        if (i >= got_count) {
+            missing++;
+            fprintf(stderr, "missing: %u S%u %s\n", expected[i].time_ms, expected[i].key,
+                    key_event_name(expected[i].type));
+        } else if (got[i].key != expected[i].key || got[i].type != expected[i].type ||
+                   got[i].time_ms != expected[i].time_ms) {
+            wrong++;
+            fprintf(stderr, "expected %u S%u %s, got %u S%u %s\n", expected[i].time_ms, expected[i].key,
+                    key_event_name(expected[i].type), got[i].time_ms, got[i].key, key_event_name(got[i].type));
+        }
+    }
+    extra = got_count > expect_count ? got_count - expect_count : 0;
+
+    start = sim_now_ns();
+    for (i = 0; i < TIMING_ROUNDS; i++) {
+        replay(0);
+    }
+    ns_per_scan = (double)(sim_now_ns() - start) / ((double)scans * TIMING_ROUNDS);
+
+    printf("{\"bench\":\"ladder\",\"trace\":\"%s\",\"noise\":%u,\"scans\":%u,\"expected\":%u,\"events\":%u", path, noise,
+           scans, expect_count, got_count);
+    printf(",\"missing\":%u,\"wrong\":%u,\"extra\":%u,\"ns_per_scan\":%.0f}\n", missing, wrong, extra, ns_per_scan);
+    return missing == 0 && wrong == 0 && extra == 0 ? 0 : 1;
+}
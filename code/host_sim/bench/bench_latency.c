@@ -0,0 +1,233 @@
+/*
+ * Command-path latency instrumentation: sends binary motion commands to the
+ * running car (forward, stop, backward, stop, ...) and times each one from
+ * sendto() to the first motor HAL write, then asks the car for its own
+ * per-stage histograms (car_latency.h) with a CAR_OP_STATS request and a
+ * legacy {"cmd":"stats"} datagram.
+ *
+ * The motor ramp is turned off so that every command writes the outputs
+ * from the control task rather than on a later ramp tick.
+ *
+ * Checks that the car counted every command in each control-task stage, that
+ * its receive-to-HAL p50 is not above the externally measured p50 (the
+ * car's interval lies inside the bench's), that the JSON reply carries the
+ * same count and that a reset request clears the histograms.
+ *
+ *   ./build/bench_latency [commands] [gap_ms]
+ *
+ * The car binds its ports with SIM_BIND_PORT_OFFSET (default 10000).
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_latency.h"
+#include "car_motor.h"
+#include "car_proto.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define MAX_COMMANDS 4096
+#define WRITE_TIMEOUT_MS 100
+#define REPLY_TIMEOUT_MS 500
+/* Histogram buckets round up by at most 1/CAR_LAT_SUB. */
+#define BUCKET_SLACK(us) ((us) + (us) / CAR_LAT_SUB + 1)
+
+/* Without the ramp every dispatch writes the motor outputs at once. */
+static const struct car_motor_limits no_ramp = { 0, 0, 0, 0 };
+
+static const unsigned char sequence[] = { CAR_OP_FORWARD, CAR_OP_STOP, CAR_OP_BACKWARD, CAR_OP_STOP };
+
+static struct sockaddr_in car_addr;
+static volatile int armed;
+static uint64_t write_ns;
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int is_motor_port(unsigned int port)
+{
+    return port == HI_PWM_PORT_PWM0 || port == HI_PWM_PORT_PWM1 || port == HI_PWM_PORT_PWM3 ||
+           port == HI_PWM_PORT_PWM4;
+}
+
+/* HAL hook: the first motor PWM write after a command was sent. */
+static void on_hal(const struct sim_hal_event *ev, void *ctx)
+{
+    (void)ctx;
+    if ((ev->type == SIM_HAL_PWM_START || ev->type == SIM_HAL_PWM_STOP) && is_motor_port(ev->id) && armed) {
+        write_ns = ev->t_ns;
+        __atomic_store_n(&armed, 0, __ATOMIC_RELEASE);
+    }
+}
+
+static int send_cmd(int fd, unsigned short seq, unsigned char op, const unsigned char *payload, unsigned char len)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN + 1];
+    struct car_cmd cmd;
+    int n;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.seq = seq;
+    cmd.op = op;
+    cmd.mode = CAR_MODE_ALWAY;
+    cmd.speed = CAR_SPEED_HIGH;
+    cmd.payload = payload;
+    cmd.payload_len = len;
+    n = car_proto_encode(frame, sizeof(frame), &cmd);
+    return sendto(fd, frame, n, 0, (struct sockaddr *)&car_addr, sizeof(car_addr)) == n ? 0 : -1;
+}
+
+/* Sends a stats request and waits for the reply; flags as in CAR_STATS_F_*. */
+static int query_binary(int fd, unsigned short seq, unsigned char flags, struct car_lat_summary *sum)
+{
+    unsigned char buf[CAR_STATS_MAX_LEN];
+    struct car_cmd reply;
+    int len;
+
+    if (send_cmd(fd, seq, CAR_OP_STATS, &flags, 1) != 0) {
+        return -1;
+    }
+    while ((len = (int)recv(fd, buf, sizeof(buf), 0)) > 0) {
+        if (car_proto_decode(buf, len, &reply) == CAR_PROTO_OK && reply.op == CAR_OP_STATS && reply.seq == seq) {
+            return car_proto_get_stats(&reply, sum, CAR_LAT_MAX);
+        }
+    }
+    return -1;
+}
+
+/* Sends {"cmd":"stats"} and returns the "n" of stage name in the reply, or -1. */
+static long query_json(int fd, const char *name)
+{
+    static const char request[] = "{\"cmd\":\"stats\"}";
+    char buf[1024];
+    char key[32];
+    const char *p;
+    int len;
+
+    if (sendto(fd, request, sizeof(request) - 1, 0, (struct sockaddr *)&car_addr, sizeof(car_addr)) < 0) {
+        return -1;
+    }
+    while ((len = (int)recv(fd, buf, sizeof(buf) - 1, 0)) > 0) {
+        buf[len] = '\0';
+        if (strncmp(buf, "{\"stats\":", 9) != 0) {
+            continue;
+        }
+        snprintf(key, sizeof(key), "\"%s\":{\"n\":", name);
+        p = strstr(buf, key);
+        return p != NULL ? strtol(p + strlen(key), NULL, 10) : -1;
+    }
+    return -1;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int commands = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 400U;
+    unsigned int gap_ms = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 5U;
+    static double ext_us[MAX_COMMANDS];
+    struct car_lat_summary sum[CAR_LAT_MAX];
+    struct car_lat_summary cleared[CAR_LAT_MAX];
+    struct timeval timeout = { 0, REPLY_TIMEOUT_MS * 1000 };
+    unsigned int missed = 0;
+    unsigned int n = 0;
+    unsigned int i;
+    long json_total;
+    int stages;
+    int cleared_stages;
+    double ext_p50 = 0.0;
+    double ext_p99 = 0.0;
+    int counted;
+    int ok;
+    int fd;
+    FILE *out;
+
+    commands = commands > MAX_COMMANDS ? MAX_COMMANDS : commands;
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    sim_hal_set_hook(on_hal, NULL);
+    car_motor_set_limits(&no_ramp);
+    sim_start();
+    sleep_ms(500);
+
+    for (i = 0; i < commands; i++) {
+        uint64_t sent;
+
+        __atomic_store_n(&armed, 1, __ATOMIC_RELEASE);
+        sent = sim_now_ns();
+        if (send_cmd(fd, (unsigned short)i, sequence[i % sizeof(sequence)], NULL, 0) != 0) {
+            missed++;
+            continue;
+        }
+        unsigned int waited = 0;
+        while (__atomic_load_n(&armed, __ATOMIC_ACQUIRE) && waited++ < WRITE_TIMEOUT_MS * 10) {
+            usleep(100);
+        }
+        if (__atomic_load_n(&armed, __ATOMIC_ACQUIRE)) {
+            missed++;
+        } else {
+            ext_us[n++] = (double)(write_ns - sent) / 1e3;
+        }
+        sleep_ms(gap_ms);
+    }
+    __atomic_store_n(&armed, 0, __ATOMIC_RELEASE);
+    sleep_ms(20);
+
+    json_total = query_json(fd, car_lat_name(CAR_LAT_TOTAL));
+    stages = query_binary(fd, 0xF000, CAR_STATS_F_RESET, sum);
+    cleared_stages = query_binary(fd, 0xF001, 0, cleared);
+    close(fd);
+
+    if (n > 0) {
+        qsort(ext_us, n, sizeof(ext_us[0]), cmp_double);
+        ext_p50 = ext_us[n / 2];
+        ext_p99 = ext_us[(n * 99) / 100];
+    }
+
+    fprintf(out, "{\"bench\":\"latency\",\"commands\":%u,\"gap_ms\":%u,\"missed\":%u", commands, gap_ms, missed);
+    fprintf(out, ",\"send_to_pwm_us_p50\":%.0f,\"send_to_pwm_us_p99\":%.0f", ext_p50, ext_p99);
+    for (i = 0; (int)i < stages; i++) {
+        fprintf(out, ",\"%s\":{\"n\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}", car_lat_name(i), sum[i].count,
+                sum[i].p50_us, sum[i].p90_us, sum[i].p99_us, sum[i].max_us);
+    }
+    fprintf(out, ",\"json_total_n\":%ld}\n", json_total);
+    fclose(out);
+
+    /* Every command changed the motion, so every one went through the control task. */
+    counted = stages == CAR_LAT_MAX;
+    for (i = CAR_LAT_PICKUP; counted && i < CAR_LAT_MAX; i++) {
+        counted = sum[i].count == commands;
+    }
+    ok = missed == 0 && counted && sum[CAR_LAT_PARSE].count == commands &&
+         sum[CAR_LAT_TOTAL].p50_us <= BUCKET_SLACK((unsigned int)ext_p50) && json_total == (long)commands &&
+         cleared_stages == CAR_LAT_MAX && cleared[CAR_LAT_TOTAL].count == 0;
+    _exit(ok ? 0 : 1);
+}
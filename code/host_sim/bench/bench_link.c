@@ -0,0 +1,347 @@
+/*
+ * Control-link supervision (car_link.h). A controller drives the running
+ * car forward in CAR_MODE_ALWAY at CONTROL_HZ and then goes silent; the
+ * bench watches the car state and measures the time from the last
+ * datagram to the slow, brake and stop stages. The motor ramp is turned
+ * off so that every stage shows in the car state at once.
+ *
+ * Per stall it checks that each stage is reached no earlier than its
+ * limit and no later than the limit plus one CAR_LINK_CHECK_MS period and
+ * a control tick. It also checks that:
+ *
+ *   - a short stall that only slows the car is undone when the controller
+ *     sends again,
+ *   - NOP heartbeats alone keep the car driving, and the loss estimate
+ *     follows the seq gaps the heartbeats leave (every LOSS_EVERY-th seq
+ *     is skipped), both in car_link_get_metrics() and in the link field of
+ *     the full telemetry frames,
+ *   - heartbeats from a second controller, an observer session, do not
+ *     keep the car of a silent driver going: it stops within the stop
+ *     window, and the link metrics never counted the observer as a driver,
+ *   - a Wi-Fi station leaving the hotspot brakes the car within one control
+ *     tick, without waiting for the link limits.
+ *
+ *   ./build/bench_link [stalls]
+ *
+ * The car binds its ports with SIM_BIND_PORT_OFFSET (default 10000) and
+ * sends telemetry back to the socket the bench sends commands from.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_link.h"
+#include "car_motor.h"
+#include "car_proto.h"
+#include "car_test.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define CONTROL_HZ 50
+#define DRIVE_MS 300
+#define HEARTBEAT_MS 3000
+#define LOSS_EVERY 10
+#define MAX_STALLS 50
+/* One control tick: the 10 ms kernel tick the control timers run on. */
+#define TICK_MS CAR_STEP_TICK_MS
+#define LATE_MS (CAR_LINK_CHECK_MS + 2 * TICK_MS)
+
+/* Without the ramp a stage shows in the car state at once. */
+static const struct car_motor_limits no_ramp = { 0, 0, 0, 0 };
+
+static const unsigned char controller_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+static struct sockaddr_in car_addr;
+static int cmd_fd;
+static int observer_fd;
+static unsigned short cmd_seq;
+static volatile int quit;
+
+/* Newest link field seen in telemetry, with a count of the frames carrying one. */
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct car_link_report report;
+static unsigned int reports;
+
+struct stall {
+    double slow_ms;
+    double brake_ms;
+    double stop_ms;
+};
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static double ms_since(uint64_t t_ns)
+{
+    return (double)(sim_now_ns() - t_ns) / 1e6;
+}
+
+static void send_op(unsigned char op, unsigned short speed)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    struct car_cmd cmd;
+    int len;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.seq = cmd_seq++;
+    cmd.op = op;
+    cmd.mode = CAR_MODE_ALWAY;
+    cmd.speed = speed;
+    len = car_proto_encode(frame, sizeof(frame), &cmd);
+    sendto(cmd_fd, frame, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+}
+
+/* Drives forward at CONTROL_HZ for ms and returns the time of the last datagram. */
+static uint64_t drive(unsigned int ms)
+{
+    uint64_t last = 0;
+    unsigned int i;
+
+    for (i = 0; i < ms * CONTROL_HZ / 1000; i++) {
+        send_op(CAR_OP_FORWARD, CAR_SPEED_HIGH);
+        last = sim_now_ns();
+        sleep_ms(1000 / CONTROL_HZ);
+    }
+    return last;
+}
+
+/* Polls the car state until done() holds or timeout_ms passed; returns ms since t_ns or -1. */
+static double wait_state(int (*done)(const struct car_state *), uint64_t t_ns, unsigned int timeout_ms)
+{
+    struct car_state state;
+
+    while (ms_since(t_ns) < timeout_ms) {
+        get_car_state(&state);
+        if (done(&state)) {
+            return ms_since(t_ns);
+        }
+        usleep(200);
+    }
+    return -1.0;
+}
+
+static int is_slow(const struct car_state *s)
+{
+    return s->cur_status == CAR_STATUS_FORWARD && s->speed == CAR_SPEED_LOW;
+}
+
+static int is_braking(const struct car_state *s)
+{
+    return s->cur_status == CAR_STATUS_BRAKE;
+}
+
+static int is_stopped(const struct car_state *s)
+{
+    return s->cur_status == CAR_STATUS_STOP;
+}
+
+static int is_full_speed(const struct car_state *s)
+{
+    return s->cur_status == CAR_STATUS_FORWARD && s->speed == CAR_SPEED_HIGH;
+}
+
+/* A second controller sends heartbeats at CONTROL_HZ; returns ms from t_ns to the stop, or -1. */
+static double observe_until_stopped(uint64_t t_ns, unsigned int timeout_ms)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    unsigned short seq = 0;
+    struct car_state state;
+    struct car_cmd cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = CAR_OP_NOP;
+    cmd.mode = CAR_PROTO_KEEP;
+    for (uint64_t next = sim_now_ns(); ms_since(t_ns) < timeout_ms; usleep(200)) {
+        if (sim_now_ns() >= next) {
+            cmd.seq = seq++;
+            sendto(observer_fd, frame, car_proto_encode(frame, sizeof(frame), &cmd), 0,
+                   (struct sockaddr *)&car_addr, sizeof(car_addr));
+            next += 1000000000ULL / CONTROL_HZ;
+        }
+        get_car_state(&state);
+        if (is_stopped(&state)) {
+            return ms_since(t_ns);
+        }
+    }
+    return -1.0;
+}
+
+/* Telemetry: keeps the newest link field. */
+static void *status_thread(void *arg)
+{
+    unsigned char buf[CAR_STATE_MAX_LEN];
+    struct car_cmd frame;
+    struct car_link_report link;
+
+    (void)arg;
+    while (!quit) {
+        int len = (int)recv(cmd_fd, buf, sizeof(buf), 0);
+
+        if (len <= 0 || car_proto_decode(buf, len, &frame) != CAR_PROTO_OK ||
+            car_proto_get_link(&frame, &link) != 1) {
+            continue;
+        }
+        pthread_mutex_lock(&report_lock);
+        report = link;
+        reports++;
+        pthread_mutex_unlock(&report_lock);
+    }
+    return NULL;
+}
+
+static int in_window(double ms, unsigned int limit_ms)
+{
+    return ms >= limit_ms - TICK_MS && ms <= limit_ms + LATE_MS;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int stalls = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 5U;
+    static struct stall runs[MAX_STALLS];
+    struct timeval tv = { 0, 100000 };
+    struct car_loop_stats s0;
+    struct car_loop_stats s1;
+    struct car_link_metrics metrics;
+    struct car_link_metrics final;
+    struct car_link_report seen;
+    struct car_state state;
+    pthread_t status_tid;
+    unsigned int seen_reports;
+    unsigned int stalls_ok = 0;
+    unsigned int i;
+    uint64_t last;
+    double worst_stop = 0.0;
+    double recover_ms;
+    double leave_ms;
+    double observed_stop_ms;
+    int heartbeat_ok;
+    int ok;
+    FILE *out;
+
+    stalls = stalls == 0 ? 1 : (stalls > MAX_STALLS ? MAX_STALLS : stalls);
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+    cmd_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(cmd_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    observer_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    car_motor_set_limits(&no_ramp);
+    sim_start();
+    sleep_ms(500);
+    sim_wifi_station_join(controller_mac);
+    pthread_create(&status_tid, NULL, status_thread, NULL);
+    get_car_loop_stats(&s0);
+
+    /*
+     * NOP heartbeats with seq gaps keep the car going for longer than the stop
+     * limit. This runs first, so that the loss estimate has little gap-free
+     * history to average in.
+     */
+    drive(DRIVE_MS);
+    for (i = 0; i < HEARTBEAT_MS * CONTROL_HZ / 1000; i++) {
+        if (cmd_seq % LOSS_EVERY == 0) {
+            cmd_seq++;
+        }
+        send_op(CAR_OP_NOP, 0);
+        sleep_ms(1000 / CONTROL_HZ);
+    }
+    get_car_state(&state);
+    heartbeat_ok = is_full_speed(&state);
+    car_link_get_metrics(&metrics);
+    pthread_mutex_lock(&report_lock);
+    seen = report;
+    seen_reports = reports;
+    pthread_mutex_unlock(&report_lock);
+
+    /* Stalls: drive, go silent, time each stage from the last datagram. */
+    for (i = 0; i < stalls; i++) {
+        struct stall *r = &runs[i];
+
+        last = drive(DRIVE_MS);
+        r->slow_ms = wait_state(is_slow, last, CAR_LINK_SLOW_MS + 2 * LATE_MS);
+        r->brake_ms = wait_state(is_braking, last, CAR_LINK_BRAKE_MS + 2 * LATE_MS);
+        r->stop_ms = wait_state(is_stopped, last, CAR_LINK_STOP_MS + 2 * LATE_MS);
+        if (in_window(r->slow_ms, CAR_LINK_SLOW_MS) && in_window(r->brake_ms, CAR_LINK_BRAKE_MS) &&
+            in_window(r->stop_ms, CAR_LINK_STOP_MS)) {
+            stalls_ok++;
+        }
+        if (r->stop_ms > worst_stop || r->stop_ms < 0) {
+            worst_stop = r->stop_ms < 0 ? 1e9 : r->stop_ms;
+        }
+    }
+
+    /* A short stall only slows the car; the next datagram restores the speed. */
+    last = drive(DRIVE_MS);
+    wait_state(is_slow, last, CAR_LINK_SLOW_MS + 2 * LATE_MS);
+    last = sim_now_ns();
+    send_op(CAR_OP_NOP, 0);
+    recover_ms = wait_state(is_full_speed, last, LATE_MS);
+
+    /* The driver goes silent while an observer keeps sending heartbeats. */
+    last = drive(DRIVE_MS);
+    observed_stop_ms = observe_until_stopped(last, CAR_LINK_STOP_MS + 2 * LATE_MS);
+    car_link_get_metrics(&final);
+
+    /* The controller's station leaves while the car is driving. */
+    drive(DRIVE_MS);
+    last = sim_now_ns();
+    sim_wifi_station_leave(controller_mac, 0);
+    leave_ms = wait_state(is_braking, last, CAR_LINK_SLOW_MS);
+    wait_state(is_stopped, last, CAR_LINK_STOP_MS + 2 * LATE_MS);
+    get_car_loop_stats(&s1);
+
+    quit = 1;
+    pthread_join(status_tid, NULL);
+    close(cmd_fd);
+    close(observer_fd);
+
+    fprintf(out, "{\"bench\":\"link\",\"limits_ms\":[%d,%d,%d],\"check_ms\":%d,\"stalls\":%u,\"stalls_ok\":%u,\"runs\":[",
+            CAR_LINK_SLOW_MS, CAR_LINK_BRAKE_MS, CAR_LINK_STOP_MS, CAR_LINK_CHECK_MS, stalls, stalls_ok);
+    for (i = 0; i < stalls; i++) {
+        fprintf(out, "%s{\"slow_ms\":%.1f,\"brake_ms\":%.1f,\"stop_ms\":%.1f}", i ? "," : "", runs[i].slow_ms,
+                runs[i].brake_ms, runs[i].stop_ms);
+    }
+    fprintf(out, "],\"stall_to_stop_ms_max\":%.1f,\"recover_ms\":%.1f,\"heartbeat_ok\":%d,\"observed_stop_ms\":%.1f",
+            worst_stop, recover_ms, heartbeat_ok, observed_stop_ms);
+    fprintf(out, ",\"leave_to_brake_ms\":%.1f", leave_ms);
+    fprintf(out,
+            ",\"metrics\":{\"rx\":%u,\"jitter_us\":%u,\"loss_permille\":%u,\"driver_changes\":%u,\"gap_hist\":[%u,%u,%u,%u,%u,%u]}",
+            metrics.rx, metrics.jitter_us, metrics.loss_permille, final.driver_changes, metrics.gap_hist[0],
+            metrics.gap_hist[1], metrics.gap_hist[2], metrics.gap_hist[3], metrics.gap_hist[4], metrics.gap_hist[5]);
+    fprintf(out,
+            ",\"telemetry\":{\"frames\":%u,\"jitter_us\":%u,\"loss_permille\":%u,\"gap_pct\":[%u,%u,%u,%u,%u,%u]}",
+            seen_reports, seen.jitter_us, seen.loss_permille, seen.gap_pct[0], seen.gap_pct[1], seen.gap_pct[2],
+            seen.gap_pct[3], seen.gap_pct[4], seen.gap_pct[5]);
+    fprintf(out, ",\"actions\":{\"recover\":%u,\"slow\":%u,\"brake\":%u,\"stop\":%u}}\n",
+            s1.link_actions[CAR_LINK_OK] - s0.link_actions[CAR_LINK_OK],
+            s1.link_actions[CAR_LINK_SLOW] - s0.link_actions[CAR_LINK_SLOW],
+            s1.link_actions[CAR_LINK_BRAKE] - s0.link_actions[CAR_LINK_BRAKE],
+            s1.link_actions[CAR_LINK_STOP] - s0.link_actions[CAR_LINK_STOP]);
+    fclose(out);
+
+    /* One seq in LOSS_EVERY skipped: the estimate is 1000 / LOSS_EVERY permille, give or take a quarter. */
+    ok = stalls_ok == stalls && recover_ms >= 0 && heartbeat_ok && in_window(observed_stop_ms, CAR_LINK_STOP_MS) &&
+         final.driver_changes == 1 && leave_ms >= 0 &&
+         leave_ms <= TICK_MS && metrics.loss_permille * 4 >= 3 * 1000 / LOSS_EVERY &&
+         metrics.loss_permille * 4 <= 5 * 1000 / LOSS_EVERY && seen_reports > 0 &&
+         seen.loss_permille * 4 >= 3 * 1000 / LOSS_EVERY && seen.loss_permille * 4 <= 5 * 1000 / LOSS_EVERY;
+    _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,210 @@
+/*
+ * Motion state machine: drives the running application through every
+ * (current, target) pair of CarStatus values and checks the per-wheel PWM
+ * outputs, the input levels of stopped wheels and the published state after
+ * each transition against an independent model of the states. Staying in a
+ * state must not touch the HAL. Reports command-to-PWM latency over all
+ * state-changing transitions.
+ *
+ *   ./build/bench_motion
+ *
+ * Exits non-zero on any mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_motor.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "sim_hal.h"
+
+#define SETTLE_TIMEOUT_NS 300000000ULL
+#define SAME_STATE_WAIT_MS 30
+#define DRIVE_LINEAR 600
+#define DRIVE_TURN (-300)
+
+static const struct car_motor_limits no_ramp = { 0, 0, 0, 0 };
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* What each state should put on the wheels, written out independently of the table. */
+static void expected_duty(unsigned int status, int *left, int *right)
+{
+    const int v = CAR_SPEED_MEDIUM;
+
+    switch (status) {
+    case CAR_STATUS_FORWARD:
+        *left = v;
+        *right = v;
+        break;
+    case CAR_STATUS_BACKWARD:
+        *left = -v;
+        *right = -v;
+        break;
+    case CAR_STATUS_LEFT:
+        *left = -v;
+        *right = 0;
+        break;
+    case CAR_STATUS_RIGHT:
+        *left = 0;
+        *right = -v;
+        break;
+    case CAR_STATUS_DRIVE:
+        car_drive_mix(DRIVE_LINEAR, DRIVE_TURN, left, right);
+        break;
+    default:
+        *left = 0;
+        *right = 0;
+        break;
+    }
+}
+
+/* A stopped wheel has both inputs at CAR_MOTOR_STOP_LEVEL, however it was stopped. */
+static int wheel_matches(unsigned int fwd_port, unsigned int rev_port, int duty)
+{
+    static const unsigned int port_gpio[] = { [HI_PWM_PORT_PWM0] = 9, [HI_PWM_PORT_PWM1] = 10,
+                                              [HI_PWM_PORT_PWM3] = 0, [HI_PWM_PORT_PWM4] = 1 };
+    struct sim_pwm_state fwd;
+    struct sim_pwm_state rev;
+    struct sim_pin_state fwd_pin;
+    struct sim_pin_state rev_pin;
+
+    sim_pwm_get(fwd_port, &fwd);
+    sim_pwm_get(rev_port, &rev);
+    if (duty > 0) {
+        return fwd.running && fwd.duty == (unsigned int)duty && !rev.running;
+    }
+    if (duty < 0) {
+        return rev.running && rev.duty == (unsigned int)-duty && !fwd.running;
+    }
+    sim_pin_get(port_gpio[fwd_port], &fwd_pin);
+    sim_pin_get(port_gpio[rev_port], &rev_pin);
+    return !fwd.running && !rev.running && fwd_pin.level == CAR_MOTOR_STOP_LEVEL &&
+           rev_pin.level == CAR_MOTOR_STOP_LEVEL;
+}
+
+static int state_matches(unsigned int status)
+{
+    struct car_state state;
+    int left;
+    int right;
+
+    expected_duty(status, &left, &right);
+    get_car_state(&state);
+    return state.cur_status == status && wheel_matches(HI_PWM_PORT_PWM4, HI_PWM_PORT_PWM3, left) &&
+           wheel_matches(HI_PWM_PORT_PWM1, HI_PWM_PORT_PWM0, right);
+}
+
+static void command(unsigned int status)
+{
+    if (status == CAR_STATUS_DRIVE) {
+        set_car_drive(CAR_SRC_UDP, DRIVE_LINEAR, DRIVE_TURN);
+    } else {
+        set_car_status(CAR_SRC_UDP, (CarStatus)status);
+    }
+}
+
+/* Waits for the outputs of status; returns the time it took in ns, 0 on timeout. */
+static uint64_t wait_state(unsigned int status, uint64_t t0)
+{
+    while (!state_matches(status)) {
+        struct timespec ts = { 0, 20000 };
+
+        if (sim_now_ns() - t0 > SETTLE_TIMEOUT_NS) {
+            return 0;
+        }
+        nanosleep(&ts, NULL);
+    }
+    return sim_now_ns() - t0;
+}
+
+static unsigned long hal_writes(void)
+{
+    unsigned long counts[SIM_HAL_EVENT_MAX];
+
+    sim_hal_get_counts(counts);
+    return counts[SIM_HAL_PWM_START] + counts[SIM_HAL_PWM_STOP] + counts[SIM_HAL_IO_FUNC] +
+           counts[SIM_HAL_GPIO_DIR] + counts[SIM_HAL_GPIO_OUT];
+}
+
+int main(void)
+{
+    unsigned int failures = 0;
+    unsigned int pairs = 0;
+    unsigned int changes = 0;
+    double sum_us = 0;
+    double max_us = 0;
+    unsigned int cur;
+    unsigned int go;
+    FILE *out;
+
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+
+    /* Outputs jump straight to their targets; the ramp has its own bench. */
+    car_motor_set_limits(&no_ramp);
+    sim_start();
+    sleep_ms(500);
+
+    /* Commands are posted from this thread; nothing is sent over UDP. */
+    set_car_mode(CAR_SRC_UDP, CAR_MODE_ALWAY);
+    set_car_speed(CAR_SRC_UDP, CAR_SPEED_MEDIUM);
+
+    for (cur = 0; cur < CAR_STATUS_MAX; cur++) {
+        for (go = 0; go < CAR_STATUS_MAX; go++) {
+            uint64_t ns;
+
+            pairs++;
+            command(cur);
+            if (wait_state(cur, sim_now_ns()) == 0) {
+                fprintf(stderr, "%s: outputs never settled\n", car_status_name(cur));
+                failures++;
+                continue;
+            }
+
+            sim_hal_reset_counts();
+            command(go);
+            if (go == cur) {
+                sleep_ms(SAME_STATE_WAIT_MS);
+                if (!state_matches(go) || hal_writes() != 0) {
+                    fprintf(stderr, "%s -> %s: %lu HAL writes staying in the state\n", car_status_name(cur),
+                            car_status_name(go), hal_writes());
+                    failures++;
+                }
+                continue;
+            }
+
+            ns = wait_state(go, sim_now_ns());
+            if (ns == 0) {
+                fprintf(stderr, "%s -> %s: outputs do not match\n", car_status_name(cur), car_status_name(go));
+                failures++;
+                continue;
+            }
+            changes++;
+            sum_us += (double)ns / 1000.0;
+            if ((double)ns / 1000.0 > max_us) {
+                max_us = (double)ns / 1000.0;
+            }
+        }
+    }
+
+    fprintf(out, "{\"bench\":\"motion\",\"states\":%u,\"pairs\":%u,\"failures\":%u", (unsigned int)CAR_STATUS_MAX,
+            pairs, failures);
+    if (changes > 0) {
+        fprintf(out, ",\"cmd_to_pwm_us_mean\":%.0f,\"cmd_to_pwm_us_max\":%.0f", sum_us / changes, max_us);
+    }
+    fprintf(out, "}\n");
+    fclose(out);
+    _exit(failures == 0 ? 0 : 1);
+}
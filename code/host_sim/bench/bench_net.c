@@ -0,0 +1,221 @@
+/*
+ * The UDP network task: its RAM cost and the latencies it serves. Lists the
+ * threads the car application created with the stack size each asked for
+ * (what they cost on the board) and sends reliable motion commands to the
+ * running car, alternating forward and backward every gap_ms. Each command
+ * is timed from sendto() to
+ *
+ *   - the first motor HAL write (the command path),
+ *   - the first telemetry frame showing the new status (state to wire),
+ *   - the first telemetry frame acking its seq.
+ *
+ * The motor ramp is turned off so that every command writes the outputs
+ * from the control task.
+ *
+ * Checks that one network thread serves both ports within NET_STACK_MAX
+ * bytes of stack, that commands reach the HAL within a control tick and
+ * that telemetry and acks follow within two.
+ *
+ *   ./build/bench_net [commands] [gap_ms]
+ *
+ * The car binds its ports with SIM_BIND_PORT_OFFSET (default 10000) and
+ * sends telemetry back to the socket the bench sends commands from.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_motor.h"
+#include "car_proto.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define MAX_COMMANDS 2000
+#define MAX_THREADS 16
+#define WAIT_MS 200
+/* One control tick: the 10 ms kernel tick the control timers run on. */
+#define TICK_US (CAR_STEP_TICK_MS * 1000U)
+/* Stack budget for everything that serves the UDP ports. */
+#define NET_STACK_MAX 4096U
+
+/* Without the ramp every dispatch writes the motor outputs at once. */
+static const struct car_motor_limits no_ramp = { 0, 0, 0, 0 };
+
+static const unsigned char sequence[] = { CAR_OP_FORWARD, CAR_OP_BACKWARD };
+
+static volatile int armed;
+static uint64_t write_ns;
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int is_motor_port(unsigned int port)
+{
+    return port == HI_PWM_PORT_PWM0 || port == HI_PWM_PORT_PWM1 || port == HI_PWM_PORT_PWM3 ||
+           port == HI_PWM_PORT_PWM4;
+}
+
+/* HAL hook: the first motor PWM write after a command was sent. */
+static void on_hal(const struct sim_hal_event *ev, void *ctx)
+{
+    (void)ctx;
+    if ((ev->type == SIM_HAL_PWM_START || ev->type == SIM_HAL_PWM_STOP) && is_motor_port(ev->id) && armed) {
+        write_ns = ev->t_ns;
+        __atomic_store_n(&armed, 0, __ATOMIC_RELEASE);
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double pct(double *v, unsigned int n, unsigned int p)
+{
+    return n == 0 ? -1.0 : v[(n * p) / 100 < n ? (n * p) / 100 : n - 1];
+}
+
+/* Reads telemetry until it shows status and acks seq; records when each was first seen. */
+static void wait_telemetry(int fd, uint64_t sent, unsigned char status, unsigned short seq, double *state_us,
+                           double *ack_us)
+{
+    unsigned char buf[CAR_STATE_MAX_LEN];
+    struct car_cmd frame;
+    struct car_ack ack;
+
+    *state_us = -1.0;
+    *ack_us = -1.0;
+    while ((*state_us < 0 || *ack_us < 0) && sim_now_ns() - sent < WAIT_MS * 1000000ULL) {
+        int len = (int)recv(fd, buf, sizeof(buf), 0);
+        double us = (double)(sim_now_ns() - sent) / 1e3;
+
+        if (len <= 0 || car_proto_decode(buf, len, &frame) != CAR_PROTO_OK || frame.op != CAR_OP_STATE) {
+            continue;
+        }
+        if (*state_us < 0 && frame.payload_len > 1 && (frame.payload[0] & CAR_STATE_F_STATUS) &&
+            frame.payload[1] == status) {
+            *state_us = us;
+        }
+        if (*ack_us < 0 && car_proto_get_ack(&frame, &ack) == 1 && ack.seq == seq) {
+            *ack_us = us;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int commands = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 200U;
+    unsigned int gap_ms = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 20U;
+    static double cmd_us[MAX_COMMANDS];
+    static double state_us[MAX_COMMANDS];
+    static double ack_us[MAX_COMMANDS];
+    struct sim_thread_info threads[MAX_THREADS];
+    struct timeval tv = { 0, 10000 };
+    struct sockaddr_in car_addr;
+    unsigned int n_threads;
+    unsigned int net_threads = 0;
+    unsigned int net_stack = 0;
+    unsigned int app_stack = 0;
+    unsigned int n_cmd = 0;
+    unsigned int n_state = 0;
+    unsigned int n_ack = 0;
+    unsigned int i;
+    int ok;
+    int fd;
+    FILE *out;
+
+    commands = commands == 0 ? 1 : (commands > MAX_COMMANDS ? MAX_COMMANDS : commands);
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    sim_hal_set_hook(on_hal, NULL);
+    car_motor_set_limits(&no_ramp);
+    sim_start();
+    sleep_ms(500);
+
+    for (i = 0; i < commands; i++) {
+        unsigned char frame[CAR_PROTO_MIN_LEN];
+        unsigned char op = sequence[i % sizeof(sequence)];
+        unsigned int waited = 0;
+        struct car_cmd cmd;
+        uint64_t sent;
+        int len;
+
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.seq = (unsigned short)i;
+        cmd.op = op;
+        cmd.flags = CAR_CMD_F_RELIABLE;
+        cmd.mode = CAR_MODE_ALWAY;
+        len = car_proto_encode(frame, sizeof(frame), &cmd);
+
+        __atomic_store_n(&armed, 1, __ATOMIC_RELEASE);
+        sent = sim_now_ns();
+        sendto(fd, frame, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+        wait_telemetry(fd, sent, op, cmd.seq, &state_us[n_state], &ack_us[n_ack]);
+        while (__atomic_load_n(&armed, __ATOMIC_ACQUIRE) && waited++ < WAIT_MS * 10) {
+            usleep(100);
+        }
+        if (!__atomic_load_n(&armed, __ATOMIC_ACQUIRE)) {
+            cmd_us[n_cmd++] = (double)(write_ns - sent) / 1e3;
+        }
+        __atomic_store_n(&armed, 0, __ATOMIC_RELEASE);
+        n_state += state_us[n_state] >= 0;
+        n_ack += ack_us[n_ack] >= 0;
+        sleep_ms(gap_ms);
+    }
+    close(fd);
+
+    qsort(cmd_us, n_cmd, sizeof(cmd_us[0]), cmp_double);
+    qsort(state_us, n_state, sizeof(state_us[0]), cmp_double);
+    qsort(ack_us, n_ack, sizeof(ack_us[0]), cmp_double);
+
+    n_threads = sim_threads_get(threads, MAX_THREADS);
+    n_threads = n_threads > MAX_THREADS ? MAX_THREADS : n_threads;
+    fprintf(out, "{\"bench\":\"net\",\"commands\":%u,\"gap_ms\":%u,\"threads\":[", commands, gap_ms);
+    for (i = 0; i < n_threads; i++) {
+        fprintf(out, "%s{\"name\":\"%s\",\"stack\":%u}", i ? "," : "", threads[i].name, threads[i].stack_size);
+        app_stack += threads[i].stack_size;
+        if (strncmp(threads[i].name, "udp", 3) == 0 || strncmp(threads[i].name, "status", 6) == 0) {
+            net_threads++;
+            net_stack += threads[i].stack_size;
+        }
+    }
+    fprintf(out, "],\"app_stack_bytes\":%u,\"net_threads\":%u,\"net_stack_bytes\":%u", app_stack, net_threads,
+            net_stack);
+    fprintf(out, ",\"send_to_pwm_us\":{\"n\":%u,\"p50\":%.0f,\"p99\":%.0f}", n_cmd, pct(cmd_us, n_cmd, 50),
+            pct(cmd_us, n_cmd, 99));
+    fprintf(out, ",\"send_to_state_us\":{\"n\":%u,\"p50\":%.0f,\"p99\":%.0f}", n_state, pct(state_us, n_state, 50),
+            pct(state_us, n_state, 99));
+    fprintf(out, ",\"send_to_ack_us\":{\"n\":%u,\"p50\":%.0f,\"p99\":%.0f}}\n", n_ack, pct(ack_us, n_ack, 50),
+            pct(ack_us, n_ack, 99));
+    fclose(out);
+
+    ok = net_threads == 1 && net_stack <= NET_STACK_MAX && n_cmd == commands && n_state == commands &&
+         n_ack == commands && pct(cmd_us, n_cmd, 99) <= TICK_US &&
+         pct(state_us, n_state, 99) <= 2 * TICK_US && pct(ack_us, n_ack, 99) <= 2 * TICK_US;
+    _exit(ok ? 0 : 1);
+}
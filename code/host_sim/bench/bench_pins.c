@@ -0,0 +1,259 @@
+/*
+ * HAL calls and latency per motion transition: the original pwm_* sequences
+ * (four uncached gpio_control() calls each, replayed here) against the pin
+ * state cache behind car_motor. Transitions run with ramping disabled so
+ * each one is a single output change. After every cached transition the
+ * simulated pins are checked: a driven input is muxed to its PWM function
+ * with the PWM running, the other input is a GPIO output at the expected
+ * level. For both paths "pwm_pins_muxed_gpio" counts running PWM ports
+ * whose pin was left muxed to GPIO, which keeps the PWM off the pin.
+ *
+ *   ./build/bench_pins [cycles]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "car_motor.h"
+#include "car_test.h"
+#include "hi_io.h"
+#include "hi_pwm.h"
+#include "iot_gpio.h"
+#include "iot_pwm.h"
+#include "sim_hal.h"
+
+#define PWM_FREQ 60000
+
+struct motor_pin {
+    unsigned int gpio;
+    unsigned int port;
+    unsigned char pwm_func;
+};
+
+/* Left forward/reverse, right forward/reverse. */
+static const struct motor_pin pins[4] = {
+    { 1, HI_PWM_PORT_PWM4, HI_IO_FUNC_GPIO_1_PWM4_OUT },
+    { 0, HI_PWM_PORT_PWM3, HI_IO_FUNC_GPIO_0_PWM3_OUT },
+    { 10, HI_PWM_PORT_PWM1, HI_IO_FUNC_GPIO_10_PWM1_OUT },
+    { 9, HI_PWM_PORT_PWM0, HI_IO_FUNC_GPIO_9_PWM0_OUT },
+};
+
+/* Stop, forward, backward, left, right, ... as signed wheel duties. */
+struct transition {
+    const char *name;
+    int left;
+    int right;
+};
+
+static const struct transition cycle[] = {
+    { "forward", CAR_SPEED_HIGH, CAR_SPEED_HIGH },
+    { "forward_low", CAR_SPEED_LOW, CAR_SPEED_LOW },
+    { "backward", -CAR_SPEED_HIGH, -CAR_SPEED_HIGH },
+    { "left", -CAR_SPEED_HIGH, 0 },
+    { "right", 0, -CAR_SPEED_HIGH },
+    { "stop", 0, 0 },
+};
+
+#define CYCLE_LEN (sizeof(cycle) / sizeof(cycle[0]))
+
+/* ---- the pre-cache sequences ---- */
+
+static void legacy_gpio_control(unsigned int gpio, IotGpioValue value)
+{
+    hi_io_set_func(gpio, 0);
+    IoTGpioSetDir(gpio, IOT_GPIO_DIR_OUT);
+    IoTGpioSetOutputVal(gpio, value);
+}
+
+static void legacy_pins(IotGpioValue g0, IotGpioValue g1, IotGpioValue g9, IotGpioValue g10)
+{
+    legacy_gpio_control(0, g0);
+    legacy_gpio_control(1, g1);
+    legacy_gpio_control(9, g9);
+    legacy_gpio_control(10, g10);
+}
+
+static void legacy_transition(const struct transition *t)
+{
+    unsigned int duty;
+
+    if (t->left == 0 && t->right == 0) {
+        IoTPwmStop(HI_PWM_PORT_PWM0);
+        IoTPwmStop(HI_PWM_PORT_PWM1);
+        IoTPwmStop(HI_PWM_PORT_PWM3);
+        IoTPwmStop(HI_PWM_PORT_PWM4);
+        legacy_pins(IOT_GPIO_VALUE1, IOT_GPIO_VALUE1, IOT_GPIO_VALUE1, IOT_GPIO_VALUE1);
+    } else if (t->left > 0) {
+        duty = (unsigned int)t->left;
+        legacy_pins(IOT_GPIO_VALUE0, IOT_GPIO_VALUE1, IOT_GPIO_VALUE0, IOT_GPIO_VALUE1);
+        IoTPwmStart(HI_PWM_PORT_PWM4, duty, PWM_FREQ);
+        IoTPwmStart(HI_PWM_PORT_PWM1, duty, PWM_FREQ);
+    } else if (t->right < 0 && t->left < 0) {
+        duty = (unsigned int)-t->left;
+        legacy_pins(IOT_GPIO_VALUE1, IOT_GPIO_VALUE0, IOT_GPIO_VALUE1, IOT_GPIO_VALUE0);
+        IoTPwmStart(HI_PWM_PORT_PWM3, duty, PWM_FREQ);
+        IoTPwmStart(HI_PWM_PORT_PWM0, duty, PWM_FREQ);
+    } else if (t->left < 0) {
+        duty = (unsigned int)-t->left;
+        legacy_pins(IOT_GPIO_VALUE1, IOT_GPIO_VALUE0, IOT_GPIO_VALUE0, IOT_GPIO_VALUE0);
+        IoTPwmStart(HI_PWM_PORT_PWM3, duty, PWM_FREQ);
+    } else {
+        duty = (unsigned int)-t->right;
+        legacy_pins(IOT_GPIO_VALUE0, IOT_GPIO_VALUE0, IOT_GPIO_VALUE1, IOT_GPIO_VALUE0);
+        IoTPwmStart(HI_PWM_PORT_PWM0, duty, PWM_FREQ);
+    }
+}
+
+static void legacy_init(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < 4; i++) {
+        hi_io_set_func(pins[i].gpio, pins[i].pwm_func);
+        IoTPwmInit(pins[i].port);
+    }
+}
+
+/* ---- checks ---- */
+
+/* Running PWM ports whose pin is not muxed to the PWM function. */
+static unsigned int pwm_pins_muxed_gpio(void)
+{
+    unsigned int bad = 0;
+    unsigned int i;
+
+    for (i = 0; i < 4; i++) {
+        struct sim_pwm_state pwm;
+        struct sim_pin_state pin;
+
+        sim_pwm_get(pins[i].port, &pwm);
+        sim_pin_get(pins[i].gpio, &pin);
+        if (pwm.running && pin.func != pins[i].pwm_func) {
+            bad++;
+        }
+    }
+    return bad;
+}
+
+/* One wheel against a signed duty. */
+static int wheel_ok(const struct motor_pin *fwd, const struct motor_pin *rev, int duty)
+{
+    const struct motor_pin *drive = duty > 0 ? fwd : rev;
+    const struct motor_pin *other = duty > 0 ? rev : fwd;
+    struct sim_pwm_state pwm;
+    struct sim_pin_state pin;
+
+    if (duty == 0) {
+        unsigned int i;
+
+        for (i = 0; i < 2; i++) {
+            const struct motor_pin *p = i == 0 ? fwd : rev;
+
+            sim_pwm_get(p->port, &pwm);
+            sim_pin_get(p->gpio, &pin);
+            if (pwm.running || pin.func != 0 || pin.dir != IOT_GPIO_DIR_OUT || pin.level != 1) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    sim_pwm_get(drive->port, &pwm);
+    sim_pin_get(drive->gpio, &pin);
+    if (!pwm.running || pwm.duty != (unsigned int)(duty > 0 ? duty : -duty) || pin.func != drive->pwm_func) {
+        return 0;
+    }
+    sim_pwm_get(other->port, &pwm);
+    sim_pin_get(other->gpio, &pin);
+    return !pwm.running && pin.func == 0 && pin.dir == IOT_GPIO_DIR_OUT && pin.level == 0;
+}
+
+static unsigned long hal_writes(void)
+{
+    unsigned long counts[SIM_HAL_EVENT_MAX];
+    unsigned long sum = 0;
+    unsigned int i;
+
+    sim_hal_get_counts(counts);
+    for (i = 0; i < SIM_HAL_EVENT_MAX; i++) {
+        if (i != SIM_HAL_ADC_READ && i != SIM_HAL_PWM_INIT) {
+            sum += counts[i];
+        }
+    }
+    return sum;
+}
+
+static void report(FILE *out, const char *name, unsigned long transitions, unsigned long writes, double ns,
+                   unsigned int muxed_gpio)
+{
+    fprintf(out, "\"%s\":{\"hal_writes_per_transition\":%.2f,\"ns_per_transition\":%.0f", name,
+            (double)writes / (double)transitions, ns / (double)transitions);
+    fprintf(out, ",\"pwm_pins_muxed_gpio\":%u", muxed_gpio);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct car_motor_limits no_ramp = { 0, 0, 0, 0 };
+    unsigned long cycles = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000UL;
+    unsigned long transitions = cycles * CYCLE_LEN;
+    unsigned int legacy_muxed = 0;
+    unsigned int cached_muxed = 0;
+    unsigned int cached_wrong = 0;
+    unsigned long legacy_writes;
+    unsigned long cached_writes;
+    double legacy_ns;
+    double cached_ns;
+    unsigned long c;
+    unsigned int i;
+    uint64_t t0;
+    FILE *out;
+
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+
+    /* One checked pass, then the timed cycles. */
+    legacy_init();
+    for (i = 0; i < CYCLE_LEN; i++) {
+        legacy_transition(&cycle[i]);
+        legacy_muxed += pwm_pins_muxed_gpio();
+    }
+    sim_hal_reset_counts();
+    t0 = sim_now_ns();
+    for (c = 0; c < cycles; c++) {
+        for (i = 0; i < CYCLE_LEN; i++) {
+            legacy_transition(&cycle[i]);
+        }
+    }
+    legacy_ns = (double)(sim_now_ns() - t0);
+    legacy_writes = hal_writes();
+
+    pwm_init();
+    car_motor_set_limits(&no_ramp);
+    for (i = 0; i < CYCLE_LEN; i++) {
+        car_motor_set(cycle[i].left, cycle[i].right);
+        cached_muxed += pwm_pins_muxed_gpio();
+        if (!wheel_ok(&pins[0], &pins[1], cycle[i].left) || !wheel_ok(&pins[2], &pins[3], cycle[i].right)) {
+            fprintf(stderr, "%s: simulated pins do not match\n", cycle[i].name);
+            cached_wrong++;
+        }
+    }
+    sim_hal_reset_counts();
+    t0 = sim_now_ns();
+    for (c = 0; c < cycles; c++) {
+        for (i = 0; i < CYCLE_LEN; i++) {
+            car_motor_set(cycle[i].left, cycle[i].right);
+        }
+    }
+    cached_ns = (double)(sim_now_ns() - t0);
+    cached_writes = hal_writes();
+
+    fprintf(out, "{\"bench\":\"pins\",\"transitions\":%lu,", transitions);
+    report(out, "legacy", transitions, legacy_writes, legacy_ns, legacy_muxed);
+    fprintf(out, "},");
+    report(out, "cached", transitions, cached_writes, cached_ns, cached_muxed);
+    fprintf(out, ",\"wrong_outputs\":%u}}\n", cached_wrong);
+    fclose(out);
+    return cached_muxed == 0 && cached_wrong == 0 ? 0 : 1;
+}
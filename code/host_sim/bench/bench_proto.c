@@ -0,0 +1,227 @@
+/*
+ * Parse cost per packet and peak parser stack: binary control frames, the
+ * legacy JSON tokenizer and, when built with CJSON_DIR, cJSON itself.
+ * Also checks that frames and segment programs with out-of-range fields are
+ * rejected, and that a telemetry frame prepared once decodes correctly for
+ * each session it is finished for, with or without an ack.
+ *
+ *   ./build/bench_proto [iterations]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "car_proto.h"
+#include "car_test.h"
+#include "sim_hal.h"
+
+#ifdef BENCH_CJSON
+#include "cJSON.h"
+#endif
+
+#define STACK_PROBE_SIZE (128 * 1024)
+#define STACK_PAINT 0xA5
+
+static const char *const json_packets[] = {
+    "{\"cmd\":\"forward\",\"mode\":\"step\",\"speed\":\"high\"}",
+    "{\"cmd\":\"left\",\"mode\":\"alway\",\"speed\":\"low\"}",
+    "{\"cmd\":\"stop\"}",
+    "{\"cmd\": \"backward\", \"mode\": \"step\", \"speed\": \"medium\"}",
+};
+
+#define PACKET_NUM (sizeof(json_packets) / sizeof(json_packets[0]))
+
+static unsigned char frames[PACKET_NUM][CAR_PROTO_MIN_LEN];
+static int frame_len[PACKET_NUM];
+static int json_len[PACKET_NUM];
+static volatile unsigned long sink;
+
+static void *run_nothing(void *arg)
+{
+    return arg;
+}
+
+static void *run_tokenizer(void *arg)
+{
+    struct car_cmd cmd;
+    unsigned int i;
+    for (i = 0; i < PACKET_NUM; i++) {
+        car_proto_parse_json(json_packets[i], json_len[i], &cmd);
+        sink += cmd.op;
+    }
+    return arg;
+}
+
+static void *run_binary(void *arg)
+{
+    struct car_cmd cmd;
+    unsigned int i;
+    for (i = 0; i < PACKET_NUM; i++) {
+        car_proto_decode(frames[i], frame_len[i], &cmd);
+        sink += cmd.op;
+    }
+    return arg;
+}
+
+#ifdef BENCH_CJSON
+/* The lookups the old udp_thread() did on every datagram. */
+static void *run_cjson(void *arg)
+{
+    unsigned int i;
+    for (i = 0; i < PACKET_NUM; i++) {
+        cJSON *root = cJSON_Parse(json_packets[i]);
+        cJSON *cmd = cJSON_GetObjectItem(root, "cmd");
+        cJSON *mode = cJSON_GetObjectItem(root, "mode");
+        cJSON *speed = cJSON_GetObjectItem(root, "speed");
+        sink += (cmd != NULL) + (mode != NULL) + (speed != NULL);
+        cJSON_Delete(root);
+    }
+    return arg;
+}
+#endif
+
+/* A segment program is rejected as a whole when any one segment is out of range. */
+static int segments_rejected(void)
+{
+    static const unsigned char bad[][CAR_SEG_WIRE_LEN] = {
+        { CAR_STATUS_LEFT, 0x01, 0xFA, 0x64, 0x00 }, /* speed CAR_DUTY_MAX + 1 */
+        { CAR_STATUS_DRIVE, 0x10, 0x27, 0x64, 0x00 },
+        { CAR_STATUS_MAX, 0x10, 0x27, 0x64, 0x00 },
+    };
+    unsigned char payload[1 + 2 * CAR_SEG_WIRE_LEN] = { 0, CAR_STATUS_FORWARD, 0x10, 0x27, 0x64, 0x00 };
+    struct car_segment seg[2];
+    struct car_cmd cmd = { .op = CAR_OP_SEGMENTS, .payload = payload, .payload_len = sizeof(payload) };
+    int append;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        memcpy(payload + 1 + CAR_SEG_WIRE_LEN, bad[i], CAR_SEG_WIRE_LEN);
+        if (car_proto_get_segments(&cmd, seg, 2, &append) != CAR_PROTO_ERR_RANGE) {
+            return 0;
+        }
+    }
+    payload[1 + CAR_SEG_WIRE_LEN] = CAR_STATUS_BACKWARD;
+    return car_proto_get_segments(&cmd, seg, 2, &append) == 2;
+}
+
+/* Runs fn on a painted stack and returns how many bytes it touched. */
+static size_t stack_usage(void *(*fn)(void *))
+{
+    unsigned char *stack = NULL;
+    pthread_attr_t attr;
+    pthread_t tid;
+    size_t i;
+
+    if (posix_memalign((void **)&stack, 4096, STACK_PROBE_SIZE) != 0) {
+        return 0;
+    }
+    memset(stack, STACK_PAINT, STACK_PROBE_SIZE);
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, STACK_PROBE_SIZE);
+    pthread_create(&tid, &attr, fn, NULL);
+    pthread_join(tid, NULL);
+    pthread_attr_destroy(&attr);
+
+    for (i = 0; i < STACK_PROBE_SIZE && stack[i] == STACK_PAINT; i++) {
+    }
+    free(stack);
+    return STACK_PROBE_SIZE - i;
+}
+
+static double ns_per_packet(void *(*fn)(void *), unsigned long iterations)
+{
+    uint64_t t0 = sim_now_ns();
+    unsigned long i;
+
+    for (i = 0; i < iterations; i++) {
+        fn(NULL);
+    }
+    return (double)(sim_now_ns() - t0) / (double)(iterations * PACKET_NUM);
+}
+
+/* Decodes a finished telemetry frame and checks its seq, ack and link metrics. */
+static int state_frame_ok(struct car_state_frame *frame, unsigned short seq, const struct car_ack *ack,
+                          const struct car_link_report *link)
+{
+    struct car_link_report got_link;
+    struct car_ack got_ack;
+    struct car_cmd cmd;
+    int len = car_proto_state_finish(frame, seq, ack);
+
+    if (car_proto_decode(frame->buf, len, &cmd) != CAR_PROTO_OK || cmd.op != CAR_OP_STATE || cmd.seq != seq ||
+        car_proto_get_ack(&cmd, &got_ack) != (ack != NULL) || car_proto_get_link(&cmd, &got_link) != 1) {
+        return 0;
+    }
+    if (ack != NULL && (got_ack.seq != ack->seq || got_ack.mask != ack->mask)) {
+        return 0;
+    }
+    return memcmp(&got_link, link, sizeof(got_link)) == 0 && cmd.payload[1] == CAR_STATUS_LEFT;
+}
+
+/* One full frame finished for three sessions in turn, then an unchanged delta. */
+static int shared_state_frames(void)
+{
+    static const struct car_link_report link = { 1234, 56, { 10, 20, 30, 20, 10, 10 } };
+    static const struct car_ack ack = { 41, 1, 0x0000000DU };
+    struct car_state state;
+    struct car_state_frame frame;
+
+    memset(&state, 0, sizeof(state));
+    state.cur_status = CAR_STATUS_LEFT;
+    state.go_status = CAR_STATUS_LEFT;
+    state.speed = CAR_SPEED_HIGH;
+    if (car_proto_state_prepare(&frame, &state, NULL, &link) != 1) {
+        return 0;
+    }
+    if (!state_frame_ok(&frame, 7, &ack, &link) || !state_frame_ok(&frame, 300, NULL, &link) ||
+        !state_frame_ok(&frame, 8, &ack, &link)) {
+        return 0;
+    }
+    return car_proto_state_prepare(&frame, &state, &state, NULL) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000UL;
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    struct car_cmd cmd;
+    size_t base_stack;
+    int range_ok;
+    int shared_ok;
+    unsigned int i;
+    int len;
+
+    /* Same commands, once per format. */
+    for (i = 0; i < PACKET_NUM; i++) {
+        json_len[i] = (int)strlen(json_packets[i]);
+        if (car_proto_parse_json(json_packets[i], json_len[i], &cmd) != CAR_PROTO_OK) {
+            fprintf(stderr, "bad JSON sample %u\n", i);
+            return 1;
+        }
+        cmd.seq = (unsigned short)i;
+        frame_len[i] = car_proto_encode(frames[i], sizeof(frames[i]), &cmd);
+    }
+
+    /* A speed above CAR_DUTY_MAX would reach the PWM as is. */
+    cmd.speed = CAR_DUTY_MAX + 1;
+    len = car_proto_encode(frame, sizeof(frame), &cmd);
+    range_ok = car_proto_decode(frame, len, &cmd) == CAR_PROTO_ERR_RANGE;
+    range_ok = range_ok && segments_rejected();
+    shared_ok = shared_state_frames();
+
+    base_stack = stack_usage(run_nothing);
+    printf("{\"bench\":\"proto\",\"iterations\":%lu,\"json_bytes\":%d,\"binary_bytes\":%d", iterations,
+           json_len[0], frame_len[0]);
+    printf(",\"binary_ns_per_packet\":%.1f,\"binary_stack_bytes\":%zu", ns_per_packet(run_binary, iterations),
+           stack_usage(run_binary) - base_stack);
+    printf(",\"json_ns_per_packet\":%.1f,\"json_stack_bytes\":%zu", ns_per_packet(run_tokenizer, iterations),
+           stack_usage(run_tokenizer) - base_stack);
+#ifdef BENCH_CJSON
+    printf(",\"cjson_ns_per_packet\":%.1f,\"cjson_stack_bytes\":%zu", ns_per_packet(run_cjson, iterations),
+           stack_usage(run_cjson) - base_stack);
+#endif
+    printf(",\"range_rejected\":%d,\"shared_state_frames\":%d}\n", range_ok, shared_ok);
+    return range_ok && shared_ok ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+/*
+ * Motor duty ramp: drives the running application through stop, forward at
+ * high, a direct reversal to backward at high, left and stop, rebuilds the
+ * signed per-wheel duty trajectory from the PWM writes seen by the simulated
+ * HAL and checks it against the default car_motor limits:
+ *
+ *   - no update changes the duty by more than accel (away from zero) or
+ *     decel (towards zero) times one ramp period,
+ *   - consecutive updates change the step by no more than jerk times one
+ *     ramp period squared,
+ *   - a reversal passes through zero and dwells there for the zero dwell.
+ *
+ *   ./build/bench_ramp
+ *
+ * Exits non-zero on any violation.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_link.h"
+#include "car_motor.h"
+#include "car_proto.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define MAX_SAMPLES 1024
+
+struct sample {
+    uint64_t t_ns;
+    int duty;
+};
+
+struct wheel_trace {
+    unsigned int fwd_port;
+    unsigned int rev_port;
+    unsigned int fwd_duty; /* 0 while stopped */
+    unsigned int rev_duty;
+    int duty;
+    unsigned int count;
+    struct sample samples[MAX_SAMPLES];
+};
+
+struct step {
+    unsigned char op;
+    unsigned short speed;
+    unsigned int hold_ms;
+    int target[CAR_WHEEL_MAX];
+};
+
+/* The scripted controller does not keep the link alive between commands. */
+static const struct car_link_limits no_watchdog = { 0, 0, 0 };
+
+static const struct step script[] = {
+    { CAR_OP_FORWARD, CAR_SPEED_HIGH, 1000, { CAR_SPEED_HIGH, CAR_SPEED_HIGH } },
+    { CAR_OP_BACKWARD, CAR_SPEED_HIGH, 1500, { -CAR_SPEED_HIGH, -CAR_SPEED_HIGH } },
+    { CAR_OP_LEFT, CAR_SPEED_LOW, 1000, { -CAR_SPEED_LOW, 0 } },
+    { CAR_OP_STOP, 0, 1000, { 0, 0 } },
+};
+
+#define SCRIPT_LEN (sizeof(script) / sizeof(script[0]))
+
+static uint64_t sent_ns[SCRIPT_LEN];
+
+static struct wheel_trace wheels[CAR_WHEEL_MAX] = {
+    { HI_PWM_PORT_PWM4, HI_PWM_PORT_PWM3, 0, 0, 0, 0, { { 0, 0 } } },
+    { HI_PWM_PORT_PWM1, HI_PWM_PORT_PWM0, 0, 0, 0, 0, { { 0, 0 } } },
+};
+static unsigned long hal_writes;
+
+/* HAL hook, called from the control task: one sample per change of signed duty. */
+static void on_hal(const struct sim_hal_event *ev, void *ctx)
+{
+    unsigned int i;
+
+    (void)ctx;
+    if (ev->type == SIM_HAL_ADC_READ) {
+        return;
+    }
+    hal_writes++;
+    if (ev->type != SIM_HAL_PWM_START && ev->type != SIM_HAL_PWM_STOP) {
+        return;
+    }
+    for (i = 0; i < CAR_WHEEL_MAX; i++) {
+        struct wheel_trace *w = &wheels[i];
+        unsigned int duty = ev->type == SIM_HAL_PWM_START ? ev->value : 0;
+        int signed_duty;
+
+        if (ev->id == w->fwd_port) {
+            w->fwd_duty = duty;
+        } else if (ev->id == w->rev_port) {
+            w->rev_duty = duty;
+        } else {
+            continue;
+        }
+        signed_duty = w->fwd_duty != 0 ? (int)w->fwd_duty : -(int)w->rev_duty;
+        if (w->fwd_duty != 0 && w->rev_duty != 0) {
+            signed_duty = 0x7FFFFFFF; /* both directions driven: always a violation */
+        }
+        if (signed_duty != w->duty && w->count < MAX_SAMPLES) {
+            w->samples[w->count].t_ns = ev->t_ns;
+            w->samples[w->count].duty = signed_duty;
+            __atomic_store_n(&w->count, w->count + 1, __ATOMIC_RELEASE);
+        }
+        w->duty = signed_duty;
+    }
+}
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int abs_int(int v)
+{
+    return v < 0 ? -v : v;
+}
+
+struct ramp_result {
+    unsigned int updates;
+    unsigned int violations;
+    unsigned int reversals;
+    int max_step;
+    int max_jerk;
+    double min_dwell_ms;
+};
+
+/* Target of the wheel at time t: the last command sent before it, stopped before the first. */
+static int target_at(unsigned int wheel, uint64_t t)
+{
+    int target = 0;
+    unsigned int i;
+
+    for (i = 0; i < SCRIPT_LEN && sent_ns[i] <= t; i++) {
+        target = script[i].target[wheel];
+    }
+    return target;
+}
+
+static void check_wheel(const char *name, unsigned int wheel, struct ramp_result *r)
+{
+    const struct wheel_trace *w = &wheels[wheel];
+    const int accel_step = CAR_MOTOR_ACCEL_MAX / 1000 * CAR_MOTOR_RAMP_MS;
+    const int decel_step = CAR_MOTOR_DECEL_MAX / 1000 * CAR_MOTOR_RAMP_MS;
+    const int jerk_step = (int)((long long)CAR_MOTOR_JERK_MAX * CAR_MOTOR_RAMP_MS * CAR_MOTOR_RAMP_MS / 1000000);
+    unsigned int n = __atomic_load_n(&w->count, __ATOMIC_ACQUIRE);
+    int prev = 0;
+    int prev_step = 0;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        const struct sample *s = &w->samples[i];
+        int step = s->duty - prev;
+        int limit = abs_int(s->duty) > abs_int(prev) ? accel_step : decel_step;
+
+        /* The ramp starts from rest at zero (from a stop or a reversal) and after it had reached its target. */
+        if (prev == 0 || (i > 0 && prev == target_at(wheel, w->samples[i - 1].t_ns))) {
+            prev_step = 0;
+        }
+        r->updates++;
+        if (abs_int(step) > r->max_step) {
+            r->max_step = abs_int(step);
+        }
+        if (abs_int(step - prev_step) > r->max_jerk) {
+            r->max_jerk = abs_int(step - prev_step);
+        }
+        if ((long long)s->duty * prev < 0 || s->duty == 0x7FFFFFFF) {
+            fprintf(stderr, "%s: %d -> %d without passing through zero\n", name, prev, s->duty);
+            r->violations++;
+        } else if (abs_int(step) > limit) {
+            fprintf(stderr, "%s: step %d -> %d exceeds %d\n", name, prev, s->duty, limit);
+            r->violations++;
+        } else if (abs_int(step - prev_step) > jerk_step) {
+            fprintf(stderr, "%s: step change %d -> %d exceeds %d\n", name, prev_step, step, jerk_step);
+            r->violations++;
+        }
+
+        /* Zero between two duties of opposite sign: time spent at zero. */
+        if (s->duty == 0 && prev != 0 && i + 1 < n && (long long)w->samples[i + 1].duty * prev < 0) {
+            double dwell = (double)(w->samples[i + 1].t_ns - s->t_ns) / 1e6;
+
+            r->reversals++;
+            if (r->min_dwell_ms < 0 || dwell < r->min_dwell_ms) {
+                r->min_dwell_ms = dwell;
+            }
+            /* The dwell is counted in ramp periods; allow half a period of timer jitter. */
+            if (dwell < CAR_MOTOR_ZERO_DWELL_MS - CAR_MOTOR_RAMP_MS / 2.0) {
+                fprintf(stderr, "%s: dwell at zero %.1f ms\n", name, dwell);
+                r->violations++;
+            }
+        }
+        prev_step = step;
+        prev = s->duty;
+    }
+}
+
+int main(void)
+{
+    struct ramp_result r = { 0, 0, 0, 0, 0, -1.0 };
+    struct sockaddr_in car_addr = { 0 };
+    unsigned short seq = 0;
+    unsigned int i;
+    int fd;
+    FILE *out;
+
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+
+    car_link_set_limits(&no_watchdog);
+    sim_start();
+    sleep_ms(500);
+    sim_hal_set_hook(on_hal, NULL);
+
+    for (i = 0; i < SCRIPT_LEN; i++) {
+        unsigned char frame[CAR_PROTO_MIN_LEN];
+        struct car_cmd cmd;
+        int len;
+
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.seq = ++seq;
+        cmd.op = script[i].op;
+        cmd.mode = CAR_MODE_ALWAY;
+        cmd.speed = script[i].speed;
+        len = car_proto_encode(frame, sizeof(frame), &cmd);
+        sent_ns[i] = sim_now_ns();
+        sendto(fd, frame, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+        sleep_ms(script[i].hold_ms);
+    }
+    sim_hal_set_hook(NULL, NULL);
+
+    check_wheel("left", CAR_WHEEL_LEFT, &r);
+    check_wheel("right", CAR_WHEEL_RIGHT, &r);
+
+    fprintf(out, "{\"bench\":\"ramp\",\"updates\":%u,\"hal_writes\":%lu,\"max_step\":%d,\"max_step_change\":%d", r.updates,
+            hal_writes, r.max_step, r.max_jerk);
+    fprintf(out, ",\"reversals\":%u,\"min_dwell_ms\":%.1f,\"violations\":%u}\n", r.reversals, r.min_dwell_ms,
+            r.violations);
+    fclose(out);
+    _exit(r.violations == 0 && r.reversals > 0 ? 0 : 1);
+}
@@ -0,0 +1,390 @@
+/*
+ * Reliable command delivery (CAR_OP_F_RELIABLE, car_reliable.h) over a
+ * simulated lossy link. Commands from the bench reach the running car
+ * through an impairment stage that drops, duplicates and delays each
+ * datagram by a random amount, so later datagrams overtake earlier ones;
+ * telemetry frames coming back lose their acks at the same rate.
+ *
+ * Each cycle sends a burst of motion commands CYCLE_GAP_MS apart and then a
+ * stop, and watches the car for HOLD_MS. It runs once with plain frames and
+ * once with reliable frames, retransmitted as car_proto.h asks until the
+ * ack covers them (stops at CAR_REL_RETRY_STOP_MS, others at
+ * CAR_REL_RETRY_MS). Per run it reports the stops that did not stop the car
+ * or were undone by a late motion command, the send-to-stopped and
+ * send-to-ack latencies and the retransmissions, plus the car's session
+ * counters.
+ *
+ * During the reliable run a second controller sends a reliable heartbeat
+ * with seq 0 every cycle, straight to the car. It has its own session and
+ * window and must not restart the first controller's window.
+ *
+ * Checks that with reliable delivery every stop holds, that the
+ * duplicates and overtaken commands the link produced were rejected rather
+ * than applied, and that the car started exactly one window per controller.
+ *
+ *   ./build/bench_reliable [cycles] [loss_pct] [seed]
+ *
+ * The car binds its ports with SIM_BIND_PORT_OFFSET (default 10000) and
+ * sends telemetry back to the socket each run sends its commands from.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_motor.h"
+#include "car_proto.h"
+#include "car_reliable.h"
+#include "car_test.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define MAX_CYCLES 1000
+#define BURST 4
+#define CYCLE_GAP_MS 5
+#define HOLD_MS 300
+#define DUP_PCT 5
+#define DELAY_US 2000
+#define JITTER_US 10000
+#define LINK_SLOTS 256
+
+/* Without the ramp a stop shows in the car state at once. */
+static const struct car_motor_limits no_ramp = { 0, 0, 0, 0 };
+
+static const unsigned char motions[] = { CAR_OP_FORWARD, CAR_OP_LEFT, CAR_OP_BACKWARD, CAR_OP_RIGHT };
+
+/* The impaired link: datagrams waiting for their delivery time. */
+struct link_packet {
+    uint64_t due_ns;
+    int fd;
+    int len;
+    unsigned char data[CAR_PROTO_MIN_LEN + 1];
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct link_packet slot[LINK_SLOTS];
+    unsigned int used;
+    unsigned int loss_pct;
+    unsigned long sent;
+    unsigned long dropped;
+    unsigned long duplicated;
+    unsigned long acks_dropped;
+    unsigned int rng;
+} net = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static struct sockaddr_in car_addr;
+static volatile int quit;
+static int other_fd;
+static int run_fd; /* the current run's socket, telemetry comes back to it */
+
+/* Newest ack that made it back through the link. */
+static pthread_mutex_t ack_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct car_ack last_ack;
+
+struct run_result {
+    unsigned int stops;
+    unsigned int lost;
+    unsigned int retransmits;
+    unsigned int n_stop;
+    unsigned int n_ack;
+    double stop_ms[MAX_CYCLES];
+    double ack_ms[MAX_CYCLES];
+};
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* xorshift32, under net.lock. */
+static unsigned int link_rand(unsigned int n)
+{
+    net.rng ^= net.rng << 13;
+    net.rng ^= net.rng >> 17;
+    net.rng ^= net.rng << 5;
+    return net.rng % n;
+}
+
+static void link_queue(int fd, const unsigned char *data, int len)
+{
+    if (net.used < LINK_SLOTS) {
+        struct link_packet *p = &net.slot[net.used++];
+        p->due_ns = sim_now_ns() + (DELAY_US + link_rand(JITTER_US)) * 1000ULL;
+        p->fd = fd;
+        p->len = len;
+        memcpy(p->data, data, (size_t)len);
+    }
+}
+
+/* Hands a datagram to the link: it may be dropped, delayed or sent twice. */
+static void link_send(int fd, const unsigned char *data, int len)
+{
+    pthread_mutex_lock(&net.lock);
+    net.sent++;
+    if (link_rand(100) < net.loss_pct) {
+        net.dropped++;
+    } else {
+        link_queue(fd, data, len);
+        if (link_rand(100) < DUP_PCT) {
+            net.duplicated++;
+            link_queue(fd, data, len);
+        }
+    }
+    pthread_mutex_unlock(&net.lock);
+}
+
+/* Delivers the datagrams that are due, in due order. */
+static void *link_thread(void *arg)
+{
+    (void)arg;
+    while (!quit) {
+        struct link_packet due;
+        int found = 0;
+
+        pthread_mutex_lock(&net.lock);
+        uint64_t now = sim_now_ns();
+        unsigned int best = 0;
+        for (unsigned int i = 0; i < net.used; i++) {
+            if (net.slot[i].due_ns <= now && (!found || net.slot[i].due_ns < net.slot[best].due_ns)) {
+                best = i;
+                found = 1;
+            }
+        }
+        if (found) {
+            due = net.slot[best];
+            net.slot[best] = net.slot[--net.used];
+        }
+        pthread_mutex_unlock(&net.lock);
+
+        if (found) {
+            sendto(due.fd, due.data, due.len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+        } else {
+            usleep(100);
+        }
+    }
+    return NULL;
+}
+
+/* Reads telemetry and keeps the acks that survive the link. */
+static void *ack_thread(void *arg)
+{
+    unsigned char buf[256];
+    struct car_cmd frame;
+    struct car_ack ack;
+
+    (void)arg;
+    while (!quit) {
+        int len = (int)recv(__atomic_load_n(&run_fd, __ATOMIC_ACQUIRE), buf, sizeof(buf), 0);
+        if (len <= 0 || car_proto_decode(buf, len, &frame) != CAR_PROTO_OK || car_proto_get_ack(&frame, &ack) != 1) {
+            continue;
+        }
+        pthread_mutex_lock(&net.lock);
+        int lost = link_rand(100) < net.loss_pct;
+        net.acks_dropped += lost;
+        pthread_mutex_unlock(&net.lock);
+        if (!lost) {
+            pthread_mutex_lock(&ack_lock);
+            last_ack = ack;
+            pthread_mutex_unlock(&ack_lock);
+        }
+    }
+    return NULL;
+}
+
+/* Seen by the car: in the ack window, or older than it. */
+static int acked(unsigned short seq)
+{
+    struct car_ack ack;
+    short behind;
+
+    pthread_mutex_lock(&ack_lock);
+    ack = last_ack;
+    pthread_mutex_unlock(&ack_lock);
+    behind = (short)(ack.seq - seq);
+    return ack.valid && behind >= 0 && (behind >= CAR_REL_WINDOW || (ack.mask & (1U << behind)));
+}
+
+static int encode(unsigned char *frame, unsigned short seq, unsigned char op, int reliable)
+{
+    struct car_cmd cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.seq = seq;
+    cmd.op = op;
+    cmd.mode = CAR_MODE_ALWAY;
+    cmd.speed = CAR_SPEED_HIGH;
+    cmd.flags = reliable ? CAR_CMD_F_RELIABLE : 0;
+    return car_proto_encode(frame, CAR_PROTO_MIN_LEN + 1, &cmd);
+}
+
+static unsigned int cur_status(void)
+{
+    struct car_state state;
+
+    get_car_state(&state);
+    return state.cur_status;
+}
+
+/*
+ * One run of cycles on its own socket (a new session). The newest command
+ * supersedes the older ones, so only it is retransmitted.
+ */
+static void run(int fd, unsigned int cycles, int reliable, struct run_result *res)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN + 1];
+    unsigned short seq = 0;
+
+    memset(res, 0, sizeof(*res));
+    pthread_mutex_lock(&ack_lock);
+    memset(&last_ack, 0, sizeof(last_ack));
+    pthread_mutex_unlock(&ack_lock);
+    __atomic_store_n(&run_fd, fd, __ATOMIC_RELEASE);
+
+    for (unsigned int c = 0; c < cycles; c++) {
+        unsigned int i;
+        int len;
+
+        if (reliable) {
+            len = encode(frame, 0, CAR_OP_NOP, 1);
+            sendto(other_fd, frame, len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+        }
+        for (i = 0; i < BURST; i++) {
+            link_send(fd, frame, encode(frame, seq++, motions[(c + i) % sizeof(motions)], reliable));
+            sleep_ms(CYCLE_GAP_MS);
+        }
+
+        unsigned short stop_seq = seq++;
+        len = encode(frame, stop_seq, CAR_OP_STOP, reliable);
+        uint64_t sent = sim_now_ns();
+        uint64_t last_tx = sent;
+        uint64_t end = sent + HOLD_MS * 1000000ULL;
+        int stopped = 0;
+        int ack_seen = 0;
+
+        link_send(fd, frame, len);
+        res->stops++;
+        for (uint64_t now = sent; now < end; now = sim_now_ns()) {
+            if (!stopped && cur_status() == CAR_STATUS_STOP) {
+                res->stop_ms[res->n_stop++] = (double)(now - sent) / 1e6;
+                stopped = 1;
+            }
+            if (reliable && !ack_seen) {
+                if (acked(stop_seq)) {
+                    res->ack_ms[res->n_ack++] = (double)(now - sent) / 1e6;
+                    ack_seen = 1;
+                } else if (now - last_tx >= CAR_REL_RETRY_STOP_MS * 1000000ULL) {
+                    link_send(fd, frame, len);
+                    res->retransmits++;
+                    last_tx = now;
+                }
+            }
+            usleep(200);
+        }
+        /* Lost, or undone by a motion command that arrived late. */
+        if (!stopped || cur_status() != CAR_STATUS_STOP) {
+            res->lost++;
+        }
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_run(FILE *out, const char *name, struct run_result *res)
+{
+    qsort(res->stop_ms, res->n_stop, sizeof(double), cmp_double);
+    qsort(res->ack_ms, res->n_ack, sizeof(double), cmp_double);
+    fprintf(out, ",\"%s\":{\"stops\":%u,\"stops_lost\":%u,\"retransmits\":%u", name, res->stops, res->lost,
+            res->retransmits);
+    fprintf(out, ",\"stop_ms_p50\":%.1f,\"stop_ms_p99\":%.1f", res->n_stop ? res->stop_ms[res->n_stop / 2] : 0.0,
+            res->n_stop ? res->stop_ms[(res->n_stop * 99) / 100] : 0.0);
+    fprintf(out, ",\"ack_ms_p50\":%.1f,\"ack_ms_p99\":%.1f}", res->n_ack ? res->ack_ms[res->n_ack / 2] : 0.0,
+            res->n_ack ? res->ack_ms[(res->n_ack * 99) / 100] : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int cycles = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 50U;
+    static struct run_result plain;
+    static struct run_result rel;
+    struct car_rel_stats before;
+    struct car_rel_stats after;
+    int fds[2];
+    struct timeval tv = { 0, 100000 };
+    pthread_t link_tid;
+    pthread_t ack_tid;
+    unsigned int applied;
+    int ok;
+    FILE *out;
+
+    cycles = cycles > MAX_CYCLES ? MAX_CYCLES : cycles;
+    net.loss_pct = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 20U;
+    net.rng = argc > 3 ? (unsigned int)strtoul(argv[3], NULL, 10) : 1U;
+    net.rng = net.rng == 0 ? 1 : net.rng;
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+
+    for (unsigned int i = 0; i < 2; i++) {
+        fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        setsockopt(fds[i], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    run_fd = fds[0];
+    other_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    car_motor_set_limits(&no_ramp);
+    sim_start();
+    sleep_ms(500);
+    pthread_create(&link_tid, NULL, link_thread, NULL);
+    pthread_create(&ack_tid, NULL, ack_thread, NULL);
+
+    run(fds[0], cycles, 0, &plain);
+    car_rel_get_stats(&before);
+    run(fds[1], cycles, 1, &rel);
+    sleep_ms(50);
+    car_rel_get_stats(&after);
+    quit = 1;
+    pthread_join(link_tid, NULL);
+    pthread_join(ack_tid, NULL);
+    close(fds[0]);
+    close(fds[1]);
+    close(other_fd);
+
+    applied = after.result[CAR_REL_APPLY] - before.result[CAR_REL_APPLY];
+    fprintf(out, "{\"bench\":\"reliable\",\"cycles\":%u,\"loss_pct\":%u,\"dup_pct\":%u,\"jitter_ms\":%u", cycles,
+            net.loss_pct, DUP_PCT, JITTER_US / 1000);
+    fprintf(out, ",\"link\":{\"sent\":%lu,\"dropped\":%lu,\"duplicated\":%lu,\"acks_dropped\":%lu}", net.sent,
+            net.dropped, net.duplicated, net.acks_dropped);
+    print_run(out, "plain", &plain);
+    print_run(out, "reliable", &rel);
+    fprintf(out, ",\"car\":{\"sessions\":%u,\"applied\":%u,\"duplicate\":%u,\"stale\":%u,\"too_old\":%u}}\n",
+            after.sessions - before.sessions, applied,
+            after.result[CAR_REL_DUPLICATE] - before.result[CAR_REL_DUPLICATE],
+            after.result[CAR_REL_STALE] - before.result[CAR_REL_STALE],
+            after.result[CAR_REL_TOO_OLD] - before.result[CAR_REL_TOO_OLD]);
+    fclose(out);
+
+    /* Each of the cycles * (BURST + 1) commands is applied at most once. */
+    ok = rel.lost == 0 && after.sessions - before.sessions == 2 && applied <= cycles * (BURST + 1) &&
+         (net.duplicated == 0 || after.result[CAR_REL_DUPLICATE] > before.result[CAR_REL_DUPLICATE]);
+    _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,197 @@
+/*
+ * Command receive path throughput, in packets per second:
+ *
+ *   - recvfrom: the old udp_receive(), which cleared a 1 KB buffer, copied
+ *     each datagram into it with one recvfrom() and decoded the copy,
+ *   - netconn: the netconn path (lwip/api.h), which takes datagrams in
+ *     recvmmsg() batches on the host and decodes them in the netbuf they
+ *     arrived in.
+ *
+ * Each round queues a burst of command frames on a loopback socket and
+ * times draining and decoding it, so the sender is not measured. Binary
+ * frames and legacy JSON datagrams are measured separately. Checks that
+ * every datagram was decoded and that the netconn path is the faster one.
+ *
+ *   ./build/bench_rx [packets] [burst]
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "car_proto.h"
+#include "car_test.h"
+#include "lwip/api.h"
+#include "sim_hal.h"
+
+/* The netconn has no getsockname(), so it gets a fixed loopback port. */
+#define NETCONN_PORT 50011
+#define MAX_BURST 256
+#define RCVBUF_BYTES (1024 * 1024)
+
+static const char json_cmd[] = "{\"cmd\":\"forward\",\"mode\":\"alway\",\"speed\":\"high\"}";
+
+static char recvline[1024];
+static volatile unsigned long sink;
+
+/* The decoder both paths share, as in udp_test.c. */
+static int decode(const unsigned char *data, int len)
+{
+    struct car_cmd cmd;
+
+    if (len > 0 && data[0] == CAR_PROTO_MAGIC) {
+        return car_proto_decode(data, len, &cmd) == CAR_PROTO_OK ? cmd.op : -1;
+    }
+    return car_proto_parse_json((const char *)data, len, &cmd) == CAR_PROTO_OK ? cmd.op : -1;
+}
+
+static unsigned int drain_recvfrom(int fd)
+{
+    struct sockaddr_in from;
+    socklen_t from_len;
+    unsigned int n = 0;
+
+    for (;;) {
+        memset(recvline, 0, sizeof(recvline));
+        from_len = sizeof(from);
+        int ret = (int)recvfrom(fd, recvline, sizeof(recvline) - 1, MSG_DONTWAIT, (struct sockaddr *)&from,
+                                &from_len);
+        if (ret <= 0) {
+            return n;
+        }
+        recvline[ret] = '\0';
+        sink += (unsigned long)decode((const unsigned char *)recvline, ret);
+        n++;
+    }
+}
+
+static unsigned int drain_netconn(struct netconn *conn)
+{
+    struct netbuf *buf;
+    unsigned int n = 0;
+
+    while (netconn_recv(conn, &buf) == ERR_OK) {
+        void *data;
+        u16_t len;
+
+        if (netbuf_data(buf, &data, &len) == ERR_OK) {
+            sink += (unsigned long)decode(data, len);
+        }
+        netbuf_delete(buf);
+        n++;
+    }
+    return n;
+}
+
+static void send_burst(int fd, const struct sockaddr_in *to, const void *frame, int len, unsigned int burst)
+{
+    for (unsigned int i = 0; i < burst; i++) {
+        sendto(fd, frame, len, 0, (const struct sockaddr *)to, sizeof(*to));
+    }
+}
+
+struct rx_result {
+    double recvfrom_pps;
+    double netconn_pps;
+    unsigned long drops;
+};
+
+static void run(int tx, int rx, const struct sockaddr_in *rx_addr, struct netconn *conn,
+                const struct sockaddr_in *conn_addr, const void *frame, int len, unsigned int packets,
+                unsigned int burst, struct rx_result *res)
+{
+    uint64_t recvfrom_ns = 0;
+    uint64_t netconn_ns = 0;
+    unsigned long recvfrom_n = 0;
+    unsigned long netconn_n = 0;
+
+    for (unsigned int done = 0; done < packets; done += burst) {
+        uint64_t t0;
+
+        send_burst(tx, rx_addr, frame, len, burst);
+        t0 = sim_now_ns();
+        recvfrom_n += drain_recvfrom(rx);
+        recvfrom_ns += sim_now_ns() - t0;
+
+        send_burst(tx, conn_addr, frame, len, burst);
+        t0 = sim_now_ns();
+        netconn_n += drain_netconn(conn);
+        netconn_ns += sim_now_ns() - t0;
+    }
+    res->recvfrom_pps = recvfrom_ns ? recvfrom_n * 1e9 / recvfrom_ns : 0.0;
+    res->netconn_pps = netconn_ns ? netconn_n * 1e9 / netconn_ns : 0.0;
+    res->drops = 2UL * ((packets + burst - 1) / burst) * burst - recvfrom_n - netconn_n;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int packets = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 200000U;
+    unsigned int burst = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 64U;
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    struct sockaddr_in rx_addr;
+    struct sockaddr_in conn_addr;
+    socklen_t addr_len = sizeof(rx_addr);
+    struct rx_result bin;
+    struct rx_result json;
+    struct netconn *conn;
+    struct car_cmd cmd;
+    ip_addr_t loopback;
+    int rcvbuf = RCVBUF_BYTES;
+    int frame_len;
+    int tx;
+    int rx;
+    int ok;
+
+    burst = burst == 0 ? 1 : (burst > MAX_BURST ? MAX_BURST : burst);
+    packets = packets < burst ? burst : packets;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = CAR_OP_FORWARD;
+    cmd.mode = CAR_MODE_ALWAY;
+    cmd.speed = CAR_SPEED_HIGH;
+    frame_len = car_proto_encode(frame, sizeof(frame), &cmd);
+
+    tx = socket(AF_INET, SOCK_DGRAM, 0);
+    rx = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&rx_addr, 0, sizeof(rx_addr));
+    rx_addr.sin_family = AF_INET;
+    rx_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (bind(rx, (struct sockaddr *)&rx_addr, sizeof(rx_addr)) < 0 ||
+        getsockname(rx, (struct sockaddr *)&rx_addr, &addr_len) < 0) {
+        fprintf(stderr, "bench_rx: cannot bind the recvfrom socket\n");
+        return 1;
+    }
+
+    conn = netconn_new(NETCONN_UDP);
+    ip_addr_set_ip4_u32(&loopback, htonl(INADDR_LOOPBACK));
+    if (conn == NULL || netconn_bind(conn, &loopback, NETCONN_PORT) != ERR_OK) {
+        fprintf(stderr, "bench_rx: cannot bind 127.0.0.1:%d\n", NETCONN_PORT);
+        return 1;
+    }
+    netconn_set_nonblocking(conn, 1);
+    conn_addr = rx_addr;
+    conn_addr.sin_port = htons(NETCONN_PORT);
+
+    run(tx, rx, &rx_addr, conn, &conn_addr, frame, frame_len, packets, burst, &bin);
+    run(tx, rx, &rx_addr, conn, &conn_addr, json_cmd, (int)strlen(json_cmd), packets, burst, &json);
+    netconn_delete(conn);
+    close(rx);
+    close(tx);
+
+    printf("{\"bench\":\"rx\",\"packets\":%u,\"burst\":%u", packets, burst);
+    printf(",\"binary\":{\"recvfrom_pps\":%.0f,\"netconn_pps\":%.0f,\"speedup\":%.2f,\"drops\":%lu}",
+           bin.recvfrom_pps, bin.netconn_pps, bin.recvfrom_pps > 0 ? bin.netconn_pps / bin.recvfrom_pps : 0.0,
+           bin.drops);
+    printf(",\"json\":{\"recvfrom_pps\":%.0f,\"netconn_pps\":%.0f,\"speedup\":%.2f,\"drops\":%lu}}\n",
+           json.recvfrom_pps, json.netconn_pps, json.recvfrom_pps > 0 ? json.netconn_pps / json.recvfrom_pps : 0.0,
+           json.drops);
+
+    ok = bin.drops == 0 && json.drops == 0 && bin.netconn_pps > bin.recvfrom_pps &&
+         json.netconn_pps > json.recvfrom_pps;
+    return ok ? 0 : 1;
+}
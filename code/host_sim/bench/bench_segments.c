@@ -0,0 +1,174 @@
+/*
+ * Timing accuracy of queued motion segments (CAR_OP_SEGMENTS), measured at
+ * the simulated HAL: every motion change shows up as a burst of PWM/GPIO
+ * writes, and the start of each burst is compared with the schedule the
+ * manoeuvre asked for.
+ *
+ *   ./build/bench_segments [runs]
+ *
+ * The car binds its ports with SIM_BIND_PORT_OFFSET (default 10000).
+ */
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_motor.h"
+#include "car_proto.h"
+#include "car_test.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define MAX_BURSTS 256
+#define BURST_GAP_NS 2000000ULL
+
+static const struct car_motor_limits no_ramp = { 0, 0, 0, 0 };
+
+/* Forward at high for 800 ms, left for 300 ms, ... then the queue runs dry and the car stops. */
+static const struct car_segment manoeuvre[] = {
+    { CAR_STATUS_FORWARD, 0, CAR_SPEED_HIGH, 800 },
+    { CAR_STATUS_LEFT, 0, CAR_SPEED_LOW, 300 },
+    { CAR_STATUS_BACKWARD, 0, CAR_SPEED_MEDIUM, 450 },
+    { CAR_STATUS_RIGHT, 0, 0, 125 },
+    { CAR_STATUS_FORWARD, 0, CAR_SPEED_LOW, 60 },
+    { CAR_STATUS_STOP, 0, 0, 200 },
+    { CAR_STATUS_BACKWARD, 0, CAR_SPEED_HIGH, 330 },
+};
+
+#define SEG_NUM (sizeof(manoeuvre) / sizeof(manoeuvre[0]))
+
+static uint64_t bursts[MAX_BURSTS];
+static unsigned int burst_count;
+static uint64_t last_event_ns;
+
+/* HAL hook, called from the control task: start of each write burst. */
+static void on_hal(const struct sim_hal_event *ev, void *ctx)
+{
+    (void)ctx;
+    if (ev->type == SIM_HAL_ADC_READ) {
+        return;
+    }
+    if (ev->t_ns - last_event_ns > BURST_GAP_NS) {
+        unsigned int n = __atomic_load_n(&burst_count, __ATOMIC_RELAXED);
+        if (n < MAX_BURSTS) {
+            bursts[n] = ev->t_ns;
+            __atomic_store_n(&burst_count, n + 1, __ATOMIC_RELEASE);
+        }
+    }
+    last_event_ns = ev->t_ns;
+}
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int encode_manoeuvre(unsigned char *buf, int size, unsigned short seq)
+{
+    unsigned char payload[1 + SEG_NUM * CAR_SEG_WIRE_LEN];
+    unsigned char *p = payload + 1;
+    struct car_cmd cmd;
+    unsigned int i;
+
+    payload[0] = 0; /* replace */
+    for (i = 0; i < SEG_NUM; i++, p += CAR_SEG_WIRE_LEN) {
+        p[0] = manoeuvre[i].op;
+        p[1] = (unsigned char)(manoeuvre[i].speed & 0xFF);
+        p[2] = (unsigned char)(manoeuvre[i].speed >> 8);
+        p[3] = (unsigned char)(manoeuvre[i].duration_ms & 0xFF);
+        p[4] = (unsigned char)(manoeuvre[i].duration_ms >> 8);
+    }
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.seq = seq;
+    cmd.op = CAR_OP_SEGMENTS;
+    cmd.mode = CAR_PROTO_KEEP;
+    cmd.payload = payload;
+    cmd.payload_len = sizeof(payload);
+    return car_proto_encode(buf, size, &cmd);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int runs = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 5U;
+    unsigned char frame[CAR_PROTO_MIN_LEN + CAR_PROTO_MAX_PAYLOAD];
+    struct sockaddr_in car_addr = { 0 };
+    unsigned long total_ms = 0;
+    double sum_err = 0;
+    double max_err = 0;
+    double sum_end_err = 0;
+    unsigned int samples = 0;
+    unsigned int bad_runs = 0;
+    unsigned int run;
+    unsigned int i;
+    int frame_len;
+    int fd;
+    FILE *out;
+
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+
+    for (i = 0; i < SEG_NUM; i++) {
+        total_ms += manoeuvre[i].duration_ms;
+    }
+    frame_len = encode_manoeuvre(frame, sizeof(frame), 1);
+
+    /* Outputs jump straight to their targets; the ramp has its own bench. */
+    car_motor_set_limits(&no_ramp);
+    sim_start();
+    sleep_ms(500);
+    sim_hal_set_hook(on_hal, NULL);
+
+    for (run = 0; run < runs; run++) {
+        unsigned int first = __atomic_load_n(&burst_count, __ATOMIC_ACQUIRE);
+        uint64_t expect;
+
+        sendto(fd, frame, frame_len, 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+        sleep_ms(total_ms + 300);
+
+        /* One burst per segment plus the final stop. */
+        if (__atomic_load_n(&burst_count, __ATOMIC_ACQUIRE) - first != SEG_NUM + 1) {
+            bad_runs++;
+            continue;
+        }
+        expect = bursts[first];
+        for (i = 1; i <= SEG_NUM; i++) {
+            double err;
+
+            expect += (uint64_t)manoeuvre[i - 1].duration_ms * 1000000ULL;
+            err = ((double)bursts[first + i] - (double)expect) / 1e6;
+            sum_err += fabs(err);
+            if (fabs(err) > max_err) {
+                max_err = fabs(err);
+            }
+            samples++;
+        }
+        sum_end_err += ((double)(bursts[first + SEG_NUM] - bursts[first]) / 1e6) - (double)total_ms;
+    }
+
+    fprintf(out, "{\"bench\":\"segments\",\"runs\":%u,\"segments\":%u,\"frame_bytes\":%d,\"manoeuvre_ms\":%lu", runs,
+            (unsigned int)SEG_NUM, frame_len, total_ms);
+    fprintf(out, ",\"bad_runs\":%u", bad_runs);
+    if (samples > 0) {
+        fprintf(out, ",\"boundary_err_ms_mean\":%.2f,\"boundary_err_ms_max\":%.2f,\"end_err_ms_mean\":%.2f",
+                sum_err / samples, max_err, sum_end_err / (runs - bad_runs));
+    }
+    fprintf(out, "}\n");
+    fclose(out);
+    _exit(bad_runs == 0 ? 0 : 1);
+}
@@ -0,0 +1,232 @@
+/*
+ * Stress test of the single-writer seqlock (car_seqlock.h) used for the
+ * command mailboxes. One writer thread per command source publishes a
+ * mailbox-sized record as fast as it can; one reader uses car_seq_read()
+ * and another car_seq_try_read(), as the control task does. Every word of a
+ * record is derived from its generation, so a torn copy is detected.
+ *
+ * A second phase stops a writer halfway through a publish, as a writer
+ * preempted by a higher-priority task would be, and checks that
+ * car_seq_try_read() gives up at once instead of waiting for it, and
+ * reads the record once the writer finishes.
+ *
+ * Each reader also times its calls while the writers publish: the first
+ * LATENCY_SAMPLES calls give the p50/p99/max of a car_seq_read() (retries
+ * included) and of a car_seq_try_read() under writer contention.
+ *
+ * Checks that no reader accepted a torn record, that generations never
+ * went backwards, that both readers got records through while the
+ * writers ran, and the stalled-writer phase.
+ *
+ *   ./build/bench_seqlock [ms]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "car_seqlock.h"
+#include "car_test.h"
+#include "sim_hal.h"
+
+/* The size of the control task's struct car_mailbox. */
+#define RECORD_WORDS 16
+#define STALLED_READS 1000000UL
+#define LATENCY_SAMPLES (1U << 20)
+
+struct record {
+    unsigned int gen;
+    unsigned int word[RECORD_WORDS - 1];
+};
+
+struct source {
+    struct car_seqlock lock;
+    struct record shared;
+    unsigned long published;
+};
+
+struct reader {
+    int try_read;
+    unsigned long reads;
+    unsigned long torn; /* car_seq_read() retries or car_seq_try_read() failures */
+    unsigned long accepted_torn;
+    unsigned long backwards;
+    unsigned int samples;
+    unsigned int *latency_ns; /* LATENCY_SAMPLES entries */
+};
+
+static struct source sources[CAR_SRC_MAX];
+static volatile int quit;
+
+static unsigned int record_word(unsigned int gen, unsigned int i)
+{
+    return gen * 2654435761U + i;
+}
+
+static void record_fill(struct record *r, unsigned int gen)
+{
+    r->gen = gen;
+    for (unsigned int i = 0; i < RECORD_WORDS - 1; i++) {
+        r->word[i] = record_word(gen, i);
+    }
+}
+
+static int record_torn(const struct record *r)
+{
+    for (unsigned int i = 0; i < RECORD_WORDS - 1; i++) {
+        if (r->word[i] != record_word(r->gen, i)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *writer(void *arg)
+{
+    struct source *s = arg;
+    struct record local;
+    unsigned int gen = 0;
+
+    while (!__atomic_load_n(&quit, __ATOMIC_ACQUIRE)) {
+        record_fill(&local, ++gen);
+        car_seq_publish(&s->lock, &s->shared, &local, sizeof(local));
+    }
+    s->published = gen;
+    return NULL;
+}
+
+static void *reader(void *arg)
+{
+    struct reader *rd = arg;
+    unsigned int last[CAR_SRC_MAX] = { 0 };
+    struct record r;
+
+    while (!__atomic_load_n(&quit, __ATOMIC_ACQUIRE)) {
+        for (unsigned int src = 0; src < CAR_SRC_MAX; src++) {
+            struct source *s = &sources[src];
+            uint64_t t0 = sim_now_ns();
+            int got = 1;
+
+            if (rd->try_read) {
+                got = car_seq_try_read(&s->lock, &s->shared, &r, sizeof(r));
+            } else {
+                rd->torn += car_seq_read(&s->lock, &s->shared, &r, sizeof(r));
+            }
+            if (rd->samples < LATENCY_SAMPLES) {
+                rd->latency_ns[rd->samples++] = (unsigned int)(sim_now_ns() - t0);
+            }
+            if (!got) {
+                rd->torn++;
+                continue;
+            }
+            rd->reads++;
+            rd->accepted_torn += record_torn(&r);
+            rd->backwards += (int)(r.gen - last[src]) < 0;
+            last[src] = r.gen;
+        }
+    }
+    return NULL;
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts the reader's samples and prints them as a JSON object. */
+static void print_latency(const struct reader *rd)
+{
+    unsigned int n = rd->samples;
+
+    if (n == 0) {
+        printf(",\"latency_ns\":null");
+        return;
+    }
+    qsort(rd->latency_ns, n, sizeof(rd->latency_ns[0]), cmp_uint);
+    printf(",\"latency_ns\":{\"samples\":%u,\"p50\":%u,\"p99\":%u,\"max\":%u}", n, rd->latency_ns[n / 2],
+           rd->latency_ns[(unsigned long)n * 99 / 100], rd->latency_ns[n - 1]);
+}
+
+/* A writer stopped between the two sequence stores, halfway through the copy. */
+static int stalled_writer(double *try_ns)
+{
+    struct source s;
+    struct record local;
+    struct record r;
+    unsigned long failed = 0;
+    uint64_t t0;
+
+    memset(&s, 0, sizeof(s));
+    record_fill(&local, 1);
+    car_seq_publish(&s.lock, &s.shared, &local, sizeof(local));
+
+    record_fill(&local, 2);
+    __atomic_store_n(&s.lock.seq, s.lock.seq + 1, __ATOMIC_RELEASE);
+    car_seq_copy_in(&s.shared, &local, sizeof(local) / 2);
+
+    t0 = sim_now_ns();
+    for (unsigned long i = 0; i < STALLED_READS; i++) {
+        failed += !car_seq_try_read(&s.lock, &s.shared, &r, sizeof(r));
+    }
+    *try_ns = (double)(sim_now_ns() - t0) / STALLED_READS;
+
+    /* The writer runs again and finishes its publish. */
+    car_seq_copy_in(&s.shared, &local, sizeof(local));
+    __atomic_store_n(&s.lock.seq, s.lock.seq + 1, __ATOMIC_RELEASE);
+
+    return failed == STALLED_READS && car_seq_try_read(&s.lock, &s.shared, &r, sizeof(r)) && r.gen == 2 &&
+           !record_torn(&r);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long ms = argc > 1 ? strtoul(argv[1], NULL, 10) : 500UL;
+    pthread_t writers[CAR_SRC_MAX];
+    pthread_t readers[2];
+    struct reader rd[2] = { { .try_read = 0 }, { .try_read = 1 } };
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    unsigned long published = 0;
+    double try_ns;
+    int stalled_ok;
+    int ok;
+
+    for (unsigned int src = 0; src < CAR_SRC_MAX; src++) {
+        pthread_create(&writers[src], NULL, writer, &sources[src]);
+    }
+    for (unsigned int i = 0; i < 2; i++) {
+        rd[i].latency_ns = malloc(LATENCY_SAMPLES * sizeof(rd[i].latency_ns[0]));
+        if (rd[i].latency_ns == NULL) {
+            return 1;
+        }
+        pthread_create(&readers[i], NULL, reader, &rd[i]);
+    }
+    nanosleep(&ts, NULL);
+    __atomic_store_n(&quit, 1, __ATOMIC_RELEASE);
+    for (unsigned int src = 0; src < CAR_SRC_MAX; src++) {
+        pthread_join(writers[src], NULL);
+        published += sources[src].published;
+    }
+    for (unsigned int i = 0; i < 2; i++) {
+        pthread_join(readers[i], NULL);
+    }
+    stalled_ok = stalled_writer(&try_ns);
+
+    printf("{\"bench\":\"seqlock\",\"ms\":%lu,\"writers\":%u,\"published\":%lu", ms, CAR_SRC_MAX, published);
+    for (unsigned int i = 0; i < 2; i++) {
+        printf(",\"%s\":{\"reads\":%lu,\"torn\":%lu,\"accepted_torn\":%lu,\"backwards\":%lu",
+               rd[i].try_read ? "try_read" : "read", rd[i].reads, rd[i].torn, rd[i].accepted_torn, rd[i].backwards);
+        print_latency(&rd[i]);
+        printf("}");
+    }
+    printf(",\"stalled_writer\":{\"ok\":%d,\"try_read_ns\":%.1f}}\n", stalled_ok, try_ns);
+
+    ok = stalled_ok;
+    for (unsigned int i = 0; i < 2; i++) {
+        ok = ok && rd[i].reads != 0 && rd[i].accepted_torn == 0 && rd[i].backwards == 0;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,498 @@
+/*
+ * Closed-loop wheel speed: a motor model driven by the PWM and pin state of
+ * the simulated HAL turns two wheels with mismatched motors and feeds their
+ * encoder pulses back on the encoder GPIOs. A forward run at medium speed,
+ * with the battery voltage dropping by SAG mid-run, and one at high speed
+ * are measured from the model's true wheel speeds:
+ *
+ *   - settling: time from the command until both wheels stay within
+ *     SETTLE_BAND of the target speed (CAR_ENC_TPS_MAX scaled by the duty),
+ *   - straight-line error: difference of the distances travelled by the two
+ *     wheels over the run, relative to their mean, against the open-loop
+ *     error the mismatch alone would give,
+ *   - recovery after the supply drop.
+ *
+ *   - that the measured wheel speeds (car_speed_get()) follow the model, at
+ *     the REPORT_PCT percentile.
+ *
+ * The runs are made twice. "loop" runs before the application starts: the
+ * bench calls the ramp (car_motor_step) and the speed controller
+ * (car_speed_step) at their periods on the stepped clock (sim_clock_freeze())
+ * and advances the model in between. No host thread is involved, so these
+ * numbers are the same on every run, and the limits apply to them. "app"
+ * sends the commands to the running application over UDP with the model in
+ * a real-time thread and reads the speeds from the published car state.
+ * When the host delays the model thread its pulses arrive in a burst, the
+ * loop reacts and the wheels leave the band, which put the settling time
+ * past a second and the speed error past REPORT_MAX on a loaded host. Its
+ * numbers are reported, and only checked for the wheels reaching the band,
+ * before and after the supply drop.
+ *
+ * At high speed the weaker motor cannot reach the target, so only the
+ * straight-line error is checked there.
+ *
+ * Before the runs, the encoder inputs must be pulled up, and NOISE_EDGES
+ * isolated edges (further apart than CAR_ENC_STOP_US) must not be taken for
+ * an encoder: the loop stays open until the wheels really turn.
+ *
+ *   ./build/bench_speed
+ *
+ * Exits non-zero when a limit is missed.
+ */
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_encoder.h"
+#include "car_link.h"
+#include "car_motor.h"
+#include "car_proto.h"
+#include "car_speed.h"
+#include "car_test.h"
+#include "hi_pwm.h"
+#include "iot_gpio_ex.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+
+/* Motor model: first-order speed response, speed proportional to duty and supply. */
+#define MODEL_TAU_DRIVE_S 0.100
+/* Both L9110S outputs low, whether the wheel was braked or coasted. */
+#define MODEL_TAU_STOP_S 0.020
+#define MODEL_DT_NS 250000ULL
+#define RAMP_NS (CAR_MOTOR_RAMP_MS * 1000000ULL)
+#define SPEED_NS (CAR_SPEED_CTRL_MS * 1000000ULL)
+#define MODEL_GAIN_LEFT 0.85
+#define MODEL_GAIN_RIGHT 1.05
+
+#define RUN_MS 3000
+#define STOP_MS 1500
+#define SAG 0.85
+#define SAG_MS 2000
+#define SETTLE_BAND 0.05
+
+/* Limits. */
+#define SETTLE_MAX_MS 1200.0
+#define RECOVER_MAX_MS 800.0
+#define STRAIGHT_MAX 0.02
+#define REPORT_MAX 0.10
+#define REPORT_PCT 90
+#define REPORT_SAMPLES 4096
+#define NOISE_EDGES (CAR_ENC_PRESENT_TICKS * 2)
+
+struct model_wheel {
+    unsigned int fwd_port;
+    unsigned int rev_port;
+    unsigned int enc_gpio;
+    double gain;
+    double tps;   /* true speed, ticks per second, signed */
+    double ticks; /* distance in ticks, signed */
+    double dist;  /* distance counted since the last reset, unsigned */
+    int level;    /* encoder output */
+};
+
+/* The scripted controller does not keep the link alive between commands. */
+static const struct car_link_limits no_watchdog = { 0, 0, 0 };
+
+static struct model_wheel wheels[CAR_WHEEL_MAX] = {
+    { HI_PWM_PORT_PWM4, HI_PWM_PORT_PWM3, CAR_ENC_GPIO_LEFT, MODEL_GAIN_LEFT, 0, 0, 0, 0 },
+    { HI_PWM_PORT_PWM1, HI_PWM_PORT_PWM0, CAR_ENC_GPIO_RIGHT, MODEL_GAIN_RIGHT, 0, 0, 0, 0 },
+};
+
+static pthread_mutex_t model_lock = PTHREAD_MUTEX_INITIALIZER;
+static double model_supply = 1.0;
+static volatile int model_running = 1;
+
+static int cmd_fd;
+static struct sockaddr_in car_addr;
+
+static double report_errs[REPORT_SAMPLES];
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* Speed the wheel heads for under the current HAL outputs, and the time constant. */
+static double model_target(const struct model_wheel *w, double *tau)
+{
+    struct sim_pwm_state fwd;
+    struct sim_pwm_state rev;
+    double full = CAR_ENC_TPS_MAX * w->gain * model_supply / CAR_DUTY_MAX;
+
+    sim_pwm_get(w->fwd_port, &fwd);
+    sim_pwm_get(w->rev_port, &rev);
+    *tau = MODEL_TAU_DRIVE_S;
+    if (fwd.running && !rev.running) {
+        return fwd.duty * full;
+    }
+    if (rev.running && !fwd.running) {
+        return -(double)rev.duty * full;
+    }
+    *tau = MODEL_TAU_STOP_S;
+    return 0;
+}
+
+/* Integrates both wheels over one MODEL_DT_NS step and toggles the encoder inputs. */
+static void model_advance(void)
+{
+    const double dt = MODEL_DT_NS / 1e9;
+    unsigned int i;
+
+    for (i = 0; i < CAR_WHEEL_MAX; i++) {
+        struct model_wheel *w = &wheels[i];
+        double tau;
+        double target;
+        int level;
+
+        pthread_mutex_lock(&model_lock);
+        target = model_target(w, &tau);
+        w->tps += (target - w->tps) * dt / tau;
+        w->ticks += w->tps * dt;
+        w->dist += fabs(w->tps) * dt;
+        level = (long long)floor(w->ticks * 2) & 1;
+        pthread_mutex_unlock(&model_lock);
+
+        /* One pulse per tick; the encoder does not tell the direction. */
+        if (level != w->level) {
+            w->level = level;
+            sim_gpio_set_input(w->enc_gpio, level);
+        }
+    }
+}
+
+/* Advances the model in real time, for the running application. */
+static void *model_thread(void *arg)
+{
+    uint64_t next = sim_now_ns();
+
+    (void)arg;
+    while (model_running) {
+        next += MODEL_DT_NS;
+        model_advance();
+        for (;;) {
+            uint64_t now = sim_now_ns();
+            if (now >= next) {
+                break;
+            }
+            struct timespec ts = { 0, (long)(next - now) };
+            nanosleep(&ts, NULL);
+        }
+    }
+    return NULL;
+}
+
+static void model_read(double tps[CAR_WHEEL_MAX], double dist[CAR_WHEEL_MAX])
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&model_lock);
+    for (i = 0; i < CAR_WHEEL_MAX; i++) {
+        tps[i] = wheels[i].tps;
+        dist[i] = wheels[i].dist;
+    }
+    pthread_mutex_unlock(&model_lock);
+}
+
+static void model_reset_dist(void)
+{
+    pthread_mutex_lock(&model_lock);
+    wheels[CAR_WHEEL_LEFT].dist = 0;
+    wheels[CAR_WHEEL_RIGHT].dist = 0;
+    pthread_mutex_unlock(&model_lock);
+}
+
+static void model_set_supply(double supply)
+{
+    pthread_mutex_lock(&model_lock);
+    model_supply = supply;
+    pthread_mutex_unlock(&model_lock);
+}
+
+static void send_cmd(unsigned char op, unsigned short speed)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    struct car_cmd cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = op;
+    cmd.mode = CAR_MODE_ALWAY;
+    cmd.speed = speed;
+    sendto(cmd_fd, frame, car_proto_encode(frame, sizeof(frame), &cmd), 0, (struct sockaddr *)&car_addr,
+           sizeof(car_addr));
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int in_band(const double tps[CAR_WHEEL_MAX], double target)
+{
+    return fabs(tps[CAR_WHEEL_LEFT] - target) <= target * SETTLE_BAND &&
+           fabs(tps[CAR_WHEEL_RIGHT] - target) <= target * SETTLE_BAND;
+}
+
+struct run_result {
+    double settle_ms;   /* from the command, -1 if never settled */
+    double recover_ms;  /* from the supply drop, -1 if never recovered */
+    double straight;    /* relative distance difference */
+    double report_err;  /* REPORT_PCT percentile relative error of the published speeds, app only */
+};
+
+/*
+ * Settling and recovery of one run. Settling is the last time the wheels
+ * entered the band, so leaving it again after a first crossing counts.
+ */
+struct settle {
+    double target;
+    uint64_t start;
+    uint64_t sag_at;
+    double settle_ns;
+    double recover_ns;
+    int was_in;
+};
+
+static void settle_begin(struct settle *t, unsigned short speed)
+{
+    model_set_supply(1.0);
+    model_reset_dist();
+    t->target = (double)speed * CAR_ENC_TPS_MAX / CAR_DUTY_MAX;
+    t->start = sim_now_ns();
+    t->sag_at = 0;
+    t->settle_ns = -1;
+    t->recover_ns = -1;
+    t->was_in = 0;
+}
+
+/* Samples the model at now; the supply drops at SAG_MS when sag is set. Returns 0 at the end of the run. */
+static int settle_sample(struct settle *t, int sag, uint64_t now, double tps[CAR_WHEEL_MAX])
+{
+    double dist[CAR_WHEEL_MAX];
+    int in;
+
+    if (now - t->start >= (uint64_t)RUN_MS * 1000000ULL) {
+        return 0;
+    }
+    if (sag && t->sag_at == 0 && now - t->start >= (uint64_t)SAG_MS * 1000000ULL) {
+        model_set_supply(SAG);
+        t->sag_at = now;
+        t->was_in = 0;
+    }
+    model_read(tps, dist);
+    in = in_band(tps, t->target);
+    if (in && !t->was_in) {
+        if (t->sag_at == 0) {
+            t->settle_ns = (double)(now - t->start);
+        } else {
+            t->recover_ns = (double)(now - t->sag_at);
+        }
+    } else if (!in) {
+        if (t->sag_at == 0) {
+            t->settle_ns = -1;
+        } else {
+            t->recover_ns = -1;
+        }
+    }
+    t->was_in = in;
+    return 1;
+}
+
+static void settle_end(const struct settle *t, struct run_result *r)
+{
+    double tps[CAR_WHEEL_MAX];
+    double dist[CAR_WHEEL_MAX];
+
+    model_read(tps, dist);
+    r->settle_ms = t->settle_ns < 0 ? -1 : t->settle_ns / 1e6;
+    r->recover_ms = t->recover_ns < 0 ? -1 : t->recover_ns / 1e6;
+    r->straight = fabs(dist[CAR_WHEEL_LEFT] - dist[CAR_WHEEL_RIGHT]) / ((dist[CAR_WHEEL_LEFT] + dist[CAR_WHEEL_RIGHT]) / 2);
+}
+
+/* One step of the stepped clock: the model, then the ramp and the speed loop when their period is up. */
+static void loop_tick(uint64_t t_ns)
+{
+    sim_clock_advance(MODEL_DT_NS);
+    model_advance();
+    if (t_ns % RAMP_NS == 0) {
+        car_motor_step();
+    }
+    if (t_ns % SPEED_NS == 0) {
+        car_speed_step();
+    }
+}
+
+/* Relative errors of measured wheel speeds, once settled and away from the supply step. */
+static void report_sample(const struct settle *t, uint64_t now, const int measured[CAR_WHEEL_MAX],
+                          const double tps[CAR_WHEEL_MAX], unsigned int *reports)
+{
+    if (t->settle_ns >= 0 && t->sag_at == 0 && now - t->start >= 1500000000ULL && *reports + 2 <= REPORT_SAMPLES) {
+        report_errs[(*reports)++] = fabs(measured[CAR_WHEEL_LEFT] - tps[CAR_WHEEL_LEFT]) / t->target;
+        report_errs[(*reports)++] = fabs(measured[CAR_WHEEL_RIGHT] - tps[CAR_WHEEL_RIGHT]) / t->target;
+    }
+}
+
+static double report_pct(unsigned int reports)
+{
+    if (reports == 0) {
+        return 0;
+    }
+    qsort(report_errs, reports, sizeof(report_errs[0]), cmp_double);
+    return report_errs[reports * REPORT_PCT / 100];
+}
+
+/* One forward run at speed on the stepped clock, then the stop. */
+static void loop_forward(unsigned short speed, int sag, struct run_result *r)
+{
+    struct settle t;
+    double tps[CAR_WHEEL_MAX];
+    uint64_t t_ns = 0;
+    unsigned int reports = 0;
+
+    settle_begin(&t, speed);
+    car_motor_set(speed, speed);
+    for (;;) {
+        t_ns += MODEL_DT_NS;
+        loop_tick(t_ns);
+        if (!settle_sample(&t, sag, sim_now_ns(), tps)) {
+            break;
+        }
+        if (t_ns % SPEED_NS == 0) {
+            int measured[CAR_WHEEL_MAX] = { car_speed_get(CAR_WHEEL_LEFT), car_speed_get(CAR_WHEEL_RIGHT) };
+            report_sample(&t, sim_now_ns(), measured, tps, &reports);
+        }
+    }
+    settle_end(&t, r);
+    r->report_err = report_pct(reports);
+
+    car_motor_set(0, 0);
+    for (uint64_t end = t_ns + STOP_MS * 1000000ULL; t_ns < end;) {
+        t_ns += MODEL_DT_NS;
+        loop_tick(t_ns);
+    }
+}
+
+/* One forward run at speed sent to the running application. */
+static void run_forward(unsigned short speed, int sag, struct run_result *r)
+{
+    struct settle t;
+    double tps[CAR_WHEEL_MAX];
+    unsigned int reports = 0;
+
+    settle_begin(&t, speed);
+    send_cmd(CAR_OP_FORWARD, speed);
+    for (;;) {
+        uint64_t now = sim_now_ns();
+
+        if (!settle_sample(&t, sag, now, tps)) {
+            break;
+        }
+
+        /* The speeds in the published car state. */
+        struct car_state state;
+        get_car_state(&state);
+        int measured[CAR_WHEEL_MAX] = { state.left_tps, state.right_tps };
+        report_sample(&t, now, measured, tps, &reports);
+        sleep_ms(2);
+    }
+    settle_end(&t, r);
+    r->report_err = report_pct(reports);
+
+    send_cmd(CAR_OP_STOP, 0);
+    sleep_ms(STOP_MS);
+}
+
+/* Pull-ups on both encoder inputs, and no encoder seen from isolated edges. */
+static int noise_rejected(void)
+{
+    struct sim_pin_state pin;
+    unsigned int i;
+    unsigned int n;
+
+    for (i = 0; i < CAR_WHEEL_MAX; i++) {
+        sim_pin_get(wheels[i].enc_gpio, &pin);
+        if (pin.pull != IOT_IO_PULL_UP) {
+            return 0;
+        }
+    }
+    for (n = 0; n < NOISE_EDGES; n++) {
+        sim_clock_advance((CAR_ENC_STOP_US + 1000ULL) * 1000ULL);
+        sim_gpio_set_input(wheels[n % CAR_WHEEL_MAX].enc_gpio, 1);
+        sim_gpio_set_input(wheels[n % CAR_WHEEL_MAX].enc_gpio, 0);
+    }
+    return !car_encoder_present();
+}
+
+static void print_runs(FILE *out, const char *name, const struct run_result *medium, const struct run_result *high)
+{
+    fprintf(out, ",\"%s\":{\"medium\":{\"settle_ms\":%.0f,\"recover_ms\":%.0f,\"straight_err\":%.4f", name,
+            medium->settle_ms, medium->recover_ms, medium->straight);
+    fprintf(out, ",\"report_err\":%.3f},\"high\":{\"straight_err\":%.4f}}", medium->report_err, high->straight);
+}
+
+int main(void)
+{
+    const double open_loop = fabs(MODEL_GAIN_LEFT - MODEL_GAIN_RIGHT) / ((MODEL_GAIN_LEFT + MODEL_GAIN_RIGHT) / 2);
+    struct run_result loop_medium;
+    struct run_result loop_high;
+    struct run_result medium;
+    struct run_result high;
+    pthread_t model;
+    int noise_ok;
+    int ok;
+    FILE *out;
+
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+
+    cmd_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(getenv("SIM_BIND_PORT_OFFSET"))));
+
+    /* The speed loop alone, on the stepped clock, before any application thread runs. */
+    car_encoder_init();
+    sim_clock_freeze();
+    noise_ok = noise_rejected();
+    loop_forward(CAR_SPEED_MEDIUM, 1, &loop_medium);
+    loop_forward(CAR_SPEED_HIGH, 0, &loop_high);
+    sim_clock_resume();
+
+    car_link_set_limits(&no_watchdog);
+    sim_start();
+    sleep_ms(500);
+    pthread_create(&model, NULL, model_thread, NULL);
+
+    run_forward(CAR_SPEED_MEDIUM, 1, &medium);
+    run_forward(CAR_SPEED_HIGH, 0, &high);
+
+    model_running = 0;
+    pthread_join(model, NULL);
+
+    ok = noise_ok && loop_medium.settle_ms >= 0 && loop_medium.settle_ms <= SETTLE_MAX_MS &&
+         loop_medium.recover_ms >= 0 && loop_medium.recover_ms <= RECOVER_MAX_MS && loop_medium.straight <= STRAIGHT_MAX &&
+         loop_medium.report_err <= REPORT_MAX && loop_high.straight <= STRAIGHT_MAX && medium.settle_ms >= 0 &&
+         medium.recover_ms >= 0;
+
+    fprintf(out, "{\"bench\":\"speed\",\"noise_rejected\":%d,\"open_loop_straight_err\":%.4f", noise_ok, open_loop);
+    print_runs(out, "loop", &loop_medium, &loop_high);
+    print_runs(out, "app", &medium, &high);
+    fprintf(out, ",\"ok\":%d}\n", ok);
+    fclose(out);
+    _exit(ok ? 0 : 1);
+}
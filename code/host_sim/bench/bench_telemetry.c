@@ -0,0 +1,270 @@
+/*
+ * Telemetry link usage and change-to-wire latency, measured against the
+ * whole car application running on the simulated HAL.
+ *
+ * For each client format (legacy JSON, binary) a scripted command stream
+ * is sent to the car. Latency is taken from sending a command to receiving
+ * the first status update that reflects it; bytes per second are counted
+ * over the stream and over an idle period that only carries heartbeats.
+ * During the binary stream a second socket that only sent a heartbeat
+ * (CAR_OP_NOP) observes; it must get the updates on its own port too.
+ *
+ *   ./build/bench_telemetry [commands] [interval_ms] [idle_ms]
+ *
+ * The car binds its ports with SIM_BIND_PORT_OFFSET (default 10000). It
+ * sends binary telemetry back to the socket the bench sends commands from,
+ * and the JSON status to STATUS_PORT on loopback, where the bench listens
+ * like a legacy controller.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "car_proto.h"
+#include "car_test.h"
+#include "sim_hal.h"
+
+#define CMD_PORT 50001
+#define STATUS_PORT 50002
+#define MAX_SAMPLES 4096
+
+struct script_step {
+    const char *json;
+    unsigned char op;
+    unsigned short speed;
+};
+
+/* Motion and speed changes in "alway" mode so the step timer never interferes. */
+static const struct script_step script[] = {
+    { "{\"cmd\":\"forward\",\"mode\":\"alway\",\"speed\":\"high\"}", CAR_OP_FORWARD, CAR_SPEED_HIGH },
+    { "{\"cmd\":\"left\",\"mode\":\"alway\",\"speed\":\"low\"}", CAR_OP_LEFT, CAR_SPEED_LOW },
+    { "{\"cmd\":\"backward\",\"mode\":\"alway\",\"speed\":\"medium\"}", CAR_OP_BACKWARD, CAR_SPEED_MEDIUM },
+    { "{\"cmd\":\"right\",\"mode\":\"alway\",\"speed\":\"high\"}", CAR_OP_RIGHT, CAR_SPEED_HIGH },
+    { "{\"cmd\":\"stop\",\"mode\":\"alway\",\"speed\":\"medium\"}", CAR_OP_STOP, CAR_SPEED_MEDIUM },
+};
+
+#define SCRIPT_LEN (sizeof(script) / sizeof(script[0]))
+
+struct link_stats {
+    unsigned long bytes;
+    unsigned long frames;
+};
+
+static int cmd_fd;
+static int status_fd;
+static int rx_fd; /* cmd_fd or status_fd, by the format under test */
+static int observer_fd;
+static struct sockaddr_in car_addr;
+static unsigned int car_status = 0xFF;
+static double latency_us[MAX_SAMPLES];
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static void send_step(const struct script_step *step, int binary, unsigned short seq)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    struct car_cmd cmd;
+
+    if (!binary) {
+        sendto(cmd_fd, step->json, strlen(step->json), 0, (struct sockaddr *)&car_addr, sizeof(car_addr));
+        return;
+    }
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.seq = seq;
+    cmd.op = step->op;
+    cmd.mode = CAR_MODE_ALWAY;
+    cmd.speed = step->speed;
+    sendto(cmd_fd, frame, car_proto_encode(frame, sizeof(frame), &cmd), 0, (struct sockaddr *)&car_addr,
+           sizeof(car_addr));
+}
+
+/* Tracks the reported cur_status from either format. */
+static void parse_update(const unsigned char *buf, int len)
+{
+    struct car_cmd frame;
+    unsigned int i;
+
+    if (len > 0 && buf[0] == CAR_PROTO_MAGIC) {
+        if (car_proto_decode(buf, len, &frame) == CAR_PROTO_OK && frame.op == CAR_OP_STATE &&
+            frame.payload_len > 1 && (frame.payload[0] & CAR_STATE_F_STATUS)) {
+            car_status = frame.payload[1];
+        }
+        return;
+    }
+    for (i = 0; i < CAR_STATUS_MAX; i++) {
+        char needle[32];
+        snprintf(needle, sizeof(needle), "\"status\":\"%s\"", car_status_name(i));
+        if (memmem(buf, len, needle, strlen(needle)) != NULL) {
+            car_status = i;
+        }
+    }
+}
+
+/* Receives until deadline_ns, or until the reported status equals want. */
+static int receive_until(uint64_t deadline_ns, unsigned int want, struct link_stats *stats)
+{
+    unsigned char buf[256];
+
+    for (;;) {
+        uint64_t now = sim_now_ns();
+        if (now >= deadline_ns) {
+            return 0;
+        }
+        struct timeval tv = { 0, (suseconds_t)((deadline_ns - now) / 1000) };
+        setsockopt(rx_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        int len = (int)recv(rx_fd, buf, sizeof(buf), 0);
+        if (len <= 0) {
+            continue;
+        }
+        stats->bytes += (unsigned long)len;
+        stats->frames++;
+        parse_update(buf, len);
+        if (car_status == want) {
+            return 1;
+        }
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Joins as an observer session: a heartbeat, no driving command. */
+static void observer_join(void)
+{
+    unsigned char frame[CAR_PROTO_MIN_LEN];
+    struct car_cmd cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = CAR_OP_NOP;
+    cmd.mode = CAR_PROTO_KEEP;
+    sendto(observer_fd, frame, car_proto_encode(frame, sizeof(frame), &cmd), 0, (struct sockaddr *)&car_addr,
+           sizeof(car_addr));
+}
+
+/* Returns 0 if the binary run's observer got no telemetry. */
+static int run_format(FILE *out, int binary, unsigned int commands, unsigned long interval_ms,
+                      unsigned long idle_ms)
+{
+    unsigned char buf[256];
+    unsigned long observed = 0;
+    struct link_stats active = { 0, 0 };
+    struct link_stats idle = { 0, 0 };
+    unsigned int samples = 0;
+    unsigned int i;
+    uint64_t t0;
+
+    /* Register as a client of this format and let the first full update pass. */
+    rx_fd = binary ? cmd_fd : status_fd;
+    car_status = 0xFF;
+    send_step(&script[SCRIPT_LEN - 1], binary, 0);
+    receive_until(sim_now_ns() + 1500000000ULL, CAR_STATUS_STOP, &idle);
+    receive_until(sim_now_ns() + 100000000ULL, 0xFF, &idle);
+    if (binary) {
+        observer_join();
+    }
+
+    t0 = sim_now_ns();
+    for (i = 0; i < commands; i++) {
+        const struct script_step *step = &script[i % SCRIPT_LEN];
+        uint64_t sent = sim_now_ns();
+        uint64_t next = sent + (uint64_t)interval_ms * 1000000ULL;
+
+        send_step(step, binary, (unsigned short)(i + 1));
+        if (receive_until(next, step->op, &active) && samples < MAX_SAMPLES) {
+            latency_us[samples++] = (double)(sim_now_ns() - sent) / 1000.0;
+        }
+        receive_until(next, 0xFF, &active);
+    }
+    double active_s = (double)(sim_now_ns() - t0) / 1e9;
+
+    idle.bytes = 0;
+    idle.frames = 0;
+    t0 = sim_now_ns();
+    receive_until(t0 + (uint64_t)idle_ms * 1000000ULL, 0xFF, &idle);
+    double idle_s = (double)(sim_now_ns() - t0) / 1e9;
+
+    qsort(latency_us, samples, sizeof(latency_us[0]), cmp_double);
+    fprintf(out, ",\"%s\":{\"commands\":%u,\"updates_seen\":%u,\"active_bytes_per_s\":%.1f", binary ? "binary" : "json",
+            commands, samples, (double)active.bytes / active_s);
+    fprintf(out, ",\"active_frames_per_s\":%.1f,\"idle_bytes_per_s\":%.1f,\"idle_frames_per_s\":%.2f",
+            (double)active.frames / active_s, (double)idle.bytes / idle_s, (double)idle.frames / idle_s);
+    if (samples > 0) {
+        fprintf(out, ",\"latency_us_p50\":%.0f,\"latency_us_p99\":%.0f,\"latency_us_max\":%.0f",
+                latency_us[samples / 2], latency_us[(samples * 99) / 100], latency_us[samples - 1]);
+    }
+    if (binary) {
+        while (recv(observer_fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+            observed++;
+        }
+        fprintf(out, ",\"observer_frames\":%lu", observed);
+    }
+    fprintf(out, "}");
+    return !binary || observed != 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int commands = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 100U;
+    unsigned long interval_ms = argc > 2 ? strtoul(argv[2], NULL, 10) : 50UL;
+    unsigned long idle_ms = argc > 3 ? strtoul(argv[3], NULL, 10) : 5000UL;
+    struct link_stats boot = { 0, 0 };
+    struct sockaddr_in status_addr;
+    const char *offset;
+    int ok;
+    FILE *out;
+
+    /* The car logs every packet on stdout; keep it for the result only. */
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+
+    setenv("SIM_BIND_PORT_OFFSET", "10000", 0);
+    setenv("SIM_WIFI_START_MS", "0", 0);
+    offset = getenv("SIM_BIND_PORT_OFFSET");
+
+    cmd_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    observer_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    status_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&status_addr, 0, sizeof(status_addr));
+    status_addr.sin_family = AF_INET;
+    status_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    status_addr.sin_port = htons(STATUS_PORT);
+    if (bind(status_fd, (struct sockaddr *)&status_addr, sizeof(status_addr)) != 0) {
+        fprintf(out, "{\"bench\":\"telemetry\",\"error\":\"cannot bind status port %u\"}\n", STATUS_PORT);
+        fclose(out);
+        _exit(1);
+    }
+    rx_fd = status_fd;
+    car_addr.sin_family = AF_INET;
+    car_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    car_addr.sin_port = htons((unsigned short)(CMD_PORT + atoi(offset)));
+
+    sim_start();
+
+    /* Wait for the UDP threads: retry a stop until the car answers. */
+    while (!receive_until(sim_now_ns() + 200000000ULL, CAR_STATUS_STOP, &boot)) {
+        send_step(&script[SCRIPT_LEN - 1], 0, 0);
+    }
+
+    fprintf(out, "{\"bench\":\"telemetry\",\"interval_ms\":%lu,\"idle_ms\":%lu", interval_ms, idle_ms);
+    ok = run_format(out, 0, commands, interval_ms, idle_ms);
+    ok &= run_format(out, 1, commands, interval_ms, idle_ms);
+    fprintf(out, "}\n");
+    fclose(out);
+    _exit(ok ? 0 : 1);
+}
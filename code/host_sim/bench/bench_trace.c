@@ -0,0 +1,58 @@
+/*
+ * Cost of one trace event: a car_trace_write() record against the printf
+ * line it replaced. stdout goes to /dev/null, fully buffered, so the printf
+ * figure is a lower bound; on the board it waits for the UART.
+ *
+ *   ./build/bench_trace [events]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "car_trace.h"
+#include "sim_hal.h"
+
+int main(int argc, char **argv)
+{
+    unsigned long events = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000UL;
+    unsigned long drained = 0;
+    unsigned long i;
+    uint64_t t0;
+    double trace_ns;
+    double printf_ns;
+    FILE *out;
+
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+    setvbuf(stdout, NULL, _IOFBF, 4096);
+
+    /* Drained every half ring so no record is dropped, the drain is not timed. */
+    t0 = sim_now_ns();
+    for (i = 0; i < events; i++) {
+        car_trace_write(CAR_TRACE_RING_RECV, CAR_EV_UDP_CMD, 1, 1, 42667);
+        if ((i & (CAR_TRACE_RING_SIZE / 2 - 1)) == CAR_TRACE_RING_SIZE / 2 - 1) {
+            uint64_t d0 = sim_now_ns();
+            drained += car_trace_drain();
+            t0 += sim_now_ns() - d0;
+        }
+    }
+    trace_ns = (double)(sim_now_ns() - t0) / (double)events;
+
+    t0 = sim_now_ns();
+    for (i = 0; i < events; i++) {
+        printf("Command received: op=%d mode=%d speed=%d seq=%d\n", 1, 1, 42667, (int)(i & 0xFFFF));
+    }
+    fflush(stdout);
+    printf_ns = (double)(sim_now_ns() - t0) / (double)events;
+
+    drained += car_trace_drain();
+    fprintf(out, "{\"bench\":\"trace\",\"events\":%lu,\"record_bytes\":%zu,\"trace_ns_per_event\":%.1f", events,
+            sizeof(struct car_trace_rec), trace_ns);
+    fprintf(out, ",\"printf_devnull_ns_per_event\":%.1f,\"drained\":%lu,\"dropped\":%u}\n", printf_ns, drained,
+            car_trace_dropped());
+    fclose(out);
+    return 0;
+}
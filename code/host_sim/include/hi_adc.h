@@ -0,0 +1,42 @@
+/*
+ * Host simulation of hi_adc.h. Samples come from the scripted ADC source
+ * in sim_hal.h.
+ */
+
+#ifndef __HI_ADC_H__
+#define __HI_ADC_H__
+
+#include "hi_types_base.h"
+
+typedef enum {
+    HI_ADC_CHANNEL_0,
+    HI_ADC_CHANNEL_1,
+    HI_ADC_CHANNEL_2,
+    HI_ADC_CHANNEL_3,
+    HI_ADC_CHANNEL_4,
+    HI_ADC_CHANNEL_5,
+    HI_ADC_CHANNEL_6,
+    HI_ADC_CHANNEL_7,
+    HI_ADC_CHANNEL_BUTT,
+} hi_adc_channel_index;
+
+typedef enum {
+    HI_ADC_EQU_MODEL_1,
+    HI_ADC_EQU_MODEL_2,
+    HI_ADC_EQU_MODEL_4,
+    HI_ADC_EQU_MODEL_8,
+    HI_ADC_EQU_MODEL_BUTT,
+} hi_adc_equ_model_sel;
+
+typedef enum {
+    HI_ADC_CUR_BAIS_DEFAULT,
+    HI_ADC_CUR_BAIS_AUTO,
+    HI_ADC_CUR_BAIS_1P8V,
+    HI_ADC_CUR_BAIS_3P3V,
+    HI_ADC_CUR_BAIS_BUTT,
+} hi_adc_cur_bais;
+
+hi_u32 hi_adc_read(hi_adc_channel_index channel, hi_u16 *data, hi_adc_equ_model_sel equ_model,
+                   hi_adc_cur_bais cur_bais, hi_u16 delay_cnt);
+
+#endif /* __HI_ADC_H__ */
@@ -0,0 +1,12 @@
+/*
+ * Host simulation of hi_early_debug.h; early printing goes to stdio.
+ */
+
+#ifndef __HI_EARLY_DEBUG_H__
+#define __HI_EARLY_DEBUG_H__
+
+#include <stdio.h>
+
+#define hi_early_printf printf
+
+#endif /* __HI_EARLY_DEBUG_H__ */
@@ -0,0 +1,44 @@
+/*
+ * Host simulation of hi_gpio.h.
+ */
+
+#ifndef __HI_GPIO_H__
+#define __HI_GPIO_H__
+
+#include "hi_types_base.h"
+
+typedef enum {
+    HI_GPIO_IDX_0,
+    HI_GPIO_IDX_1,
+    HI_GPIO_IDX_2,
+    HI_GPIO_IDX_3,
+    HI_GPIO_IDX_4,
+    HI_GPIO_IDX_5,
+    HI_GPIO_IDX_6,
+    HI_GPIO_IDX_7,
+    HI_GPIO_IDX_8,
+    HI_GPIO_IDX_9,
+    HI_GPIO_IDX_10,
+    HI_GPIO_IDX_11,
+    HI_GPIO_IDX_12,
+    HI_GPIO_IDX_13,
+    HI_GPIO_IDX_14,
+    HI_GPIO_IDX_MAX,
+} hi_gpio_idx;
+
+typedef enum {
+    HI_GPIO_DIR_IN,
+    HI_GPIO_DIR_OUT,
+} hi_gpio_dir;
+
+typedef enum {
+    HI_GPIO_VALUE0,
+    HI_GPIO_VALUE1,
+} hi_gpio_value;
+
+hi_u32 hi_gpio_init(hi_void);
+hi_u32 hi_gpio_set_dir(hi_gpio_idx id, hi_gpio_dir dir);
+hi_u32 hi_gpio_set_ouput_val(hi_gpio_idx id, hi_gpio_value val);
+hi_u32 hi_gpio_get_input_val(hi_gpio_idx id, hi_gpio_value *val);
+
+#endif /* __HI_GPIO_H__ */
@@ -0,0 +1,46 @@
+/*
+ * Host simulation of hi_io.h. Function numbers follow the Hi3861 pin mux
+ * table for the pins used by the applications; the simulator only needs
+ * them to tell the GPIO function (0) apart from the peripheral ones.
+ */
+
+#ifndef __HI_IO_H__
+#define __HI_IO_H__
+
+#include "hi_types_base.h"
+
+typedef enum {
+    HI_IO_NAME_GPIO_0,
+    HI_IO_NAME_GPIO_1,
+    HI_IO_NAME_GPIO_2,
+    HI_IO_NAME_GPIO_3,
+    HI_IO_NAME_GPIO_4,
+    HI_IO_NAME_GPIO_5,
+    HI_IO_NAME_GPIO_6,
+    HI_IO_NAME_GPIO_7,
+    HI_IO_NAME_GPIO_8,
+    HI_IO_NAME_GPIO_9,
+    HI_IO_NAME_GPIO_10,
+    HI_IO_NAME_GPIO_11,
+    HI_IO_NAME_GPIO_12,
+    HI_IO_NAME_GPIO_13,
+    HI_IO_NAME_GPIO_14,
+    HI_IO_NAME_MAX,
+} hi_io_name;
+
+#define HI_IO_FUNC_GPIO_0_GPIO 0
+#define HI_IO_FUNC_GPIO_0_PWM3_OUT 4
+#define HI_IO_FUNC_GPIO_1_GPIO 0
+#define HI_IO_FUNC_GPIO_1_PWM4_OUT 4
+#define HI_IO_FUNC_GPIO_5_GPIO 0
+#define HI_IO_FUNC_GPIO_7_GPIO 0
+#define HI_IO_FUNC_GPIO_8_GPIO 0
+#define HI_IO_FUNC_GPIO_9_GPIO 0
+#define HI_IO_FUNC_GPIO_9_PWM0_OUT 5
+#define HI_IO_FUNC_GPIO_10_GPIO 0
+#define HI_IO_FUNC_GPIO_10_PWM1_OUT 5
+
+hi_u32 hi_io_set_func(hi_io_name id, hi_u8 val);
+hi_u32 hi_io_get_func(hi_io_name id, hi_u8 *val);
+
+#endif /* __HI_IO_H__ */
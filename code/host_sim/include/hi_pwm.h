@@ -0,0 +1,24 @@
+/*
+ * Host simulation of hi_pwm.h.
+ */
+
+#ifndef __HI_PWM_H__
+#define __HI_PWM_H__
+
+#include "hi_types_base.h"
+
+typedef enum {
+    HI_PWM_PORT_PWM0,
+    HI_PWM_PORT_PWM1,
+    HI_PWM_PORT_PWM2,
+    HI_PWM_PORT_PWM3,
+    HI_PWM_PORT_PWM4,
+    HI_PWM_PORT_PWM5,
+    HI_PWM_PORT_MAX,
+} hi_pwm_port;
+
+hi_u32 hi_pwm_init(hi_pwm_port port);
+hi_u32 hi_pwm_start(hi_pwm_port port, hi_u16 duty, hi_u16 freq);
+hi_u32 hi_pwm_stop(hi_pwm_port port);
+
+#endif /* __HI_PWM_H__ */
@@ -0,0 +1,31 @@
+/*
+ * Host simulation of the secure C library subset exported by hi_stdlib.h.
+ */
+
+#ifndef __HI_STDLIB_H__
+#define __HI_STDLIB_H__
+
+#include <string.h>
+#include "hi_types_base.h"
+
+#define EOK 0
+
+static inline int memset_s(void *dest, size_t destMax, int c, size_t count)
+{
+    if (dest == NULL || count > destMax) {
+        return -1;
+    }
+    memset(dest, c, count);
+    return EOK;
+}
+
+static inline int memcpy_s(void *dest, size_t destMax, const void *src, size_t count)
+{
+    if (dest == NULL || src == NULL || count > destMax) {
+        return -1;
+    }
+    memcpy(dest, src, count);
+    return EOK;
+}
+
+#endif /* __HI_STDLIB_H__ */
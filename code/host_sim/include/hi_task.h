@@ -0,0 +1,11 @@
+/*
+ * Host simulation of hi_task.h. Applications use CMSIS-RTOS2 threads,
+ * see cmsis_os2.h.
+ */
+
+#ifndef __HI_TASK_H__
+#define __HI_TASK_H__
+
+#include "hi_types_base.h"
+
+#endif /* __HI_TASK_H__ */
@@ -0,0 +1,14 @@
+/*
+ * Host simulation of hi_time.h, backed by CLOCK_MONOTONIC.
+ */
+
+#ifndef __HI_TIME_H__
+#define __HI_TIME_H__
+
+#include "hi_types_base.h"
+
+hi_u32 hi_get_us(hi_void);
+hi_u32 hi_get_ms(hi_void);
+hi_void hi_udelay(hi_u32 us);
+
+#endif /* __HI_TIME_H__ */
@@ -0,0 +1,31 @@
+/*
+ * Host simulation of the HiSilicon base types (hi_types_base.h).
+ */
+
+#ifndef __HI_TYPES_BASE_H__
+#define __HI_TYPES_BASE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t hi_u8;
+typedef uint16_t hi_u16;
+typedef uint32_t hi_u32;
+typedef uint64_t hi_u64;
+typedef int8_t hi_s8;
+typedef int16_t hi_s16;
+typedef int32_t hi_s32;
+typedef int64_t hi_s64;
+typedef char hi_char;
+typedef void hi_void;
+typedef hi_u8 hi_bool;
+typedef size_t hi_size_t;
+
+#define HI_TRUE 1
+#define HI_FALSE 0
+#define HI_NULL NULL
+
+#define HI_ERR_SUCCESS 0U
+#define HI_ERR_FAILURE ((hi_u32)(-1))
+
+#endif /* __HI_TYPES_BASE_H__ */
@@ -0,0 +1,14 @@
+/*
+ * Host simulation of hi_wifi_api.h (MAC address query only).
+ */
+
+#ifndef __HI_WIFI_API_H__
+#define __HI_WIFI_API_H__
+
+#include "hi_types_base.h"
+
+#define HI_WIFI_MAC_LEN 6
+
+int hi_wifi_get_macaddr(char *mac_addr, unsigned char len);
+
+#endif /* __HI_WIFI_API_H__ */
@@ -0,0 +1,45 @@
+/*
+ * Host simulation of the OHOS IoT GPIO kit (iot_gpio.h).
+ */
+
+#ifndef IOT_GPIO_H
+#define IOT_GPIO_H
+
+#define IOT_SUCCESS 0
+#define IOT_FAILURE ((unsigned int)-1)
+
+typedef enum {
+    IOT_GPIO_VALUE0 = 0,
+    IOT_GPIO_VALUE1
+} IotGpioValue;
+
+typedef enum {
+    IOT_GPIO_DIR_IN = 0,
+    IOT_GPIO_DIR_OUT
+} IotGpioDir;
+
+typedef enum {
+    IOT_INT_TYPE_LEVEL = 0,
+    IOT_INT_TYPE_EDGE
+} IotGpioIntType;
+
+typedef enum {
+    IOT_GPIO_EDGE_FALL_LEVEL_LOW = 0,
+    IOT_GPIO_EDGE_RISE_LEVEL_HIGH
+} IotGpioIntPolarity;
+
+typedef void (*GpioIsrCallbackFunc)(char *arg);
+
+unsigned int IoTGpioInit(unsigned int id);
+unsigned int IoTGpioDeinit(unsigned int id);
+unsigned int IoTGpioSetDir(unsigned int id, IotGpioDir dir);
+unsigned int IoTGpioGetDir(unsigned int id, IotGpioDir *dir);
+unsigned int IoTGpioSetOutputVal(unsigned int id, IotGpioValue val);
+unsigned int IoTGpioGetOutputVal(unsigned int id, IotGpioValue *val);
+unsigned int IoTGpioGetInputVal(unsigned int id, IotGpioValue *val);
+unsigned int IoTGpioRegisterIsrFunc(unsigned int id, IotGpioIntType intType, IotGpioIntPolarity intPolarity,
+                                    GpioIsrCallbackFunc func, char *arg);
+unsigned int IoTGpioUnregisterIsrFunc(unsigned int id);
+unsigned int IoTGpioSetIsrMask(unsigned int id, unsigned char mask);
+
+#endif /* IOT_GPIO_H */
@@ -0,0 +1,18 @@
+/*
+ * Host simulation of the Hi3861 IoT GPIO extensions (iot_gpio_ex.h).
+ * Only the pad pull setting is provided; it is stored in the pin state.
+ */
+
+#ifndef IOT_GPIO_EX_H
+#define IOT_GPIO_EX_H
+
+typedef enum {
+    IOT_IO_PULL_NONE,
+    IOT_IO_PULL_UP,
+    IOT_IO_PULL_DOWN,
+    IOT_IO_PULL_MAX,
+} IotIoPull;
+
+unsigned int IoTGpioSetPull(unsigned int id, IotIoPull val);
+
+#endif /* IOT_GPIO_EX_H */
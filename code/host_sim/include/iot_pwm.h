@@ -0,0 +1,13 @@
+/*
+ * Host simulation of the OHOS IoT PWM kit (iot_pwm.h).
+ */
+
+#ifndef IOT_PWM_H
+#define IOT_PWM_H
+
+unsigned int IoTPwmInit(unsigned int port);
+unsigned int IoTPwmDeinit(unsigned int port);
+unsigned int IoTPwmStart(unsigned int port, unsigned short duty, unsigned int freq);
+unsigned int IoTPwmStop(unsigned int port);
+
+#endif /* IOT_PWM_H */
@@ -0,0 +1,69 @@
+/*
+ * Host simulation of lwip/api.h (the netconn API) and lwip/netbuf.h, UDP
+ * only.
+ *
+ * A netconn is a POSIX datagram socket. netconn_recv() hands out datagrams
+ * from a per-connection batch that is filled with one recvmmsg() call, and
+ * the netbuf points into that batch: like a pbuf on the board, the data is
+ * not copied again. A netbuf from netconn_recv() stays valid until it is
+ * deleted or the batch is refilled, so delete it before the next receive.
+ *
+ * The callback of netconn_new_with_callback() is called from a watcher
+ * thread, which stands in for the lwIP TCP/IP thread. It reports
+ * NETCONN_EVT_RCVPLUS once when datagrams are waiting after the connection
+ * was drained (netconn_recv() returned ERR_WOULDBLOCK), not once per
+ * datagram, and len is 0.
+ *
+ * netconn_bind() applies SIM_BIND_PORT_OFFSET, like bind() in
+ * lwip/sockets.h.
+ */
+
+#ifndef LWIP_HDR_API_H
+#define LWIP_HDR_API_H
+
+#include "lwip/arch.h"
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+
+enum netconn_type {
+    NETCONN_UDP = 0x20,
+};
+
+enum netconn_evt {
+    NETCONN_EVT_RCVPLUS,
+    NETCONN_EVT_RCVMINUS,
+    NETCONN_EVT_SENDPLUS,
+    NETCONN_EVT_SENDMINUS,
+    NETCONN_EVT_ERROR,
+};
+
+struct netconn;
+
+struct netbuf {
+    void *data;
+    u16_t len;
+    ip_addr_t addr;
+    u16_t port;
+    struct netconn *conn; /* owning connection, NULL for netbuf_new() */
+};
+
+typedef void (*netconn_callback)(struct netconn *conn, enum netconn_evt evt, u16_t len);
+
+struct netconn *netconn_new_with_callback(enum netconn_type type, netconn_callback callback);
+#define netconn_new(type) netconn_new_with_callback((type), NULL)
+err_t netconn_delete(struct netconn *conn);
+err_t netconn_bind(struct netconn *conn, const ip_addr_t *addr, u16_t port);
+err_t netconn_recv(struct netconn *conn, struct netbuf **new_buf);
+err_t netconn_sendto(struct netconn *conn, struct netbuf *buf, const ip_addr_t *addr, u16_t port);
+void netconn_set_nonblocking(struct netconn *conn, int val);
+
+struct netbuf *netbuf_new(void);
+void netbuf_delete(struct netbuf *buf);
+err_t netbuf_ref(struct netbuf *buf, const void *dataptr, u16_t size);
+err_t netbuf_data(struct netbuf *buf, void **dataptr, u16_t *len);
+u16_t netbuf_copy(struct netbuf *buf, void *dataptr, u16_t len);
+#define netbuf_len(buf) ((buf)->len)
+#define netbuf_fromaddr(buf) (&((buf)->addr))
+#define netbuf_fromport(buf) ((buf)->port)
+
+#endif /* LWIP_HDR_API_H */
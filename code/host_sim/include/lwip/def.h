@@ -0,0 +1,23 @@
+/*
+ * Host simulation of lwip/def.h: byte order helpers usable in constant
+ * initialisers.
+ */
+
+#ifndef LWIP_HDR_DEF_H
+#define LWIP_HDR_DEF_H
+
+#include <stdint.h>
+
+#define LWIP_MAKEU32(a, b, c, d)                                                            \
+    (((uint32_t)((a) & 0xff) << 24) | ((uint32_t)((b) & 0xff) << 16) | ((uint32_t)((c) & 0xff) << 8) | \
+     (uint32_t)((d) & 0xff))
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PP_HTONL(x) (x)
+#else
+#define PP_HTONL(x)                                                                            \
+    ((((x) & 0x000000ffUL) << 24) | (((x) & 0x0000ff00UL) << 8) | (((x) & 0x00ff0000UL) >> 8) | \
+     (((x) & 0xff000000UL) >> 24))
+#endif
+
+#endif /* LWIP_HDR_DEF_H */
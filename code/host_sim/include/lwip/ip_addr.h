@@ -0,0 +1,32 @@
+/*
+ * Host simulation of lwip/ip_addr.h (IPv4 subset).
+ */
+
+#ifndef LWIP_HDR_IP_ADDR_H
+#define LWIP_HDR_IP_ADDR_H
+
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#include "lwip/def.h"
+
+typedef struct ip4_addr {
+    uint32_t addr;
+} ip4_addr_t;
+
+#define IP4_ADDR(ipaddr, a, b, c, d)                                                    \
+    ((ipaddr)->addr = htonl(((uint32_t)((a) & 0xff) << 24) | ((uint32_t)((b) & 0xff) << 16) | \
+                            ((uint32_t)((c) & 0xff) << 8) | (uint32_t)((d) & 0xff)))
+
+#define ip4_addr_get_u32(src_ipaddr) ((src_ipaddr)->addr)
+
+/* An IPv4-only build: ip_addr_t is the IPv4 address. */
+typedef ip4_addr_t ip_addr_t;
+
+#define ip_2_ip4(ipaddr) (ipaddr)
+#define ip_addr_set_ip4_u32(ipaddr, val) ((ipaddr)->addr = (val))
+
+extern const ip_addr_t ip_addr_any;
+#define IP_ADDR_ANY (&ip_addr_any)
+
+#endif /* LWIP_HDR_IP_ADDR_H */
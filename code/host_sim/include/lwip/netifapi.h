@@ -0,0 +1,27 @@
+/*
+ * Host simulation of lwip/netifapi.h. The AP interface is a fixed record;
+ * address and DHCP server calls only update it. netifapi_dhcps_start()
+ * returns ERR_USE while the server is running.
+ */
+
+#ifndef LWIP_HDR_NETIFAPI_H
+#define LWIP_HDR_NETIFAPI_H
+
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+
+struct netif {
+    char name[8];
+    ip4_addr_t ip_addr;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+    int dhcps_running;
+};
+
+struct netif *netifapi_netif_find(const char *name);
+err_t netifapi_netif_set_addr(struct netif *netif, const ip4_addr_t *ipaddr, const ip4_addr_t *netmask,
+                              const ip4_addr_t *gw);
+err_t netifapi_dhcps_start(struct netif *netif, char *start_ip, unsigned short ip_num);
+err_t netifapi_dhcps_stop(struct netif *netif);
+
+#endif /* LWIP_HDR_NETIFAPI_H */
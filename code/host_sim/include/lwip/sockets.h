@@ -0,0 +1,24 @@
+/*
+ * Host simulation of lwip/sockets.h: the lwIP BSD socket API maps one to
+ * one onto POSIX sockets.
+ *
+ * bind() goes through sim_lwip_bind() so that SIM_BIND_PORT_OFFSET can move
+ * the car's local ports (50001/50002) out of the way of a controller that
+ * runs on the same host and listens on 50002 itself.
+ */
+
+#ifndef LWIP_HDR_SOCKETS_H
+#define LWIP_HDR_SOCKETS_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int sim_lwip_bind(int s, const struct sockaddr *name, socklen_t namelen);
+
+#define bind(s, name, namelen) sim_lwip_bind((s), (name), (namelen))
+
+#endif /* LWIP_HDR_SOCKETS_H */
@@ -0,0 +1,31 @@
+/*
+ * Host simulation of ohos_init.h.
+ *
+ * On the board the SYS_RUN/APP_FEATURE_INIT entries are placed in linker
+ * sections and called by the system during boot. On the host they register
+ * themselves from a constructor and sim_main() calls them in layer order.
+ */
+
+#ifndef OHOS_INIT_H
+#define OHOS_INIT_H
+
+typedef void (*InitCall)(void);
+
+enum {
+    SIM_INIT_LAYER_SYS_RUN,
+    SIM_INIT_LAYER_APP_FEATURE,
+    SIM_INIT_LAYER_MAX
+};
+
+void sim_register_init(int layer, InitCall func, const char *name);
+
+#define SIM_INIT_ENTRY(layer, func)                                      \
+    static void __attribute__((constructor)) sim_init_##func(void)     \
+    {                                                                  \
+        sim_register_init((layer), (func), #func);                     \
+    }
+
+#define SYS_RUN(func) SIM_INIT_ENTRY(SIM_INIT_LAYER_SYS_RUN, func)
+#define APP_FEATURE_INIT(func) SIM_INIT_ENTRY(SIM_INIT_LAYER_APP_FEATURE, func)
+
+#endif /* OHOS_INIT_H */
@@ -0,0 +1,104 @@
+/*
+ * Host-side control API of the simulated HAL.
+ *
+ * The application code is built unmodified against the headers in this
+ * directory. Host harnesses use the calls below to read back what the
+ * application wrote to the HAL (PWM/GPIO recorders), to drive inputs
+ * (scripted ADC, GPIO levels, Wi-Fi station events) and to start the
+ * registered SYS_RUN/APP_FEATURE_INIT entries.
+ */
+
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include <stdint.h>
+
+#define SIM_GPIO_NUM 15
+#define SIM_PWM_NUM 6
+#define SIM_ADC_NUM 8
+
+/* Monotonic time since simulator start. */
+uint64_t sim_now_ns(void);
+
+/*
+ * Stepped clock for harnesses that call the application's control code
+ * themselves: after sim_clock_freeze() the time only moves by
+ * sim_clock_advance(), so the result does not depend on host scheduling.
+ * sim_clock_resume() runs on from the stepped time. Only before sim_start():
+ * no simulator thread may be waiting on the clock meanwhile.
+ */
+void sim_clock_freeze(void);
+void sim_clock_advance(uint64_t ns);
+void sim_clock_resume(void);
+
+enum sim_hal_event_type {
+    SIM_HAL_PWM_INIT,
+    SIM_HAL_PWM_START,
+    SIM_HAL_PWM_STOP,
+    SIM_HAL_IO_FUNC,
+    SIM_HAL_GPIO_DIR,
+    SIM_HAL_GPIO_OUT,
+    SIM_HAL_ADC_READ,
+    SIM_HAL_EVENT_MAX
+};
+
+struct sim_hal_event {
+    uint64_t t_ns;
+    uint8_t type;  /* enum sim_hal_event_type */
+    uint8_t id;    /* PWM port or GPIO number */
+    uint32_t value; /* duty, mux function, direction, level or ADC code */
+    uint32_t arg;  /* PWM frequency */
+};
+
+/* Called synchronously for every HAL access, from the calling thread and
+ * with the HAL lock held: the hook must not call back into the HAL. */
+typedef void (*sim_hal_hook_t)(const struct sim_hal_event *ev, void *ctx);
+void sim_hal_set_hook(sim_hal_hook_t hook, void *ctx);
+
+void sim_hal_get_counts(unsigned long counts[SIM_HAL_EVENT_MAX]);
+void sim_hal_reset_counts(void);
+const char *sim_hal_event_name(unsigned int type);
+
+struct sim_pwm_state {
+    int running;
+    unsigned int duty;
+    unsigned int freq;
+};
+
+struct sim_pin_state {
+    unsigned char func;
+    unsigned char dir;
+    unsigned char level;
+    unsigned char pull; /* IotIoPull */
+};
+
+void sim_pwm_get(unsigned int port, struct sim_pwm_state *st);
+void sim_pin_get(unsigned int gpio, struct sim_pin_state *st);
+
+/* Drive a GPIO input; fires the registered ISR on a matching edge. */
+void sim_gpio_set_input(unsigned int gpio, int level);
+
+/* Scripted ADC source. Script lines are "<time_ms> <channel> <code>". */
+void sim_adc_set(unsigned int channel, unsigned short code);
+int sim_adc_load_script(const char *path, int loop);
+
+/* Simulated Wi-Fi service. */
+void sim_wifi_station_join(const unsigned char mac[6]);
+void sim_wifi_station_leave(const unsigned char mac[6], unsigned short reason);
+
+/*
+ * Threads the applications created, with the stack size each asked for:
+ * that is what they cost on the board (host stacks are larger). Returns
+ * the number of threads, filling at most max entries.
+ */
+struct sim_thread_info {
+    char name[32];
+    unsigned int stack_size;
+    int priority;
+};
+unsigned int sim_threads_get(struct sim_thread_info *info, unsigned int max);
+
+/* Reads SIM_* environment settings and runs the registered init entries. */
+void sim_start(void);
+
+#endif /* SIM_HAL_H */
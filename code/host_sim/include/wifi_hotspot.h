@@ -0,0 +1,76 @@
+/*
+ * Host simulation of the OHOS Wi-Fi hotspot service (wifi_hotspot.h).
+ * The simulated service reports the hotspot active after SIM_WIFI_START_MS
+ * and lets the host harness inject station join/leave events, see sim_hal.h.
+ */
+
+#ifndef HARMONY_OS_LITE_WIFI_HOTSPOT_H
+#define HARMONY_OS_LITE_WIFI_HOTSPOT_H
+
+#define WIFI_MAX_SSID_LEN 33
+#define WIFI_MAX_KEY_LEN 65
+#define WIFI_MAC_LEN 6
+
+typedef enum {
+    WIFI_SUCCESS = 0,
+    ERROR_WIFI_INVALID_ARGS = -1,
+    ERROR_WIFI_CHIP_INVALID = -2,
+    ERROR_WIFI_IFACE_INVALID = -3,
+    ERROR_WIFI_RTT_CONTROLLER_INVALID = -4,
+    ERROR_WIFI_NOT_SUPPORTED = -5,
+    ERROR_WIFI_NOT_AVAILABLE = -6,
+    ERROR_WIFI_NOT_STARTED = -7,
+    ERROR_WIFI_BUSY = -8,
+    ERROR_WIFI_INVALID_PASSWORD = -9,
+    ERROR_WIFI_UNKNOWN = -128
+} WifiErrorCode;
+
+typedef enum {
+    WIFI_SEC_TYPE_INVALID = -1,
+    WIFI_SEC_TYPE_OPEN,
+    WIFI_SEC_TYPE_WEP,
+    WIFI_SEC_TYPE_PSK,
+    WIFI_SEC_TYPE_SAE,
+} WifiSecurityType;
+
+typedef enum {
+    HOTSPOT_BAND_TYPE_2G = 1,
+    HOTSPOT_BAND_TYPE_5G = 2,
+} HotspotBandType;
+
+#define WIFI_HOTSPOT_NOT_ACTIVE 0
+#define WIFI_HOTSPOT_ACTIVE 1
+
+typedef struct {
+    char ssid[WIFI_MAX_SSID_LEN];
+    int securityType;
+    int band;
+    int channelNum;
+    char preSharedKey[WIFI_MAX_KEY_LEN];
+} HotspotConfig;
+
+typedef struct {
+    char *name;
+    unsigned char macAddress[WIFI_MAC_LEN];
+    unsigned int ipAddress;
+    unsigned short disconnectedReason;
+} StationInfo;
+
+typedef struct {
+    void (*OnWifiConnectionChanged)(int state, void *info);
+    void (*OnWifiScanStateChanged)(int state, int size);
+    void (*OnHotspotStateChanged)(int state);
+    void (*OnHotspotStaJoin)(StationInfo *info);
+    void (*OnHotspotStaLeave)(StationInfo *info);
+    void (*OnDeviceConfigChange)(int state);
+} WifiEvent;
+
+WifiErrorCode RegisterWifiEvent(WifiEvent *event);
+WifiErrorCode UnRegisterWifiEvent(const WifiEvent *event);
+WifiErrorCode SetHotspotConfig(const HotspotConfig *config);
+WifiErrorCode GetHotspotConfig(HotspotConfig *result);
+WifiErrorCode EnableHotspot(void);
+WifiErrorCode DisableHotspot(void);
+int IsHotspotActive(void);
+
+#endif /* HARMONY_OS_LITE_WIFI_HOTSPOT_H */
@@ -0,0 +1,784 @@
+/*
+ * CMSIS-RTOS2 on pthreads for the host build.
+ *
+ * Objects are heap allocated and never freed while in use; this mirrors how
+ * the applications create their threads, timers and flags once at boot.
+ * Priorities are accepted but not enforced, the host scheduler decides.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cmsis_os2.h"
+#include "sim_hal.h"
+
+#define SIM_THREAD_MIN_STACK (256 * 1024)
+#define NS_PER_SEC 1000000000ULL
+
+static uint64_t ticks_to_ns(uint32_t ticks)
+{
+    return (uint64_t)ticks * NS_PER_SEC / SIM_TICK_HZ;
+}
+
+static struct timespec ns_to_abs_timespec(uint64_t sim_ns);
+
+static pthread_condattr_t mono_condattr;
+static pthread_once_t mono_condattr_once = PTHREAD_ONCE_INIT;
+
+static void mono_condattr_init(void)
+{
+    pthread_condattr_init(&mono_condattr);
+    pthread_condattr_setclock(&mono_condattr, CLOCK_MONOTONIC);
+}
+
+/* All condition variables wait on CLOCK_MONOTONIC, like sim_now_ns(). */
+static void cond_init(pthread_cond_t *cond)
+{
+    pthread_once(&mono_condattr_once, mono_condattr_init);
+    pthread_cond_init(cond, &mono_condattr);
+}
+
+/* Waits on cond until deadline_ns (sim time). Returns 0 or ETIMEDOUT. */
+static int cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, uint64_t deadline_ns)
+{
+    struct timespec ts = ns_to_abs_timespec(deadline_ns);
+    return pthread_cond_timedwait(cond, lock, &ts);
+}
+
+/* ---- kernel ---- */
+
+static uint64_t sim_epoch_ns;
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+static void __attribute__((constructor)) sim_clock_init(void)
+{
+    sim_epoch_ns = mono_ns();
+}
+
+/* Set between sim_clock_freeze() and sim_clock_resume(): the clock only moves by sim_clock_advance(). */
+static int sim_clock_frozen;
+static uint64_t sim_clock_frozen_ns;
+
+uint64_t sim_now_ns(void)
+{
+    if (sim_clock_frozen) {
+        return sim_clock_frozen_ns;
+    }
+    return mono_ns() - sim_epoch_ns;
+}
+
+void sim_clock_freeze(void)
+{
+    sim_clock_frozen_ns = sim_now_ns();
+    sim_clock_frozen = 1;
+}
+
+void sim_clock_advance(uint64_t ns)
+{
+    sim_clock_frozen_ns += ns;
+}
+
+/* Runs on from the stepped time, so the clock never goes backwards. */
+void sim_clock_resume(void)
+{
+    sim_epoch_ns = mono_ns() - sim_clock_frozen_ns;
+    sim_clock_frozen = 0;
+}
+
+static struct timespec ns_to_abs_timespec(uint64_t sim_ns)
+{
+    uint64_t abs_ns = sim_ns + sim_epoch_ns;
+    struct timespec ts;
+    ts.tv_sec = (time_t)(abs_ns / NS_PER_SEC);
+    ts.tv_nsec = (long)(abs_ns % NS_PER_SEC);
+    return ts;
+}
+
+uint32_t osKernelGetTickCount(void)
+{
+    return (uint32_t)(sim_now_ns() * SIM_TICK_HZ / NS_PER_SEC);
+}
+
+uint32_t osKernelGetTickFreq(void)
+{
+    return SIM_TICK_HZ;
+}
+
+/* ---- threads ---- */
+
+struct sim_thread {
+    pthread_t tid;
+    osThreadFunc_t func;
+    void *argument;
+    char name[32];
+    osPriority_t priority; /* recorded only: host threads are not scheduled by priority */
+};
+
+static __thread struct sim_thread *current_thread;
+
+#define SIM_THREADS_MAX 32
+
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_thread_info threads[SIM_THREADS_MAX];
+static unsigned int thread_count;
+
+unsigned int sim_threads_get(struct sim_thread_info *info, unsigned int max)
+{
+    unsigned int n;
+
+    pthread_mutex_lock(&threads_lock);
+    n = thread_count;
+    memcpy(info, threads, (n < max ? n : max) * sizeof(*info));
+    pthread_mutex_unlock(&threads_lock);
+    return n;
+}
+
+static void *thread_main(void *p)
+{
+    struct sim_thread *t = p;
+    current_thread = t;
+    t->func(t->argument);
+    return NULL;
+}
+
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr)
+{
+    struct sim_thread *t;
+    pthread_attr_t pattr;
+    size_t stack = SIM_THREAD_MIN_STACK;
+
+    if (func == NULL) {
+        return NULL;
+    }
+    t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        return NULL;
+    }
+    t->func = func;
+    t->argument = argument;
+    if (attr != NULL && attr->name != NULL) {
+        strncpy(t->name, attr->name, sizeof(t->name) - 1);
+    }
+    t->priority = (attr != NULL && attr->priority != osPriorityNone) ? attr->priority : osPriorityNormal;
+    /* Board stacks are a few KB; host libc needs more, so only grow them. */
+    if (attr != NULL && attr->stack_size > stack) {
+        stack = attr->stack_size;
+    }
+
+    pthread_attr_init(&pattr);
+    pthread_attr_setstacksize(&pattr, stack);
+    pthread_attr_setdetachstate(&pattr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&t->tid, &pattr, thread_main, t) != 0) {
+        pthread_attr_destroy(&pattr);
+        free(t);
+        return NULL;
+    }
+    pthread_attr_destroy(&pattr);
+    pthread_mutex_lock(&threads_lock);
+    if (thread_count < SIM_THREADS_MAX) {
+        struct sim_thread_info *info = &threads[thread_count++];
+        memcpy(info->name, t->name, sizeof(info->name));
+        info->stack_size = attr != NULL ? attr->stack_size : 0;
+        info->priority = t->priority;
+    }
+    pthread_mutex_unlock(&threads_lock);
+    if (t->name[0] != '\0') {
+        char short_name[16];
+        snprintf(short_name, sizeof(short_name), "%.15s", t->name);
+        pthread_setname_np(t->tid, short_name);
+    }
+    return t;
+}
+
+osThreadId_t osThreadGetId(void)
+{
+    return current_thread;
+}
+
+const char *osThreadGetName(osThreadId_t thread_id)
+{
+    struct sim_thread *t = thread_id;
+    return t != NULL ? t->name : NULL;
+}
+
+osStatus_t osThreadSetPriority(osThreadId_t thread_id, osPriority_t priority)
+{
+    struct sim_thread *t = thread_id;
+
+    if (t == NULL || priority < osPriorityIdle || priority > osPriorityISR) {
+        return osErrorParameter;
+    }
+    t->priority = priority;
+    return osOK;
+}
+
+osPriority_t osThreadGetPriority(osThreadId_t thread_id)
+{
+    struct sim_thread *t = thread_id;
+    return t != NULL ? t->priority : osPriorityError;
+}
+
+osStatus_t osThreadYield(void)
+{
+    sched_yield();
+    return osOK;
+}
+
+void osThreadExit(void)
+{
+    pthread_exit(NULL);
+}
+
+static void sleep_until_ns(uint64_t deadline_ns)
+{
+    struct timespec ts = ns_to_abs_timespec(deadline_ns);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+osStatus_t osDelay(uint32_t ticks)
+{
+    sleep_until_ns(sim_now_ns() + ticks_to_ns(ticks));
+    return osOK;
+}
+
+osStatus_t osDelayUntil(uint32_t ticks)
+{
+    sleep_until_ns(ticks_to_ns(ticks));
+    return osOK;
+}
+
+/* ---- timers ---- */
+
+struct sim_timer {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t tid;
+    osTimerFunc_t func;
+    void *argument;
+    osTimerType_t type;
+    int running;
+    int deleted;
+    uint64_t deadline_ns;
+    uint64_t period_ns;
+};
+
+static void *timer_main(void *p)
+{
+    struct sim_timer *t = p;
+
+    pthread_mutex_lock(&t->lock);
+    while (!t->deleted) {
+        if (!t->running) {
+            pthread_cond_wait(&t->cond, &t->lock);
+            continue;
+        }
+        if (sim_now_ns() < t->deadline_ns) {
+            cond_wait_until(&t->cond, &t->lock, t->deadline_ns);
+            continue;
+        }
+        if (t->type == osTimerPeriodic) {
+            t->deadline_ns += t->period_ns;
+        } else {
+            t->running = 0;
+        }
+        pthread_mutex_unlock(&t->lock);
+        t->func(t->argument);
+        pthread_mutex_lock(&t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->cond);
+    free(t);
+    return NULL;
+}
+
+osTimerId_t osTimerNew(osTimerFunc_t func, osTimerType_t type, void *argument, const osTimerAttr_t *attr)
+{
+    struct sim_timer *t;
+    (void)attr;
+
+    if (func == NULL) {
+        return NULL;
+    }
+    t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&t->lock, NULL);
+    cond_init(&t->cond);
+    t->func = func;
+    t->argument = argument;
+    t->type = type;
+    if (pthread_create(&t->tid, NULL, timer_main, t) != 0) {
+        free(t);
+        return NULL;
+    }
+    pthread_detach(t->tid);
+    return t;
+}
+
+osStatus_t osTimerStart(osTimerId_t timer_id, uint32_t ticks)
+{
+    struct sim_timer *t = timer_id;
+    if (t == NULL || ticks == 0) {
+        return osErrorParameter;
+    }
+    pthread_mutex_lock(&t->lock);
+    t->period_ns = ticks_to_ns(ticks);
+    t->deadline_ns = sim_now_ns() + t->period_ns;
+    t->running = 1;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return osOK;
+}
+
+osStatus_t osTimerStop(osTimerId_t timer_id)
+{
+    struct sim_timer *t = timer_id;
+    osStatus_t ret = osOK;
+    if (t == NULL) {
+        return osErrorParameter;
+    }
+    pthread_mutex_lock(&t->lock);
+    if (!t->running) {
+        ret = osErrorResource;
+    }
+    t->running = 0;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return ret;
+}
+
+uint32_t osTimerIsRunning(osTimerId_t timer_id)
+{
+    struct sim_timer *t = timer_id;
+    uint32_t running;
+    if (t == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&t->lock);
+    running = (uint32_t)t->running;
+    pthread_mutex_unlock(&t->lock);
+    return running;
+}
+
+osStatus_t osTimerDelete(osTimerId_t timer_id)
+{
+    struct sim_timer *t = timer_id;
+    if (t == NULL) {
+        return osErrorParameter;
+    }
+    pthread_mutex_lock(&t->lock);
+    t->running = 0;
+    t->deleted = 1;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return osOK;
+}
+
+/* ---- event flags ---- */
+
+struct sim_flags {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t flags;
+};
+
+osEventFlagsId_t osEventFlagsNew(const osEventFlagsAttr_t *attr)
+{
+    struct sim_flags *f = calloc(1, sizeof(*f));
+    (void)attr;
+    if (f == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&f->lock, NULL);
+    cond_init(&f->cond);
+    return f;
+}
+
+uint32_t osEventFlagsSet(osEventFlagsId_t ef_id, uint32_t flags)
+{
+    struct sim_flags *f = ef_id;
+    uint32_t ret;
+    if (f == NULL || (flags & osFlagsError)) {
+        return osFlagsErrorParameter;
+    }
+    pthread_mutex_lock(&f->lock);
+    f->flags |= flags;
+    ret = f->flags;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+    return ret;
+}
+
+uint32_t osEventFlagsClear(osEventFlagsId_t ef_id, uint32_t flags)
+{
+    struct sim_flags *f = ef_id;
+    uint32_t ret;
+    if (f == NULL) {
+        return osFlagsErrorParameter;
+    }
+    pthread_mutex_lock(&f->lock);
+    ret = f->flags;
+    f->flags &= ~flags;
+    pthread_mutex_unlock(&f->lock);
+    return ret;
+}
+
+uint32_t osEventFlagsGet(osEventFlagsId_t ef_id)
+{
+    struct sim_flags *f = ef_id;
+    uint32_t ret;
+    if (f == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&f->lock);
+    ret = f->flags;
+    pthread_mutex_unlock(&f->lock);
+    return ret;
+}
+
+static int flags_satisfied(uint32_t have, uint32_t want, uint32_t options)
+{
+    if (options & osFlagsWaitAll) {
+        return (have & want) == want;
+    }
+    return (have & want) != 0;
+}
+
+uint32_t osEventFlagsWait(osEventFlagsId_t ef_id, uint32_t flags, uint32_t options, uint32_t timeout)
+{
+    struct sim_flags *f = ef_id;
+    uint64_t deadline = 0;
+    uint32_t ret;
+
+    if (f == NULL || flags == 0) {
+        return osFlagsErrorParameter;
+    }
+    if (timeout != osWaitForever) {
+        deadline = sim_now_ns() + ticks_to_ns(timeout);
+    }
+
+    pthread_mutex_lock(&f->lock);
+    while (!flags_satisfied(f->flags, flags, options)) {
+        if (timeout == 0) {
+            pthread_mutex_unlock(&f->lock);
+            return osFlagsErrorResource;
+        }
+        if (timeout == osWaitForever) {
+            pthread_cond_wait(&f->cond, &f->lock);
+        } else if (cond_wait_until(&f->cond, &f->lock, deadline) == ETIMEDOUT &&
+                   !flags_satisfied(f->flags, flags, options)) {
+            pthread_mutex_unlock(&f->lock);
+            return osFlagsErrorTimeout;
+        }
+    }
+    ret = f->flags;
+    if (!(options & osFlagsNoClear)) {
+        f->flags &= ~flags;
+    }
+    pthread_mutex_unlock(&f->lock);
+    return ret;
+}
+
+osStatus_t osEventFlagsDelete(osEventFlagsId_t ef_id)
+{
+    struct sim_flags *f = ef_id;
+    if (f == NULL) {
+        return osErrorParameter;
+    }
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->cond);
+    free(f);
+    return osOK;
+}
+
+/* ---- mutexes ---- */
+
+osMutexId_t osMutexNew(const osMutexAttr_t *attr)
+{
+    pthread_mutex_t *m = calloc(1, sizeof(*m));
+    pthread_mutexattr_t mattr;
+    (void)attr;
+    if (m == NULL) {
+        return NULL;
+    }
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(m, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+    return m;
+}
+
+osStatus_t osMutexAcquire(osMutexId_t mutex_id, uint32_t timeout)
+{
+    pthread_mutex_t *m = mutex_id;
+    if (m == NULL) {
+        return osErrorParameter;
+    }
+    if (timeout == osWaitForever) {
+        return pthread_mutex_lock(m) == 0 ? osOK : osError;
+    }
+    if (timeout == 0) {
+        return pthread_mutex_trylock(m) == 0 ? osOK : osErrorResource;
+    }
+    struct timespec ts = ns_to_abs_timespec(sim_now_ns() + ticks_to_ns(timeout));
+    return pthread_mutex_clocklock(m, CLOCK_MONOTONIC, &ts) == 0 ? osOK : osErrorTimeout;
+}
+
+osStatus_t osMutexRelease(osMutexId_t mutex_id)
+{
+    pthread_mutex_t *m = mutex_id;
+    if (m == NULL) {
+        return osErrorParameter;
+    }
+    return pthread_mutex_unlock(m) == 0 ? osOK : osErrorResource;
+}
+
+osStatus_t osMutexDelete(osMutexId_t mutex_id)
+{
+    pthread_mutex_t *m = mutex_id;
+    if (m == NULL) {
+        return osErrorParameter;
+    }
+    pthread_mutex_destroy(m);
+    free(m);
+    return osOK;
+}
+
+/* ---- semaphores ---- */
+
+struct sim_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t count;
+    uint32_t max;
+};
+
+osSemaphoreId_t osSemaphoreNew(uint32_t max_count, uint32_t initial_count, const osSemaphoreAttr_t *attr)
+{
+    struct sim_sem *s;
+    (void)attr;
+    if (max_count == 0 || initial_count > max_count) {
+        return NULL;
+    }
+    s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    cond_init(&s->cond);
+    s->count = initial_count;
+    s->max = max_count;
+    return s;
+}
+
+osStatus_t osSemaphoreAcquire(osSemaphoreId_t semaphore_id, uint32_t timeout)
+{
+    struct sim_sem *s = semaphore_id;
+    uint64_t deadline = 0;
+    if (s == NULL) {
+        return osErrorParameter;
+    }
+    if (timeout != osWaitForever) {
+        deadline = sim_now_ns() + ticks_to_ns(timeout);
+    }
+    pthread_mutex_lock(&s->lock);
+    while (s->count == 0) {
+        if (timeout == 0) {
+            pthread_mutex_unlock(&s->lock);
+            return osErrorResource;
+        }
+        if (timeout == osWaitForever) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        } else if (cond_wait_until(&s->cond, &s->lock, deadline) == ETIMEDOUT && s->count == 0) {
+            pthread_mutex_unlock(&s->lock);
+            return osErrorTimeout;
+        }
+    }
+    s->count--;
+    pthread_mutex_unlock(&s->lock);
+    return osOK;
+}
+
+osStatus_t osSemaphoreRelease(osSemaphoreId_t semaphore_id)
+{
+    struct sim_sem *s = semaphore_id;
+    osStatus_t ret = osOK;
+    if (s == NULL) {
+        return osErrorParameter;
+    }
+    pthread_mutex_lock(&s->lock);
+    if (s->count < s->max) {
+        s->count++;
+        pthread_cond_signal(&s->cond);
+    } else {
+        ret = osErrorResource;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ret;
+}
+
+uint32_t osSemaphoreGetCount(osSemaphoreId_t semaphore_id)
+{
+    struct sim_sem *s = semaphore_id;
+    uint32_t count;
+    if (s == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&s->lock);
+    count = s->count;
+    pthread_mutex_unlock(&s->lock);
+    return count;
+}
+
+osStatus_t osSemaphoreDelete(osSemaphoreId_t semaphore_id)
+{
+    struct sim_sem *s = semaphore_id;
+    if (s == NULL) {
+        return osErrorParameter;
+    }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s);
+    return osOK;
+}
+
+/* ---- message queues ---- */
+
+struct sim_mq {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint32_t msg_count;
+    uint32_t msg_size;
+    uint32_t head;
+    uint32_t used;
+    unsigned char *buf;
+};
+
+osMessageQueueId_t osMessageQueueNew(uint32_t msg_count, uint32_t msg_size, const osMessageQueueAttr_t *attr)
+{
+    struct sim_mq *q;
+    (void)attr;
+    if (msg_count == 0 || msg_size == 0) {
+        return NULL;
+    }
+    q = calloc(1, sizeof(*q));
+    if (q == NULL) {
+        return NULL;
+    }
+    q->buf = calloc(msg_count, msg_size);
+    if (q->buf == NULL) {
+        free(q);
+        return NULL;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    cond_init(&q->not_empty);
+    cond_init(&q->not_full);
+    q->msg_count = msg_count;
+    q->msg_size = msg_size;
+    return q;
+}
+
+static int mq_wait(pthread_cond_t *cond, pthread_mutex_t *lock, uint32_t timeout, uint64_t deadline)
+{
+    if (timeout == osWaitForever) {
+        pthread_cond_wait(cond, lock);
+        return 0;
+    }
+    return cond_wait_until(cond, lock, deadline);
+}
+
+osStatus_t osMessageQueuePut(osMessageQueueId_t mq_id, const void *msg_ptr, uint8_t msg_prio, uint32_t timeout)
+{
+    struct sim_mq *q = mq_id;
+    uint64_t deadline = 0;
+    (void)msg_prio;
+    if (q == NULL || msg_ptr == NULL) {
+        return osErrorParameter;
+    }
+    if (timeout != osWaitForever) {
+        deadline = sim_now_ns() + ticks_to_ns(timeout);
+    }
+    pthread_mutex_lock(&q->lock);
+    while (q->used == q->msg_count) {
+        if (timeout == 0 || (mq_wait(&q->not_full, &q->lock, timeout, deadline) == ETIMEDOUT &&
+                             q->used == q->msg_count)) {
+            pthread_mutex_unlock(&q->lock);
+            return timeout == 0 ? osErrorResource : osErrorTimeout;
+        }
+    }
+    memcpy(q->buf + ((q->head + q->used) % q->msg_count) * q->msg_size, msg_ptr, q->msg_size);
+    q->used++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return osOK;
+}
+
+osStatus_t osMessageQueueGet(osMessageQueueId_t mq_id, void *msg_ptr, uint8_t *msg_prio, uint32_t timeout)
+{
+    struct sim_mq *q = mq_id;
+    uint64_t deadline = 0;
+    if (q == NULL || msg_ptr == NULL) {
+        return osErrorParameter;
+    }
+    if (timeout != osWaitForever) {
+        deadline = sim_now_ns() + ticks_to_ns(timeout);
+    }
+    pthread_mutex_lock(&q->lock);
+    while (q->used == 0) {
+        if (timeout == 0 || (mq_wait(&q->not_empty, &q->lock, timeout, deadline) == ETIMEDOUT &&
+                             q->used == 0)) {
+            pthread_mutex_unlock(&q->lock);
+            return timeout == 0 ? osErrorResource : osErrorTimeout;
+        }
+    }
+    memcpy(msg_ptr, q->buf + q->head * q->msg_size, q->msg_size);
+    q->head = (q->head + 1) % q->msg_count;
+    q->used--;
+    if (msg_prio != NULL) {
+        *msg_prio = 0;
+    }
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return osOK;
+}
+
+uint32_t osMessageQueueGetCount(osMessageQueueId_t mq_id)
+{
+    struct sim_mq *q = mq_id;
+    uint32_t used;
+    if (q == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&q->lock);
+    used = q->used;
+    pthread_mutex_unlock(&q->lock);
+    return used;
+}
+
+osStatus_t osMessageQueueDelete(osMessageQueueId_t mq_id)
+{
+    struct sim_mq *q = mq_id;
+    if (q == NULL) {
+        return osErrorParameter;
+    }
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->buf);
+    free(q);
+    return osOK;
+}
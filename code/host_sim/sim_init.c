@@ -0,0 +1,53 @@
+/*
+ * SYS_RUN/APP_FEATURE_INIT registry: the constructors in ohos_init.h record
+ * the entries, sim_start() runs them in layer order as the board does at boot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ohos_init.h"
+#include "sim_hal.h"
+
+#define SIM_INIT_MAX 32
+
+struct sim_init_entry {
+    int layer;
+    InitCall func;
+    const char *name;
+};
+
+static struct sim_init_entry init_entries[SIM_INIT_MAX];
+static int init_count;
+
+void sim_register_init(int layer, InitCall func, const char *name)
+{
+    if (init_count >= SIM_INIT_MAX) {
+        fprintf(stderr, "sim: too many init entries, dropping %s\n", name);
+        return;
+    }
+    init_entries[init_count].layer = layer;
+    init_entries[init_count].func = func;
+    init_entries[init_count].name = name;
+    init_count++;
+}
+
+void sim_start(void)
+{
+    const char *script = getenv("SIM_ADC_SCRIPT");
+    const char *loop = getenv("SIM_ADC_LOOP");
+    int layer;
+    int i;
+
+    if (script != NULL && sim_adc_load_script(script, loop != NULL && atoi(loop) != 0) < 0) {
+        fprintf(stderr, "sim: cannot load ADC script %s\n", script);
+    }
+
+    for (layer = 0; layer < SIM_INIT_LAYER_MAX; layer++) {
+        for (i = 0; i < init_count; i++) {
+            if (init_entries[i].layer == layer) {
+                init_entries[i].func();
+            }
+        }
+    }
+}
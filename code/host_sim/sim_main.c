@@ -0,0 +1,54 @@
+/*
+ * Host entry point: runs the registered SYS_RUN and APP_FEATURE_INIT entries
+ * (see sim_init.c), then keeps the process alive.
+ *
+ * Environment:
+ *   SIM_RUN_MS        stop after this many milliseconds (default: run forever)
+ *   SIM_ADC_SCRIPT    scripted ADC source, lines "<time_ms> <channel> <code>"
+ *   SIM_ADC_LOOP      replay the ADC script in a loop when set to 1
+ *   SIM_HAL_STATS     print HAL call counts on exit when set to 1
+ *   SIM_WIFI_START_MS delay before the simulated hotspot reports active
+ *   SIM_BIND_PORT_OFFSET added to every local port the applications bind
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim_hal.h"
+
+static void print_hal_stats(void)
+{
+    unsigned long counts[SIM_HAL_EVENT_MAX];
+    unsigned int i;
+
+    sim_hal_get_counts(counts);
+    fprintf(stderr, "sim: HAL calls:");
+    for (i = 0; i < SIM_HAL_EVENT_MAX; i++) {
+        fprintf(stderr, " %s=%lu", sim_hal_event_name(i), counts[i]);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(void)
+{
+    const char *run_ms = getenv("SIM_RUN_MS");
+    const char *stats = getenv("SIM_HAL_STATS");
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    sim_start();
+
+    if (run_ms == NULL) {
+        for (;;) {
+            pause();
+        }
+    }
+    unsigned long ms = strtoul(run_ms, NULL, 10);
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+    if (stats != NULL && atoi(stats) != 0) {
+        print_hal_stats();
+    }
+    return 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * lwIP socket and netconn shims for the host build.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "lwip/api.h"
+#include "sim_hal.h"
+
+/* Datagrams taken per recvmmsg() call and the largest one kept. */
+#define SIM_NETCONN_BATCH 32
+#define SIM_NETCONN_MTU 1536
+/* How often the watcher looks whether its connection was deleted. */
+#define SIM_NETCONN_POLL_MS 100
+
+struct netconn {
+    int fd;
+    int nonblocking;
+    netconn_callback callback;
+
+    /* The current batch: msgs[next..count) have not been handed out. */
+    struct mmsghdr msgs[SIM_NETCONN_BATCH];
+    struct iovec iov[SIM_NETCONN_BATCH];
+    struct sockaddr_in from[SIM_NETCONN_BATCH];
+    struct netbuf bufs[SIM_NETCONN_BATCH];
+    unsigned char data[SIM_NETCONN_BATCH][SIM_NETCONN_MTU];
+    unsigned int count;
+    unsigned int next;
+
+    /* Watcher: armed after a drain, reports the next datagram once. */
+    pthread_t watcher;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int armed;
+    int quit;
+};
+
+const ip_addr_t ip_addr_any = { 0 };
+
+int sim_lwip_bind(int s, const struct sockaddr *name, socklen_t namelen)
+{
+    const char *env = getenv("SIM_BIND_PORT_OFFSET");
+    struct sockaddr_in addr;
+
+    if (env == NULL || name == NULL || name->sa_family != AF_INET || namelen < sizeof(addr)) {
+        return bind(s, name, namelen);
+    }
+    memcpy(&addr, name, sizeof(addr));
+    if (addr.sin_port != 0) {
+        addr.sin_port = htons((unsigned short)(ntohs(addr.sin_port) + atoi(env)));
+    }
+    return bind(s, (const struct sockaddr *)&addr, sizeof(addr));
+}
+
+static void netconn_arm(struct netconn *conn)
+{
+    pthread_mutex_lock(&conn->lock);
+    conn->armed = 1;
+    pthread_cond_signal(&conn->cond);
+    pthread_mutex_unlock(&conn->lock);
+}
+
+/* The TCP/IP thread's part: tell the owner that datagrams are waiting. */
+static void *netconn_watch(void *arg)
+{
+    struct netconn *conn = arg;
+    struct pollfd pfd = { .fd = conn->fd, .events = POLLIN };
+
+    for (;;) {
+        pthread_mutex_lock(&conn->lock);
+        while (!conn->armed && !conn->quit) {
+            pthread_cond_wait(&conn->cond, &conn->lock);
+        }
+        pthread_mutex_unlock(&conn->lock);
+        if (conn->quit) {
+            break;
+        }
+        if (poll(&pfd, 1, SIM_NETCONN_POLL_MS) > 0 && (pfd.revents & POLLIN)) {
+            pthread_mutex_lock(&conn->lock);
+            conn->armed = 0;
+            pthread_mutex_unlock(&conn->lock);
+            conn->callback(conn, NETCONN_EVT_RCVPLUS, 0);
+        }
+    }
+    return NULL;
+}
+
+struct netconn *netconn_new_with_callback(enum netconn_type type, netconn_callback callback)
+{
+    struct netconn *conn;
+
+    if (type != NETCONN_UDP || (conn = calloc(1, sizeof(*conn))) == NULL) {
+        return NULL;
+    }
+    conn->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (conn->fd < 0) {
+        free(conn);
+        return NULL;
+    }
+    for (unsigned int i = 0; i < SIM_NETCONN_BATCH; i++) {
+        conn->iov[i].iov_base = conn->data[i];
+        conn->iov[i].iov_len = sizeof(conn->data[i]);
+        conn->msgs[i].msg_hdr.msg_iov = &conn->iov[i];
+        conn->msgs[i].msg_hdr.msg_iovlen = 1;
+        conn->msgs[i].msg_hdr.msg_name = &conn->from[i];
+        conn->bufs[i].conn = conn;
+    }
+    pthread_mutex_init(&conn->lock, NULL);
+    pthread_cond_init(&conn->cond, NULL);
+    conn->callback = callback;
+    conn->armed = 1;
+    if (callback != NULL && pthread_create(&conn->watcher, NULL, netconn_watch, conn) != 0) {
+        close(conn->fd);
+        free(conn);
+        return NULL;
+    }
+    return conn;
+}
+
+err_t netconn_delete(struct netconn *conn)
+{
+    if (conn == NULL) {
+        return ERR_ARG;
+    }
+    if (conn->callback != NULL) {
+        pthread_mutex_lock(&conn->lock);
+        conn->quit = 1;
+        pthread_cond_signal(&conn->cond);
+        pthread_mutex_unlock(&conn->lock);
+        pthread_join(conn->watcher, NULL);
+    }
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->lock);
+    pthread_cond_destroy(&conn->cond);
+    free(conn);
+    return ERR_OK;
+}
+
+err_t netconn_bind(struct netconn *conn, const ip_addr_t *addr, u16_t port)
+{
+    struct sockaddr_in sin;
+
+    if (conn == NULL) {
+        return ERR_ARG;
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = addr == NULL ? htonl(INADDR_ANY) : ip4_addr_get_u32(addr);
+    sin.sin_port = htons(port);
+    return sim_lwip_bind(conn->fd, (const struct sockaddr *)&sin, sizeof(sin)) == 0 ? ERR_OK : ERR_USE;
+}
+
+void netconn_set_nonblocking(struct netconn *conn, int val)
+{
+    conn->nonblocking = val;
+}
+
+err_t netconn_recv(struct netconn *conn, struct netbuf **new_buf)
+{
+    struct netbuf *buf;
+    int n;
+
+    if (conn == NULL || new_buf == NULL) {
+        return ERR_ARG;
+    }
+    *new_buf = NULL;
+    if (conn->next == conn->count) {
+        for (unsigned int i = 0; i < SIM_NETCONN_BATCH; i++) {
+            conn->msgs[i].msg_hdr.msg_namelen = sizeof(conn->from[i]);
+        }
+        do {
+            n = recvmmsg(conn->fd, conn->msgs, SIM_NETCONN_BATCH, conn->nonblocking ? MSG_DONTWAIT : MSG_WAITFORONE,
+                         NULL);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                return ERR_CONN;
+            }
+            if (conn->callback != NULL) {
+                netconn_arm(conn);
+            }
+            return ERR_WOULDBLOCK;
+        }
+        conn->count = (unsigned int)n;
+        conn->next = 0;
+    }
+
+    buf = &conn->bufs[conn->next];
+    buf->data = conn->data[conn->next];
+    buf->len = (u16_t)conn->msgs[conn->next].msg_len;
+    buf->addr.addr = conn->from[conn->next].sin_addr.s_addr;
+    buf->port = ntohs(conn->from[conn->next].sin_port);
+    conn->next++;
+    *new_buf = buf;
+    return ERR_OK;
+}
+
+err_t netconn_sendto(struct netconn *conn, struct netbuf *buf, const ip_addr_t *addr, u16_t port)
+{
+    struct sockaddr_in sin;
+
+    if (conn == NULL || buf == NULL || addr == NULL) {
+        return ERR_ARG;
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = ip4_addr_get_u32(addr);
+    sin.sin_port = htons(port);
+    if (sendto(conn->fd, buf->data, buf->len, 0, (const struct sockaddr *)&sin, sizeof(sin)) < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? ERR_WOULDBLOCK : ERR_CONN;
+    }
+    return ERR_OK;
+}
+
+struct netbuf *netbuf_new(void)
+{
+    return calloc(1, sizeof(struct netbuf));
+}
+
+/* Received netbufs belong to their connection's batch and are reused. */
+void netbuf_delete(struct netbuf *buf)
+{
+    if (buf != NULL && buf->conn == NULL) {
+        free(buf);
+    }
+}
+
+err_t netbuf_ref(struct netbuf *buf, const void *dataptr, u16_t size)
+{
+    if (buf == NULL) {
+        return ERR_ARG;
+    }
+    buf->data = (void *)dataptr;
+    buf->len = size;
+    return ERR_OK;
+}
+
+err_t netbuf_data(struct netbuf *buf, void **dataptr, u16_t *len)
+{
+    if (buf == NULL || dataptr == NULL || len == NULL || buf->data == NULL) {
+        return ERR_BUF;
+    }
+    *dataptr = buf->data;
+    *len = buf->len;
+    return ERR_OK;
+}
+
+u16_t netbuf_copy(struct netbuf *buf, void *dataptr, u16_t len)
+{
+    if (buf == NULL || buf->data == NULL) {
+        return 0;
+    }
+    len = len < buf->len ? len : buf->len;
+    memcpy(dataptr, buf->data, len);
+    return len;
+}
@@ -0,0 +1,515 @@
+/*
+ * Simulated PWM, GPIO, pin mux and ADC peripherals for the host build.
+ *
+ * Every HAL write is counted, stored in the pin/PWM state tables and passed
+ * to the optional recorder hook, so host harnesses can check exactly what
+ * the application drove and how often.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hi_adc.h"
+#include "hi_gpio.h"
+#include "hi_io.h"
+#include "hi_pwm.h"
+#include "hi_time.h"
+#include "iot_gpio.h"
+#include "iot_gpio_ex.h"
+#include "iot_pwm.h"
+#include "sim_hal.h"
+
+#define SIM_ADC_IDLE_CODE 4095
+#define SIM_ADC_SCRIPT_MAX 4096
+
+static pthread_mutex_t hal_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_hal_hook_t hal_hook;
+static void *hal_hook_ctx;
+static unsigned long hal_counts[SIM_HAL_EVENT_MAX];
+
+static struct sim_pwm_state pwm_state[SIM_PWM_NUM];
+static struct sim_pin_state pin_state[SIM_GPIO_NUM];
+
+struct sim_gpio_isr {
+    GpioIsrCallbackFunc func;
+    char *arg;
+    IotGpioIntType type;
+    IotGpioIntPolarity polarity;
+    unsigned char masked;
+};
+
+static struct sim_gpio_isr gpio_isr[SIM_GPIO_NUM];
+static unsigned char gpio_input[SIM_GPIO_NUM];
+
+static const char *const hal_event_names[SIM_HAL_EVENT_MAX] = {
+    "pwm_init", "pwm_start", "pwm_stop", "io_func", "gpio_dir", "gpio_out", "adc_read",
+};
+
+const char *sim_hal_event_name(unsigned int type)
+{
+    return type < SIM_HAL_EVENT_MAX ? hal_event_names[type] : "unknown";
+}
+
+/* Called with hal_lock held. */
+static void hal_record(unsigned int type, unsigned int id, uint32_t value, uint32_t arg)
+{
+    struct sim_hal_event ev;
+
+    hal_counts[type]++;
+    if (hal_hook == NULL) {
+        return;
+    }
+    ev.t_ns = sim_now_ns();
+    ev.type = (uint8_t)type;
+    ev.id = (uint8_t)id;
+    ev.value = value;
+    ev.arg = arg;
+    hal_hook(&ev, hal_hook_ctx);
+}
+
+void sim_hal_set_hook(sim_hal_hook_t hook, void *ctx)
+{
+    pthread_mutex_lock(&hal_lock);
+    hal_hook = hook;
+    hal_hook_ctx = ctx;
+    pthread_mutex_unlock(&hal_lock);
+}
+
+void sim_hal_get_counts(unsigned long counts[SIM_HAL_EVENT_MAX])
+{
+    pthread_mutex_lock(&hal_lock);
+    memcpy(counts, hal_counts, sizeof(hal_counts));
+    pthread_mutex_unlock(&hal_lock);
+}
+
+void sim_hal_reset_counts(void)
+{
+    pthread_mutex_lock(&hal_lock);
+    memset(hal_counts, 0, sizeof(hal_counts));
+    pthread_mutex_unlock(&hal_lock);
+}
+
+void sim_pwm_get(unsigned int port, struct sim_pwm_state *st)
+{
+    pthread_mutex_lock(&hal_lock);
+    if (port < SIM_PWM_NUM) {
+        *st = pwm_state[port];
+    } else {
+        memset(st, 0, sizeof(*st));
+    }
+    pthread_mutex_unlock(&hal_lock);
+}
+
+void sim_pin_get(unsigned int gpio, struct sim_pin_state *st)
+{
+    pthread_mutex_lock(&hal_lock);
+    if (gpio < SIM_GPIO_NUM) {
+        *st = pin_state[gpio];
+    } else {
+        memset(st, 0, sizeof(*st));
+    }
+    pthread_mutex_unlock(&hal_lock);
+}
+
+/* ---- pin mux ---- */
+
+hi_u32 hi_io_set_func(hi_io_name id, hi_u8 val)
+{
+    if ((unsigned int)id >= SIM_GPIO_NUM) {
+        return HI_ERR_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    pin_state[id].func = val;
+    hal_record(SIM_HAL_IO_FUNC, id, val, 0);
+    pthread_mutex_unlock(&hal_lock);
+    return HI_ERR_SUCCESS;
+}
+
+hi_u32 hi_io_get_func(hi_io_name id, hi_u8 *val)
+{
+    if ((unsigned int)id >= SIM_GPIO_NUM || val == NULL) {
+        return HI_ERR_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    *val = pin_state[id].func;
+    pthread_mutex_unlock(&hal_lock);
+    return HI_ERR_SUCCESS;
+}
+
+/* ---- GPIO ---- */
+
+static unsigned int gpio_set_dir(unsigned int id, unsigned int dir)
+{
+    if (id >= SIM_GPIO_NUM) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    pin_state[id].dir = (unsigned char)dir;
+    hal_record(SIM_HAL_GPIO_DIR, id, dir, 0);
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+static unsigned int gpio_set_level(unsigned int id, unsigned int level)
+{
+    if (id >= SIM_GPIO_NUM) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    pin_state[id].level = (unsigned char)(level != 0);
+    hal_record(SIM_HAL_GPIO_OUT, id, level != 0, 0);
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+unsigned int IoTGpioInit(unsigned int id)
+{
+    return id < SIM_GPIO_NUM ? IOT_SUCCESS : IOT_FAILURE;
+}
+
+unsigned int IoTGpioDeinit(unsigned int id)
+{
+    return id < SIM_GPIO_NUM ? IOT_SUCCESS : IOT_FAILURE;
+}
+
+unsigned int IoTGpioSetDir(unsigned int id, IotGpioDir dir)
+{
+    return gpio_set_dir(id, dir);
+}
+
+unsigned int IoTGpioGetDir(unsigned int id, IotGpioDir *dir)
+{
+    if (id >= SIM_GPIO_NUM || dir == NULL) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    *dir = (IotGpioDir)pin_state[id].dir;
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+unsigned int IoTGpioSetOutputVal(unsigned int id, IotGpioValue val)
+{
+    return gpio_set_level(id, val);
+}
+
+unsigned int IoTGpioGetOutputVal(unsigned int id, IotGpioValue *val)
+{
+    if (id >= SIM_GPIO_NUM || val == NULL) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    *val = (IotGpioValue)pin_state[id].level;
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+unsigned int IoTGpioGetInputVal(unsigned int id, IotGpioValue *val)
+{
+    if (id >= SIM_GPIO_NUM || val == NULL) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    *val = (IotGpioValue)gpio_input[id];
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+unsigned int IoTGpioSetPull(unsigned int id, IotIoPull val)
+{
+    if (id >= SIM_GPIO_NUM || val >= IOT_IO_PULL_MAX) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    pin_state[id].pull = (unsigned char)val;
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+unsigned int IoTGpioRegisterIsrFunc(unsigned int id, IotGpioIntType intType, IotGpioIntPolarity intPolarity,
+                                    GpioIsrCallbackFunc func, char *arg)
+{
+    if (id >= SIM_GPIO_NUM || func == NULL) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    gpio_isr[id].func = func;
+    gpio_isr[id].arg = arg;
+    gpio_isr[id].type = intType;
+    gpio_isr[id].polarity = intPolarity;
+    gpio_isr[id].masked = 0;
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+unsigned int IoTGpioUnregisterIsrFunc(unsigned int id)
+{
+    if (id >= SIM_GPIO_NUM) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    memset(&gpio_isr[id], 0, sizeof(gpio_isr[id]));
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+unsigned int IoTGpioSetIsrMask(unsigned int id, unsigned char mask)
+{
+    if (id >= SIM_GPIO_NUM) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    gpio_isr[id].masked = mask;
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+void sim_gpio_set_input(unsigned int gpio, int level)
+{
+    GpioIsrCallbackFunc func = NULL;
+    char *arg = NULL;
+    unsigned char old;
+    unsigned char now = (unsigned char)(level != 0);
+
+    if (gpio >= SIM_GPIO_NUM) {
+        return;
+    }
+    pthread_mutex_lock(&hal_lock);
+    old = gpio_input[gpio];
+    gpio_input[gpio] = now;
+    if (gpio_isr[gpio].func != NULL && !gpio_isr[gpio].masked) {
+        int want = gpio_isr[gpio].polarity == IOT_GPIO_EDGE_RISE_LEVEL_HIGH;
+        int fire = gpio_isr[gpio].type == IOT_INT_TYPE_EDGE ? (old != now && now == want) : (now == want);
+        if (fire) {
+            func = gpio_isr[gpio].func;
+            arg = gpio_isr[gpio].arg;
+        }
+    }
+    pthread_mutex_unlock(&hal_lock);
+
+    /* The ISR runs on the caller's thread, outside the HAL lock. */
+    if (func != NULL) {
+        func(arg);
+    }
+}
+
+hi_u32 hi_gpio_init(hi_void)
+{
+    return HI_ERR_SUCCESS;
+}
+
+hi_u32 hi_gpio_set_dir(hi_gpio_idx id, hi_gpio_dir dir)
+{
+    return gpio_set_dir(id, dir) == IOT_SUCCESS ? HI_ERR_SUCCESS : HI_ERR_FAILURE;
+}
+
+hi_u32 hi_gpio_set_ouput_val(hi_gpio_idx id, hi_gpio_value val)
+{
+    return gpio_set_level(id, val) == IOT_SUCCESS ? HI_ERR_SUCCESS : HI_ERR_FAILURE;
+}
+
+hi_u32 hi_gpio_get_input_val(hi_gpio_idx id, hi_gpio_value *val)
+{
+    IotGpioValue v;
+    if (IoTGpioGetInputVal(id, &v) != IOT_SUCCESS || val == NULL) {
+        return HI_ERR_FAILURE;
+    }
+    *val = (hi_gpio_value)v;
+    return HI_ERR_SUCCESS;
+}
+
+/* ---- PWM ---- */
+
+static unsigned int pwm_start(unsigned int port, unsigned int duty, unsigned int freq)
+{
+    if (port >= SIM_PWM_NUM) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    pwm_state[port].running = 1;
+    pwm_state[port].duty = duty;
+    pwm_state[port].freq = freq;
+    hal_record(SIM_HAL_PWM_START, port, duty, freq);
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+static unsigned int pwm_stop(unsigned int port)
+{
+    if (port >= SIM_PWM_NUM) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    pwm_state[port].running = 0;
+    pwm_state[port].duty = 0;
+    hal_record(SIM_HAL_PWM_STOP, port, 0, 0);
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+unsigned int IoTPwmInit(unsigned int port)
+{
+    if (port >= SIM_PWM_NUM) {
+        return IOT_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    hal_record(SIM_HAL_PWM_INIT, port, 0, 0);
+    pthread_mutex_unlock(&hal_lock);
+    return IOT_SUCCESS;
+}
+
+unsigned int IoTPwmDeinit(unsigned int port)
+{
+    return pwm_stop(port);
+}
+
+unsigned int IoTPwmStart(unsigned int port, unsigned short duty, unsigned int freq)
+{
+    return pwm_start(port, duty, freq);
+}
+
+unsigned int IoTPwmStop(unsigned int port)
+{
+    return pwm_stop(port);
+}
+
+hi_u32 hi_pwm_init(hi_pwm_port port)
+{
+    return IoTPwmInit(port) == IOT_SUCCESS ? HI_ERR_SUCCESS : HI_ERR_FAILURE;
+}
+
+hi_u32 hi_pwm_start(hi_pwm_port port, hi_u16 duty, hi_u16 freq)
+{
+    return pwm_start(port, duty, freq) == IOT_SUCCESS ? HI_ERR_SUCCESS : HI_ERR_FAILURE;
+}
+
+hi_u32 hi_pwm_stop(hi_pwm_port port)
+{
+    return pwm_stop(port) == IOT_SUCCESS ? HI_ERR_SUCCESS : HI_ERR_FAILURE;
+}
+
+/* ---- ADC ---- */
+
+struct sim_adc_step {
+    uint64_t t_ns;
+    unsigned char channel;
+    unsigned short code;
+};
+
+static unsigned short adc_code[SIM_ADC_NUM] = {
+    SIM_ADC_IDLE_CODE, SIM_ADC_IDLE_CODE, SIM_ADC_IDLE_CODE, SIM_ADC_IDLE_CODE,
+    SIM_ADC_IDLE_CODE, SIM_ADC_IDLE_CODE, SIM_ADC_IDLE_CODE, SIM_ADC_IDLE_CODE,
+};
+static struct sim_adc_step *adc_script;
+static unsigned int adc_script_len;
+static unsigned int adc_script_pos;
+static uint64_t adc_script_start_ns;
+static int adc_script_loop;
+
+void sim_adc_set(unsigned int channel, unsigned short code)
+{
+    if (channel >= SIM_ADC_NUM) {
+        return;
+    }
+    pthread_mutex_lock(&hal_lock);
+    adc_code[channel] = code;
+    pthread_mutex_unlock(&hal_lock);
+}
+
+int sim_adc_load_script(const char *path, int loop)
+{
+    FILE *fp = fopen(path, "r");
+    char line[128];
+    struct sim_adc_step *steps;
+    unsigned int n = 0;
+
+    if (fp == NULL) {
+        return -1;
+    }
+    steps = calloc(SIM_ADC_SCRIPT_MAX, sizeof(*steps));
+    if (steps == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    while (n < SIM_ADC_SCRIPT_MAX && fgets(line, sizeof(line), fp) != NULL) {
+        unsigned long ms;
+        unsigned int channel;
+        unsigned int code;
+        if (line[0] == '#' || sscanf(line, "%lu %u %u", &ms, &channel, &code) != 3 || channel >= SIM_ADC_NUM) {
+            continue;
+        }
+        steps[n].t_ns = (uint64_t)ms * 1000000ULL;
+        steps[n].channel = (unsigned char)channel;
+        steps[n].code = (unsigned short)(code > 4095 ? 4095 : code);
+        n++;
+    }
+    fclose(fp);
+
+    pthread_mutex_lock(&hal_lock);
+    free(adc_script);
+    adc_script = steps;
+    adc_script_len = n;
+    adc_script_pos = 0;
+    adc_script_loop = loop;
+    adc_script_start_ns = sim_now_ns();
+    pthread_mutex_unlock(&hal_lock);
+    return (int)n;
+}
+
+/* Called with hal_lock held: applies every script step that is due. */
+static void adc_script_advance(void)
+{
+    uint64_t t;
+
+    if (adc_script_len == 0) {
+        return;
+    }
+    t = sim_now_ns() - adc_script_start_ns;
+    while (adc_script_pos < adc_script_len && adc_script[adc_script_pos].t_ns <= t) {
+        adc_code[adc_script[adc_script_pos].channel] = adc_script[adc_script_pos].code;
+        adc_script_pos++;
+    }
+    if (adc_script_pos == adc_script_len && adc_script_loop) {
+        adc_script_pos = 0;
+        adc_script_start_ns += adc_script[adc_script_len - 1].t_ns + 1;
+    }
+}
+
+hi_u32 hi_adc_read(hi_adc_channel_index channel, hi_u16 *data, hi_adc_equ_model_sel equ_model,
+                   hi_adc_cur_bais cur_bais, hi_u16 delay_cnt)
+{
+    (void)equ_model;
+    (void)cur_bais;
+    (void)delay_cnt;
+
+    if ((unsigned int)channel >= SIM_ADC_NUM || data == NULL) {
+        return HI_ERR_FAILURE;
+    }
+    pthread_mutex_lock(&hal_lock);
+    adc_script_advance();
+    *data = adc_code[channel];
+    hal_record(SIM_HAL_ADC_READ, channel, *data, 0);
+    pthread_mutex_unlock(&hal_lock);
+    return HI_ERR_SUCCESS;
+}
+
+/* ---- time ---- */
+
+hi_u32 hi_get_us(hi_void)
+{
+    return (hi_u32)(sim_now_ns() / 1000ULL);
+}
+
+hi_u32 hi_get_ms(hi_void)
+{
+    return (hi_u32)(sim_now_ns() / 1000000ULL);
+}
+
+hi_void hi_udelay(hi_u32 us)
+{
+    uint64_t end = sim_now_ns() + (uint64_t)us * 1000ULL;
+    while (sim_now_ns() < end) {
+    }
+}
@@ -0,0 +1,273 @@
+/*
+ * Simulated Wi-Fi hotspot service and AP network interface.
+ *
+ * EnableHotspot() reports WIFI_HOTSPOT_ACTIVE from a service thread after
+ * SIM_WIFI_START_MS (default 300 ms), like the asynchronous callback of the
+ * real service. Like the SDK, the service starts the DHCP server on ap0
+ * with its default pool before reporting the hotspot active, and starting
+ * a DHCP server that is already running fails, so the application has to
+ * stop it before restarting it on its own address. Station join/leave
+ * events are injected by the harness.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hi_wifi_api.h"
+#include "lwip/netifapi.h"
+#include "sim_hal.h"
+#include "wifi_hotspot.h"
+
+#define SIM_WIFI_MAX_LISTENERS 4
+#define SIM_WIFI_DEFAULT_START_MS 300
+
+static pthread_mutex_t wifi_lock = PTHREAD_MUTEX_INITIALIZER;
+static WifiEvent *wifi_listeners[SIM_WIFI_MAX_LISTENERS];
+static HotspotConfig wifi_config;
+static int wifi_active;
+static struct netif ap_netif = { .name = "ap0" };
+
+static const unsigned char sim_mac[HI_WIFI_MAC_LEN] = { 0x02, 0x00, 0x5e, 0x38, 0x61, 0x01 };
+
+int hi_wifi_get_macaddr(char *mac_addr, unsigned char len)
+{
+    if (mac_addr == NULL || len < HI_WIFI_MAC_LEN) {
+        return -1;
+    }
+    memcpy(mac_addr, sim_mac, HI_WIFI_MAC_LEN);
+    return 0;
+}
+
+WifiErrorCode RegisterWifiEvent(WifiEvent *event)
+{
+    WifiErrorCode ret = ERROR_WIFI_BUSY;
+    int i;
+
+    if (event == NULL) {
+        return ERROR_WIFI_INVALID_ARGS;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    for (i = 0; i < SIM_WIFI_MAX_LISTENERS; i++) {
+        if (wifi_listeners[i] == event) {
+            ret = WIFI_SUCCESS;
+            break;
+        }
+        if (wifi_listeners[i] == NULL) {
+            wifi_listeners[i] = event;
+            ret = WIFI_SUCCESS;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    return ret;
+}
+
+WifiErrorCode UnRegisterWifiEvent(const WifiEvent *event)
+{
+    int i;
+
+    pthread_mutex_lock(&wifi_lock);
+    for (i = 0; i < SIM_WIFI_MAX_LISTENERS; i++) {
+        if (wifi_listeners[i] == event) {
+            wifi_listeners[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    return WIFI_SUCCESS;
+}
+
+WifiErrorCode SetHotspotConfig(const HotspotConfig *config)
+{
+    if (config == NULL) {
+        return ERROR_WIFI_INVALID_ARGS;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    wifi_config = *config;
+    pthread_mutex_unlock(&wifi_lock);
+    return WIFI_SUCCESS;
+}
+
+WifiErrorCode GetHotspotConfig(HotspotConfig *result)
+{
+    if (result == NULL) {
+        return ERROR_WIFI_INVALID_ARGS;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    *result = wifi_config;
+    pthread_mutex_unlock(&wifi_lock);
+    return WIFI_SUCCESS;
+}
+
+/* Snapshot the listeners so callbacks run without the service lock. */
+static int wifi_get_listeners(WifiEvent *out[SIM_WIFI_MAX_LISTENERS])
+{
+    int i;
+    int n = 0;
+
+    pthread_mutex_lock(&wifi_lock);
+    for (i = 0; i < SIM_WIFI_MAX_LISTENERS; i++) {
+        if (wifi_listeners[i] != NULL) {
+            out[n++] = wifi_listeners[i];
+        }
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    return n;
+}
+
+static void wifi_notify_state(int state)
+{
+    WifiEvent *listeners[SIM_WIFI_MAX_LISTENERS];
+    int n = wifi_get_listeners(listeners);
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (listeners[i]->OnHotspotStateChanged != NULL) {
+            listeners[i]->OnHotspotStateChanged(state);
+        }
+    }
+}
+
+static unsigned long wifi_start_delay_ms(void)
+{
+    const char *env = getenv("SIM_WIFI_START_MS");
+    return env != NULL ? strtoul(env, NULL, 10) : SIM_WIFI_DEFAULT_START_MS;
+}
+
+static void *wifi_service_main(void *arg)
+{
+    unsigned long ms = wifi_start_delay_ms();
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    (void)arg;
+
+    nanosleep(&ts, NULL);
+    pthread_mutex_lock(&wifi_lock);
+    wifi_active = 1;
+    ap_netif.dhcps_running = 1;
+    pthread_mutex_unlock(&wifi_lock);
+    wifi_notify_state(WIFI_HOTSPOT_ACTIVE);
+    return NULL;
+}
+
+WifiErrorCode EnableHotspot(void)
+{
+    pthread_t tid;
+
+    pthread_mutex_lock(&wifi_lock);
+    if (wifi_active) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ERROR_WIFI_BUSY;
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    if (pthread_create(&tid, NULL, wifi_service_main, NULL) != 0) {
+        return ERROR_WIFI_UNKNOWN;
+    }
+    pthread_detach(tid);
+    return WIFI_SUCCESS;
+}
+
+WifiErrorCode DisableHotspot(void)
+{
+    pthread_mutex_lock(&wifi_lock);
+    wifi_active = 0;
+    ap_netif.dhcps_running = 0;
+    pthread_mutex_unlock(&wifi_lock);
+    wifi_notify_state(WIFI_HOTSPOT_NOT_ACTIVE);
+    return WIFI_SUCCESS;
+}
+
+int IsHotspotActive(void)
+{
+    int active;
+
+    pthread_mutex_lock(&wifi_lock);
+    active = wifi_active;
+    pthread_mutex_unlock(&wifi_lock);
+    return active ? WIFI_HOTSPOT_ACTIVE : WIFI_HOTSPOT_NOT_ACTIVE;
+}
+
+static void wifi_station_event(const unsigned char mac[6], unsigned short reason, int join)
+{
+    WifiEvent *listeners[SIM_WIFI_MAX_LISTENERS];
+    int n = wifi_get_listeners(listeners);
+    StationInfo info;
+    int i;
+
+    memset(&info, 0, sizeof(info));
+    memcpy(info.macAddress, mac, WIFI_MAC_LEN);
+    info.disconnectedReason = reason;
+    for (i = 0; i < n; i++) {
+        if (join && listeners[i]->OnHotspotStaJoin != NULL) {
+            listeners[i]->OnHotspotStaJoin(&info);
+        } else if (!join && listeners[i]->OnHotspotStaLeave != NULL) {
+            listeners[i]->OnHotspotStaLeave(&info);
+        }
+    }
+}
+
+void sim_wifi_station_join(const unsigned char mac[6])
+{
+    wifi_station_event(mac, 0, 1);
+}
+
+void sim_wifi_station_leave(const unsigned char mac[6], unsigned short reason)
+{
+    wifi_station_event(mac, reason, 0);
+}
+
+/* ---- AP network interface ---- */
+
+struct netif *netifapi_netif_find(const char *name)
+{
+    if (name == NULL || strcmp(name, ap_netif.name) != 0) {
+        return NULL;
+    }
+    return &ap_netif;
+}
+
+err_t netifapi_netif_set_addr(struct netif *netif, const ip4_addr_t *ipaddr, const ip4_addr_t *netmask,
+                              const ip4_addr_t *gw)
+{
+    if (netif == NULL) {
+        return ERR_ARG;
+    }
+    if (ipaddr != NULL) {
+        netif->ip_addr = *ipaddr;
+    }
+    if (netmask != NULL) {
+        netif->netmask = *netmask;
+    }
+    if (gw != NULL) {
+        netif->gw = *gw;
+    }
+    return ERR_OK;
+}
+
+err_t netifapi_dhcps_start(struct netif *netif, char *start_ip, unsigned short ip_num)
+{
+    (void)start_ip;
+    (void)ip_num;
+    if (netif == NULL) {
+        return ERR_ARG;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    if (netif->dhcps_running) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ERR_USE;
+    }
+    netif->dhcps_running = 1;
+    pthread_mutex_unlock(&wifi_lock);
+    return ERR_OK;
+}
+
+err_t netifapi_dhcps_stop(struct netif *netif)
+{
+    if (netif == NULL) {
+        return ERR_ARG;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    netif->dhcps_running = 0;
+    pthread_mutex_unlock(&wifi_lock);
+    return ERR_OK;
+}